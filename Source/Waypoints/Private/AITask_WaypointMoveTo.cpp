@@ -0,0 +1,57 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "AITask_WaypointMoveTo.h"
+
+#include "HAL/IConsoleManager.h"
+
+static int32 GWaypointsReuseMoveTasks = 1;
+static FAutoConsoleVariableRef CVarWaypointsReuseMoveTasks(
+	TEXT("Waypoints.MoveTasks.Reuse"),
+	GWaypointsReuseMoveTasks,
+	TEXT("Patrolling AIs keep one move task for every leg instead of creating one per waypoint.\n")
+	TEXT("0: off, 1: on (default)"));
+
+bool UAITask_WaypointMoveTo::IsReuseEnabled()
+{
+	return GWaypointsReuseMoveTasks != 0;
+}
+
+void UAITask_WaypointMoveTo::ConditionalPerformMove()
+{
+	bLegFinished = false;
+	Super::ConditionalPerformMove();
+}
+
+void UAITask_WaypointMoveTo::Resume()
+{
+	// An idle task paused by another move has nothing to resume, the base class would start the last leg's move again
+	if (bLegFinished)
+	{
+		UGameplayTask::Resume();
+		return;
+	}
+
+	Super::Resume();
+}
+
+void UAITask_WaypointMoveTo::OnRequestFinished(FAIRequestID RequestID, const FPathFollowingResult& Result)
+{
+	const bool bReplacedByNewRequest = Result.HasFlag(FPathFollowingResultFlags::UserAbort) && Result.HasFlag(FPathFollowingResultFlags::NewRequest)
+		&& !Result.HasFlag(FPathFollowingResultFlags::ForcedScript);
+	const bool bKeepsTracking = bUseContinuousTracking && MoveRequest.IsMoveToActorRequest() && Result.IsSuccess();
+
+	if (RequestID != MoveRequestID || !IsActive() || bReplacedByNewRequest || bKeepsTracking)
+	{
+		Super::OnRequestFinished(RequestID, Result);
+		return;
+	}
+
+	// Ending the task would leave it to the garbage collector, it waits for the next leg instead
+	MoveRequestID = FAIRequestID::InvalidRequest;
+	MoveResult = Result.Code;
+	bLegFinished = true;
+	ResetObservers();
+	ResetTimers();
+
+	OnLegFinished.ExecuteIfBound(*this);
+}
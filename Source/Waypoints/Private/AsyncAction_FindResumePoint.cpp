@@ -0,0 +1,45 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "AsyncAction_FindResumePoint.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+
+#include "Engine/Engine.h"
+#include "GameFramework/Controller.h"
+
+UAsyncAction_FindResumePoint* UAsyncAction_FindResumePoint::FindResumePoint(UObject* WorldContextObject, AController* Controller, AWaypointLoop* Loop, int32 MaxCandidates)
+{
+	UAsyncAction_FindResumePoint* Action = NewObject<UAsyncAction_FindResumePoint>();
+	Action->Controller = Controller;
+	Action->Loop = Loop;
+	Action->MaxCandidates = MaxCandidates;
+	Action->RegisterWithGameInstance(WorldContextObject);
+	return Action;
+}
+
+void UAsyncAction_FindResumePoint::Activate()
+{
+	AController* MyController = Controller.Get();
+	UWaypointSubsystem* Subsystem = MyController ? UWorld::GetSubsystem<UWaypointSubsystem>(MyController->GetWorld()) : nullptr;
+	if (Subsystem == nullptr)
+	{
+		OnResumePointFound(FWaypointResumePoint());
+		return;
+	}
+
+	Subsystem->FindResumePoint(MyController, Loop.Get(), MaxCandidates, FOnWaypointResumePointFound::CreateUObject(this, &UAsyncAction_FindResumePoint::OnResumePointFound));
+}
+
+void UAsyncAction_FindResumePoint::OnResumePointFound(const FWaypointResumePoint& ResumePoint)
+{
+	if (ResumePoint.IsValid())
+	{
+		OnFound.Broadcast(ResumePoint);
+	}
+	else
+	{
+		OnFailed.Broadcast(ResumePoint);
+	}
+
+	SetReadyToDestroy();
+}
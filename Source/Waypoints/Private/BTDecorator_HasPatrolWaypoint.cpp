@@ -0,0 +1,99 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "BTDecorator_HasPatrolWaypoint.h"
+#include "WaypointPatrolComponent.h"
+
+#include "AIController.h"
+#include "BehaviorTree/BehaviorTreeComponent.h"
+
+UBTDecorator_HasPatrolWaypoint::UBTDecorator_HasPatrolWaypoint(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	NodeName = "Has Patrol Waypoint";
+	Condition = EWaypointPatrolCondition::HasWaypoint;
+
+	bNotifyBecomeRelevant = true;
+	bNotifyCeaseRelevant = true;
+}
+
+bool UBTDecorator_HasPatrolWaypoint::CalculateRawConditionValue(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) const
+{
+	return CheckCondition(UWaypointPatrolComponent::FindPatrolComponent(OwnerComp.GetAIOwner()));
+}
+
+bool UBTDecorator_HasPatrolWaypoint::CheckCondition(const UWaypointPatrolComponent* PatrolComponent) const
+{
+	FVector Location;
+	FWaypointPointParams Params;
+	if (PatrolComponent == nullptr || !PatrolComponent->GetCurrentPoint(Location, Params))
+	{
+		return false;
+	}
+
+	return Condition == EWaypointPatrolCondition::HasWaypoint || Params.WaitTime > 0.f;
+}
+
+void UBTDecorator_HasPatrolWaypoint::InitializeMemory(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTMemoryInit::Type InitType) const
+{
+	InitializeNodeMemory<FBTHasPatrolWaypointDecoratorMemory>(NodeMemory, InitType);
+}
+
+void UBTDecorator_HasPatrolWaypoint::CleanupMemory(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTMemoryClear::Type CleanupType) const
+{
+	CleanupNodeMemory<FBTHasPatrolWaypointDecoratorMemory>(NodeMemory, CleanupType);
+}
+
+uint16 UBTDecorator_HasPatrolWaypoint::GetInstanceMemorySize() const
+{
+	return sizeof(FBTHasPatrolWaypointDecoratorMemory);
+}
+
+void UBTDecorator_HasPatrolWaypoint::OnBecomeRelevant(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
+{
+	FBTHasPatrolWaypointDecoratorMemory* MyMemory = CastInstanceNodeMemory<FBTHasPatrolWaypointDecoratorMemory>(NodeMemory);
+
+	UWaypointPatrolComponent* PatrolComponent = UWaypointPatrolComponent::FindPatrolComponent(OwnerComp.GetAIOwner());
+	if (PatrolComponent && FlowAbortMode != EBTFlowAbortMode::None)
+	{
+		MyMemory->PatrolComponent = PatrolComponent;
+		MyMemory->bLastResult = CheckCondition(PatrolComponent);
+		MyMemory->WaypointChangedHandle = PatrolComponent->OnWaypointChanged.AddUObject(this, &UBTDecorator_HasPatrolWaypoint::OnWaypointChanged, TWeakObjectPtr<UBehaviorTreeComponent>(&OwnerComp));
+	}
+}
+
+void UBTDecorator_HasPatrolWaypoint::OnCeaseRelevant(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
+{
+	FBTHasPatrolWaypointDecoratorMemory* MyMemory = CastInstanceNodeMemory<FBTHasPatrolWaypointDecoratorMemory>(NodeMemory);
+
+	if (UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get())
+	{
+		PatrolComponent->OnWaypointChanged.Remove(MyMemory->WaypointChangedHandle);
+	}
+
+	MyMemory->PatrolComponent.Reset();
+	MyMemory->WaypointChangedHandle.Reset();
+}
+
+void UBTDecorator_HasPatrolWaypoint::OnWaypointChanged(UWaypointPatrolComponent* PatrolComponent, TWeakObjectPtr<UBehaviorTreeComponent> WeakOwnerComp)
+{
+	UBehaviorTreeComponent* OwnerComp = WeakOwnerComp.Get();
+	uint8* NodeMemory = OwnerComp ? OwnerComp->GetNodeMemory(this, OwnerComp->FindInstanceContainingNode(this)) : nullptr;
+	if (NodeMemory == nullptr)
+	{
+		return;
+	}
+
+	// The delegate fires on every leg, most of which leave the condition as it was
+	FBTHasPatrolWaypointDecoratorMemory* MyMemory = CastInstanceNodeMemory<FBTHasPatrolWaypointDecoratorMemory>(NodeMemory);
+	const bool bResult = CheckCondition(PatrolComponent);
+	if (bResult != MyMemory->bLastResult)
+	{
+		MyMemory->bLastResult = bResult;
+		ConditionalFlowAbort(*OwnerComp, EBTDecoratorAbortRequest::ConditionResultChanged);
+	}
+}
+
+FString UBTDecorator_HasPatrolWaypoint::GetStaticDescription() const
+{
+	const TCHAR* ConditionDesc = Condition == EWaypointPatrolCondition::HasWaypoint ? TEXT("has a waypoint") : TEXT("waypoint has a wait time");
+	return FString::Printf(TEXT("%s: patrol %s"), *Super::GetStaticDescription(), ConditionDesc);
+}
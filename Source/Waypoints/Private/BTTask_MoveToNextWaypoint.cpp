@@ -6,20 +6,28 @@
 #include "GameFramework/Actor.h"
 #include "AISystem.h"
 #include "Navigation/PathFollowingComponent.h"
+#include "Navigation/CrowdFollowingComponent.h"
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
 #include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
 #include "VisualLogger/VisualLogger.h"
 #include "AIController.h"
 #include "BehaviorTree/BlackboardComponent.h"
 #include "Tasks/AITask_MoveTo.h"
+#include "AITask_WaypointMoveTo.h"
 
+#include "NavigationSystem.h"
 #include "Waypoint.h"
+#include "WaypointLoop.h"
+#include "WaypointPatrolComponent.h"
+#include "WaypointPatrolTaskStats.h"
+#include "WaypointPatrolTelemetry.h"
+#include "WaypointSubsystem.h"
 
 UBTTask_MoveToNextWaypoint::UBTTask_MoveToNextWaypoint(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
 	NodeName = "Move To Next Waypoint";
 	bUseGameplayTasks = true; //GET_AI_CONFIG_VAR(bEnableBTAITasks); deprecated in 5.2, always true now
-	bNotifyTick = !bUseGameplayTasks;
+	bNotifyTick = true; // Waiting at waypoints and postponed paths are handled in TickTask
 	bNotifyTaskFinished = true;
 
 	bReachTestIncludesGoalRadius = bReachTestIncludesAgentRadius = GET_AI_CONFIG_VAR(bFinishMoveOnGoalOverlap);
@@ -27,6 +35,12 @@ UBTTask_MoveToNextWaypoint::UBTTask_MoveToNextWaypoint(const FObjectInitializer&
 
 	bSetNextWaypointAfterFinishing = true;
 	bWaitAtCheckpoint = true;
+	bUsePathRequestQueue = true;
+	bUseSharedCorridors = true;
+	bReuseMoveTasks = true;
+	FormationUpdateInterval = 0.25f;
+	FormationTolerance = 50.f;
+	FormationRepathInterval = 1.f;
 
 	// Accept only waypoints
 	BlackboardKey.AddObjectFilter(this, GET_MEMBER_NAME_CHECKED(UBTTask_MoveToNextWaypoint, BlackboardKey), AWaypoint::StaticClass());
@@ -34,13 +48,35 @@ UBTTask_MoveToNextWaypoint::UBTTask_MoveToNextWaypoint(const FObjectInitializer&
 
 EBTNodeResult::Type UBTTask_MoveToNextWaypoint::ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
 {
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+	FWaypointPatrolTaskStats::AgentStarted(EWaypointPatrolTaskType::BehaviorTree, GetInstanceMemorySize());
+
 	EBTNodeResult::Type NodeResult = EBTNodeResult::InProgress;
 
 	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
 	MyMemory->PreviousGoalLocation = FAISystem::InvalidLocation;
 	MyMemory->MoveRequestID = FAIRequestID::InvalidRequest;
+	MyMemory->RemainingWaitTime = 0.f;
+	MyMemory->PathRequestId = 0;
+	MyMemory->bFollowingSharedCorridor = false;
+	MyMemory->bFollowingSquadLeader = false;
 
 	AAIController* MyController = OwnerComp.GetAIOwner();
+	MyMemory->PatrolComponent = UWaypointPatrolComponent::FindPatrolComponent(MyController);
+
+	// A patrol restored from a save game finishes the wait it was interrupted in before moving on
+	if (UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get())
+	{
+		const float RestoredWaitTime = PatrolComponent->ConsumeRestoredWaitTime();
+		if (RestoredWaitTime > 0.f && bWaitAtCheckpoint)
+		{
+			MyMemory->bWaitingForPath = false;
+			MyMemory->RemainingWaitTime = RestoredWaitTime;
+			PatrolComponent->StartWait(RestoredWaitTime);
+			return EBTNodeResult::InProgress;
+		}
+	}
+
 	MyMemory->bWaitingForPath = bUseGameplayTasks ? false : MyController->ShouldPostponePathUpdates();
 	if (!MyMemory->bWaitingForPath)
 	{
@@ -64,40 +100,62 @@ EBTNodeResult::Type UBTTask_MoveToNextWaypoint::PerformMoveTask(UBehaviorTreeCom
 	if (MyController && MyBlackboard)
 	{
 		FAIMoveRequest MoveReq;
-		MoveReq.SetNavigationFilter(MyController->GetDefaultNavigationFilterClass());
-		//MoveReq.SetCanStrafe(bAllowStrafe);
-		MoveReq.SetUsePathfinding(true);
-		//MoveReq.SetStopOnOverlap(true);
-		MoveReq.SetAllowPartialPath(true);
+		BuildMoveRequest(OwnerComp, NodeMemory, MoveReq);
 
-		if (BlackboardKey.SelectedKeyType == UBlackboardKeyType_Object::StaticClass())
+		// Followers don't walk the leg themselves, TickTask keeps them in formation until the leader is done with it
+		const UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get();
+		if (MoveReq.IsValid() && PatrolComponent && PatrolComponent->IsSquadFollower())
 		{
-			UObject* KeyValue = MyBlackboard->GetValue<UBlackboardKeyType_Object>(BlackboardKey.GetSelectedKeyID());
-			AWaypoint* TargetActor = Cast<AWaypoint>(KeyValue);
-			if (TargetActor)
-			{
-				MoveReq.SetAcceptanceRadius(TargetActor->GetAcceptanceRadius());
-				MoveReq.SetReachTestIncludesAgentRadius(bReachTestIncludesAgentRadius);
-				MoveReq.SetReachTestIncludesGoalRadius(bReachTestIncludesGoalRadius);
-				MoveReq.SetGoalActor(TargetActor);
-			}
-			else
-			{
-				UE_VLOG(MyController, LogBehaviorTree, Warning, TEXT("UBTTask_MoveToNextWaypoint::ExecuteTask tried to go to actor while BB %s entry was empty"), *BlackboardKey.SelectedKeyName.ToString());
-			}
+			MyMemory->bFollowingSquadLeader = true;
+			MyMemory->SquadLegIndex = PatrolComponent->GetCurrentIndex();
+			MyMemory->NextFormationUpdate = 0.f;
+			MyMemory->NextFormationRepath = 0.f;
+			MyMemory->bFormationPathfinding = false;
+			NodeResult = EBTNodeResult::InProgress;
 		}
-
-		if (MoveReq.IsValid())
+		else if (MoveReq.IsValid() && bUseSharedCorridors && RequestSharedCorridorMove(OwnerComp, NodeMemory, MoveReq))
+		{
+			NodeResult = EBTNodeResult::InProgress;
+		}
+		else if (MoveReq.IsValid() && bUsePathRequestQueue && RequestQueuedPath(OwnerComp, NodeMemory, MoveReq))
+		{
+			NodeResult = EBTNodeResult::InProgress;
+		}
+		else if (MoveReq.IsValid())
 		{
 			if (true) //GET_AI_CONFIG_VAR(bEnableBTAITasks) deprecated in 5.2, always true now
 			{
 				UAITask_MoveTo* MoveTask = MyMemory->Task.Get();
+				if (MoveTask == nullptr && MyMemory->PersistentTask.IsValid())
+				{
+					// The task of the previous leg is idle and only needs the new request.
+					// It's let go if another move paused it, since it would wait for that move to finish, or if reuse was turned off.
+					UAITask_WaypointMoveTo* PersistentTask = MyMemory->PersistentTask.Get();
+					if (bReuseMoveTasks && UAITask_WaypointMoveTo::IsReuseEnabled() && PersistentTask->IsActive() && PersistentTask->IsLegFinished())
+					{
+						MoveTask = PersistentTask;
+					}
+					else
+					{
+						MyMemory->PersistentTask.Reset();
+						PersistentTask->ExternalCancel();
+					}
+				}
+
 				const bool bReuseExistingTask = (MoveTask != nullptr);
 
 				MoveTask = PrepareMoveTask(OwnerComp, MoveTask, MoveReq);
 				if (MoveTask)
 				{
+					FWaypointPatrolTaskStats::MoveTaskStarted(EWaypointPatrolTaskType::BehaviorTree);
 					MyMemory->bObserverCanFinishTask = false;
+					MyMemory->Task = MoveTask;
+
+					UAITask_WaypointMoveTo* WaypointMoveTask = Cast<UAITask_WaypointMoveTo>(MoveTask);
+					if (WaypointMoveTask)
+					{
+						MyMemory->PersistentTask = WaypointMoveTask;
+					}
 
 					if (bReuseExistingTask)
 					{
@@ -113,13 +171,14 @@ EBTNodeResult::Type UBTTask_MoveToNextWaypoint::PerformMoveTask(UBehaviorTreeCom
 					}
 					else
 					{
-						MyMemory->Task = MoveTask;
 						UE_VLOG(MyController, LogBehaviorTree, Verbose, TEXT("\'%s\' task implementing move with task %s"), *GetNodeName(), *MoveTask->GetName());
 						MoveTask->ReadyForActivation();
 					}
 
 					MyMemory->bObserverCanFinishTask = true;
-					NodeResult = (MoveTask->GetState() != EGameplayTaskState::Finished) ? EBTNodeResult::InProgress :
+					// A kept task doesn't end with its move, it can also have reached the goal already
+					const bool bMoveFinished = MoveTask->GetState() == EGameplayTaskState::Finished || (WaypointMoveTask && WaypointMoveTask->IsLegFinished());
+					NodeResult = !bMoveFinished ? EBTNodeResult::InProgress :
 						MoveTask->WasMoveSuccessful() ? EBTNodeResult::Succeeded :
 						EBTNodeResult::Failed;
 				}
@@ -141,14 +200,252 @@ EBTNodeResult::Type UBTTask_MoveToNextWaypoint::PerformMoveTask(UBehaviorTreeCom
 				}
 			}
 		}
+
+		if (NodeResult == EBTNodeResult::InProgress)
+		{
+			AWaypoint* TargetActor = Cast<AWaypoint>(MoveReq.GetGoalActor());
+			FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::Depart, MyController, TargetActor);
+
+			// Queued paths are observed once the queue has found them, squad followers have no path of their own
+			const UPathFollowingComponent* PathFollowingComp = MyController->GetPathFollowingComponent();
+			if (MyMemory->PathRequestId == 0 && !MyMemory->bFollowingSquadLeader && PathFollowingComp && PathFollowingComp->GetPath().IsValid())
+			{
+				FWaypointPatrolTelemetry::ObservePath(*PathFollowingComp->GetPath(), MyController, TargetActor);
+			}
+		}
 	}
 
 	return NodeResult;
 }
 
+bool UBTTask_MoveToNextWaypoint::BuildMoveRequest(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, FAIMoveRequest& MoveReq) const
+{
+	AAIController* MyController = OwnerComp.GetAIOwner();
+	AWaypoint* TargetActor = nullptr;
+	FVector TargetLocation;
+	FWaypointPointParams TargetParams;
+	if (!MyController || !GetTargetPoint(OwnerComp, NodeMemory, TargetActor, TargetLocation, TargetParams))
+	{
+		return false;
+	}
+
+	MoveReq.SetNavigationFilter(MyController->GetDefaultNavigationFilterClass());
+	//MoveReq.SetCanStrafe(bAllowStrafe);
+	MoveReq.SetUsePathfinding(true);
+	//MoveReq.SetStopOnOverlap(true);
+	MoveReq.SetAllowPartialPath(true);
+	MoveReq.SetAcceptanceRadius(TargetParams.AcceptanceRadius);
+	MoveReq.SetReachTestIncludesAgentRadius(bReachTestIncludesAgentRadius);
+	MoveReq.SetReachTestIncludesGoalRadius(bReachTestIncludesGoalRadius);
+
+	if (TargetActor)
+	{
+		MoveReq.SetGoalActor(TargetActor);
+	}
+	else
+	{
+		MoveReq.SetGoalLocation(TargetLocation);
+	}
+
+	return true;
+}
+
+bool UBTTask_MoveToNextWaypoint::GetTargetPoint(const UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, AWaypoint*& OutWaypoint, FVector& OutLocation, FWaypointPointParams& OutParams) const
+{
+	const FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
+	if (const UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get())
+	{
+		OutWaypoint = PatrolComponent->GetCurrentWaypoint();
+		return PatrolComponent->GetCurrentPoint(OutLocation, OutParams);
+	}
+
+	const UBlackboardComponent* MyBlackboard = OwnerComp.GetBlackboardComponent();
+	if (MyBlackboard && BlackboardKey.SelectedKeyType == UBlackboardKeyType_Object::StaticClass())
+	{
+		UObject* KeyValue = MyBlackboard->GetValue<UBlackboardKeyType_Object>(BlackboardKey.GetSelectedKeyID());
+		OutWaypoint = Cast<AWaypoint>(KeyValue);
+		if (OutWaypoint)
+		{
+			OutLocation = OutWaypoint->GetActorLocation();
+			OutParams = OutWaypoint->GetPointParams();
+			return true;
+		}
+		else
+		{
+			UE_VLOG(OwnerComp.GetAIOwner(), LogBehaviorTree, Warning, TEXT("UBTTask_MoveToNextWaypoint::ExecuteTask tried to go to actor while BB %s entry was empty"), *BlackboardKey.SelectedKeyName.ToString());
+		}
+	}
+
+	return false;
+}
+
+bool UBTTask_MoveToNextWaypoint::RequestQueuedPath(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, const FAIMoveRequest& MoveReq)
+{
+	AAIController* MyController = OwnerComp.GetAIOwner();
+	APawn* MyPawn = MyController ? MyController->GetPawn() : nullptr;
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(OwnerComp.GetWorld());
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(OwnerComp.GetWorld());
+	// The queue only handles waypoint actors, points of generated loops are moved to directly
+	if (!MyPawn || !Subsystem || !NavSys || !MoveReq.GetGoalActor() || !FWaypointPathRequestQueue::IsEnabled())
+	{
+		return false;
+	}
+
+	FWaypointPathRequest Request;
+	Request.Requester = MyController;
+	Request.Start = MyPawn->GetNavAgentLocation();
+	Request.Goal = MoveReq.GetGoalActor();
+	Request.AgentProperties = MyController->GetNavAgentPropertiesRef();
+	Request.NavData = NavSys->GetNavDataForProps(Request.AgentProperties);
+	Request.FilterClass = MoveReq.GetNavigationFilter();
+	Request.bAllowPartialPath = MoveReq.IsUsingPartialPaths();
+	Request.OnFinished = FOnWaypointPathRequestFinished::CreateUObject(this, &UBTTask_MoveToNextWaypoint::OnQueuedPathFinished, TWeakObjectPtr<UBehaviorTreeComponent>(&OwnerComp));
+
+	if (!Request.NavData.IsValid())
+	{
+		return false;
+	}
+
+	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
+	MyMemory->PathRequestId = Subsystem->GetPathRequestQueue().AddRequest(MoveTemp(Request));
+
+	UE_VLOG(MyController, LogBehaviorTree, Verbose, TEXT("\'%s\' queued path request %u"), *GetNodeName(), MyMemory->PathRequestId);
+	return true;
+}
+
+void UBTTask_MoveToNextWaypoint::OnQueuedPathFinished(uint32 RequestId, FNavPathSharedPtr Path, TWeakObjectPtr<UBehaviorTreeComponent> WeakOwnerComp)
+{
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+
+	UBehaviorTreeComponent* OwnerComp = WeakOwnerComp.Get();
+	if (OwnerComp == nullptr)
+	{
+		return;
+	}
+
+	uint8* RawMemory = OwnerComp->GetNodeMemory(this, OwnerComp->FindInstanceContainingNode(this));
+	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(RawMemory);
+
+	// The task was aborted or restarted since the request was made
+	if (MyMemory == nullptr || MyMemory->PathRequestId != RequestId)
+	{
+		return;
+	}
+
+	MyMemory->PathRequestId = 0;
+
+	AAIController* MyController = OwnerComp->GetAIOwner();
+	FAIMoveRequest MoveReq;
+	if (!Path.IsValid() || !MyController || !BuildMoveRequest(*OwnerComp, RawMemory, MoveReq))
+	{
+		FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::PathFailed, MyController, Cast<AWaypoint>(MoveReq.GetGoalActor()));
+		FinishLatentTask(*OwnerComp, EBTNodeResult::Failed);
+		return;
+	}
+
+	const FAIRequestID RequestID = MyController->RequestMove(MoveReq, Path);
+	if (!RequestID.IsValid())
+	{
+		FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::PathFailed, MyController, Cast<AWaypoint>(MoveReq.GetGoalActor()));
+		FinishLatentTask(*OwnerComp, EBTNodeResult::Failed);
+		return;
+	}
+
+	FWaypointPatrolTelemetry::ObservePath(*Path, MyController, Cast<AWaypoint>(MoveReq.GetGoalActor()));
+
+	MyMemory->MoveRequestID = RequestID;
+	WaitForMessage(*OwnerComp, UBrainComponent::AIMessage_MoveFinished, RequestID);
+	WaitForMessage(*OwnerComp, UBrainComponent::AIMessage_RepathFailed);
+}
+
+bool UBTTask_MoveToNextWaypoint::RequestSharedCorridorMove(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, const FAIMoveRequest& MoveReq)
+{
+	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
+	const UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get();
+	AWaypointLoop* Loop = PatrolComponent ? PatrolComponent->GetLoop() : nullptr;
+	AAIController* MyController = OwnerComp.GetAIOwner();
+	APawn* MyPawn = MyController ? MyController->GetPawn() : nullptr;
+	UCrowdFollowingComponent* CrowdComp = MyController ? Cast<UCrowdFollowingComponent>(MyController->GetPathFollowingComponent()) : nullptr;
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(OwnerComp.GetWorld());
+
+	// Corridors are found with the default filter, agents with their own filter class need their own path
+	if (!Loop || !MyPawn || !NavSys || MoveReq.GetNavigationFilter() || !FWaypointSegmentCorridor::IsEnabled())
+	{
+		return false;
+	}
+
+	// The loop keeps paths for each kind of agent walking it, picked from the pawn class like waypoints do
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(OwnerComp.GetWorld());
+	const FWaypointNavAgentInfoPtr PawnNavAgent = Subsystem ? Subsystem->GetNavAgentInfo(MyPawn->GetClass()) : nullptr;
+	const ANavigationData* NavData = NavSys->GetNavDataForProps(MyController->GetNavAgentPropertiesRef(), MyPawn->GetNavAgentLocation());
+	if (!PawnNavAgent.IsValid() || PawnNavAgent->NavData.Get() != NavData)
+	{
+		return false;
+	}
+
+	FNavPathSharedPtr Path = Loop->MakeSharedCorridorPath(PatrolComponent->GetCurrentIndex(), PatrolComponent->IsReversed(), MyPawn->GetNavAgentLocation(), PawnNavAgent, MyController);
+	if (!Path.IsValid())
+	{
+		return false;
+	}
+
+	// The corridor is already as short as it gets, the crowd shouldn't spend raycasts and replans optimizing it
+	const bool bCrowdSimulation = CrowdComp && CrowdComp->IsCrowdSimulationEnabled();
+	const bool bOptimizedVisibility = bCrowdSimulation && CrowdComp->IsCrowdOptimizeVisibilityEnabled();
+	const bool bOptimizedTopology = bCrowdSimulation && CrowdComp->IsCrowdOptimizeTopologyEnabled();
+	if (bCrowdSimulation)
+	{
+		CrowdComp->SetCrowdOptimizeVisibility(false);
+		CrowdComp->SetCrowdOptimizeTopology(false);
+	}
+
+	const FAIRequestID RequestID = MyController->RequestMove(MoveReq, Path);
+	if (!RequestID.IsValid())
+	{
+		if (bCrowdSimulation)
+		{
+			CrowdComp->SetCrowdOptimizeVisibility(bOptimizedVisibility);
+			CrowdComp->SetCrowdOptimizeTopology(bOptimizedTopology);
+		}
+
+		return false;
+	}
+
+	MyMemory->bFollowingSharedCorridor = true;
+	MyMemory->bCrowdSimulation = bCrowdSimulation;
+	MyMemory->bCrowdOptimizedVisibility = bOptimizedVisibility;
+	MyMemory->bCrowdOptimizedTopology = bOptimizedTopology;
+	MyMemory->MoveRequestID = RequestID;
+	WaitForMessage(OwnerComp, UBrainComponent::AIMessage_MoveFinished, RequestID);
+	WaitForMessage(OwnerComp, UBrainComponent::AIMessage_RepathFailed);
+
+	UE_VLOG(MyController, LogBehaviorTree, Verbose, TEXT("\'%s\' following the shared corridor of %s"), *GetNodeName(), *Loop->GetName());
+	return true;
+}
+
 UAITask_MoveTo* UBTTask_MoveToNextWaypoint::PrepareMoveTask(UBehaviorTreeComponent& OwnerComp, UAITask_MoveTo* ExistingTask, FAIMoveRequest& MoveRequest)
 {
-	UAITask_MoveTo* MoveTask = ExistingTask ? ExistingTask : NewBTAITask<UAITask_MoveTo>(OwnerComp);
+	UAITask_MoveTo* MoveTask = ExistingTask;
+	if (MoveTask == nullptr && bReuseMoveTasks && UAITask_WaypointMoveTo::IsReuseEnabled())
+	{
+		UAITask_WaypointMoveTo* WaypointMoveTask = NewBTAITask<UAITask_WaypointMoveTo>(OwnerComp);
+		if (WaypointMoveTask)
+		{
+			WaypointMoveTask->OnLegFinished.BindUObject(this, &UBTTask_MoveToNextWaypoint::OnMoveTaskLegFinished);
+		}
+
+		MoveTask = WaypointMoveTask;
+	}
+	else if (MoveTask == nullptr)
+	{
+		MoveTask = NewBTAITask<UAITask_MoveTo>(OwnerComp);
+	}
+
+	if (MoveTask && MoveTask != ExistingTask)
+	{
+		FWaypointPatrolTaskStats::ObjectAllocated(EWaypointPatrolTaskType::BehaviorTree, MoveTask->GetClass()->GetStructureSize());
+	}
+
 	if (MoveTask)
 	{
 		MoveTask->SetUp(MoveTask->GetAIController(), MoveRequest);
@@ -159,8 +456,27 @@ UAITask_MoveTo* UBTTask_MoveToNextWaypoint::PrepareMoveTask(UBehaviorTreeCompone
 
 EBTNodeResult::Type UBTTask_MoveToNextWaypoint::AbortTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
 {
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+
 	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
-	if (!MyMemory->bWaitingForPath)
+	if (MyMemory->PathRequestId != 0)
+	{
+		if (UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(OwnerComp.GetWorld()))
+		{
+			Subsystem->GetPathRequestQueue().CancelRequest(MyMemory->PathRequestId);
+		}
+
+		MyMemory->PathRequestId = 0;
+	}
+	else if (MyMemory->bFollowingSquadLeader)
+	{
+		AAIController* MyController = OwnerComp.GetAIOwner();
+		if (MyMemory->MoveRequestID.IsValid() && MyController && MyController->GetPathFollowingComponent())
+		{
+			MyController->GetPathFollowingComponent()->AbortMove(*this, FPathFollowingResultFlags::OwnerFinished, MyMemory->MoveRequestID);
+		}
+	}
+	else if (!MyMemory->bWaitingForPath)
 	{
 		if (MyMemory->MoveRequestID.IsValid())
 		{
@@ -190,11 +506,38 @@ EBTNodeResult::Type UBTTask_MoveToNextWaypoint::AbortTask(UBehaviorTreeComponent
 
 void UBTTask_MoveToNextWaypoint::OnTaskFinished(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTNodeResult::Type TaskResult)
 {
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+	FWaypointPatrolTaskStats::AgentStopped(EWaypointPatrolTaskType::BehaviorTree, GetInstanceMemorySize());
+	FWaypointPatrolTaskStats::LegFinished(EWaypointPatrolTaskType::BehaviorTree);
+
 	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
 	MyMemory->Task.Reset();
 
-	// Set the blackboard value to the next waypoint
-	if (bSetNextWaypointAfterFinishing && BlackboardKey.SelectedKeyType == UBlackboardKeyType_Object::StaticClass())
+	if (MyMemory->bFollowingSharedCorridor)
+	{
+		AAIController* MyController = OwnerComp.GetAIOwner();
+		UCrowdFollowingComponent* CrowdComp = MyController ? Cast<UCrowdFollowingComponent>(MyController->GetPathFollowingComponent()) : nullptr;
+		if (CrowdComp && MyMemory->bCrowdSimulation)
+		{
+			CrowdComp->SetCrowdOptimizeVisibility(MyMemory->bCrowdOptimizedVisibility);
+			CrowdComp->SetCrowdOptimizeTopology(MyMemory->bCrowdOptimizedTopology);
+		}
+
+		MyMemory->bFollowingSharedCorridor = false;
+	}
+
+	// Move the patrol on to the next waypoint, through the blackboard only if the AI has no patrol component
+	UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get();
+	if (PatrolComponent)
+	{
+		PatrolComponent->EndWait();
+	}
+
+	if (bSetNextWaypointAfterFinishing && PatrolComponent)
+	{
+		PatrolComponent->AdvanceToNextWaypoint();
+	}
+	else if (bSetNextWaypointAfterFinishing && BlackboardKey.SelectedKeyType == UBlackboardKeyType_Object::StaticClass())
 	{
 		UBlackboardComponent* MyBlackboard = OwnerComp.GetBlackboardComponent();
 		UObject* KeyValue = MyBlackboard->GetValue<UBlackboardKeyType_Object>(BlackboardKey.GetSelectedKeyID());
@@ -216,8 +559,16 @@ void UBTTask_MoveToNextWaypoint::OnTaskFinished(UBehaviorTreeComponent& OwnerCom
 
 void UBTTask_MoveToNextWaypoint::TickTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, float DeltaSeconds)
 {
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+
 	FBTMoveToNextWaypointTaskMemory* MyMemory = (FBTMoveToNextWaypointTaskMemory*)NodeMemory;
 
+	if (MyMemory->bFollowingSquadLeader)
+	{
+		UpdateFormationMove(OwnerComp, NodeMemory, DeltaSeconds);
+		return;
+	}
+
 	if (MyMemory->bWaitingForPath && !OwnerComp.IsPaused())
 	{
 		AAIController* MyController = OwnerComp.GetAIOwner();
@@ -241,39 +592,128 @@ void UBTTask_MoveToNextWaypoint::TickTask(UBehaviorTreeComponent& OwnerComp, uin
 
 		if (MyMemory->RemainingWaitTime <= 0.f)
 		{
+			if (FWaypointPatrolTelemetry::IsEnabled())
+			{
+				AWaypoint* TargetActor = nullptr;
+				FVector TargetLocation;
+				FWaypointPointParams TargetParams;
+				GetTargetPoint(OwnerComp, NodeMemory, TargetActor, TargetLocation, TargetParams);
+				FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::WaitEnd, OwnerComp.GetAIOwner(), TargetActor);
+			}
+
 			FinishLatentTask(OwnerComp, EBTNodeResult::Succeeded);
 		}
 	}
 }
 
+void UBTTask_MoveToNextWaypoint::UpdateFormationMove(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, float DeltaSeconds)
+{
+	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
+	const UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get();
+
+	// The leader advanced the squad once it was done waiting, or it's gone and this agent patrols on its own from here
+	if (PatrolComponent == nullptr || !PatrolComponent->IsSquadFollower() || PatrolComponent->GetCurrentIndex() != MyMemory->SquadLegIndex)
+	{
+		FinishLatentTask(OwnerComp, EBTNodeResult::Succeeded);
+		return;
+	}
+
+	MyMemory->NextFormationUpdate -= DeltaSeconds;
+	MyMemory->NextFormationRepath -= DeltaSeconds;
+	if (MyMemory->NextFormationUpdate > 0.f || OwnerComp.IsPaused())
+	{
+		return;
+	}
+
+	MyMemory->NextFormationUpdate = FormationUpdateInterval;
+
+	AAIController* MyController = OwnerComp.GetAIOwner();
+	const APawn* MyPawn = MyController ? MyController->GetPawn() : nullptr;
+	const UPathFollowingComponent* PathFollowingComp = MyController ? MyController->GetPathFollowingComponent() : nullptr;
+	FVector Slot;
+	if (!MyPawn || !PathFollowingComp || !PatrolComponent->GetFormationSlot(Slot))
+	{
+		return;
+	}
+
+	// Close enough, or already heading there
+	const FVector::FReal ToleranceSq = FMath::Square(FormationTolerance);
+	const bool bMoving = PathFollowingComp->GetStatus() == EPathFollowingStatus::Moving;
+	if (FVector::DistSquared2D(MyPawn->GetNavAgentLocation(), Slot) <= ToleranceSq
+		|| (bMoving && FVector::DistSquared2D(PathFollowingComp->GetPathDestination(), Slot) <= ToleranceSq))
+	{
+		return;
+	}
+
+	// Slots are next to the leader, a straight move gets there unless something is in the way
+	FVector HitLocation;
+	const bool bBlocked = UNavigationSystemV1::NavigationRaycast(MyController, MyPawn->GetNavAgentLocation(), Slot, HitLocation, nullptr, MyController);
+
+	// The slot moves with the leader, pathfinding to it on every update would repath the whole time it's out of sight.
+	// The last path still leads to where the leader just was, so it's walked until the next repath is due.
+	if (bBlocked)
+	{
+		if (bMoving && MyMemory->bFormationPathfinding && MyMemory->NextFormationRepath > 0.f)
+		{
+			return;
+		}
+
+		MyMemory->NextFormationRepath = FormationRepathInterval;
+	}
+
+	MyMemory->bFormationPathfinding = bBlocked;
+
+	FAIMoveRequest MoveReq(Slot);
+	MoveReq.SetUsePathfinding(bBlocked);
+	MoveReq.SetAllowPartialPath(true);
+	MoveReq.SetAcceptanceRadius(FormationTolerance * 0.5f);
+
+	const FPathFollowingRequestResult RequestResult = MyController->MoveTo(MoveReq);
+	MyMemory->MoveRequestID = RequestResult.Code == EPathFollowingRequestResult::RequestSuccessful ? RequestResult.MoveId : FAIRequestID::InvalidRequest;
+}
+
 void UBTTask_MoveToNextWaypoint::OnMessage(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, FName Message, int32 SenderID, bool bSuccess)
 {
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+
 	// AIMessage_RepathFailed means task has failed
 	bSuccess &= (Message != UBrainComponent::AIMessage_RepathFailed);
 	
 	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
-	const UBlackboardComponent* MyBlackboard = OwnerComp.GetBlackboardComponent();
-	UObject* KeyValue = MyBlackboard->GetValue<UBlackboardKeyType_Object>(BlackboardKey.GetSelectedKeyID());
-	AWaypoint* TargetActor = Cast<AWaypoint>(KeyValue);
+	AWaypoint* TargetActor = nullptr;
+	FVector TargetLocation;
+	FWaypointPointParams TargetParams;
+	const bool bHasTarget = GetTargetPoint(OwnerComp, NodeMemory, TargetActor, TargetLocation, TargetParams);
 
 	AAIController* MyController = OwnerComp.GetAIOwner();
 
+	if (Message == UBrainComponent::AIMessage_MoveFinished)
+	{
+		FWaypointPatrolTelemetry::Record(bSuccess ? EWaypointPatrolEvent::Arrive : EWaypointPatrolEvent::PathFailed, MyController, TargetActor);
+	}
+
 	// We've finished moving to the waypoint, now time to wait
-	if (bSuccess && TargetActor && bWaitAtCheckpoint && (TargetActor->GetWaitTime() > 0.f))
+	if (bSuccess && bHasTarget && bWaitAtCheckpoint && (TargetParams.WaitTime > 0.f))
 	{
 		// Turn the actor towards the waypoint
-		if (MyController && TargetActor->GetOrientGuardToWaypoint())
+		if (MyController && EnumHasAnyFlags(TargetParams.Flags, EWaypointPointFlags::OrientGuardToWaypoint))
 		{
 			APawn* Pawn = MyController->GetPawn();
 			const FVector PawnLocation = Pawn->GetActorLocation();
-			const FVector DirectionVector = TargetActor->GetActorForwardVector();
+			const FVector DirectionVector = FVector(TargetParams.FacingDirection);
 			const FVector FocalPoint = PawnLocation + DirectionVector * 10000.0f;
 
 			MyController->SetFocalPoint(FocalPoint, EAIFocusPriority::Gameplay);
 
 		}
 
-		MyMemory->RemainingWaitTime = TargetActor->GetWaitTime();
+		MyMemory->RemainingWaitTime = TargetParams.WaitTime;
+		if (UWaypointPatrolComponent* PatrolComponent = MyMemory->PatrolComponent.Get())
+		{
+			PatrolComponent->StartWait(TargetParams.WaitTime);
+		}
+
+		FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::WaitStart, MyController, TargetActor);
 		return;
 	}
 
@@ -282,21 +722,37 @@ void UBTTask_MoveToNextWaypoint::OnMessage(UBehaviorTreeComponent& OwnerComp, ui
 
 void UBTTask_MoveToNextWaypoint::OnGameplayTaskDeactivated(UGameplayTask& Task)
 {
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+
 	// AI move task finished
 	UAITask_MoveTo* MoveTask = Cast<UAITask_MoveTo>(&Task);
-	if (MoveTask && MoveTask->GetAIController() && MoveTask->GetState() != EGameplayTaskState::Paused)
+	if (MoveTask && MoveTask->GetState() != EGameplayTaskState::Paused)
+	{
+		OnMoveTaskFinished(*MoveTask);
+	}
+}
+
+void UBTTask_MoveToNextWaypoint::OnMoveTaskLegFinished(UAITask_WaypointMoveTo& MoveTask)
+{
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::BehaviorTree);
+	OnMoveTaskFinished(MoveTask);
+}
+
+void UBTTask_MoveToNextWaypoint::OnMoveTaskFinished(UAITask_MoveTo& MoveTask)
+{
+	UBehaviorTreeComponent* BehaviorComp = MoveTask.GetAIController() ? GetBTComponentForTask(MoveTask) : nullptr;
+	if (BehaviorComp)
 	{
-		UBehaviorTreeComponent* BehaviorComp = GetBTComponentForTask(Task);
-		if (BehaviorComp)
+		uint8* RawMemory = BehaviorComp->GetNodeMemory(this, BehaviorComp->FindInstanceContainingNode(this));
+		FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(RawMemory);
+
+		if (MyMemory->bObserverCanFinishTask && (&MoveTask == MyMemory->Task))
 		{
-			uint8* RawMemory = BehaviorComp->GetNodeMemory(this, BehaviorComp->FindInstanceContainingNode(this));
-			FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(RawMemory);
+			const bool bSuccess = MoveTask.WasMoveSuccessful();
+			FWaypointPatrolTelemetry::Record(bSuccess ? EWaypointPatrolEvent::Arrive : EWaypointPatrolEvent::PathFailed,
+				MoveTask.GetAIController(), Cast<AWaypoint>(MoveTask.GetMoveRequestRef().GetGoalActor()));
 
-			if (MyMemory->bObserverCanFinishTask && (MoveTask == MyMemory->Task))
-			{
-				const bool bSuccess = MoveTask->WasMoveSuccessful();
-				FinishLatentTask(*BehaviorComp, bSuccess ? EBTNodeResult::Succeeded : EBTNodeResult::Failed);
-			}
+			FinishLatentTask(*BehaviorComp, bSuccess ? EBTNodeResult::Succeeded : EBTNodeResult::Failed);
 		}
 	}
 }
@@ -328,6 +784,9 @@ void UBTTask_MoveToNextWaypoint::DescribeRuntimeValues(const UBehaviorTreeCompon
 
 		const FString ModeDesc =
 			MyMemory->bWaitingForPath ? TEXT("(WAITING)") :
+			MyMemory->PathRequestId != 0 ? TEXT("(QUEUED)") :
+			MyMemory->bFollowingSharedCorridor ? TEXT("(corridor)") :
+			MyMemory->bFollowingSquadLeader ? TEXT("(squad)") :
 			bIsUsingTask ? TEXT("(task)") :
 			TEXT("");
 
@@ -340,6 +799,22 @@ uint16 UBTTask_MoveToNextWaypoint::GetInstanceMemorySize() const
 	return sizeof(FBTMoveToNextWaypointTaskMemory);
 }
 
+void UBTTask_MoveToNextWaypoint::CleanupMemory(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTMemoryClear::Type CleanupType) const
+{
+	// The kept move task would otherwise stay active on the controller after the tree is gone
+	FBTMoveToNextWaypointTaskMemory* MyMemory = CastInstanceNodeMemory<FBTMoveToNextWaypointTaskMemory>(NodeMemory);
+	UAITask_WaypointMoveTo* MoveTask = MyMemory->PersistentTask.Get();
+	if (MoveTask && CleanupType == EBTMemoryClear::Destroy)
+	{
+		MyMemory->bObserverCanFinishTask = false;
+		MyMemory->Task.Reset();
+		MyMemory->PersistentTask.Reset();
+		MoveTask->ExternalCancel();
+	}
+
+	Super::CleanupMemory(OwnerComp, NodeMemory, CleanupType);
+}
+
 #if WITH_EDITOR
 
 FName UBTTask_MoveToNextWaypoint::GetNodeIconName() const
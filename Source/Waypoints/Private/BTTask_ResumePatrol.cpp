@@ -0,0 +1,114 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "BTTask_ResumePatrol.h"
+#include "Waypoint.h"
+#include "WaypointPatrolComponent.h"
+#include "WaypointSubsystem.h"
+
+#include "AIController.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/BlackboardComponent.h"
+
+UBTTask_ResumePatrol::UBTTask_ResumePatrol(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	NodeName = "Resume Patrol";
+	MaxCandidates = 4;
+
+	// Accept only waypoints
+	BlackboardKey.AddObjectFilter(this, GET_MEMBER_NAME_CHECKED(UBTTask_ResumePatrol, BlackboardKey), AWaypoint::StaticClass());
+}
+
+EBTNodeResult::Type UBTTask_ResumePatrol::ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
+{
+	static uint32 NextQueryId = 0;
+
+	AAIController* MyController = OwnerComp.GetAIOwner();
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(OwnerComp.GetWorld());
+	if (!MyController || !Subsystem)
+	{
+		return EBTNodeResult::Failed;
+	}
+
+	FBTResumePatrolTaskMemory* MyMemory = CastInstanceNodeMemory<FBTResumePatrolTaskMemory>(NodeMemory);
+	MyMemory->QueryId = ++NextQueryId;
+	MyMemory->bExecuting = true;
+	MyMemory->bSucceeded = false;
+
+	// Keep the loop the AI was patrolling, if it had one
+	const UWaypointPatrolComponent* PatrolComponent = UWaypointPatrolComponent::FindPatrolComponent(MyController);
+	Subsystem->FindResumePoint(MyController, PatrolComponent ? PatrolComponent->GetLoop() : nullptr, MaxCandidates,
+		FOnWaypointResumePointFound::CreateUObject(this, &UBTTask_ResumePatrol::OnResumePointFound, TWeakObjectPtr<UBehaviorTreeComponent>(&OwnerComp), MyMemory->QueryId));
+
+	const bool bFinished = MyMemory->QueryId == 0;
+	MyMemory->bExecuting = false;
+
+	return !bFinished ? EBTNodeResult::InProgress : MyMemory->bSucceeded ? EBTNodeResult::Succeeded : EBTNodeResult::Failed;
+}
+
+EBTNodeResult::Type UBTTask_ResumePatrol::AbortTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
+{
+	// The query can't be cancelled, its result is ignored instead
+	FBTResumePatrolTaskMemory* MyMemory = CastInstanceNodeMemory<FBTResumePatrolTaskMemory>(NodeMemory);
+	MyMemory->QueryId = 0;
+
+	return Super::AbortTask(OwnerComp, NodeMemory);
+}
+
+void UBTTask_ResumePatrol::OnResumePointFound(const FWaypointResumePoint& ResumePoint, TWeakObjectPtr<UBehaviorTreeComponent> WeakOwnerComp, uint32 QueryId)
+{
+	UBehaviorTreeComponent* OwnerComp = WeakOwnerComp.Get();
+	if (OwnerComp == nullptr)
+	{
+		return;
+	}
+
+	uint8* RawMemory = OwnerComp->GetNodeMemory(this, OwnerComp->FindInstanceContainingNode(this));
+	FBTResumePatrolTaskMemory* MyMemory = CastInstanceNodeMemory<FBTResumePatrolTaskMemory>(RawMemory);
+
+	// The task was aborted or restarted since the query was made
+	if (MyMemory == nullptr || MyMemory->QueryId != QueryId)
+	{
+		return;
+	}
+
+	MyMemory->QueryId = 0;
+	MyMemory->bSucceeded = ApplyResumePoint(*OwnerComp, ResumePoint);
+
+	if (!MyMemory->bExecuting)
+	{
+		FinishLatentTask(*OwnerComp, MyMemory->bSucceeded ? EBTNodeResult::Succeeded : EBTNodeResult::Failed);
+	}
+}
+
+bool UBTTask_ResumePatrol::ApplyResumePoint(UBehaviorTreeComponent& OwnerComp, const FWaypointResumePoint& ResumePoint) const
+{
+	if (!ResumePoint.IsValid())
+	{
+		return false;
+	}
+
+	if (UWaypointPatrolComponent* PatrolComponent = UWaypointPatrolComponent::FindPatrolComponent(OwnerComp.GetAIOwner()))
+	{
+		PatrolComponent->SetResumePoint(ResumePoint);
+		return true;
+	}
+
+	UBlackboardComponent* MyBlackboard = OwnerComp.GetBlackboardComponent();
+	if (MyBlackboard && ResumePoint.Waypoint && BlackboardKey.SelectedKeyType == UBlackboardKeyType_Object::StaticClass())
+	{
+		MyBlackboard->SetValue<UBlackboardKeyType_Object>(BlackboardKey.GetSelectedKeyID(), ResumePoint.Waypoint);
+		return true;
+	}
+
+	return false;
+}
+
+uint16 UBTTask_ResumePatrol::GetInstanceMemorySize() const
+{
+	return sizeof(FBTResumePatrolTaskMemory);
+}
+
+FString UBTTask_ResumePatrol::GetStaticDescription() const
+{
+	return FString::Printf(TEXT("%s: cheapest of %d closest waypoints"), *Super::GetStaticDescription(), MaxCandidates);
+}
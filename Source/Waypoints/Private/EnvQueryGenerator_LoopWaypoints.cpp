@@ -0,0 +1,64 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "EnvQueryGenerator_LoopWaypoints.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+
+#include "EnvironmentQuery/Contexts/EnvQueryContext_Querier.h"
+
+#define LOCTEXT_NAMESPACE "EnvQueryGenerator"
+
+UEnvQueryGenerator_LoopWaypoints::UEnvQueryGenerator_LoopWaypoints(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	LoopContext = UEnvQueryContext_Querier::StaticClass();
+}
+
+void UEnvQueryGenerator_LoopWaypoints::GenerateItems(FEnvQueryInstance& QueryInstance) const
+{
+	const UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(QueryInstance.World);
+
+	TArray<AActor*> ContextActors;
+	if (Subsystem == nullptr || !QueryInstance.PrepareContext(LoopContext, ContextActors))
+	{
+		return;
+	}
+
+	TArray<const AWaypointLoop*, TInlineAllocator<4>> GeneratedLoops;
+	TArray<FNavLocation> Points;
+
+	for (const AActor* ContextActor : ContextActors)
+	{
+		const AWaypointLoop* Loop = Subsystem->FindLoopForActor(ContextActor);
+		if (Loop == nullptr || GeneratedLoops.Contains(Loop))
+		{
+			continue;
+		}
+
+		GeneratedLoops.Add(Loop);
+
+		const TConstArrayView<FVector> Locations = Loop->GetLoopData().GetLocations();
+		Points.Reserve(Points.Num() + Locations.Num());
+		for (const FVector& Location : Locations)
+		{
+			Points.Add(FNavLocation(Location));
+		}
+	}
+
+	ProjectAndFilterNavPoints(Points, QueryInstance);
+	StoreNavPoints(Points, QueryInstance);
+}
+
+FText UEnvQueryGenerator_LoopWaypoints::GetDescriptionTitle() const
+{
+	return FText::Format(LOCTEXT("LoopWaypointsDescriptionGenerateAroundContext", "{0}: generate on loop of {1}"),
+		Super::GetDescriptionTitle(), UEnvQueryTypes::DescribeContext(LoopContext));
+}
+
+FText UEnvQueryGenerator_LoopWaypoints::GetDescriptionDetails() const
+{
+	const FText ProjectionDesc = ProjectionData.ToText(FEnvTraceData::Brief);
+	return ProjectionDesc.IsEmpty() ? FText::GetEmpty() : ProjectionDesc;
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,77 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "EnvQueryGenerator_WaypointsInRadius.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+
+#include "EnvironmentQuery/Contexts/EnvQueryContext_Querier.h"
+
+#define LOCTEXT_NAMESPACE "EnvQueryGenerator"
+
+UEnvQueryGenerator_WaypointsInRadius::UEnvQueryGenerator_WaypointsInRadius(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	SearchCenter = UEnvQueryContext_Querier::StaticClass();
+	SearchRadius.DefaultValue = 1500.f;
+}
+
+void UEnvQueryGenerator_WaypointsInRadius::GenerateItems(FEnvQueryInstance& QueryInstance) const
+{
+	UObject* BindOwner = QueryInstance.Owner.Get();
+	const UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(QueryInstance.World);
+	if (BindOwner == nullptr || Subsystem == nullptr)
+	{
+		return;
+	}
+
+	SearchRadius.BindData(BindOwner, QueryInstance.QueryID);
+	const FVector::FReal RadiusSq = FMath::Square(SearchRadius.GetValue());
+
+	TArray<FVector> Centers;
+	if (!QueryInstance.PrepareContext(SearchCenter, Centers) || Centers.Num() == 0)
+	{
+		return;
+	}
+
+	// Straight scans of the packed locations, every point is added once even if it's in range of several centers
+	TArray<FNavLocation> Points;
+	Subsystem->ForEachLoop([&Centers, RadiusSq, &Points](const AWaypointLoop& Loop)
+		{
+			for (const FVector& Location : Loop.GetLoopData().GetLocations())
+			{
+				const bool bInRange = Centers.ContainsByPredicate([&Location, RadiusSq](const FVector& Center)
+					{
+						return FVector::DistSquared(Center, Location) <= RadiusSq;
+					});
+
+				if (bInRange)
+				{
+					Points.Add(FNavLocation(Location));
+				}
+			}
+		});
+
+	ProjectAndFilterNavPoints(Points, QueryInstance);
+	StoreNavPoints(Points, QueryInstance);
+}
+
+FText UEnvQueryGenerator_WaypointsInRadius::GetDescriptionTitle() const
+{
+	return FText::Format(LOCTEXT("WaypointsInRadiusDescriptionGenerateAroundContext", "{0}: generate around {1}"),
+		Super::GetDescriptionTitle(), UEnvQueryTypes::DescribeContext(SearchCenter));
+}
+
+FText UEnvQueryGenerator_WaypointsInRadius::GetDescriptionDetails() const
+{
+	FText Desc = FText::Format(LOCTEXT("WaypointsInRadiusDescription", "radius: {0}"), FText::FromString(SearchRadius.ToString()));
+
+	const FText ProjDesc = ProjectionData.ToText(FEnvTraceData::Brief);
+	if (!ProjDesc.IsEmpty())
+	{
+		Desc = FText::Format(LOCTEXT("WaypointsInRadiusDescriptionWithProjection", "{0}, {1}"), Desc, ProjDesc);
+	}
+
+	return Desc;
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,73 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "EnvQueryTest_IsOnCurrentLoop.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+
+#include "EnvironmentQuery/Contexts/EnvQueryContext_Querier.h"
+#include "EnvironmentQuery/Items/EnvQueryItemType_VectorBase.h"
+
+#define LOCTEXT_NAMESPACE "EnvQueryGenerator"
+
+UEnvQueryTest_IsOnCurrentLoop::UEnvQueryTest_IsOnCurrentLoop(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Cost = EEnvTestCost::Low;
+	ValidItemType = UEnvQueryItemType_VectorBase::StaticClass();
+	SetWorkOnFloatValues(false);
+
+	LoopContext = UEnvQueryContext_Querier::StaticClass();
+	MatchTolerance = 50.f;
+}
+
+void UEnvQueryTest_IsOnCurrentLoop::RunTest(FEnvQueryInstance& QueryInstance) const
+{
+	UObject* QueryOwner = QueryInstance.Owner.Get();
+	const UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(QueryInstance.World);
+	if (QueryOwner == nullptr || Subsystem == nullptr)
+	{
+		return;
+	}
+
+	BoolValue.BindData(QueryOwner, QueryInstance.QueryID);
+	const bool bWantsOnLoop = BoolValue.GetValue();
+
+	TArray<AActor*> ContextActors;
+	if (!QueryInstance.PrepareContext(LoopContext, ContextActors))
+	{
+		return;
+	}
+
+	TArray<const AWaypointLoop*, TInlineAllocator<4>> ContextLoops;
+	for (const AActor* ContextActor : ContextActors)
+	{
+		ContextLoops.Add(Subsystem->FindLoopForActor(ContextActor));
+	}
+
+	for (FEnvQueryInstance::ItemIterator It(this, QueryInstance); It; ++It)
+	{
+		const FVector ItemLocation = GetItemLocation(QueryInstance, It.GetIndex());
+
+		// On the loop of any context is on a current loop, the item is scored once
+		bool bOnLoop = false;
+		for (int32 i = 0; !bOnLoop && i < ContextLoops.Num(); ++i)
+		{
+			bOnLoop = ContextLoops[i] && ContextLoops[i]->GetLoopData().FindPointAt(ItemLocation, MatchTolerance) != INDEX_NONE;
+		}
+
+		It.SetScore(TestPurpose, FilterType, bOnLoop, bWantsOnLoop);
+	}
+}
+
+FText UEnvQueryTest_IsOnCurrentLoop::GetDescriptionTitle() const
+{
+	return FText::Format(LOCTEXT("IsOnCurrentLoopDescription", "{0}: loop of {1}"),
+		Super::GetDescriptionTitle(), UEnvQueryTypes::DescribeContext(LoopContext));
+}
+
+FText UEnvQueryTest_IsOnCurrentLoop::GetDescriptionDetails() const
+{
+	return DescribeBoolTestParams(TEXT("on loop"));
+}
+
+#undef LOCTEXT_NAMESPACE
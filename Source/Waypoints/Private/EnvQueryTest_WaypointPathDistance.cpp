@@ -0,0 +1,128 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "EnvQueryTest_WaypointPathDistance.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+
+#include "EnvironmentQuery/Contexts/EnvQueryContext_Querier.h"
+#include "EnvironmentQuery/Items/EnvQueryItemType_VectorBase.h"
+
+#define LOCTEXT_NAMESPACE "EnvQueryGenerator"
+
+UEnvQueryTest_WaypointPathDistance::UEnvQueryTest_WaypointPathDistance(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Cost = EEnvTestCost::Low;
+	ValidItemType = UEnvQueryItemType_VectorBase::StaticClass();
+	SetWorkOnFloatValues(true);
+
+	DistanceFrom = UEnvQueryContext_Querier::StaticClass();
+	Direction = EWaypointPathDistanceDirection::Forward;
+	MatchTolerance = 50.f;
+}
+
+void UEnvQueryTest_WaypointPathDistance::RunTest(FEnvQueryInstance& QueryInstance) const
+{
+	UObject* QueryOwner = QueryInstance.Owner.Get();
+	const UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(QueryInstance.World);
+	if (QueryOwner == nullptr || Subsystem == nullptr)
+	{
+		return;
+	}
+
+	FloatValueMin.BindData(QueryOwner, QueryInstance.QueryID);
+	const float MinThresholdValue = FloatValueMin.GetValue();
+
+	FloatValueMax.BindData(QueryOwner, QueryInstance.QueryID);
+	const float MaxThresholdValue = FloatValueMax.GetValue();
+
+	TArray<AActor*> ContextActors;
+	if (!QueryInstance.PrepareContext(DistanceFrom, ContextActors))
+	{
+		return;
+	}
+
+	struct FContextLoop
+	{
+		const AWaypointLoop* Loop = nullptr;
+		int32 StartIndex = INDEX_NONE;
+
+		// Distance along the loop from its first point to each point, then to the first point again
+		TArray<FVector::FReal> Distances;
+	};
+
+	// Worked out again whenever the test resumes after running out of time, it's a single pass over the segments
+	TArray<FContextLoop, TInlineAllocator<4>> ContextLoops;
+	for (const AActor* ContextActor : ContextActors)
+	{
+		FContextLoop& ContextLoop = ContextLoops.AddDefaulted_GetRef();
+		ContextLoop.Loop = Subsystem->FindLoopForActor(ContextActor, &ContextLoop.StartIndex);
+		if (ContextLoop.Loop == nullptr)
+		{
+			continue;
+		}
+
+		const int32 NumPoints = ContextLoop.Loop->GetLoopData().Num();
+		ContextLoop.Distances.SetNumUninitialized(NumPoints + 1);
+		ContextLoop.Distances[0] = 0.;
+		for (int32 i = 0; i < NumPoints; ++i)
+		{
+			ContextLoop.Distances[i + 1] = ContextLoop.Distances[i] + ContextLoop.Loop->GetSegmentLength(i);
+		}
+	}
+
+	for (FEnvQueryInstance::ItemIterator It(this, QueryInstance); It; ++It)
+	{
+		const FVector ItemLocation = GetItemLocation(QueryInstance, It.GetIndex());
+
+		// Closest of the contexts whose loop the item is on, the item is scored once
+		TOptional<FVector::FReal> ClosestDistance;
+		for (const FContextLoop& ContextLoop : ContextLoops)
+		{
+			const int32 ItemIndex = ContextLoop.Loop ? ContextLoop.Loop->GetLoopData().FindPointAt(ItemLocation, MatchTolerance) : INDEX_NONE;
+			if (ItemIndex == INDEX_NONE || ContextLoop.StartIndex == INDEX_NONE)
+			{
+				continue;
+			}
+
+			const FVector::FReal LoopLength = ContextLoop.Distances.Last();
+			const FVector::FReal Ahead = ContextLoop.Distances[ItemIndex] - ContextLoop.Distances[ContextLoop.StartIndex];
+			const FVector::FReal ForwardDistance = Ahead >= 0. ? Ahead : Ahead + LoopLength;
+			const FVector::FReal BackwardDistance = ItemIndex == ContextLoop.StartIndex ? 0. : LoopLength - ForwardDistance;
+
+			FVector::FReal Distance = ForwardDistance;
+			if (Direction == EWaypointPathDistanceDirection::Backward)
+			{
+				Distance = BackwardDistance;
+			}
+			else if (Direction == EWaypointPathDistanceDirection::Shortest)
+			{
+				Distance = FMath::Min(ForwardDistance, BackwardDistance);
+			}
+
+			ClosestDistance = ClosestDistance.IsSet() ? FMath::Min(ClosestDistance.GetValue(), Distance) : Distance;
+		}
+
+		if (ClosestDistance.IsSet())
+		{
+			It.SetScore(TestPurpose, FilterType, (float)ClosestDistance.GetValue(), MinThresholdValue, MaxThresholdValue);
+		}
+		else
+		{
+			It.ForceItemState(EEnvItemStatus::Failed);
+		}
+	}
+}
+
+FText UEnvQueryTest_WaypointPathDistance::GetDescriptionTitle() const
+{
+	return FText::Format(LOCTEXT("WaypointPathDistanceDescription", "{0} from: {1}"),
+		Super::GetDescriptionTitle(), UEnvQueryTypes::DescribeContext(DistanceFrom));
+}
+
+FText UEnvQueryTest_WaypointPathDistance::GetDescriptionDetails() const
+{
+	return DescribeFloatTestParams();
+}
+
+#undef LOCTEXT_NAMESPACE
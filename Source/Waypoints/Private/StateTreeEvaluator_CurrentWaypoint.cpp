@@ -0,0 +1,59 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "StateTreeEvaluator_CurrentWaypoint.h"
+
+#include "AIController.h"
+#include "StateTreeExecutionContext.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+
+void FStateTreeCurrentWaypointEvaluator::TreeStart(FStateTreeExecutionContext& Context) const
+{
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	InstanceData.Loop = nullptr;
+	InstanceData.CurrentWaypoint = nullptr;
+
+	UpdateCurrentWaypoint(InstanceData);
+	InstanceData.TimeUntilUpdate = InstanceData.UpdateInterval;
+}
+
+void FStateTreeCurrentWaypointEvaluator::Tick(FStateTreeExecutionContext& Context, const float DeltaTime) const
+{
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	if (InstanceData.UpdateInterval <= 0.f && InstanceData.Loop)
+	{
+		return;
+	}
+
+	InstanceData.TimeUntilUpdate -= DeltaTime;
+	if (InstanceData.TimeUntilUpdate <= 0.f || InstanceData.Loop == nullptr)
+	{
+		UpdateCurrentWaypoint(InstanceData);
+		InstanceData.TimeUntilUpdate = InstanceData.UpdateInterval;
+	}
+}
+
+void FStateTreeCurrentWaypointEvaluator::UpdateCurrentWaypoint(FInstanceDataType& InstanceData) const
+{
+	const APawn* Pawn = InstanceData.AIController ? InstanceData.AIController->GetPawn() : nullptr;
+	if (Pawn == nullptr)
+	{
+		return;
+	}
+
+	const FVector PawnLocation = Pawn->GetActorLocation();
+
+	if (InstanceData.PatrolLoop)
+	{
+		InstanceData.Loop = InstanceData.PatrolLoop;
+	}
+	else if (InstanceData.Loop == nullptr)
+	{
+		if (const UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(Pawn->GetWorld()))
+		{
+			InstanceData.Loop = Subsystem->FindClosestLoop(PawnLocation);
+		}
+	}
+
+	InstanceData.CurrentWaypoint = InstanceData.Loop ? InstanceData.Loop->GetClosestWaypoint(PawnLocation) : nullptr;
+}
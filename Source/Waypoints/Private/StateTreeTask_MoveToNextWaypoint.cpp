@@ -0,0 +1,300 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "StateTreeTask_MoveToNextWaypoint.h"
+
+#include "AIController.h"
+#include "AISystem.h"
+#include "NavigationSystem.h"
+#include "Navigation/PathFollowingComponent.h"
+#include "StateTreeExecutionContext.h"
+#include "Waypoint.h"
+#include "WaypointPatrolTaskStats.h"
+#include "WaypointPatrolTelemetry.h"
+#include "WaypointSubsystem.h"
+
+static AWaypoint* GetFollowingWaypoint(const FStateTreeMoveToNextWaypointTaskInstanceData& InstanceData, const AWaypoint* Waypoint)
+{
+	if (Waypoint == nullptr)
+	{
+		return nullptr;
+	}
+
+	return InstanceData.bReverseDirection ? Waypoint->GetPreviousWaypoint() : Waypoint->GetNextWaypoint();
+}
+
+FStateTreeMoveToNextWaypointTask::FStateTreeMoveToNextWaypointTask()
+{
+	bReachTestIncludesGoalRadius = bReachTestIncludesAgentRadius = GET_AI_CONFIG_VAR(bFinishMoveOnGoalOverlap);
+}
+
+EStateTreeRunStatus FStateTreeMoveToNextWaypointTask::EnterState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const
+{
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::StateTree);
+	FWaypointPatrolTaskStats::AgentStarted(EWaypointPatrolTaskType::StateTree, sizeof(FInstanceDataType));
+
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	InstanceData.MoveRequestID = FAIRequestID::InvalidRequest;
+	InstanceData.PathRequestId = 0;
+	InstanceData.QueuedMoveRequestID.Reset();
+	InstanceData.RemainingWaitTime = 0.f;
+	InstanceData.Phase = EWaypointMovePhase::NeedsMove;
+	InstanceData.TargetWaypoint = InstanceData.Waypoint;
+
+	if (!InstanceData.AIController || !InstanceData.TargetWaypoint)
+	{
+		return EStateTreeRunStatus::Failed;
+	}
+
+	// Already standing at the start waypoint, carry on to the next one instead of waiting there again
+	if (HasReachedTarget(InstanceData))
+	{
+		InstanceData.TargetWaypoint = GetFollowingWaypoint(InstanceData, InstanceData.TargetWaypoint);
+	}
+
+	return StartMove(InstanceData) ? EStateTreeRunStatus::Running : EStateTreeRunStatus::Failed;
+}
+
+EStateTreeRunStatus FStateTreeMoveToNextWaypointTask::Tick(FStateTreeExecutionContext& Context, const float DeltaTime) const
+{
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::StateTree);
+
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	UPathFollowingComponent* PathFollowingComp = InstanceData.AIController ? InstanceData.AIController->GetPathFollowingComponent() : nullptr;
+	if (PathFollowingComp == nullptr)
+	{
+		return EStateTreeRunStatus::Failed;
+	}
+
+	switch (InstanceData.Phase)
+	{
+	case EWaypointMovePhase::WaitingForPath:
+	{
+		UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(InstanceData.AIController->GetWorld());
+		if (Subsystem && Subsystem->GetPathRequestQueue().IsRequestPending(InstanceData.PathRequestId))
+		{
+			break;
+		}
+
+		// The queue started the move when it found the path, any other move was started by someone else and isn't this leg
+		const FAIRequestID QueuedMoveRequestID = InstanceData.QueuedMoveRequestID.IsValid() ? *InstanceData.QueuedMoveRequestID : FAIRequestID::InvalidRequest;
+		InstanceData.PathRequestId = 0;
+		InstanceData.QueuedMoveRequestID.Reset();
+		if (QueuedMoveRequestID.IsValid() && PathFollowingComp->GetStatus() != EPathFollowingStatus::Idle && PathFollowingComp->GetCurrentRequestId() == QueuedMoveRequestID)
+		{
+			InstanceData.MoveRequestID = QueuedMoveRequestID;
+			InstanceData.Phase = EWaypointMovePhase::Moving;
+
+			if (PathFollowingComp->GetPath().IsValid())
+			{
+				FWaypointPatrolTelemetry::ObservePath(*PathFollowingComp->GetPath(), InstanceData.AIController, InstanceData.TargetWaypoint);
+			}
+		}
+		else
+		{
+			FinishLeg(InstanceData, HasReachedTarget(InstanceData));
+		}
+		break;
+	}
+
+	case EWaypointMovePhase::Moving:
+		if (PathFollowingComp->GetStatus() == EPathFollowingStatus::Idle || PathFollowingComp->GetCurrentRequestId() != InstanceData.MoveRequestID)
+		{
+			InstanceData.MoveRequestID = FAIRequestID::InvalidRequest;
+			FinishLeg(InstanceData, HasReachedTarget(InstanceData));
+		}
+		break;
+
+	case EWaypointMovePhase::WaitingAtWaypoint:
+		InstanceData.RemainingWaitTime -= DeltaTime;
+		if (InstanceData.RemainingWaitTime <= 0.f)
+		{
+			FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::WaitEnd, InstanceData.AIController, InstanceData.TargetWaypoint);
+			InstanceData.AIController->ClearFocus(EAIFocusPriority::Gameplay);
+			InstanceData.TargetWaypoint = GetFollowingWaypoint(InstanceData, InstanceData.TargetWaypoint);
+			InstanceData.Phase = EWaypointMovePhase::NeedsMove;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	if (InstanceData.Phase == EWaypointMovePhase::NeedsMove && !StartMove(InstanceData))
+	{
+		return EStateTreeRunStatus::Failed;
+	}
+
+	return EStateTreeRunStatus::Running;
+}
+
+void FStateTreeMoveToNextWaypointTask::ExitState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const
+{
+	FWaypointPatrolTaskStats::FScopedCycles ScopedCycles(EWaypointPatrolTaskType::StateTree);
+
+	FWaypointPatrolTaskStats::AgentStopped(EWaypointPatrolTaskType::StateTree, sizeof(FInstanceDataType));
+
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	if (InstanceData.AIController)
+	{
+		StopMove(InstanceData);
+		InstanceData.AIController->ClearFocus(EAIFocusPriority::Gameplay);
+	}
+}
+
+bool FStateTreeMoveToNextWaypointTask::BuildMoveRequest(const FInstanceDataType& InstanceData, FAIMoveRequest& MoveReq) const
+{
+	AWaypoint* TargetActor = InstanceData.TargetWaypoint;
+	if (TargetActor == nullptr)
+	{
+		return false;
+	}
+
+	MoveReq.SetNavigationFilter(InstanceData.AIController->GetDefaultNavigationFilterClass());
+	MoveReq.SetUsePathfinding(true);
+	MoveReq.SetAllowPartialPath(true);
+	MoveReq.SetAcceptanceRadius(TargetActor->GetAcceptanceRadius());
+	MoveReq.SetReachTestIncludesAgentRadius(bReachTestIncludesAgentRadius);
+	MoveReq.SetReachTestIncludesGoalRadius(bReachTestIncludesGoalRadius);
+	MoveReq.SetGoalActor(TargetActor);
+	return true;
+}
+
+bool FStateTreeMoveToNextWaypointTask::StartMove(FInstanceDataType& InstanceData) const
+{
+	AAIController* MyController = InstanceData.AIController;
+	FAIMoveRequest MoveReq;
+	if (!MyController || !BuildMoveRequest(InstanceData, MoveReq))
+	{
+		return false;
+	}
+
+	APawn* MyPawn = MyController->GetPawn();
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(MyController->GetWorld());
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(MyController->GetWorld());
+
+	if (bUsePathRequestQueue && MyPawn && Subsystem && NavSys && FWaypointPathRequestQueue::IsEnabled())
+	{
+		FWaypointPathRequest Request;
+		Request.Requester = MyController;
+		Request.Start = MyPawn->GetNavAgentLocation();
+		Request.Goal = MoveReq.GetGoalActor();
+		Request.AgentProperties = MyController->GetNavAgentPropertiesRef();
+		Request.NavData = NavSys->GetNavDataForProps(Request.AgentProperties);
+		Request.FilterClass = MoveReq.GetNavigationFilter();
+		Request.bAllowPartialPath = MoveReq.IsUsingPartialPaths();
+
+		// Starts the move as soon as the path is found, the task picks it up on its next tick
+		const TSharedRef<FAIRequestID> QueuedMoveRequestID = MakeShared<FAIRequestID>(FAIRequestID::InvalidRequest);
+		Request.OnFinished = FOnWaypointPathRequestFinished::CreateWeakLambda(MyController, [MyController, MoveReq, QueuedMoveRequestID](uint32 RequestId, FNavPathSharedPtr Path)
+			{
+				if (Path.IsValid())
+				{
+					*QueuedMoveRequestID = MyController->RequestMove(MoveReq, Path);
+				}
+			});
+
+		if (Request.NavData.IsValid())
+		{
+			InstanceData.PathRequestId = Subsystem->GetPathRequestQueue().AddRequest(MoveTemp(Request));
+			InstanceData.QueuedMoveRequestID = QueuedMoveRequestID;
+			InstanceData.Phase = EWaypointMovePhase::WaitingForPath;
+			FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::Depart, MyController, InstanceData.TargetWaypoint);
+			return true;
+		}
+	}
+
+	const FPathFollowingRequestResult RequestResult = MyController->MoveTo(MoveReq);
+	if (RequestResult.Code == EPathFollowingRequestResult::RequestSuccessful)
+	{
+		InstanceData.MoveRequestID = RequestResult.MoveId;
+		InstanceData.Phase = EWaypointMovePhase::Moving;
+		FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::Depart, MyController, InstanceData.TargetWaypoint);
+
+		const UPathFollowingComponent* PathFollowingComp = MyController->GetPathFollowingComponent();
+		if (PathFollowingComp && PathFollowingComp->GetPath().IsValid())
+		{
+			FWaypointPatrolTelemetry::ObservePath(*PathFollowingComp->GetPath(), MyController, InstanceData.TargetWaypoint);
+		}
+	}
+	else
+	{
+		FinishLeg(InstanceData, RequestResult.Code == EPathFollowingRequestResult::AlreadyAtGoal);
+	}
+
+	return true;
+}
+
+void FStateTreeMoveToNextWaypointTask::FinishLeg(FInstanceDataType& InstanceData, bool bSuccess) const
+{
+	FWaypointPatrolTaskStats::LegFinished(EWaypointPatrolTaskType::StateTree);
+
+	AWaypoint* TargetActor = InstanceData.TargetWaypoint;
+	FWaypointPatrolTelemetry::Record(bSuccess ? EWaypointPatrolEvent::Arrive : EWaypointPatrolEvent::PathFailed, InstanceData.AIController, TargetActor);
+
+	// We've finished moving to the waypoint, now time to wait
+	if (bSuccess && TargetActor && bWaitAtWaypoint && TargetActor->GetWaitTime() > 0.f)
+	{
+		AAIController* MyController = InstanceData.AIController;
+		if (TargetActor->GetOrientGuardToWaypoint() && MyController->GetPawn())
+		{
+			const FVector FocalPoint = MyController->GetPawn()->GetActorLocation() + TargetActor->GetActorForwardVector() * 10000.0f;
+			MyController->SetFocalPoint(FocalPoint, EAIFocusPriority::Gameplay);
+		}
+
+		InstanceData.RemainingWaitTime = TargetActor->GetWaitTime();
+		InstanceData.Phase = EWaypointMovePhase::WaitingAtWaypoint;
+		FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent::WaitStart, MyController, TargetActor);
+		return;
+	}
+
+	// Failed legs move on too, like the Behavior Tree task. The next move starts on the next tick.
+	InstanceData.TargetWaypoint = GetFollowingWaypoint(InstanceData, TargetActor);
+	InstanceData.Phase = EWaypointMovePhase::NeedsMove;
+}
+
+bool FStateTreeMoveToNextWaypointTask::HasReachedTarget(const FInstanceDataType& InstanceData) const
+{
+	const UPathFollowingComponent* PathFollowingComp = InstanceData.AIController ? InstanceData.AIController->GetPathFollowingComponent() : nullptr;
+	if (PathFollowingComp == nullptr || InstanceData.TargetWaypoint == nullptr)
+	{
+		return false;
+	}
+
+	const EPathFollowingReachMode ReachMode =
+		bReachTestIncludesAgentRadius && bReachTestIncludesGoalRadius ? EPathFollowingReachMode::OverlapAgentAndGoal :
+		bReachTestIncludesAgentRadius ? EPathFollowingReachMode::OverlapAgent :
+		bReachTestIncludesGoalRadius ? EPathFollowingReachMode::OverlapGoal :
+		EPathFollowingReachMode::ExactLocation;
+
+	return PathFollowingComp->HasReached(*InstanceData.TargetWaypoint, ReachMode, InstanceData.TargetWaypoint->GetAcceptanceRadius());
+}
+
+void FStateTreeMoveToNextWaypointTask::StopMove(FInstanceDataType& InstanceData) const
+{
+	UPathFollowingComponent* PathFollowingComp = InstanceData.AIController->GetPathFollowingComponent();
+
+	if (InstanceData.PathRequestId != 0)
+	{
+		UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(InstanceData.AIController->GetWorld());
+		if (Subsystem && Subsystem->GetPathRequestQueue().IsRequestPending(InstanceData.PathRequestId))
+		{
+			Subsystem->GetPathRequestQueue().CancelRequest(InstanceData.PathRequestId);
+		}
+		else if (InstanceData.QueuedMoveRequestID.IsValid())
+		{
+			// Serviced since the last tick, the move it started is ours
+			InstanceData.MoveRequestID = *InstanceData.QueuedMoveRequestID;
+		}
+
+		InstanceData.PathRequestId = 0;
+		InstanceData.QueuedMoveRequestID.Reset();
+	}
+
+	if (InstanceData.MoveRequestID.IsValid() && PathFollowingComp && PathFollowingComp->GetCurrentRequestId() == InstanceData.MoveRequestID)
+	{
+		PathFollowingComp->AbortMove(*InstanceData.AIController, FPathFollowingResultFlags::OwnerFinished, InstanceData.MoveRequestID);
+	}
+
+	InstanceData.MoveRequestID = FAIRequestID::InvalidRequest;
+	InstanceData.Phase = EWaypointMovePhase::NeedsMove;
+}
@@ -0,0 +1,71 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "StateTreeTask_ResumePatrol.h"
+#include "WaypointLoop.h"
+#include "WaypointPatrolComponent.h"
+#include "WaypointSubsystem.h"
+
+#include "AIController.h"
+#include "StateTreeExecutionContext.h"
+
+EStateTreeRunStatus FStateTreeResumePatrolTask::EnterState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const
+{
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	InstanceData.Waypoint = nullptr;
+	InstanceData.bReverseDirection = false;
+
+	UWaypointSubsystem* Subsystem = InstanceData.AIController ? UWorld::GetSubsystem<UWaypointSubsystem>(InstanceData.AIController->GetWorld()) : nullptr;
+	if (Subsystem == nullptr)
+	{
+		return EStateTreeRunStatus::Failed;
+	}
+
+	// The instance data can move, the query writes to a result it shares with the task instead
+	InstanceData.Result = MakeShared<TOptional<FWaypointResumePoint>>();
+	Subsystem->FindResumePoint(InstanceData.AIController, InstanceData.PatrolLoop, InstanceData.MaxCandidates,
+		FOnWaypointResumePointFound::CreateLambda([Result = InstanceData.Result](const FWaypointResumePoint& ResumePoint)
+			{
+				*Result = ResumePoint;
+			}));
+
+	return Tick(Context, 0.f);
+}
+
+EStateTreeRunStatus FStateTreeResumePatrolTask::Tick(FStateTreeExecutionContext& Context, const float DeltaTime) const
+{
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	if (!InstanceData.Result.IsValid())
+	{
+		return EStateTreeRunStatus::Failed;
+	}
+
+	if (!InstanceData.Result->IsSet())
+	{
+		return EStateTreeRunStatus::Running;
+	}
+
+	const FWaypointResumePoint ResumePoint = InstanceData.Result->GetValue();
+	InstanceData.Result.Reset();
+
+	if (!ResumePoint.IsValid())
+	{
+		return EStateTreeRunStatus::Failed;
+	}
+
+	InstanceData.Waypoint = ResumePoint.Waypoint;
+	InstanceData.bReverseDirection = ResumePoint.bReverse;
+
+	if (UWaypointPatrolComponent* PatrolComponent = UWaypointPatrolComponent::FindPatrolComponent(InstanceData.AIController))
+	{
+		PatrolComponent->SetResumePoint(ResumePoint);
+	}
+
+	return EStateTreeRunStatus::Succeeded;
+}
+
+void FStateTreeResumePatrolTask::ExitState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const
+{
+	// A query still running finishes into a result nobody reads
+	FInstanceDataType& InstanceData = Context.GetInstanceData(*this);
+	InstanceData.Result.Reset();
+}
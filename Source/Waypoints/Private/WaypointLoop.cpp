@@ -3,9 +3,15 @@
 
 #include "WaypointLoop.h"
 #include "Waypoint.h"
+#include "WaypointLoopRenderComponent.h"
+#include "WaypointSubsystem.h"
+#include "Algo/BinarySearch.h"
 #include "Components/SceneComponent.h"
+#include "NavigationData.h"
 #include "Internationalization/TextLocalizationResource.h"
 
+int32 AWaypointLoop::NumSegmentRequestsInFlight = 0;
+
 // Sets default values
 AWaypointLoop::AWaypointLoop(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
@@ -13,9 +19,14 @@ AWaypointLoop::AWaypointLoop(const FObjectInitializer& ObjectInitializer)
 	Scene = CreateDefaultSubobject<USceneComponent>(TEXT("SceneComponent"));
 	SetRootComponent(Scene);
 	bSplineColorSetup = false;
+
+	PathRenderComponent = CreateDefaultSubobject<UWaypointLoopRenderComponent>(TEXT("PathRenderComponent"));
+	PathRenderComponent->SetupAttachment(Scene);
 }
 
 #if WITH_EDITOR
+FOnWaypointLoopChanged AWaypointLoop::OnLoopChanged;
+
 void AWaypointLoop::PostEditChangeProperty(FPropertyChangedEvent& Event)
 {
 	Super::PostEditChangeProperty(Event);
@@ -33,13 +44,16 @@ void AWaypointLoop::PostEditChangeProperty(FPropertyChangedEvent& Event)
 
 		if (ChangedPropName == NAME_Waypoints)
 		{
+			RebuildLoopData();
 			RecalculateAllWaypoints();
+			NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
 		}
 
 		if (ChangedPropName == NAME_SplineColor)
 		{
 			bSplineColorSetup = true;
 			RecalculateAllWaypoints();
+			NotifyLoopChanged(EWaypointLoopChange::PropertiesChanged);
 		}
 	}
 }
@@ -55,53 +69,191 @@ void AWaypointLoop::PostLoad()
 		bSplineColorSetup = true;
 	}
 
+	RebuildLoopData();
 	RecalculateAllWaypoints();
+	NotifyLoopChanged(EWaypointLoopChange::Added);
+}
+
+void AWaypointLoop::PostEditUndo()
+{
+	Super::PostEditUndo();
+
+	RebuildLoopData();
+	RecalculateAllWaypoints();
+	NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
+}
+
+void AWaypointLoop::PostEditImport()
+{
+	Super::PostEditImport();
+
+	// Pasted loops are new loops
+	LoopGuid = FGuid::NewGuid();
+
+	Visibility.PostEditImport();
 }
 #endif // WITH_EDITOR
 
+void AWaypointLoop::PostActorCreated()
+{
+	Super::PostActorCreated();
+
+	LoopGuid = FGuid::NewGuid();
+
+	NotifyLoopChanged(EWaypointLoopChange::Added);
+}
+
+void AWaypointLoop::PostDuplicate(EDuplicateMode::Type DuplicateMode)
+{
+	Super::PostDuplicate(DuplicateMode);
+
+	// Play in editor copies keep the guid so saves made in PIE find the same loops
+	if (DuplicateMode == EDuplicateMode::Normal)
+	{
+		LoopGuid = FGuid::NewGuid();
+	}
+}
+
+void AWaypointLoop::Destroyed()
+{
+	NotifyLoopChanged(EWaypointLoopChange::Removed);
+
+	Super::Destroyed();
+}
+
+void AWaypointLoop::PostRegisterAllComponents()
+{
+	Super::PostRegisterAllComponents();
+
+	// Waypoints registered after the loop refresh their own location through UpdateWaypoint
+	RebuildLoopData();
+
+	// Loops saved before they had a guid get one from their path, which stays the same for as long as they're in the level
+	if (!LoopGuid.IsValid())
+	{
+		LoopGuid = FGuid::NewDeterministicGuid(GetPathName());
+	}
+
+	if (UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(GetWorld()))
+	{
+		Subsystem->RegisterLoop(this);
+	}
+}
+
+void AWaypointLoop::PostUnregisterAllComponents()
+{
+	if (UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(GetWorld()))
+	{
+		Subsystem->UnregisterLoop(this);
+	}
+
+	Super::PostUnregisterAllComponents();
+}
+
+void AWaypointLoop::NotifyLoopChanged(EWaypointLoopChange Change)
+{
+#if WITH_EDITOR
+	OnLoopChanged.Broadcast(this, Change);
+#endif // WITH_EDITOR
+}
+
 void AWaypointLoop::AddWaypoint(AWaypoint* NewWaypoint)
 {
-	check(!Waypoints.Contains(TWeakObjectPtr<AWaypoint>(NewWaypoint)));
+	InsertWaypoint(NewWaypoint, GetNumPoints());
+}
+
+void AWaypointLoop::InsertWaypoint(AWaypoint* NewWaypoint, int32 Index)
+{
+	check(NewWaypoint && FindWaypoint(NewWaypoint) == INDEX_NONE);
 
-	Waypoints.Push(TWeakObjectPtr<AWaypoint>(NewWaypoint));
+	Index = FMath::Clamp(Index, 0, GetNumPoints());
+
+	const int32 Entry = PointEntries.IsValidIndex(Index) ? PointEntries[Index] : Waypoints.Num();
+	Waypoints.Insert(NewWaypoint, Entry);
+	for (int32& PointEntry : PointEntries)
+	{
+		PointEntry += PointEntry >= Entry ? 1 : 0;
+	}
+
+	InsertPackedPoint(Entry, Index);
 
 	RecalculateAllWaypoints();
+	NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
 }
 
-void AWaypointLoop::InsertWaypoint(AWaypoint* NewWaypoint, int32 Index)
+void AWaypointLoop::InitializeWaypoints(TConstArrayView<AWaypoint*> NewWaypoints, TArray<FWaypointSegmentPath>&& KnownSegmentPaths)
 {
-	check(!Waypoints.Contains(TWeakObjectPtr<AWaypoint>(NewWaypoint)));
+	check(Waypoints.Num() == 0 && !bGenerated);
 
-	Waypoints.Insert(NewWaypoint, Index);
+	Waypoints.Reserve(NewWaypoints.Num());
+	for (AWaypoint* Waypoint : NewWaypoints)
+	{
+		check(Waypoint && !Waypoint->OwningLoop.IsValid());
+
+		Waypoint->OwningLoop = this;
+		Waypoint->AttachToActor(this, FAttachmentTransformRules::KeepWorldTransform);
+		Waypoints.Add(Waypoint);
+	}
 
+	RebuildLoopData();
+
+	SegmentPaths = MoveTemp(KnownSegmentPaths);
 	RecalculateAllWaypoints();
+	NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
 }
 
-void AWaypointLoop::RemoveWaypoint(const AWaypoint* Waypoint)
+void AWaypointLoop::ReorderPoints(TConstArrayView<int32> NewOrder)
 {
-	// Remove the last matching element
-	for (int32 i = Waypoints.Num() - 1; i >= 0; --i)
+	const int32 NumPoints = LoopData.Num();
+	if (NewOrder.Num() != NumPoints || (!bGenerated && PointEntries.Num() != NumPoints))
 	{
-		if (Waypoints[i].Get() == Waypoint)
-		{
-			Waypoints.RemoveAt(i);
+		return;
+	}
 
-			// Tell the previous waypoint to recalculate its spline
-			if (Waypoints.Num() != 0)
-			{
-				int32 WrappedIndex = (i - 1) % Waypoints.Num();
-				if (WrappedIndex < 0)
-				{
-					WrappedIndex += Waypoints.Num();
-				}
+	Modify();
 
-				Waypoints[WrappedIndex]->CalculateSpline();
+	for (int32 ProfileIndex = INDEX_NONE; ProfileIndex < AgentProfiles.Num(); ++ProfileIndex)
+	{
+		TArray<FWaypointSegmentPath>& Paths = GetProfileSegmentPaths(ProfileIndex);
+		TArray<FWaypointSegmentPath> OldSegmentPaths = MoveTemp(Paths);
+		Paths.SetNum(NumPoints);
+		for (int32 i = 0; i < NumPoints; ++i)
+		{
+			const int32 From = NewOrder[i];
+			const int32 To = NewOrder[(i + 1) % NumPoints];
+			if (OldSegmentPaths.IsValidIndex(From) && (From + 1) % NumPoints == To)
+			{
+				Paths[i] = MoveTemp(OldSegmentPaths[From]);
 			}
+		}
+	}
 
-			break;
+	if (!bGenerated)
+	{
+		// Loaded waypoints trade places among their own entries, the others stay where they are
+		const TArray<TWeakObjectPtr<AWaypoint>> OldWaypoints = Waypoints;
+		for (int32 i = 0; i < NumPoints; ++i)
+		{
+			Waypoints[PointEntries[i]] = OldWaypoints[PointEntries[NewOrder[i]]];
 		}
 	}
 
+	LoopData.Reorder(NewOrder);
+	SnapshotPublisher.MarkDirty();
+
+	// Kept paths still match their hash and aren't queried again
+	RecalculateAllWaypoints();
+	NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
+}
+
+void AWaypointLoop::RemoveWaypoint(const AWaypoint* Waypoint)
+{
+	const int32 Index = FindWaypoint(Waypoint);
+	if (Index != INDEX_NONE)
+	{
+		RemovePackedPoint(Index);
+	}
+
 	// Destroy this waypoint loop if there's no waypoints
 	if (Waypoints.Num() == 0)
 	{
@@ -110,60 +262,751 @@ void AWaypointLoop::RemoveWaypoint(const AWaypoint* Waypoint)
 	else
 	{
 		RecalculateAllWaypoints();
+		NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
 	}
 }
 
-int32 AWaypointLoop::FindWaypoint(const AWaypoint* Elem) const
+void AWaypointLoop::RemoveWaypoints(TConstArrayView<AWaypoint*> WaypointsToRemove)
 {
+	TArray<int32> Indices;
+	Indices.Reserve(WaypointsToRemove.Num());
+	for (AWaypoint* Waypoint : WaypointsToRemove)
+	{
+		const int32 Index = FindWaypoint(Waypoint);
+		if (Index != INDEX_NONE)
+		{
+			Indices.AddUnique(Index);
+		}
+	}
+
+	if (Indices.Num() == 0)
+	{
+		return;
+	}
+
+	// Highest first so the points still to remove keep their position, and patrols on the other points keep their handles
+	Indices.Sort(TGreater<int32>());
+	for (const int32 Index : Indices)
+	{
+		AWaypoint* Waypoint = GetWaypoint(Index);
+		RemovePackedPoint(Index);
+		Waypoint->ClearWaypointLoop();
+	}
+
+	if (Waypoints.Num() == 0)
+	{
+		Destroy();
+	}
+	else
+	{
+		RecalculateAllWaypoints();
+		NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
+	}
+}
+
+void AWaypointLoop::UpdateWaypoint(const AWaypoint* Waypoint)
+{
+	const int32 Index = FindWaypoint(Waypoint);
+	if (Index != INDEX_NONE)
+	{
+		LoopData.UpdatePoint(Index, Waypoint->GetActorLocation(), Waypoint->GetPointParams());
+		SnapshotPublisher.MarkDirty();
+	}
+	else if (!bGenerated && Waypoint && Waypoint->OwningLoop.Get() == this)
+	{
+		// A waypoint streamed in after the loop was packed gets its point back. Points are in the order of their entries,
+		// so it goes after the points of the entries before its own and the patrols on the others keep their handles.
+		const int32 Entry = Waypoints.IndexOfByPredicate([Waypoint](const TWeakObjectPtr<AWaypoint>& Other) { return Other.Get() == Waypoint; });
+		if (Entry != INDEX_NONE && !PointEntries.Contains(Entry))
+		{
+			InsertPackedPoint(Entry, Algo::LowerBound(PointEntries, Entry));
+			RecalculateAllWaypoints();
+		}
+	}
+}
+
+void AWaypointLoop::RebuildLoopData()
+{
+	// Generated loops don't have actors to rebuild from
+	if (bGenerated)
+	{
+		return;
+	}
+
+	LoopData.Reset();
+	PointEntries.Reset();
+
+	// Entries of waypoints that are streamed out are saved with the loop, they're only left out of the packed data
 	for (int32 i = 0; i < Waypoints.Num(); ++i)
 	{
-		if (Waypoints[i].Get() == Elem)
+		if (AWaypoint* Waypoint = Waypoints[i].Get())
 		{
-			return i;
+			Waypoint->LoopHandle = LoopData.InsertPoint(Waypoint->GetActorLocation(), Waypoint->GetPointParams());
+			PointEntries.Add(i);
 		}
 	}
-	
-	return INDEX_NONE;
+
+	SnapshotPublisher.MarkDirty();
+}
+
+void AWaypointLoop::InsertPackedPoint(int32 Entry, int32 Index)
+{
+	AWaypoint* Waypoint = Waypoints[Entry].Get();
+	check(Waypoint);
+
+	PointEntries.Insert(Entry, Index);
+	Waypoint->LoopHandle = LoopData.InsertPoint(Waypoint->GetActorLocation(), Waypoint->GetPointParams(), Index);
+	SnapshotPublisher.MarkDirty();
+
+	// Segments keep their paths across the insert, only the one from the previous point now ends somewhere else
+	for (int32 ProfileIndex = INDEX_NONE; ProfileIndex < AgentProfiles.Num(); ++ProfileIndex)
+	{
+		TArray<FWaypointSegmentPath>& Paths = GetProfileSegmentPaths(ProfileIndex);
+		if (Paths.Num() >= Index)
+		{
+			Paths.Insert(FWaypointSegmentPath(), Index);
+		}
+
+		TArray<FWaypointSegmentCorridor>& Corridors = GetProfileCorridors(ProfileIndex);
+		if (Corridors.Num() > 0 && Corridors.Num() >= Index * 2)
+		{
+			Corridors.InsertDefaulted(Index * 2, 2);
+		}
+
+		ResetSegment(LoopData.GetPreviousIndex(Index), ProfileIndex);
+	}
+}
+
+void AWaypointLoop::RemovePackedPoint(int32 Index)
+{
+	const int32 Entry = PointEntries[Index];
+	if (AWaypoint* Waypoint = Waypoints[Entry].Get())
+	{
+		// Handles are only unique within a loop, a stale one could resolve to a point of the next loop the waypoint joins
+		Waypoint->LoopHandle = FWaypointHandle();
+	}
+
+	Waypoints.RemoveAt(Entry);
+	PointEntries.RemoveAt(Index);
+	for (int32& PointEntry : PointEntries)
+	{
+		PointEntry -= PointEntry > Entry ? 1 : 0;
+	}
+
+	LoopData.RemovePoint(Index);
+	SnapshotPublisher.MarkDirty();
+
+	// Segments keep their paths across the remove, only the one from the previous point now ends somewhere else
+	for (int32 ProfileIndex = INDEX_NONE; ProfileIndex < AgentProfiles.Num(); ++ProfileIndex)
+	{
+		TArray<FWaypointSegmentPath>& Paths = GetProfileSegmentPaths(ProfileIndex);
+		if (Paths.IsValidIndex(Index))
+		{
+			Paths.RemoveAt(Index);
+		}
+
+		TArray<FWaypointSegmentCorridor>& Corridors = GetProfileCorridors(ProfileIndex);
+		if (Corridors.IsValidIndex(Index * 2 + 1))
+		{
+			Corridors.RemoveAt(Index * 2, 2);
+		}
+
+		if (LoopData.Num() > 0)
+		{
+			ResetSegment(LoopData.GetPreviousIndex(Index % LoopData.Num()), ProfileIndex);
+		}
+	}
+}
+
+int32 AWaypointLoop::FindWaypoint(const AWaypoint* Elem) const
+{
+	if (Elem == nullptr || Elem->OwningLoop.Get() != this)
+	{
+		return INDEX_NONE;
+	}
+
+	// Handles are only unique within a loop, one kept from another loop can resolve to a point of this one
+	const int32 Index = LoopData.ResolveHandle(Elem->GetLoopHandle());
+	return GetWaypoint(Index) == Elem ? Index : INDEX_NONE;
 }
 
 AWaypoint* AWaypointLoop::GetClosestWaypoint(const FVector& Location)
 {
-	float MinDistance = TNumericLimits<float>::Max();
-	AWaypoint* ClosestWaypoint = nullptr;
+	const int32 ClosestIndex = LoopData.FindClosestPoint(Location);
+	return GetWaypoint(ClosestIndex);
+}
 
-	for (int32 i = 0; i < Waypoints.Num(); ++i)
+FWaypointLoopSnapshotRef AWaypointLoop::GetSnapshot()
+{
+	// Other threads get the snapshot of the last frame, the game thread sees its own edits
+	if (IsInGameThread())
+	{
+		FlushSnapshot();
+	}
+
+	return SnapshotPublisher.Acquire();
+}
+
+AWaypoint* AWaypointLoop::GetWaypoint(int32 Index) const
+{
+	return PointEntries.IsValidIndex(Index) ? Waypoints[PointEntries[Index]].Get() : nullptr;
+}
+
+void AWaypointLoop::SetSplineColor(const FLinearColor& NewColor)
+{
+	SplineColor = NewColor;
+	bSplineColorSetup = true;
+
+	if (PathRenderComponent)
+	{
+		PathRenderComponent->SetLineColor(SplineColor);
+	}
+
+	NotifyLoopChanged(EWaypointLoopChange::PropertiesChanged);
+}
+
+FWaypointNavAgentInfoPtr AWaypointLoop::GetNavAgentInfo() const
+{
+	if (bGenerated)
+	{
+		UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(GetWorld());
+		return Subsystem ? Subsystem->GetNavAgentInfo(GeneratedCharacterClass.Get()) : nullptr;
+	}
+
+	const AWaypoint* FirstWaypoint = GetWaypoint(0);
+	return FirstWaypoint ? FirstWaypoint->GetNavAgentInfo() : nullptr;
+}
+
+int32 AWaypointLoop::FindOrAddAgentProfile(const FWaypointNavAgentInfoPtr& NavAgent)
+{
+	const ANavigationData* NavData = NavAgent.IsValid() ? NavAgent->NavData.Get() : nullptr;
+	const FWaypointNavAgentInfoPtr OwnNavAgent = GetNavAgentInfo();
+	if (NavData == nullptr || (OwnNavAgent.IsValid() && OwnNavAgent->NavData.Get() == NavData))
+	{
+		return INDEX_NONE;
+	}
+
+	// Paths only depend on the nav data, agents resolving to the same one share a profile
+	const int32 Existing = AgentProfiles.IndexOfByPredicate([NavData](const FWaypointAgentProfilePaths& Profile)
+		{
+			return Profile.NavAgent->NavData.Get() == NavData;
+		});
+
+	if (Existing != INDEX_NONE)
+	{
+		return Existing;
+	}
+
+	const int32 ProfileIndex = AgentProfiles.AddDefaulted();
+	AgentProfiles[ProfileIndex].NavAgent = NavAgent;
+	AgentProfiles[ProfileIndex].SegmentPaths.SetNum(GetNumPoints());
+
+	TArray<int32> SegmentIndices;
+	SegmentIndices.Reserve(GetNumPoints());
+	for (int32 i = 0; i < GetNumPoints(); ++i)
+	{
+		SegmentIndices.Add(i);
+	}
+
+	RequestProfileSegmentPaths(ProfileIndex, SegmentIndices);
+	return ProfileIndex;
+}
+
+void AWaypointLoop::PruneAgentProfiles()
+{
+	const FWaypointNavAgentInfoPtr OwnNavAgent = GetNavAgentInfo();
+	const ANavigationData* OwnNavData = OwnNavAgent.IsValid() ? OwnNavAgent->NavData.Get() : nullptr;
+
+	// Requests still in flight for a removed profile find another agent at its index, or none, and are dropped
+	AgentProfiles.RemoveAll([OwnNavData](const FWaypointAgentProfilePaths& Profile)
+		{
+			const ANavigationData* NavData = Profile.NavAgent.IsValid() ? Profile.NavAgent->NavData.Get() : nullptr;
+			return NavData == nullptr || !NavData->IsRegistered() || NavData == OwnNavData;
+		});
+}
+
+FNavPathSharedPtr AWaypointLoop::MakeSharedCorridorPath(int32 TargetIndex, bool bReverse, const FVector& AgentLocation, const FWaypointNavAgentInfoPtr& AgentNavAgent, const UObject* Querier)
+{
+	const ANavigationData* AgentNavData = AgentNavAgent.IsValid() ? AgentNavAgent->NavData.Get() : nullptr;
+	if (!LoopData.IsValidIndex(TargetIndex) || LoopData.Num() < 2 || AgentNavData == nullptr)
 	{
-		if (Waypoints[i].IsValid())
+		return nullptr;
+	}
+
+	const int32 NumProfiles = AgentProfiles.Num();
+	const int32 ProfileIndex = FindOrAddAgentProfile(AgentNavAgent);
+
+	// A new profile has all its segments in flight, its forward legs come with them
+	const bool bLegInFlight = !bReverse && AgentProfiles.Num() != NumProfiles;
+
+	TArray<FWaypointSegmentCorridor>& Corridors = GetProfileCorridors(ProfileIndex);
+	Corridors.SetNum(LoopData.Num() * 2);
+	FWaypointSegmentCorridor& Corridor = Corridors[TargetIndex * 2 + (bReverse ? 1 : 0)];
+
+	if (Corridor.IsEmpty() || Corridor.LoopRevision != LoopData.GetRevision() || !Corridor.IsValid())
+	{
+		// The agent finds its own path until the query comes back, a leg without a path isn't queried again until the loop or the navmesh changes
+		if (!Corridor.bRequested || Corridor.RequestedRevision != LoopData.GetRevision())
 		{
-			float Distance = FVector::DistSquared(Waypoints[i]->GetActorLocation(), Location);
-			if (Distance < MinDistance)
+			Corridor.bRequested = true;
+			Corridor.RequestedRevision = LoopData.GetRevision();
+
+			if (!bLegInFlight)
 			{
-				MinDistance = Distance;
-				ClosestWaypoint = Waypoints[i].Get();
+				RequestLegCorridor(ProfileIndex, TargetIndex, bReverse);
 			}
 		}
+
+		return nullptr;
+	}
+
+	if (Corridor.NavData.Get() != AgentNavData)
+	{
+		return nullptr;
+	}
+
+	return Corridor.MakeAgentPath(AgentLocation, Querier);
+}
+
+void AWaypointLoop::RequestLegCorridor(int32 ProfileIndex, int32 TargetIndex, bool bReverse)
+{
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(GetWorld());
+	if (Subsystem == nullptr || !LoopData.IsValidIndex(TargetIndex))
+	{
+		return;
+	}
+
+	// Reverse legs get their own query, paths found one way aren't always the shortest the other way
+	FWaypointSegmentQuery Query;
+	Query.SegmentIndex = bReverse ? TargetIndex : LoopData.GetPreviousIndex(TargetIndex);
+	Query.Start = LoopData.GetLocation(bReverse ? LoopData.GetNextIndex(TargetIndex) : LoopData.GetPreviousIndex(TargetIndex));
+	Query.End = LoopData.GetLocation(TargetIndex);
+	Query.NavAgent = AgentProfiles.IsValidIndex(ProfileIndex) ? AgentProfiles[ProfileIndex].NavAgent : GetNavAgentInfo();
+	Query.bRequireCompletePath = true;
+
+	TArray<FWaypointSegmentQuery> Queries;
+	Queries.Add(MoveTemp(Query));
+
+	const FWaypointNavAgentInfoPtr ProfileNavAgent = AgentProfiles.IsValidIndex(ProfileIndex) ? AgentProfiles[ProfileIndex].NavAgent : nullptr;
+	Subsystem->FindSegmentPathsAsync(MoveTemp(Queries), FOnWaypointSegmentPathsFound::CreateLambda(
+		[WeakThis = TWeakObjectPtr<ThisClass>(this), ProfileIndex, ProfileNavAgent, TargetIndex, bReverse, Revision = LoopData.GetRevision()](TConstArrayView<FWaypointSegmentQuery> Queries, TArray<FWaypointSegmentPathResult>& Results)
+		{
+			// Any edit to the loop changes its revision, the leg may not go between the same points anymore
+			AWaypointLoop* Loop = WeakThis.Get();
+			if (!Loop || Loop->LoopData.GetRevision() != Revision)
+			{
+				return;
+			}
+
+			if (ProfileIndex != INDEX_NONE && (!Loop->AgentProfiles.IsValidIndex(ProfileIndex) || ProfileNavAgent != Loop->AgentProfiles[ProfileIndex].NavAgent))
+			{
+				return;
+			}
+
+			// A corridor reset while the query was in flight was for a navmesh that changed since, its next user queries it again
+			TArray<FWaypointSegmentCorridor>& Corridors = Loop->GetProfileCorridors(ProfileIndex);
+			const int32 CorridorIndex = TargetIndex * 2 + (bReverse ? 1 : 0);
+			if (!Corridors.IsValidIndex(CorridorIndex) || !Corridors[CorridorIndex].bRequested || Corridors[CorridorIndex].RequestedRevision != Revision)
+			{
+				return;
+			}
+
+			FWaypointSegmentCorridor& Corridor = Corridors[CorridorIndex];
+			if (Results[0].Path.IsValid() && FWaypointSegmentCorridor::Build(*Results[0].Path, Corridor))
+			{
+				Corridor.LoopRevision = Revision;
+			}
+
+			Corridor.bRequested = true;
+			Corridor.RequestedRevision = Revision;
+		}));
+}
+
+void AWaypointLoop::OptimizeWaypointOrder()
+{
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(GetWorld());
+	if (Subsystem == nullptr)
+	{
+		return;
+	}
+
+	FWaypointRouteOptimizationParams Params;
+	for (int32 i = 0; i < GetNumPoints(); ++i)
+	{
+		const AWaypoint* Waypoint = GetWaypoint(i);
+		if (Waypoint && Waypoint->IsPinnedInLoopOrder())
+		{
+			Params.PinnedIndices.Add(i);
+		}
+	}
+
+	Subsystem->OptimizeLoopOrder(this, Params, FOnWaypointRouteOptimized());
+}
+
+void AWaypointLoop::BakeVisibility()
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	const FWaypointNavAgentInfoPtr NavAgent = GetNavAgentInfo();
+
+	Modify();
+	FWaypointVisibility::Bake(*World, LoopData, NavAgent.IsValid() ? NavAgent->NavData.Get() : nullptr, VisibilityBakeSettings, Visibility);
+	bVisibilityChecked = false;
+}
+
+const FWaypointVisibility* AWaypointLoop::GetVisibility() const
+{
+	if (Visibility.IsEmpty())
+	{
+		return nullptr;
+	}
+
+	if (!bVisibilityChecked || VisibilityCheckedRevision != LoopData.GetRevision())
+	{
+		bVisibilityValid = Visibility.IsValidFor(LoopData);
+		bVisibilityChecked = true;
+		VisibilityCheckedRevision = LoopData.GetRevision();
+	}
+
+	return bVisibilityValid ? &Visibility : nullptr;
+}
+
+bool AWaypointLoop::QueryBakedVisibility(const FVector& ObserverLocation, const FVector& TargetLocation, bool& bVisible) const
+{
+	bVisible = false;
+
+	const FWaypointVisibility* BakedVisibility = GetVisibility();
+	const int32 ObserverIndex = BakedVisibility ? LoopData.FindClosestPoint(ObserverLocation) : INDEX_NONE;
+	const int32 SampleIndex = BakedVisibility ? BakedVisibility->FindSample(TargetLocation) : INDEX_NONE;
+	if (ObserverIndex == INDEX_NONE || SampleIndex == INDEX_NONE)
+	{
+		return false;
 	}
 
-	return ClosestWaypoint;
+	bVisible = BakedVisibility->IsSampleVisible(ObserverIndex, SampleIndex);
+	return true;
+}
+
+void AWaypointLoop::SetGeneratedLoop(FWaypointLoopData&& InLoopData, TArray<FWaypointSegmentPath>&& InSegmentPaths, const UClass* InCharacterClass)
+{
+	check(Waypoints.Num() == 0);
+
+	bGenerated = true;
+	LoopData = MoveTemp(InLoopData);
+	SnapshotPublisher.MarkDirty();
+	SegmentPaths = MoveTemp(InSegmentPaths);
+	SegmentPaths.SetNum(LoopData.Num());
+	GeneratedCharacterClass = InCharacterClass;
+	AgentProfiles.Reset();
+
+	// The generator already validated every segment
+	RefreshPathRendering();
+	NotifyLoopChanged(EWaypointLoopChange::WaypointsChanged);
+}
+
+void AWaypointLoop::RefreshPathRendering()
+{
+	if (PathRenderComponent && UWaypointLoopRenderComponent::IsPathDrawingEnabled(GetWorld()))
+	{
+		PathRenderComponent->SetLineColor(SplineColor);
+		PathRenderComponent->SetNumSegments(SegmentPaths.Num());
+
+		// Segments shift when points are inserted or removed, the ones still being queried are cleared instead of keeping another segment's path
+		for (int32 i = 0; i < SegmentPaths.Num(); ++i)
+		{
+			PathRenderComponent->SetSegment(i, SegmentPaths[i].HasBeenComputed() ? TArrayView<const FVector>(SegmentPaths[i].Points) : TArrayView<const FVector>());
+		}
+	}
 }
 
 void AWaypointLoop::RecalculateAllWaypoints()
 {
+	SegmentPaths.SetNum(GetNumPoints());
+	for (FWaypointAgentProfilePaths& Profile : AgentProfiles)
+	{
+		Profile.SegmentPaths.SetNum(GetNumPoints());
+	}
+
+	// Saved paths are drawn right away, the ones still valid won't be sent again
+	RefreshPathRendering();
+
 	// Recalculate all indicies
-	for (int32 i = Waypoints.Num() - 1; i >= 0; --i)
+	for (int32 i = GetNumPoints() - 1; i >= 0; --i)
 	{
-		if (Waypoints[i].IsValid())
+		if (AWaypoint* Waypoint = GetWaypoint(i))
 		{
-			Waypoints[i]->RecalculateIndex();
+			Waypoint->WaypointIndex = i;
 		}
 	}
 
 	// Recalculate splines
-	for (int32 i = Waypoints.Num() - 1; i >= 0; --i)
+	TArray<int32> SegmentIndices;
+	SegmentIndices.Reserve(GetNumPoints());
+	for (int32 i = 0; i < GetNumPoints(); ++i)
 	{
-		if (Waypoints[i].IsValid())
+		SegmentIndices.Add(i);
+	}
+
+	RequestSegmentPaths(SegmentIndices);
+}
+
+FVector::FReal AWaypointLoop::GetSegmentLength(int32 SegmentIndex) const
+{
+	if (!LoopData.IsValidIndex(SegmentIndex))
+	{
+		return 0.;
+	}
+
+	const FWaypointSegmentPath* Segment = SegmentPaths.IsValidIndex(SegmentIndex) ? &SegmentPaths[SegmentIndex] : nullptr;
+	if (Segment == nullptr || Segment->Points.Num() < 2)
+	{
+		return FVector::Dist(LoopData.GetLocation(SegmentIndex), LoopData.GetLocation(LoopData.GetNextIndex(SegmentIndex)));
+	}
+
+	FVector::FReal Length = 0.;
+	for (int32 i = 1; i < Segment->Points.Num(); ++i)
+	{
+		Length += FVector::Dist(Segment->Points[i - 1], Segment->Points[i]);
+	}
+
+	return Length;
+}
+
+void AWaypointLoop::InvalidateSegments(const ANavigationData& NavData, TConstArrayView<FBox> DirtyAreas)
+{
+	for (int32 ProfileIndex = INDEX_NONE; ProfileIndex < AgentProfiles.Num(); ++ProfileIndex)
+	{
+		const FWaypointNavAgentInfoPtr NavAgent = AgentProfiles.IsValidIndex(ProfileIndex) ? AgentProfiles[ProfileIndex].NavAgent : GetNavAgentInfo();
+		if (NavAgent.IsValid() && NavAgent->NavData.Get() == &NavData)
+		{
+			InvalidateProfileSegments(ProfileIndex, DirtyAreas);
+		}
+	}
+}
+
+void AWaypointLoop::InvalidateProfileSegments(int32 ProfileIndex, TConstArrayView<FBox> DirtyAreas)
+{
+	const TArray<FWaypointSegmentPath>& Paths = GetProfileSegmentPaths(ProfileIndex);
+
+	TArray<int32> DirtySegments;
+	for (int32 i = 0; i < Paths.Num(); ++i)
+	{
+		const FWaypointSegmentPath& Segment = Paths[i];
+
+		// Segments that were never computed are left alone, they'll be computed when someone needs them
+		if (!Segment.HasBeenComputed())
+		{
+			continue;
+		}
+
+		bool bDirty = DirtyAreas.Num() == 0;
+		for (int32 AreaIndex = 0; !bDirty && AreaIndex < DirtyAreas.Num(); ++AreaIndex)
 		{
-			Waypoints[i]->CalculateSpline();
+			bDirty = DirtyAreas[AreaIndex].Intersect(Segment.Bounds);
 		}
+
+		if (bDirty)
+		{
+			DirtySegments.Add(i);
+			ResetLegCorridors(i, ProfileIndex);
+		}
+	}
+
+	if (DirtySegments.Num() > 0)
+	{
+		RequestProfileSegmentPaths(ProfileIndex, DirtySegments);
+	}
+}
+
+void AWaypointLoop::SetSegmentPath(int32 SegmentIndex, TArray<FVector>&& Points, const FBox& Bounds, uint32 Hash, int32 ProfileIndex)
+{
+	TArray<FWaypointSegmentPath>& Paths = GetProfileSegmentPaths(ProfileIndex);
+	if (!Paths.IsValidIndex(SegmentIndex))
+	{
+		return;
+	}
+
+	FWaypointSegmentPath& Segment = Paths[SegmentIndex];
+	Segment.Points = MoveTemp(Points);
+	Segment.Bounds = Bounds;
+	Segment.Hash = Hash;
+
+	ResetLegCorridors(SegmentIndex, ProfileIndex);
+
+	// Only the loop's own paths are drawn
+	if (ProfileIndex == INDEX_NONE && PathRenderComponent && UWaypointLoopRenderComponent::IsPathDrawingEnabled(GetWorld()))
+	{
+		PathRenderComponent->SetSegment(SegmentIndex, Segment.Points);
+	}
+}
+
+void AWaypointLoop::ResetSegment(int32 SegmentIndex, int32 ProfileIndex)
+{
+	TArray<FWaypointSegmentPath>& Paths = GetProfileSegmentPaths(ProfileIndex);
+	if (Paths.IsValidIndex(SegmentIndex))
+	{
+		Paths[SegmentIndex] = FWaypointSegmentPath();
+	}
+
+	ResetLegCorridors(SegmentIndex, ProfileIndex);
+}
+
+void AWaypointLoop::ResetLegCorridors(int32 SegmentIndex, int32 ProfileIndex)
+{
+	TArray<FWaypointSegmentCorridor>& Corridors = GetProfileCorridors(ProfileIndex);
+
+	// The segment from a point to the next is walked forward to the next point and in reverse to the point itself
+	const int32 NextIndex = LoopData.IsValidIndex(SegmentIndex) ? LoopData.GetNextIndex(SegmentIndex) : INDEX_NONE;
+	if (Corridors.IsValidIndex(NextIndex * 2))
+	{
+		Corridors[NextIndex * 2].Reset();
+	}
+
+	if (Corridors.IsValidIndex(SegmentIndex * 2 + 1))
+	{
+		Corridors[SegmentIndex * 2 + 1].Reset();
+	}
+}
+
+void AWaypointLoop::RequestSegmentPaths(TConstArrayView<int32> SegmentIndices)
+{
+	for (int32 ProfileIndex = INDEX_NONE; ProfileIndex < AgentProfiles.Num(); ++ProfileIndex)
+	{
+		RequestProfileSegmentPaths(ProfileIndex, SegmentIndices);
 	}
 }
+
+void AWaypointLoop::RequestProfileSegmentPaths(int32 ProfileIndex, TConstArrayView<int32> SegmentIndices)
+{
+	// Endpoints of each query, to tell whether the loop was edited while it was in flight
+	struct FPendingEndpoints
+	{
+		TWeakObjectPtr<AWaypoint> From;
+		TWeakObjectPtr<AWaypoint> To;
+	};
+
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(GetWorld());
+	if (Subsystem == nullptr)
+	{
+		return;
+	}
+
+	const TArray<FWaypointSegmentPath>& Paths = GetProfileSegmentPaths(ProfileIndex);
+
+	TArray<FWaypointSegmentQuery> Queries;
+	TArray<FPendingEndpoints> PendingEndpoints;
+	Queries.Reserve(SegmentIndices.Num());
+	PendingEndpoints.Reserve(SegmentIndices.Num());
+
+	const int32 NumPoints = GetNumPoints();
+	for (const int32 SegmentIndex : SegmentIndices)
+	{
+		if (SegmentIndex < 0 || SegmentIndex >= NumPoints)
+		{
+			continue;
+		}
+
+		const int32 NextIndex = (SegmentIndex + 1) % NumPoints;
+		AWaypoint* From = GetWaypoint(SegmentIndex);
+		AWaypoint* To = GetWaypoint(NextIndex);
+
+		// Generated loops have no actors, their points only live in the loop data
+		const bool bValidSegment = bGenerated ? NextIndex != SegmentIndex : (From && To && From != To);
+		if (!bValidSegment)
+		{
+			SetSegmentPath(SegmentIndex, TArray<FVector>(), FBox(ForceInit), 0, ProfileIndex);
+			continue;
+		}
+
+		FWaypointSegmentQuery Query;
+		Query.SegmentIndex = SegmentIndex;
+		Query.Start = bGenerated ? LoopData.GetLocation(SegmentIndex) : From->GetActorLocation();
+		Query.End = bGenerated ? LoopData.GetLocation(NextIndex) : To->GetActorLocation();
+		Query.NavAgent = AgentProfiles.IsValidIndex(ProfileIndex) ? AgentProfiles[ProfileIndex].NavAgent : bGenerated ? GetNavAgentInfo() : From->GetNavAgentInfo();
+
+		// What the segment was computed with last time is kept if the hash still matches,
+		// and a loaded path is kept until the nav data it was found on has been registered
+		if (Paths.IsValidIndex(SegmentIndex) && Paths[SegmentIndex].HasBeenComputed() && Paths[SegmentIndex].Hash != 0)
+		{
+			const bool bHasNavData = Query.NavAgent.IsValid() && Query.NavAgent->NavData.IsValid();
+			if (!bHasNavData || UWaypointSubsystem::HashSegment(Query, Paths[SegmentIndex].Bounds) == Paths[SegmentIndex].Hash)
+			{
+				continue;
+			}
+		}
+
+		Queries.Add(MoveTemp(Query));
+		PendingEndpoints.Add({ From, To });
+	}
+
+	if (Queries.Num() == 0)
+	{
+		return;
+	}
+
+	++NumSegmentRequestsInFlight;
+
+	const FWaypointNavAgentInfoPtr ProfileNavAgent = AgentProfiles.IsValidIndex(ProfileIndex) ? AgentProfiles[ProfileIndex].NavAgent : nullptr;
+	Subsystem->FindSegmentPathsAsync(MoveTemp(Queries), FOnWaypointSegmentPathsFound::CreateLambda(
+		[WeakThis = TWeakObjectPtr<ThisClass>(this), ProfileIndex, ProfileNavAgent, PendingEndpoints = MoveTemp(PendingEndpoints)](TConstArrayView<FWaypointSegmentQuery> Queries, TArray<FWaypointSegmentPathResult>& Results)
+		{
+			--NumSegmentRequestsInFlight;
+
+			// The loop can be deleted while the paths are being computed
+			AWaypointLoop* Loop = WeakThis.Get();
+			if (!Loop)
+			{
+				return;
+			}
+
+			// Profiles are dropped with the paths of a generated loop, the nav data they were for can go too
+			if (ProfileIndex != INDEX_NONE && (!Loop->AgentProfiles.IsValidIndex(ProfileIndex) || ProfileNavAgent != Loop->AgentProfiles[ProfileIndex].NavAgent))
+			{
+				return;
+			}
+
+			for (int32 i = 0; i < Queries.Num(); ++i)
+			{
+				const FWaypointSegmentQuery& Query = Queries[i];
+				const int32 SegmentIndex = Query.SegmentIndex;
+
+				// The loop was edited while the query was in flight, a newer query is on its way.
+				// Generated loops can't be edited, only requeried when the navmesh changes.
+				if (Loop->bGenerated)
+				{
+					if (!Loop->GetProfileSegmentPaths(ProfileIndex).IsValidIndex(SegmentIndex))
+					{
+						continue;
+					}
+				}
+				else if (SegmentIndex >= Loop->GetNumPoints()
+					|| Loop->GetWaypoint(SegmentIndex) != PendingEndpoints[i].From.Get()
+					|| Loop->GetWaypoint((SegmentIndex + 1) % Loop->GetNumPoints()) != PendingEndpoints[i].To.Get())
+				{
+					continue;
+				}
+
+				// Without a path the segment still depends on the navmesh between its endpoints
+				FWaypointSegmentPathResult& Result = Results[i];
+				FBox Bounds = Result.bSuccess ? FBox(Result.Points) : FBox(Query.Start, Query.End);
+				Bounds = Bounds.ExpandBy(Query.NavAgent.IsValid() ? Query.NavAgent->AgentProperties.AgentRadius : 0.f);
+				const uint32 Hash = Query.NavAgent.IsValid() && Query.NavAgent->NavData.IsValid() ? UWaypointSubsystem::HashSegment(Query, Bounds) : 0;
+
+				Loop->SetSegmentPath(SegmentIndex, MoveTemp(Result.Points), Bounds, Hash, ProfileIndex);
+
+				// Agents following corridors walk the forward leg along this same path, as long as it still goes between the same points
+				TArray<FWaypointSegmentCorridor>& Corridors = Loop->GetProfileCorridors(ProfileIndex);
+				const int32 NextIndex = Loop->LoopData.IsValidIndex(SegmentIndex) ? Loop->LoopData.GetNextIndex(SegmentIndex) : INDEX_NONE;
+				if (Result.Path.IsValid() && NextIndex != INDEX_NONE && Corridors.Num() == Loop->LoopData.Num() * 2
+					&& Query.Start == Loop->LoopData.GetLocation(SegmentIndex) && Query.End == Loop->LoopData.GetLocation(NextIndex)
+					&& FWaypointSegmentCorridor::Build(*Result.Path, Corridors[NextIndex * 2]))
+				{
+					Corridors[NextIndex * 2].LoopRevision = Loop->LoopData.GetRevision();
+				}
+			}
+		}));
+}
@@ -0,0 +1,626 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointLoopAsset.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+#include "WaypointsModule.h"
+
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Character.h"
+#include "Misc/ScopeLock.h"
+
+#if WITH_EDITOR
+#include "Editor.h"
+#include "ScopedTransaction.h"
+#endif // WITH_EDITOR
+
+#define LOCTEXT_NAMESPACE "WaypointLoopAsset"
+
+namespace WaypointLoopAsset
+{
+	// 'WPLA', then the format version
+	static constexpr uint32 Magic = 0x414C5057;
+	static constexpr uint32 Version = 1;
+
+	/**
+	 * Payload layout, every section 4 byte aligned and read in place:
+	 * header, cell coordinates, loops, points of every loop back to back, path points of every segment back to back.
+	 */
+	struct FHeader
+	{
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		int32 NumCells = 0;
+		int32 NumLoops = 0;
+		int32 NumPoints = 0;
+		int32 NumPathPoints = 0;
+	};
+
+	struct FPackedPosition
+	{
+		// Centimetres from the corner of the cell
+		uint16 Offset[3];
+		uint16 Cell;
+	};
+
+	enum class EPackedSegmentFlags : uint8
+	{
+		None = 0,
+		// The segment was computed when the asset was built, even if no path was found
+		Computed = 1 << 0,
+	};
+	ENUM_CLASS_FLAGS(EPackedSegmentFlags);
+
+	struct FPackedPoint
+	{
+		FPackedPosition Position;
+
+		// Hundredths of a second
+		uint16 WaitTime;
+		int16 AcceptanceRadius;
+
+		// Facing direction around the up axis, a full turn over the whole int16 range
+		int16 Yaw;
+
+		EWaypointPointFlags Flags;
+		EPackedSegmentFlags SegmentFlags;
+
+		// Path of the segment to the next point, and the hash it was found with
+		uint32 FirstPathPoint;
+		uint32 NumPathPoints;
+		uint32 SegmentHash;
+	};
+
+	struct FPackedLoop
+	{
+		uint32 FirstPoint;
+		uint32 NumPoints;
+	};
+
+	static_assert(sizeof(FPackedPosition) == 8 && sizeof(FPackedPoint) == 28 && sizeof(FPackedLoop) == 8, "Changing the packed layout needs a new version");
+
+	/** Pointers to every section of a payload that has been validated */
+	struct FPayloadView
+	{
+		explicit FPayloadView(const uint8* Data)
+		{
+			Header = reinterpret_cast<const FHeader*>(Data);
+			Cells = reinterpret_cast<const FIntVector*>(Header + 1);
+			Loops = reinterpret_cast<const FPackedLoop*>(Cells + Header->NumCells);
+			Points = reinterpret_cast<const FPackedPoint*>(Loops + Header->NumLoops);
+			PathPoints = reinterpret_cast<const FPackedPosition*>(Points + Header->NumPoints);
+		}
+
+		static int64 GetSize(const FHeader& Header)
+		{
+			return sizeof(FHeader)
+				+ int64(Header.NumCells) * sizeof(FIntVector)
+				+ int64(Header.NumLoops) * sizeof(FPackedLoop)
+				+ int64(Header.NumPoints) * sizeof(FPackedPoint)
+				+ int64(Header.NumPathPoints) * sizeof(FPackedPosition);
+		}
+
+		FVector GetLocation(const FPackedPosition& Position) const
+		{
+			return FVector(Cells[Position.Cell]) * UWaypointLoopAsset::CellSize + FVector(Position.Offset[0], Position.Offset[1], Position.Offset[2]);
+		}
+
+		const FHeader* Header;
+		const FIntVector* Cells;
+		const FPackedLoop* Loops;
+		const FPackedPoint* Points;
+		const FPackedPosition* PathPoints;
+	};
+
+	/** Checks every count and range once, so decoding never has to */
+	static bool IsValidPayload(const uint8* Data, int64 Size)
+	{
+		if (Data == nullptr || Size < (int64)sizeof(FHeader))
+		{
+			return false;
+		}
+
+		const FHeader& Header = *reinterpret_cast<const FHeader*>(Data);
+		if (Header.Magic != Magic || Header.Version != Version
+			|| Header.NumCells < 0 || Header.NumCells > MAX_uint16 + 1 || Header.NumLoops < 0 || Header.NumPoints < 0 || Header.NumPathPoints < 0
+			|| FPayloadView::GetSize(Header) != Size)
+		{
+			return false;
+		}
+
+		const FPayloadView View(Data);
+		for (int32 LoopIndex = 0; LoopIndex < Header.NumLoops; ++LoopIndex)
+		{
+			const FPackedLoop& Loop = View.Loops[LoopIndex];
+			if (uint64(Loop.FirstPoint) + Loop.NumPoints > uint64(Header.NumPoints))
+			{
+				return false;
+			}
+		}
+
+		auto IsValidPosition = [&Header](const FPackedPosition& Position) { return Position.Cell < Header.NumCells; };
+
+		for (int32 PointIndex = 0; PointIndex < Header.NumPoints; ++PointIndex)
+		{
+			const FPackedPoint& Point = View.Points[PointIndex];
+			if (!IsValidPosition(Point.Position) || uint64(Point.FirstPathPoint) + Point.NumPathPoints > uint64(Header.NumPathPoints))
+			{
+				return false;
+			}
+		}
+
+		for (int32 PathPointIndex = 0; PathPointIndex < Header.NumPathPoints; ++PathPointIndex)
+		{
+			if (!IsValidPosition(View.PathPoints[PathPointIndex]))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/** Quantizes positions while the payload is built, adding cells as they're needed */
+	struct FQuantizer
+	{
+		TArray<FIntVector> Cells;
+		TMap<FIntVector, uint16> CellIndices;
+
+		bool Quantize(const FVector& Location, FPackedPosition& OutPosition)
+		{
+			int32 Centimetres[3];
+			FIntVector Cell;
+			for (int32 Axis = 0; Axis < 3; ++Axis)
+			{
+				Centimetres[Axis] = FMath::RoundToInt32(Location[Axis]);
+
+				// Rounded towards negative infinity, so offsets are never negative
+				Cell[Axis] = Centimetres[Axis] >= 0 ? Centimetres[Axis] / UWaypointLoopAsset::CellSize : -((-Centimetres[Axis] - 1) / UWaypointLoopAsset::CellSize) - 1;
+				OutPosition.Offset[Axis] = uint16(Centimetres[Axis] - Cell[Axis] * UWaypointLoopAsset::CellSize);
+			}
+
+			if (const uint16* CellIndex = CellIndices.Find(Cell))
+			{
+				OutPosition.Cell = *CellIndex;
+				return true;
+			}
+
+			if (Cells.Num() > MAX_uint16)
+			{
+				return false;
+			}
+
+			OutPosition.Cell = uint16(Cells.Num());
+			CellIndices.Add(Cell, OutPosition.Cell);
+			Cells.Add(Cell);
+			return true;
+		}
+
+		FVector Dequantize(const FPackedPosition& Position) const
+		{
+			return FVector(Cells[Position.Cell]) * UWaypointLoopAsset::CellSize + FVector(Position.Offset[0], Position.Offset[1], Position.Offset[2]);
+		}
+	};
+
+	static int16 QuantizeYaw(const FVector3f& Direction)
+	{
+		const float Yaw = FMath::RadiansToDegrees(FMath::Atan2(Direction.Y, Direction.X));
+		return int16(FMath::RoundToInt32(Yaw / 360.f * 65536.f));
+	}
+
+	static FVector3f DequantizeYaw(int16 Yaw)
+	{
+		const float Radians = FMath::DegreesToRadians(Yaw * 360.f / 65536.f);
+		return FVector3f(FMath::Cos(Radians), FMath::Sin(Radians), 0.f);
+	}
+
+	/** Same corridor a loop computes for a segment, so the baked hash can match the one it will check against */
+	static FBox GetSegmentBounds(TConstArrayView<FVector> Points, const FVector& Start, const FVector& End, float AgentRadius)
+	{
+		const FBox Bounds = Points.Num() > 0 ? FBox(Points.GetData(), Points.Num()) : FBox(Start, End);
+		return Bounds.ExpandBy(AgentRadius);
+	}
+
+	template <typename T>
+	static void AppendSection(TArray<uint8>& Bytes, const TArray<T>& Section)
+	{
+		Bytes.Append(reinterpret_cast<const uint8*>(Section.GetData()), Section.Num() * sizeof(T));
+	}
+}
+
+bool UWaypointLoopAsset::Build(TConstArrayView<const AWaypointLoop*> SourceLoops)
+{
+	using namespace WaypointLoopAsset;
+
+	FQuantizer Quantizer;
+	TArray<FWaypointLoopAssetEntry> NewLoops;
+	TArray<FPackedLoop> PackedLoops;
+	TArray<FPackedPoint> PackedPoints;
+	TArray<FPackedPosition> PackedPathPoints;
+
+	for (const AWaypointLoop* SourceLoop : SourceLoops)
+	{
+		if (SourceLoop == nullptr || SourceLoop->GetLoopData().Num() == 0)
+		{
+			continue;
+		}
+
+		const FWaypointLoopData& LoopData = SourceLoop->GetLoopData();
+		const TArray<FWaypointSegmentPath>& SegmentPaths = SourceLoop->GetSegmentPaths();
+
+		FWaypointLoopAssetEntry& Entry = NewLoops.AddDefaulted_GetRef();
+		Entry.Name = FName(*SourceLoop->GetActorNameOrLabel());
+		Entry.SplineColor = SourceLoop->SplineColor;
+		Entry.NumPoints = LoopData.Num();
+
+		// Generated loops have no actor to take the class from, they're loaded with the default agent
+		const AWaypoint* FirstWaypoint = SourceLoop->GetWaypoint(0);
+		Entry.CharacterClass = FirstWaypoint ? FirstWaypoint->GetCharacterClass() : nullptr;
+
+		UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(SourceLoop->GetWorld());
+		const FWaypointNavAgentInfoPtr NavAgent = Subsystem ? Subsystem->GetNavAgentInfo(Entry.CharacterClass) : nullptr;
+		const float AgentRadius = NavAgent.IsValid() ? NavAgent->AgentProperties.AgentRadius : 0.f;
+
+		FPackedLoop& PackedLoop = PackedLoops.AddDefaulted_GetRef();
+		PackedLoop.FirstPoint = PackedPoints.Num();
+		PackedLoop.NumPoints = LoopData.Num();
+
+		for (int32 i = 0; i < LoopData.Num(); ++i)
+		{
+			const FWaypointPointParams& Params = LoopData.GetParams(i);
+
+			FPackedPoint& Point = PackedPoints.AddZeroed_GetRef();
+			Point.WaitTime = uint16(FMath::Clamp(FMath::RoundToInt32(Params.WaitTime * 100.f), 0, (int32)MAX_uint16));
+			Point.AcceptanceRadius = int16(FMath::Clamp(FMath::RoundToInt32(Params.AcceptanceRadius), (int32)MIN_int16, (int32)MAX_int16));
+			Point.Yaw = QuantizeYaw(Params.FacingDirection);
+			Point.Flags = Params.Flags;
+
+			if (!Quantizer.Quantize(LoopData.GetLocation(i), Point.Position))
+			{
+				UE_LOG(LogWaypoints, Error, TEXT("%s: the loops span more than %d cells, they can't be packed into one asset"), *GetPathName(), MAX_uint16 + 1);
+				return false;
+			}
+		}
+
+		// Paths are quantized too, and rehashed against the quantized endpoints they'll be checked with once loaded
+		for (int32 i = 0; i < LoopData.Num(); ++i)
+		{
+			if (!SegmentPaths.IsValidIndex(i) || !SegmentPaths[i].HasBeenComputed())
+			{
+				continue;
+			}
+
+			FPackedPoint& Point = PackedPoints[PackedLoop.FirstPoint + i];
+			Point.SegmentFlags = EPackedSegmentFlags::Computed;
+			Point.FirstPathPoint = PackedPathPoints.Num();
+			Point.NumPathPoints = SegmentPaths[i].Points.Num();
+
+			TArray<FVector> PathPoints;
+			PathPoints.Reserve(SegmentPaths[i].Points.Num());
+			for (const FVector& PathPoint : SegmentPaths[i].Points)
+			{
+				FPackedPosition& Position = PackedPathPoints.AddDefaulted_GetRef();
+				if (!Quantizer.Quantize(PathPoint, Position))
+				{
+					UE_LOG(LogWaypoints, Error, TEXT("%s: the loops span more than %d cells, they can't be packed into one asset"), *GetPathName(), MAX_uint16 + 1);
+					return false;
+				}
+
+				PathPoints.Add(Quantizer.Dequantize(Position));
+			}
+
+			FWaypointSegmentQuery Query;
+			Query.SegmentIndex = i;
+			Query.Start = Quantizer.Dequantize(Point.Position);
+			Query.End = Quantizer.Dequantize(PackedPoints[PackedLoop.FirstPoint + LoopData.GetNextIndex(i)].Position);
+			Query.NavAgent = NavAgent;
+
+			Point.SegmentHash = UWaypointSubsystem::HashSegment(Query, GetSegmentBounds(PathPoints, Query.Start, Query.End, AgentRadius));
+		}
+	}
+
+	FHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Header.NumCells = Quantizer.Cells.Num();
+	Header.NumLoops = PackedLoops.Num();
+	Header.NumPoints = PackedPoints.Num();
+	Header.NumPathPoints = PackedPathPoints.Num();
+
+	TArray<uint8> Bytes;
+	Bytes.Reserve(FPayloadView::GetSize(Header));
+	Bytes.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+	AppendSection(Bytes, Quantizer.Cells);
+	AppendSection(Bytes, PackedLoops);
+	AppendSection(Bytes, PackedPoints);
+	AppendSection(Bytes, PackedPathPoints);
+
+	Modify();
+
+	SetPayload(Bytes);
+	Loops = MoveTemp(NewLoops);
+
+	UE_LOG(LogWaypoints, Display, TEXT("%s: packed %d loops, %d points and %d path points into %d bytes"),
+		*GetPathName(), Header.NumLoops, Header.NumPoints, Header.NumPathPoints, Bytes.Num());
+	return true;
+}
+
+bool UWaypointLoopAsset::DecodeLoop(int32 LoopIndex, FWaypointLoopData& OutLoopData, TArray<FWaypointSegmentPath>* OutSegmentPaths, float AgentRadius) const
+{
+	using namespace WaypointLoopAsset;
+
+	OutLoopData.Reset();
+	if (OutSegmentPaths)
+	{
+		OutSegmentPaths->Reset();
+	}
+
+	// Held while decoding, so the payload can't be released or rebuilt under the view
+	FScopeLock Lock(&PayloadLock);
+
+	const uint8* Data = GetPayloadData();
+	if (Data == nullptr)
+	{
+		return false;
+	}
+
+	const FPayloadView View(Data);
+	if (LoopIndex < 0 || LoopIndex >= View.Header->NumLoops)
+	{
+		return false;
+	}
+
+	const FPackedLoop& Loop = View.Loops[LoopIndex];
+	const TConstArrayView<FPackedPoint> Points(View.Points + Loop.FirstPoint, (int32)Loop.NumPoints);
+
+	for (const FPackedPoint& Point : Points)
+	{
+		FWaypointPointParams Params;
+		Params.FacingDirection = DequantizeYaw(Point.Yaw);
+		Params.WaitTime = Point.WaitTime / 100.f;
+		Params.AcceptanceRadius = Point.AcceptanceRadius;
+		Params.Flags = Point.Flags;
+
+		OutLoopData.InsertPoint(View.GetLocation(Point.Position), Params);
+	}
+
+	if (OutSegmentPaths)
+	{
+		OutSegmentPaths->SetNum(Points.Num());
+
+		for (int32 i = 0; i < Points.Num(); ++i)
+		{
+			const FPackedPoint& Point = Points[i];
+			if (!EnumHasAnyFlags(Point.SegmentFlags, EPackedSegmentFlags::Computed))
+			{
+				continue;
+			}
+
+			FWaypointSegmentPath& Segment = (*OutSegmentPaths)[i];
+			Segment.Points.Reserve(Point.NumPathPoints);
+			for (uint32 PathPointIndex = 0; PathPointIndex < Point.NumPathPoints; ++PathPointIndex)
+			{
+				Segment.Points.Add(View.GetLocation(View.PathPoints[Point.FirstPathPoint + PathPointIndex]));
+			}
+
+			Segment.Bounds = GetSegmentBounds(Segment.Points, OutLoopData.GetLocation(i), OutLoopData.GetLocation(OutLoopData.GetNextIndex(i)), AgentRadius);
+			Segment.Hash = Point.SegmentHash;
+		}
+	}
+
+	return true;
+}
+
+AWaypointLoop* UWaypointLoopAsset::SpawnLoop(UWorld* World, int32 LoopIndex, bool bSpawnWaypoints) const
+{
+	UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(World);
+	if (Subsystem == nullptr || !Loops.IsValidIndex(LoopIndex))
+	{
+		return nullptr;
+	}
+
+	const FWaypointLoopAssetEntry& Entry = Loops[LoopIndex];
+	const FWaypointNavAgentInfoPtr NavAgent = Subsystem->GetNavAgentInfo(Entry.CharacterClass);
+
+	FWaypointLoopData LoopData;
+	TArray<FWaypointSegmentPath> SegmentPaths;
+	if (!DecodeLoop(LoopIndex, LoopData, &SegmentPaths, NavAgent.IsValid() ? NavAgent->AgentProperties.AgentRadius : 0.f) || LoopData.Num() == 0)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	// A loop without waypoints only lives in its packed data, which the level doesn't save. It's spawned from the asset again instead.
+	if (!bSpawnWaypoints)
+	{
+		SpawnParams.ObjectFlags |= RF_Transient;
+	}
+
+	AWaypointLoop* Loop = World->SpawnActor<AWaypointLoop>(FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+	if (Loop == nullptr)
+	{
+		return nullptr;
+	}
+
+	Loop->SetSplineColor(Entry.SplineColor);
+
+	// The same loop of the same asset is the same loop to save games, whichever session spawned it
+	Loop->SetLoopGuid(FGuid::NewDeterministicGuid(FString::Printf(TEXT("%s:%d"), *GetPathName(), LoopIndex)));
+
+	if (!bSpawnWaypoints)
+	{
+		Loop->SetGeneratedLoop(MoveTemp(LoopData), MoveTemp(SegmentPaths), Entry.CharacterClass);
+
+		// Baked paths are kept while their hash matches the navmesh, the others are requeried
+		Loop->RecalculateAllWaypoints();
+		return Loop;
+	}
+
+#if WITH_EDITOR
+	Loop->SetActorLabel(Entry.Name.ToString());
+#endif // WITH_EDITOR
+
+	TArray<AWaypoint*> Waypoints;
+	Waypoints.Reserve(LoopData.Num());
+	for (int32 i = 0; i < LoopData.Num(); ++i)
+	{
+		if (AWaypoint* Waypoint = World->SpawnActor<AWaypoint>(LoopData.GetLocation(i), FRotator::ZeroRotator, SpawnParams))
+		{
+			Waypoint->ApplyPointParams(LoopData.GetParams(i));
+			Waypoint->SetCharacterClass(Entry.CharacterClass);
+			Waypoints.Add(Waypoint);
+		}
+	}
+
+	// Paths are indexed by segment, they no longer line up if a waypoint couldn't be spawned
+	if (Waypoints.Num() != LoopData.Num())
+	{
+		SegmentPaths.Reset();
+	}
+
+	Loop->InitializeWaypoints(Waypoints, MoveTemp(SegmentPaths));
+	return Loop;
+}
+
+void UWaypointLoopAsset::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+
+	// Transactions don't record bulk data, undo would restore the loops and leave the payload of the last build with them.
+	// The payload goes through the transaction as plain bytes instead.
+	if (Ar.IsTransacting())
+	{
+		TArray<uint8> Bytes;
+		if (Ar.IsSaving())
+		{
+			FScopeLock Lock(&PayloadLock);
+			if (const uint8* Data = GetPayloadData())
+			{
+				Bytes.Append(Data, Payload.GetBulkDataSize());
+			}
+		}
+
+		Ar << Bytes;
+
+		if (Ar.IsLoading())
+		{
+			SetPayload(Bytes);
+		}
+
+		return;
+	}
+
+	// Bulk data can't be saved while it's locked, it's locked again the next time it's read
+	if (Ar.IsSaving())
+	{
+		ReleasePayloadData();
+	}
+
+	Payload.Serialize(Ar, this);
+}
+
+void UWaypointLoopAsset::SetPayload(TConstArrayView<uint8> Bytes)
+{
+	// Decodes running on other threads finish with the old payload first
+	FScopeLock Lock(&PayloadLock);
+	ReleasePayloadData();
+
+	if (Bytes.Num() == 0)
+	{
+		Payload.RemoveBulkData();
+		return;
+	}
+
+	Payload.Lock(LOCK_READ_WRITE);
+	FMemory::Memcpy(Payload.Realloc(Bytes.Num()), Bytes.GetData(), Bytes.Num());
+	Payload.Unlock();
+
+	// Always in its own chunk of the file, so it can be streamed or mapped without going through the export
+	Payload.SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload | BULKDATA_MemoryMappedPayload);
+}
+
+void UWaypointLoopAsset::BeginDestroy()
+{
+	ReleasePayloadData();
+
+	Super::BeginDestroy();
+}
+
+const uint8* UWaypointLoopAsset::GetPayloadData() const
+{
+	FScopeLock Lock(&PayloadLock);
+
+	if (PayloadData == nullptr && Payload.GetBulkDataSize() > 0)
+	{
+		// Maps or streams the payload in, nothing is decoded until a loop is asked for
+		const uint8* Data = static_cast<const uint8*>(Payload.LockReadOnly());
+		if (WaypointLoopAsset::IsValidPayload(Data, Payload.GetBulkDataSize()))
+		{
+			PayloadData = Data;
+		}
+		else
+		{
+			Payload.Unlock();
+			UE_LOG(LogWaypoints, Error, TEXT("%s: the loop payload is invalid or from another version, the asset needs to be rebuilt"), *GetPathName());
+		}
+	}
+
+	return PayloadData;
+}
+
+void UWaypointLoopAsset::ReleasePayloadData()
+{
+	FScopeLock Lock(&PayloadLock);
+
+	if (PayloadData)
+	{
+		Payload.Unlock();
+		PayloadData = nullptr;
+	}
+}
+
+void UWaypointLoopAsset::BuildFromEditorLevel()
+{
+#if WITH_EDITOR
+	UWorld* World = GEditor ? GEditor->GetEditorWorldContext().World() : nullptr;
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	TArray<const AWaypointLoop*> LevelLoops;
+	for (TActorIterator<AWaypointLoop> It(World); It; ++It)
+	{
+		LevelLoops.Add(*It);
+	}
+
+	const FScopedTransaction Transaction(LOCTEXT("BuildFromEditorLevel", "Build Waypoint Loop Asset"));
+	if (Build(LevelLoops))
+	{
+		MarkPackageDirty();
+	}
+#endif // WITH_EDITOR
+}
+
+void UWaypointLoopAsset::SpawnInEditorLevel()
+{
+#if WITH_EDITOR
+	UWorld* World = GEditor ? GEditor->GetEditorWorldContext().World() : nullptr;
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	const FScopedTransaction Transaction(LOCTEXT("SpawnInEditorLevel", "Spawn Waypoint Loops"));
+	for (int32 LoopIndex = 0; LoopIndex < Loops.Num(); ++LoopIndex)
+	{
+		SpawnLoop(World, LoopIndex, true);
+	}
+#endif // WITH_EDITOR
+}
+
+#undef LOCTEXT_NAMESPACE
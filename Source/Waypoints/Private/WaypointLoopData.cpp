@@ -0,0 +1,218 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointLoopData.h"
+
+#include "Misc/Crc.h"
+
+FWaypointHandle FWaypointLoopData::GetHandle(int32 Index) const
+{
+	FWaypointHandle Handle;
+	if (PointSlots.IsValidIndex(Index))
+	{
+		Handle.Slot = PointSlots[Index];
+		Handle.Generation = Slots[Handle.Slot].Generation;
+	}
+
+	return Handle;
+}
+
+int32 FWaypointLoopData::ResolveHandle(FWaypointHandle Handle) const
+{
+	if (!Handle.IsValid() || !Slots.IsValidIndex(Handle.Slot))
+	{
+		return INDEX_NONE;
+	}
+
+	const FSlot& Slot = Slots[Handle.Slot];
+	return Slot.Generation == Handle.Generation ? Slot.PointIndex : INDEX_NONE;
+}
+
+int32 FWaypointLoopData::FindClosestPoint(const FVector& Location) const
+{
+	FVector::FReal MinDistance = TNumericLimits<FVector::FReal>::Max();
+	int32 ClosestIndex = INDEX_NONE;
+
+	for (int32 i = 0; i < Locations.Num(); ++i)
+	{
+		const FVector::FReal Distance = FVector::DistSquared(Locations[i], Location);
+		if (Distance < MinDistance)
+		{
+			MinDistance = Distance;
+			ClosestIndex = i;
+		}
+	}
+
+	return ClosestIndex;
+}
+
+int32 FWaypointLoopData::FindPointAt(const FVector& Location, float Tolerance) const
+{
+	const int32 ClosestIndex = FindClosestPoint(Location);
+	return ClosestIndex != INDEX_NONE && FVector::DistSquared(Locations[ClosestIndex], Location) <= FMath::Square(Tolerance) ? ClosestIndex : INDEX_NONE;
+}
+
+void FWaypointLoopData::FindClosestPoints(const FVector& Location, int32 MaxPoints, TArray<int32>& OutIndices) const
+{
+	OutIndices.Reset();
+	if (MaxPoints <= 0)
+	{
+		return;
+	}
+
+	// Kept sorted by distance, candidate counts are small so insertion beats sorting the whole loop
+	TArray<FVector::FReal, TInlineAllocator<16>> Distances;
+	for (int32 i = 0; i < Locations.Num(); ++i)
+	{
+		const FVector::FReal Distance = FVector::DistSquared(Locations[i], Location);
+		if (OutIndices.Num() == MaxPoints && Distance >= Distances.Last())
+		{
+			continue;
+		}
+
+		int32 InsertAt = Distances.Num();
+		while (InsertAt > 0 && Distances[InsertAt - 1] > Distance)
+		{
+			--InsertAt;
+		}
+
+		if (OutIndices.Num() == MaxPoints)
+		{
+			OutIndices.Pop(false);
+			Distances.Pop(false);
+		}
+
+		OutIndices.Insert(i, InsertAt);
+		Distances.Insert(Distance, InsertAt);
+	}
+}
+
+FWaypointHandle FWaypointLoopData::InsertPoint(const FVector& Location, const FWaypointPointParams& PointParams, int32 Index)
+{
+	if (Index == INDEX_NONE || Index > Num())
+	{
+		Index = Num();
+	}
+
+	Locations.Insert(Location, Index);
+	Params.Insert(PointParams, Index);
+	PointSlots.Insert(AllocateSlot(Index), Index);
+
+	FixupSlots(Index + 1);
+	++Revision;
+
+	return GetHandle(Index);
+}
+
+void FWaypointLoopData::RemovePoint(int32 Index)
+{
+	if (!IsValidIndex(Index))
+	{
+		return;
+	}
+
+	FreeSlot(PointSlots[Index]);
+
+	Locations.RemoveAt(Index);
+	Params.RemoveAt(Index);
+	PointSlots.RemoveAt(Index);
+
+	FixupSlots(Index);
+	++Revision;
+}
+
+void FWaypointLoopData::UpdatePoint(int32 Index, const FVector& Location, const FWaypointPointParams& PointParams)
+{
+	if (IsValidIndex(Index))
+	{
+		Locations[Index] = Location;
+		Params[Index] = PointParams;
+		++Revision;
+	}
+}
+
+void FWaypointLoopData::Reorder(TConstArrayView<int32> NewOrder)
+{
+	check(NewOrder.Num() == Num());
+
+	TArray<FVector> NewLocations;
+	TArray<FWaypointPointParams> NewParams;
+	TArray<uint32> NewPointSlots;
+	NewLocations.Reserve(Num());
+	NewParams.Reserve(Num());
+	NewPointSlots.Reserve(Num());
+
+	for (const int32 OldIndex : NewOrder)
+	{
+		NewLocations.Add(Locations[OldIndex]);
+		NewParams.Add(Params[OldIndex]);
+		NewPointSlots.Add(PointSlots[OldIndex]);
+	}
+
+	Locations = MoveTemp(NewLocations);
+	Params = MoveTemp(NewParams);
+	PointSlots = MoveTemp(NewPointSlots);
+
+	FixupSlots(0);
+	++Revision;
+}
+
+void FWaypointLoopData::Reset()
+{
+	for (const uint32 Slot : PointSlots)
+	{
+		FreeSlot(Slot);
+	}
+
+	Locations.Reset();
+	Params.Reset();
+	PointSlots.Reset();
+	++Revision;
+}
+
+SIZE_T FWaypointLoopData::GetAllocatedSize() const
+{
+	return Locations.GetAllocatedSize() + Params.GetAllocatedSize() + PointSlots.GetAllocatedSize() + Slots.GetAllocatedSize() + FreeSlots.GetAllocatedSize();
+}
+
+uint32 FWaypointLoopData::HashLocations() const
+{
+	return FCrc::MemCrc32(Locations.GetData(), Locations.Num() * sizeof(FVector));
+}
+
+uint32 FWaypointLoopData::AllocateSlot(int32 PointIndex)
+{
+	uint32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(false);
+	}
+	else
+	{
+		Slot = Slots.AddDefaulted();
+	}
+
+	Slots[Slot].PointIndex = PointIndex;
+	return Slot;
+}
+
+void FWaypointLoopData::FreeSlot(uint32 Slot)
+{
+	FSlot& FreedSlot = Slots[Slot];
+	FreedSlot.PointIndex = INDEX_NONE;
+
+	// Skip 0 on wrap around, it marks invalid handles
+	if (++FreedSlot.Generation == 0)
+	{
+		FreedSlot.Generation = 1;
+	}
+
+	FreeSlots.Push(Slot);
+}
+
+void FWaypointLoopData::FixupSlots(int32 FirstIndex)
+{
+	for (int32 i = FirstIndex; i < PointSlots.Num(); ++i)
+	{
+		Slots[PointSlots[i]].PointIndex = i;
+	}
+}
@@ -0,0 +1,196 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointLoopGenerator.h"
+#include "WaypointSubsystem.h"
+
+#include "Algo/Sort.h"
+#include "Math/RandomStream.h"
+#include "NavigationData.h"
+
+namespace WaypointLoopGenerator
+{
+	/** Scatters points over the navmesh in the region, keeping them at least MinSpacing apart */
+	static void SamplePoints(const FWaypointLoopGenerationParams& Params, const ANavigationData& NavData, TArray<FVector>& OutPoints)
+	{
+		FRandomStream Random(Params.Seed);
+		const FSharedConstNavQueryFilter Filter = NavData.GetDefaultQueryFilter();
+
+		const FVector Center = Params.Region.GetCenter();
+		const FVector ProjectExtent(50.f, 50.f, FMath::Max(Params.Region.GetExtent().Z, 50.));
+		const double MinSpacingSq = FMath::Square(Params.MinSpacing);
+
+		const int32 MaxAttempts = Params.NumPoints * FMath::Max(Params.MaxAttemptsPerPoint, 1);
+		for (int32 Attempt = 0; Attempt < MaxAttempts && OutPoints.Num() < Params.NumPoints; ++Attempt)
+		{
+			const FVector Candidate(
+				Random.FRandRange(Params.Region.Min.X, Params.Region.Max.X),
+				Random.FRandRange(Params.Region.Min.Y, Params.Region.Max.Y),
+				Center.Z);
+
+			FNavLocation NavLocation;
+			if (!NavData.ProjectPoint(Candidate, NavLocation, ProjectExtent, Filter) || !Params.Region.IsInsideOrOn(NavLocation.Location))
+			{
+				continue;
+			}
+
+			const bool bTooClose = OutPoints.ContainsByPredicate([&NavLocation, MinSpacingSq](const FVector& Point)
+				{
+					return FVector::DistSquared(Point, NavLocation.Location) < MinSpacingSq;
+				});
+
+			if (!bTooClose)
+			{
+				OutPoints.Add(NavLocation.Location);
+			}
+		}
+	}
+
+	/** Orders the points by angle around their centroid, so the loop doesn't cross itself on open ground */
+	static void OrderPoints(TArray<FVector>& Points)
+	{
+		FVector Centroid = FVector::ZeroVector;
+		for (const FVector& Point : Points)
+		{
+			Centroid += Point;
+		}
+		Centroid /= FMath::Max(Points.Num(), 1);
+
+		Algo::SortBy(Points, [&Centroid](const FVector& Point)
+			{
+				return FMath::Atan2(Point.Y - Centroid.Y, Point.X - Centroid.X);
+			});
+	}
+}
+
+FWaypointLoopGenerator::FWaypointLoopGenerator(const FWaypointLoopGenerationParams& InParams, const FWaypointNavAgentInfoPtr& InNavAgent)
+	: Params(InParams)
+	, NavAgent(InNavAgent)
+{
+}
+
+bool FWaypointLoopGenerator::SamplePoints()
+{
+	check(IsInGameThread());
+
+	Points.Reset();
+
+	const ANavigationData* NavData = NavAgent.IsValid() ? NavAgent->NavData.Get() : nullptr;
+	if (NavData == nullptr || !Params.Region.IsValid || Params.NumPoints < 2)
+	{
+		return false;
+	}
+
+	Points.Reserve(Params.NumPoints);
+	WaypointLoopGenerator::SamplePoints(Params, *NavData, Points);
+	WaypointLoopGenerator::OrderPoints(Points);
+
+	Segments.Reset();
+	Segments.SetNum(Points.Num());
+	Reachable.Init(false, Points.Num());
+	Dirty.Init(true, Points.Num());
+	return true;
+}
+
+void FWaypointLoopGenerator::GetPendingQueries(TArray<FWaypointSegmentQuery>& OutQueries) const
+{
+	OutQueries.Reset();
+	if (Points.Num() < 2)
+	{
+		return;
+	}
+
+	for (int32 i = 0; i < Points.Num(); ++i)
+	{
+		if (!Dirty[i])
+		{
+			continue;
+		}
+
+		FWaypointSegmentQuery& Query = OutQueries.AddDefaulted_GetRef();
+		Query.SegmentIndex = i;
+		Query.Start = Points[i];
+		Query.End = Points[(i + 1) % Points.Num()];
+		Query.NavAgent = NavAgent;
+		Query.bRequireCompletePath = true;
+	}
+}
+
+void FWaypointLoopGenerator::ApplyPaths(TConstArrayView<FWaypointSegmentQuery> Queries, TArray<FWaypointSegmentPathResult>& Results)
+{
+	check(IsInGameThread());
+
+	for (int32 QueryIndex = 0; QueryIndex < Queries.Num(); ++QueryIndex)
+	{
+		const FWaypointSegmentQuery& Query = Queries[QueryIndex];
+		const int32 i = Query.SegmentIndex;
+		if (!Segments.IsValidIndex(i))
+		{
+			continue;
+		}
+
+		FWaypointSegmentPath& Segment = Segments[i];
+		Reachable[i] = Results[QueryIndex].bSuccess;
+		Segment.Points = MoveTemp(Results[QueryIndex].Points);
+		Segment.Bounds = Reachable[i] ? FBox(Segment.Points) : FBox(Query.Start, Query.End);
+		Segment.Bounds = Segment.Bounds.ExpandBy(NavAgent.IsValid() ? NavAgent->AgentProperties.AgentRadius : 0.f);
+		Segment.Hash = UWaypointSubsystem::HashSegment(Query, Segment.Bounds);
+		Dirty[i] = false;
+	}
+
+	DropCutOffPoints();
+}
+
+void FWaypointLoopGenerator::DropCutOffPoints()
+{
+	// A point that can't be reached nor left is cut off from the loop, drop it and join its neighbours instead
+	for (int32 i = Points.Num() - 1; i >= 0 && Points.Num() > 2; --i)
+	{
+		const int32 Incoming = (i + Points.Num() - 1) % Points.Num();
+
+		// Segments joined up this pass aren't known yet, they are judged on the next one
+		if (Reachable[i] || Reachable[Incoming] || Dirty[i] || Dirty[Incoming])
+		{
+			continue;
+		}
+
+		Points.RemoveAt(i, 1, false);
+		Segments.RemoveAt(i, 1, false);
+		Reachable.RemoveAt(i, 1, false);
+		Dirty.RemoveAt(i, 1, false);
+
+		const int32 NewIncoming = (i + Points.Num() - 1) % Points.Num();
+		Dirty[NewIncoming] = true;
+	}
+}
+
+void FWaypointLoopGenerator::Finish(FWaypointLoopGenerationResult& OutResult)
+{
+	OutResult = FWaypointLoopGenerationResult();
+	if (Points.Num() < 2)
+	{
+		return;
+	}
+
+	int32 NumReachable = 0;
+	for (const bool bReachable : Reachable)
+	{
+		NumReachable += bReachable ? 1 : 0;
+	}
+
+	OutResult.Reachability = float(NumReachable) / Points.Num();
+	if (OutResult.Reachability < Params.MinReachability)
+	{
+		return;
+	}
+
+	FWaypointPointParams PointParams = Params.PointParams;
+	for (int32 i = 0; i < Points.Num(); ++i)
+	{
+		const FVector ToNext = Points[(i + 1) % Points.Num()] - Points[i];
+		PointParams.FacingDirection = FVector3f(ToNext.GetSafeNormal2D(UE_SMALL_NUMBER, FVector::ForwardVector));
+		OutResult.LoopData.InsertPoint(Points[i], PointParams);
+	}
+
+	OutResult.SegmentPaths = MoveTemp(Segments);
+	OutResult.bSuccess = true;
+}
@@ -0,0 +1,334 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointLoopRenderComponent.h"
+#include "WaypointLoop.h"
+
+#include "Engine/Engine.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "PrimitiveSceneProxy.h"
+#include "RenderingThread.h"
+#include "SceneManagement.h"
+
+#if !UE_BUILD_SHIPPING
+static void OnShowPathsChanged(IConsoleVariable* Var);
+
+static int32 GWaypointsShowPaths = 0;
+static FAutoConsoleVariableRef CVarWaypointsShowPaths(
+	TEXT("Waypoints.ShowPaths"),
+	GWaypointsShowPaths,
+	TEXT("Draws the navigation paths of all waypoint loops in game worlds.\n")
+	TEXT("0: off (default), 1: on"),
+	FConsoleVariableDelegate::CreateStatic(&OnShowPathsChanged),
+	ECVF_Cheat);
+
+static void OnShowPathsChanged(IConsoleVariable* Var)
+{
+	if (!GEngine)
+	{
+		return;
+	}
+
+	for (const FWorldContext& Context : GEngine->GetWorldContexts())
+	{
+		UWorld* World = Context.World();
+		if (!World || !World->IsGameWorld())
+		{
+			continue;
+		}
+
+		for (TActorIterator<AWaypointLoop> It(World); It; ++It)
+		{
+			if (GWaypointsShowPaths)
+			{
+				It->RecalculateAllWaypoints();
+			}
+			else if (It->PathRenderComponent)
+			{
+				It->PathRenderComponent->ClearSegments();
+			}
+		}
+	}
+}
+#endif // !UE_BUILD_SHIPPING
+
+/** Represents the lines of a waypoint loop to the scene manager */
+class FWaypointLoopSceneProxy final : public FPrimitiveSceneProxy
+{
+public:
+	SIZE_T GetTypeHash() const override
+	{
+		static size_t UniquePointer;
+		return reinterpret_cast<size_t>(&UniquePointer);
+	}
+
+	FWaypointLoopSceneProxy(const UWaypointLoopRenderComponent* InComponent, TArray<TArray<FVector>>&& InSegments, const FLinearColor& InLineColor)
+		: FPrimitiveSceneProxy(InComponent)
+		, Segments(MoveTemp(InSegments))
+		, LineColor(InLineColor)
+		, LineThickness(InComponent->LineThickness)
+		, HeightOffset(0.f, 0.f, InComponent->HeightOffset)
+	{
+		bWillEverBeLit = false;
+
+		for (const TArray<FVector>& Segment : Segments)
+		{
+			NumLines += FMath::Max(Segment.Num() - 1, 0);
+		}
+	}
+
+	void SetSegment_RenderThread(int32 SegmentIndex, TArray<FVector>&& Points)
+	{
+		check(IsInRenderingThread());
+
+		if (!Segments.IsValidIndex(SegmentIndex))
+		{
+			Segments.SetNum(SegmentIndex + 1);
+		}
+
+		NumLines -= FMath::Max(Segments[SegmentIndex].Num() - 1, 0);
+		Segments[SegmentIndex] = MoveTemp(Points);
+		NumLines += FMath::Max(Segments[SegmentIndex].Num() - 1, 0);
+	}
+
+	void SetNumSegments_RenderThread(int32 NumSegments)
+	{
+		check(IsInRenderingThread());
+
+		for (int32 i = NumSegments; i < Segments.Num(); ++i)
+		{
+			NumLines -= FMath::Max(Segments[i].Num() - 1, 0);
+		}
+
+		Segments.SetNum(NumSegments);
+	}
+
+	void SetLineColor_RenderThread(const FLinearColor& InLineColor)
+	{
+		LineColor = InLineColor;
+	}
+
+	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override
+	{
+		if (NumLines == 0)
+		{
+			return;
+		}
+
+		const FColor DrawColor = LineColor.ToFColor(true);
+
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+		{
+			if (VisibilityMap & (1 << ViewIndex))
+			{
+				FPrimitiveDrawInterface* PDI = Collector.GetPDI(ViewIndex);
+
+				// All segments go into the same batched line list
+				PDI->AddReserveLines(SDPG_World, NumLines, false, LineThickness > 0.f);
+
+				for (const TArray<FVector>& Segment : Segments)
+				{
+					for (int32 i = 1; i < Segment.Num(); ++i)
+					{
+						PDI->DrawLine(Segment[i - 1] + HeightOffset, Segment[i] + HeightOffset, DrawColor, SDPG_World, LineThickness);
+					}
+				}
+			}
+		}
+	}
+
+	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override
+	{
+		FPrimitiveViewRelevance Result;
+		Result.bDrawRelevance = IsShown(View);
+		Result.bDynamicRelevance = true;
+		Result.bShadowRelevance = false;
+		Result.bEditorPrimitiveRelevance = UseEditorCompositing(View);
+		return Result;
+	}
+
+	virtual uint32 GetMemoryFootprint() const override
+	{
+		return sizeof(*this) + GetAllocatedSize();
+	}
+
+	uint32 GetAllocatedSize() const
+	{
+		uint32 Size = FPrimitiveSceneProxy::GetAllocatedSize() + Segments.GetAllocatedSize();
+		for (const TArray<FVector>& Segment : Segments)
+		{
+			Size += Segment.GetAllocatedSize();
+		}
+
+		return Size;
+	}
+
+private:
+	TArray<TArray<FVector>> Segments;
+	FLinearColor LineColor;
+	float LineThickness;
+	FVector HeightOffset;
+	int32 NumLines = 0;
+};
+
+UWaypointLoopRenderComponent::UWaypointLoopRenderComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	LineThickness = 2.f;
+	HeightOffset = 128.f;
+	LineColor = FLinearColor::White;
+
+	bSelectable = false;
+	bUseEditorCompositing = true;
+	CastShadow = false;
+	SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	SetGenerateOverlapEvents(false);
+	SetCanEverAffectNavigation(false);
+	SetUsingAbsoluteLocation(true);
+	SetUsingAbsoluteRotation(true);
+	SetUsingAbsoluteScale(true);
+}
+
+bool UWaypointLoopRenderComponent::IsPathDrawingEnabled(const UWorld* World)
+{
+	if (World == nullptr)
+	{
+		return false;
+	}
+
+#if WITH_EDITOR
+	if (World->WorldType == EWorldType::Editor)
+	{
+		return true;
+	}
+#endif // WITH_EDITOR
+
+#if !UE_BUILD_SHIPPING
+	return World->IsGameWorld() && GWaypointsShowPaths != 0;
+#else
+	return false;
+#endif // !UE_BUILD_SHIPPING
+}
+
+void UWaypointLoopRenderComponent::SetSegment(int32 SegmentIndex, TArrayView<const FVector> Points)
+{
+	if (SegmentIndex < 0)
+	{
+		return;
+	}
+
+	if (!Segments.IsValidIndex(SegmentIndex))
+	{
+		Segments.SetNum(SegmentIndex + 1);
+	}
+
+	FSegment& Segment = Segments[SegmentIndex];
+	Segment.Points = Points;
+	Segment.Bounds = Points.Num() > 0 ? FBox(Points.GetData(), Points.Num()) : FBox(ForceInit);
+
+	UpdateBounds();
+
+	if (FWaypointLoopSceneProxy* LoopSceneProxy = static_cast<FWaypointLoopSceneProxy*>(SceneProxy))
+	{
+		ENQUEUE_RENDER_COMMAND(SetWaypointLoopSegment)(
+			[LoopSceneProxy, SegmentIndex, NewPoints = TArray<FVector>(Points)](FRHICommandListImmediate&) mutable
+			{
+				LoopSceneProxy->SetSegment_RenderThread(SegmentIndex, MoveTemp(NewPoints));
+			});
+
+		MarkRenderTransformDirty();
+	}
+	else
+	{
+		MarkRenderStateDirty();
+	}
+}
+
+void UWaypointLoopRenderComponent::SetNumSegments(int32 NumSegments)
+{
+	if (NumSegments == Segments.Num())
+	{
+		return;
+	}
+
+	Segments.SetNum(NumSegments);
+	UpdateBounds();
+
+	if (FWaypointLoopSceneProxy* LoopSceneProxy = static_cast<FWaypointLoopSceneProxy*>(SceneProxy))
+	{
+		ENQUEUE_RENDER_COMMAND(SetWaypointLoopNumSegments)(
+			[LoopSceneProxy, NumSegments](FRHICommandListImmediate&)
+			{
+				LoopSceneProxy->SetNumSegments_RenderThread(NumSegments);
+			});
+
+		MarkRenderTransformDirty();
+	}
+}
+
+void UWaypointLoopRenderComponent::ClearSegments()
+{
+	Segments.Reset();
+	UpdateBounds();
+	MarkRenderStateDirty();
+}
+
+void UWaypointLoopRenderComponent::SetLineColor(const FLinearColor& InLineColor)
+{
+	if (LineColor == InLineColor)
+	{
+		return;
+	}
+
+	LineColor = InLineColor;
+
+	if (FWaypointLoopSceneProxy* LoopSceneProxy = static_cast<FWaypointLoopSceneProxy*>(SceneProxy))
+	{
+		ENQUEUE_RENDER_COMMAND(SetWaypointLoopLineColor)(
+			[LoopSceneProxy, InLineColor](FRHICommandListImmediate&)
+			{
+				LoopSceneProxy->SetLineColor_RenderThread(InLineColor);
+			});
+	}
+}
+
+FPrimitiveSceneProxy* UWaypointLoopRenderComponent::CreateSceneProxy()
+{
+	TArray<TArray<FVector>> ProxySegments;
+	ProxySegments.Reserve(Segments.Num());
+
+	bool bHasLines = false;
+	for (const FSegment& Segment : Segments)
+	{
+		ProxySegments.Add(Segment.Points);
+		bHasLines |= Segment.Points.Num() > 1;
+	}
+
+	// The proxy is recreated through MarkRenderStateDirty once the first segment arrives
+	if (!bHasLines)
+	{
+		return nullptr;
+	}
+
+	return new FWaypointLoopSceneProxy(this, MoveTemp(ProxySegments), LineColor);
+}
+
+FBoxSphereBounds UWaypointLoopRenderComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	// Segments are stored in world space, so the component transform is ignored
+	FBox Box(ForceInit);
+	for (const FSegment& Segment : Segments)
+	{
+		Box += Segment.Bounds;
+	}
+
+	if (!Box.IsValid)
+	{
+		return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.f);
+	}
+
+	Box.Max.Z += HeightOffset;
+	Box.Min.Z += FMath::Min(HeightOffset, 0.f);
+
+	return FBoxSphereBounds(Box.ExpandBy(LineThickness));
+}
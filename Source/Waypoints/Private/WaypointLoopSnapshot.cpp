@@ -0,0 +1,85 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointLoopSnapshot.h"
+
+#include "HAL/PlatformProcess.h"
+
+namespace WaypointLoopSnapshot
+{
+	// Yields before a publish gives up on the readers still taking a reference and leaves the snapshots for the next flush
+	static constexpr int32 MaxPublishSpins = 16;
+}
+
+FWaypointLoopSnapshotPublisher::~FWaypointLoopSnapshotPublisher()
+{
+	if (const FWaypointLoopSnapshot* Previous = Current.exchange(nullptr))
+	{
+		Retired.Add(Previous);
+	}
+
+	ReleaseRetired(true);
+}
+
+void FWaypointLoopSnapshotPublisher::Publish(const FWaypointLoopData& LoopData)
+{
+	bDirty = false;
+
+	// The publisher holds a reference to the current snapshot until it's replaced
+	FWaypointLoopSnapshot* Snapshot = new FWaypointLoopSnapshot(LoopData, ++Version);
+	Snapshot->AddRef();
+
+	if (const FWaypointLoopSnapshot* Previous = Current.exchange(Snapshot))
+	{
+		Retired.Add(Previous);
+	}
+
+	ReleaseRetired(false);
+}
+
+void FWaypointLoopSnapshotPublisher::Flush(const FWaypointLoopData& LoopData)
+{
+	if (bDirty)
+	{
+		Publish(LoopData);
+	}
+	else
+	{
+		ReleaseRetired(false);
+	}
+}
+
+FWaypointLoopSnapshotRef FWaypointLoopSnapshotPublisher::Acquire() const
+{
+	NumAcquiring.fetch_add(1);
+	FWaypointLoopSnapshotRef Snapshot(Current.load());
+	NumAcquiring.fetch_sub(1);
+
+	return Snapshot;
+}
+
+void FWaypointLoopSnapshotPublisher::ReleaseRetired(bool bWait)
+{
+	if (Retired.Num() == 0)
+	{
+		return;
+	}
+
+	// Retired snapshots were swapped out before this point, a reader starting after it loads the new one.
+	// Once no reader is between loading and referencing, every reader of a retired snapshot holds its own reference.
+	for (int32 Spin = 0; NumAcquiring.load() != 0; ++Spin)
+	{
+		if (!bWait && Spin >= WaypointLoopSnapshot::MaxPublishSpins)
+		{
+			return;
+		}
+
+		FPlatformProcess::YieldThread();
+	}
+
+	for (const FWaypointLoopSnapshot* Snapshot : Retired)
+	{
+		Snapshot->Release();
+	}
+
+	Retired.Reset();
+}
@@ -0,0 +1,63 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointNavAgentCache.h"
+
+#include "Components/CapsuleComponent.h"
+#include "GameFramework/Character.h"
+#include "NavigationData.h"
+#include "NavigationSystem.h"
+
+FWaypointNavAgentInfoPtr FWaypointNavAgentCache::Find(const UClass* CharacterClass) const
+{
+	FReadScopeLock ReadLock(Lock);
+
+	const FWaypointNavAgentInfoPtr* Entry = Entries.Find(CharacterClass);
+	return Entry ? *Entry : nullptr;
+}
+
+FWaypointNavAgentInfoPtr FWaypointNavAgentCache::FindOrResolve(UNavigationSystemV1& NavSys, const UClass* CharacterClass)
+{
+	check(IsInGameThread());
+
+	FWaypointNavAgentInfoPtr Entry = Find(CharacterClass);
+
+	// Nav data can be unregistered without a config change, resolve again in that case
+	if (Entry.IsValid() && Entry->NavData.IsValid())
+	{
+		return Entry;
+	}
+
+	Entry = Resolve(NavSys, CharacterClass);
+
+	FWriteScopeLock WriteLock(Lock);
+	Entries.Add(CharacterClass, Entry);
+
+	return Entry;
+}
+
+void FWaypointNavAgentCache::Invalidate()
+{
+	FWriteScopeLock WriteLock(Lock);
+
+	Entries.Reset();
+	++Generation;
+}
+
+FWaypointNavAgentInfoPtr FWaypointNavAgentCache::Resolve(UNavigationSystemV1& NavSys, const UClass* CharacterClass)
+{
+	if (CharacterClass == nullptr || !CharacterClass->IsChildOf(ACharacter::StaticClass()))
+	{
+		return MakeShared<const FWaypointNavAgentInfo, ESPMode::ThreadSafe>(FNavigationSystem::GetDefaultSupportedAgent(), NavSys.GetAbstractNavData());
+	}
+
+	const ACharacter* CharacterCDO = CharacterClass->GetDefaultObject<ACharacter>();
+
+	FNavAgentProperties AgentProperties;
+	AgentProperties.NavWalkingSearchHeightScale = FNavigationSystem::GetDefaultSupportedAgent().NavWalkingSearchHeightScale;
+	AgentProperties.AgentRadius = CharacterCDO->GetCapsuleComponent()->GetScaledCapsuleRadius();
+	AgentProperties.AgentHeight = CharacterCDO->GetCapsuleComponent()->GetScaledCapsuleHalfHeight() * 2.f;
+
+	const ANavigationData* NavData = NavSys.GetNavDataForProps(CharacterCDO->GetNavAgentPropertiesRef());
+
+	return MakeShared<const FWaypointNavAgentInfo, ESPMode::ThreadSafe>(AgentProperties, NavData);
+}
@@ -0,0 +1,256 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointOccupancyField.h"
+#include "WaypointSubsystem.h"
+
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+namespace WaypointOccupancyField
+{
+	// Long cycles are sampled more coarsely rather than without bound
+	static constexpr int32 MaxSamplesPerLoop = 1 << 18;
+
+	// When one loop watched a cell during its cycle, counted in samples
+	struct FCellTrack
+	{
+		int32 FirstSample = INDEX_NONE;
+		int32 LastSample = INDEX_NONE;
+		int32 NumSamples = 0;
+		int32 MaxGap = 0;
+		double SumGapSq = 0.;
+
+		void AddGap(int32 Gap)
+		{
+			if (Gap > 0)
+			{
+				SumGapSq += double(Gap) * double(Gap);
+				MaxGap = FMath::Max(MaxGap, Gap);
+			}
+		}
+	};
+
+	struct FLoopCoverage
+	{
+		TMap<int32, FCellTrack> Cells;
+		int32 NumSamples = 0;
+		float SampleInterval = 0.f;
+	};
+
+	struct FKey
+	{
+		double Time;
+		FVector Location;
+	};
+
+	// Where the guard is over one cycle: along each leg at walking speed, then standing at its end for the wait.
+	// The last leg ends where the first one starts, so the timeline wraps around.
+	static double BuildTimeline(const FWaypointOccupancyLoop& Loop, float Speed, TArray<FKey>& OutKeys)
+	{
+		double Time = 0.;
+		for (int32 Leg = 0; Leg < Loop.LegPaths.Num(); ++Leg)
+		{
+			for (const FVector& Point : Loop.LegPaths[Leg])
+			{
+				if (OutKeys.Num() > 0)
+				{
+					Time += FVector::Dist(OutKeys.Last().Location, Point) / Speed;
+				}
+
+				OutKeys.Add({ Time, Point });
+			}
+
+			const float WaitTime = Loop.WaitTimes.IsValidIndex(Leg) ? Loop.WaitTimes[Leg] : 0.f;
+			if (WaitTime > 0.f && OutKeys.Num() > 0)
+			{
+				Time += WaitTime;
+				OutKeys.Add({ Time, OutKeys.Last().Location });
+			}
+		}
+
+		return Time;
+	}
+
+	static void FollowLoop(const FWaypointOccupancyLoop& Loop, const FWaypointOccupancyParams& Params, const FVector2D& Origin, float CellSize, int32 SizeX, int32 SizeY, FLoopCoverage& OutCoverage)
+	{
+		TArray<FKey> Keys;
+		const double CycleTime = BuildTimeline(Loop, FMath::Max(Params.GuardSpeed, 1.f), Keys);
+		if (CycleTime <= 0. || Keys.Num() < 2)
+		{
+			return;
+		}
+
+		const double Interval = FMath::Max(double(FMath::Max(Params.SampleInterval, 0.01f)), CycleTime / MaxSamplesPerLoop);
+		const int32 NumSamples = FMath::Max(FMath::FloorToInt32(CycleTime / Interval), 1);
+		OutCoverage.NumSamples = NumSamples;
+		OutCoverage.SampleInterval = float(Interval);
+
+		const FVector::FReal Radius = Params.WatchRadius;
+		int32 Key = 0;
+		for (int32 Sample = 0; Sample < NumSamples; ++Sample)
+		{
+			const double Time = Sample * Interval;
+			while (Key + 2 < Keys.Num() && Keys[Key + 1].Time <= Time)
+			{
+				++Key;
+			}
+
+			const FKey& From = Keys[Key];
+			const FKey& To = Keys[Key + 1];
+			const double Span = To.Time - From.Time;
+			const FVector Location = Span > 0. ? FMath::Lerp(From.Location, To.Location, FMath::Clamp((Time - From.Time) / Span, 0., 1.)) : To.Location;
+
+			const int32 MinX = FMath::Max(FMath::FloorToInt32((Location.X - Radius - Origin.X) / CellSize), 0);
+			const int32 MaxX = FMath::Min(FMath::FloorToInt32((Location.X + Radius - Origin.X) / CellSize), SizeX - 1);
+			const int32 MinY = FMath::Max(FMath::FloorToInt32((Location.Y - Radius - Origin.Y) / CellSize), 0);
+			const int32 MaxY = FMath::Min(FMath::FloorToInt32((Location.Y + Radius - Origin.Y) / CellSize), SizeY - 1);
+
+			for (int32 Y = MinY; Y <= MaxY; ++Y)
+			{
+				for (int32 X = MinX; X <= MaxX; ++X)
+				{
+					const FVector2D Center = Origin + FVector2D(X + 0.5, Y + 0.5) * CellSize;
+					if (FVector2D::DistSquared(Center, FVector2D(Location)) > Radius * Radius)
+					{
+						continue;
+					}
+
+					FCellTrack& Track = OutCoverage.Cells.FindOrAdd(Y * SizeX + X);
+					if (Track.LastSample == INDEX_NONE)
+					{
+						Track.FirstSample = Sample;
+					}
+					else
+					{
+						Track.AddGap(Sample - Track.LastSample - 1);
+					}
+
+					Track.LastSample = Sample;
+					++Track.NumSamples;
+				}
+			}
+		}
+
+		// The gap from the last time a cell is watched wraps around to the first time in the next cycle
+		for (TPair<int32, FCellTrack>& Pair : OutCoverage.Cells)
+		{
+			Pair.Value.AddGap(Pair.Value.FirstSample + NumSamples - Pair.Value.LastSample - 1);
+		}
+	}
+
+	static void BuildCommand(const TArray<FString>& Args, UWorld* World)
+	{
+		UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(World);
+		if (Subsystem == nullptr)
+		{
+			return;
+		}
+
+		FWaypointOccupancyParams Params;
+		Params.CellSize = Args.Num() > 0 ? FCString::Atof(*Args[0]) : Params.CellSize;
+		Params.WatchRadius = Args.Num() > 1 ? FCString::Atof(*Args[1]) : Params.WatchRadius;
+		Params.GuardSpeed = Args.Num() > 2 ? FCString::Atof(*Args[2]) : Params.GuardSpeed;
+		Params.GuardsPerLoop = Args.Num() > 3 ? FCString::Atoi(*Args[3]) : Params.GuardsPerLoop;
+
+		Subsystem->BuildOccupancyField(Params);
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BuildOccupancyFieldCommand(
+		TEXT("Waypoints.BuildOccupancyField"),
+		TEXT("Rebuilds the patrol occupancy field of the world from every loop on a worker task.\n")
+		TEXT("Usage: Waypoints.BuildOccupancyField [CellSize=200] [WatchRadius=500] [GuardSpeed=300] [GuardsPerLoop=1]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BuildCommand));
+}
+
+void FWaypointOccupancyField::Build(TConstArrayView<FWaypointOccupancyLoop> Loops, const FWaypointOccupancyParams& Params, FWaypointOccupancyField& OutField)
+{
+	OutField = FWaypointOccupancyField();
+
+	FBox Bounds(ForceInit);
+	for (const FWaypointOccupancyLoop& Loop : Loops)
+	{
+		for (const TArray<FVector>& LegPath : Loop.LegPaths)
+		{
+			Bounds += FBox(LegPath);
+		}
+	}
+
+	if (!Bounds.IsValid)
+	{
+		return;
+	}
+
+	Bounds = Bounds.ExpandBy(FVector(Params.WatchRadius, Params.WatchRadius, 0.));
+	const FVector Extent = Bounds.GetSize();
+
+	float CellSize = FMath::Max(Params.CellSize, 1.f);
+	const int32 MaxCells = FMath::Max(Params.MaxCells, 1);
+	while (double(FMath::CeilToInt32(Extent.X / CellSize)) * double(FMath::CeilToInt32(Extent.Y / CellSize)) > MaxCells)
+	{
+		CellSize *= 1.25f;
+	}
+
+	OutField.Origin = FVector2D(Bounds.Min);
+	OutField.CellSize = CellSize;
+	OutField.SizeX = FMath::Max(FMath::CeilToInt32(Extent.X / CellSize), 1);
+	OutField.SizeY = FMath::Max(FMath::CeilToInt32(Extent.Y / CellSize), 1);
+
+	TArray<WaypointOccupancyField::FLoopCoverage> Coverages;
+	Coverages.SetNum(Loops.Num());
+	ParallelFor(Loops.Num(), [&Loops, &Params, &OutField, &Coverages](int32 LoopIndex)
+		{
+			WaypointOccupancyField::FollowLoop(Loops[LoopIndex], Params, OutField.Origin, OutField.CellSize, OutField.SizeX, OutField.SizeY, Coverages[LoopIndex]);
+		});
+
+	// Chance of no loop watching each cell, loops are independent so these multiply
+	OutField.Cells.SetNum(OutField.SizeX * OutField.SizeY);
+	TArray<float> Unwatched;
+	Unwatched.Init(1.f, OutField.Cells.Num());
+
+	// Evenly spread guards split each gap between them, to a first approximation
+	const float GuardsPerLoop = float(FMath::Max(Params.GuardsPerLoop, 1));
+	for (const WaypointOccupancyField::FLoopCoverage& Coverage : Coverages)
+	{
+		const double CycleTime = Coverage.NumSamples * double(Coverage.SampleInterval);
+		for (const TPair<int32, WaypointOccupancyField::FCellTrack>& Pair : Coverage.Cells)
+		{
+			const WaypointOccupancyField::FCellTrack& Track = Pair.Value;
+			const float Presence = FMath::Min(GuardsPerLoop * Track.NumSamples / float(Coverage.NumSamples), 1.f);
+			const float MeanTimeToVisit = float(Track.SumGapSq * Coverage.SampleInterval * Coverage.SampleInterval / (2. * CycleTime)) / GuardsPerLoop;
+			const float MaxUnwatchedTime = Track.MaxGap * Coverage.SampleInterval / GuardsPerLoop;
+
+			FWaypointOccupancyCell& Cell = OutField.Cells[Pair.Key];
+			Unwatched[Pair.Key] *= 1.f - Presence;
+			Cell.MeanTimeToVisit = Cell.MeanTimeToVisit < 0.f ? MeanTimeToVisit : FMath::Min(Cell.MeanTimeToVisit, MeanTimeToVisit);
+			Cell.MaxUnwatchedTime = Cell.MaxUnwatchedTime < 0.f ? MaxUnwatchedTime : FMath::Min(Cell.MaxUnwatchedTime, MaxUnwatchedTime);
+		}
+	}
+
+	for (int32 i = 0; i < OutField.Cells.Num(); ++i)
+	{
+		OutField.Cells[i].Presence = 1.f - Unwatched[i];
+	}
+}
+
+const FWaypointOccupancyCell* FWaypointOccupancyField::FindCell(const FVector& Location) const
+{
+	if (IsEmpty())
+	{
+		return nullptr;
+	}
+
+	const int32 X = FMath::FloorToInt32((Location.X - Origin.X) / CellSize);
+	const int32 Y = FMath::FloorToInt32((Location.Y - Origin.Y) / CellSize);
+	if (X < 0 || Y < 0 || X >= SizeX || Y >= SizeY)
+	{
+		return nullptr;
+	}
+
+	return &Cells[Y * SizeX + X];
+}
+
+FBox2D FWaypointOccupancyField::GetBounds() const
+{
+	return IsEmpty() ? FBox2D(ForceInit) : FBox2D(Origin, Origin + FVector2D(SizeX, SizeY) * CellSize);
+}
@@ -0,0 +1,240 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointPathRequestQueue.h"
+#include "WaypointSegmentCorridor.h"
+
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "NavFilters/NavigationQueryFilter.h"
+#include "NavigationData.h"
+#include "NavigationSystem.h"
+
+static int32 GWaypointsPathQueueEnabled = 1;
+static FAutoConsoleVariableRef CVarWaypointsPathQueueEnabled(
+	TEXT("Waypoints.PathQueue.Enabled"),
+	GWaypointsPathQueueEnabled,
+	TEXT("Routes patrol path queries through the budgeted path request queue.\n")
+	TEXT("0: every agent finds its path immediately, 1: queued (default)"));
+
+static int32 GWaypointsPathQueueMaxQueriesPerFrame = 8;
+static FAutoConsoleVariableRef CVarWaypointsPathQueueMaxQueriesPerFrame(
+	TEXT("Waypoints.PathQueue.MaxQueriesPerFrame"),
+	GWaypointsPathQueueMaxQueriesPerFrame,
+	TEXT("Maximum number of patrol path queries serviced per frame."));
+
+static float GWaypointsPathQueueBudgetMs = 1.f;
+static FAutoConsoleVariableRef CVarWaypointsPathQueueBudgetMs(
+	TEXT("Waypoints.PathQueue.BudgetMs"),
+	GWaypointsPathQueueBudgetMs,
+	TEXT("Time in milliseconds the patrol path queue may spend finding paths each frame. At least one query is serviced per frame."));
+
+static float GWaypointsPathQueueMergeDistance = 100.f;
+static FAutoConsoleVariableRef CVarWaypointsPathQueueMergeDistance(
+	TEXT("Waypoints.PathQueue.MergeDistance"),
+	GWaypointsPathQueueMergeDistance,
+	TEXT("Requests for the same goal whose start locations fall in the same cell of this size share one path query."));
+
+namespace WaypointPathRequestQueue
+{
+	static FNavPathSharedPtr FindPath(UNavigationSystemV1& NavSys, const ANavigationData& NavData, const FVector& GoalLocation, const FWaypointPathRequest& Request)
+	{
+		const UObject* Querier = Request.Requester.Get();
+
+		FPathFindingQuery Query(Querier, NavData, Request.Start, GoalLocation, UNavigationQueryFilter::GetQueryFilter(NavData, Querier, Request.FilterClass));
+		Query.SetAllowPartialPaths(Request.bAllowPartialPath);
+		Query.SetNavAgentProperties(Request.AgentProperties);
+
+		const FPathFindingResult Result = NavSys.FindPathSync(Request.AgentProperties, Query);
+		return Result.IsSuccessful() ? Result.Path : nullptr;
+	}
+}
+
+bool FWaypointPathRequestQueue::IsEnabled()
+{
+	return GWaypointsPathQueueEnabled != 0;
+}
+
+uint32 FWaypointPathRequestQueue::AddRequest(FWaypointPathRequest&& Request)
+{
+	const uint32 RequestId = NextRequestId++;
+	if (NextRequestId == 0)
+	{
+		NextRequestId = 1;
+	}
+
+	const FMergeKey Key = MakeKey(Request);
+
+	FRequestGroup* Group = Groups.Find(Key);
+	if (Group == nullptr)
+	{
+		Group = &Groups.Add(Key);
+		Group->QueuedTime = FPlatformTime::Seconds();
+	}
+
+	Group->Requests.Emplace(RequestId, MoveTemp(Request));
+	RequestKeys.Add(RequestId, Key);
+
+	return RequestId;
+}
+
+void FWaypointPathRequestQueue::CancelRequest(uint32 RequestId)
+{
+	FMergeKey Key;
+	if (!RequestKeys.RemoveAndCopyValue(RequestId, Key))
+	{
+		return;
+	}
+
+	if (FRequestGroup* Group = Groups.Find(Key))
+	{
+		Group->Requests.RemoveAll([RequestId](const TPair<uint32, FWaypointPathRequest>& Pair) { return Pair.Key == RequestId; });
+		if (Group->Requests.Num() == 0)
+		{
+			Groups.Remove(Key);
+		}
+	}
+}
+
+void FWaypointPathRequestQueue::ProcessRequests(UWorld& World)
+{
+	if (Groups.Num() == 0)
+	{
+		return;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	const double EndTime = StartTime + GWaypointsPathQueueBudgetMs / 1000.;
+
+	TArray<FVector, TInlineAllocator<4>> PlayerLocations;
+	for (FConstPlayerControllerIterator It = World.GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController && PlayerController->GetPawn())
+		{
+			PlayerLocations.Add(PlayerController->GetPawn()->GetActorLocation());
+		}
+	}
+
+	TArray<TPair<float, FMergeKey>> SortedGroups;
+	SortedGroups.Reserve(Groups.Num());
+	for (const TPair<FMergeKey, FRequestGroup>& Pair : Groups)
+	{
+		SortedGroups.Emplace(GetPriority(Pair.Value, PlayerLocations, StartTime), Pair.Key);
+	}
+
+	SortedGroups.Sort([](const TPair<float, FMergeKey>& A, const TPair<float, FMergeKey>& B) { return A.Key < B.Key; });
+
+	int32 NumQueries = 0;
+	for (const TPair<float, FMergeKey>& SortedGroup : SortedGroups)
+	{
+		if (NumQueries >= GWaypointsPathQueueMaxQueriesPerFrame || (NumQueries > 0 && FPlatformTime::Seconds() >= EndTime))
+		{
+			break;
+		}
+
+		// Take the group out before servicing it, the delegates are allowed to queue or cancel requests
+		FRequestGroup Group;
+		if (!Groups.RemoveAndCopyValue(SortedGroup.Value, Group))
+		{
+			continue;
+		}
+
+		for (const TPair<uint32, FWaypointPathRequest>& Request : Group.Requests)
+		{
+			RequestKeys.Remove(Request.Key);
+		}
+
+		ServiceGroup(World, Group);
+		++NumQueries;
+	}
+}
+
+FWaypointPathRequestQueue::FMergeKey FWaypointPathRequestQueue::MakeKey(const FWaypointPathRequest& Request)
+{
+	const float CellSize = FMath::Max(GWaypointsPathQueueMergeDistance, 1.f);
+
+	FMergeKey Key;
+	Key.Goal = Request.Goal;
+	Key.NavData = Request.NavData;
+	Key.FilterClass = Request.FilterClass.Get();
+	Key.StartCell = FIntVector(
+		FMath::FloorToInt(Request.Start.X / CellSize),
+		FMath::FloorToInt(Request.Start.Y / CellSize),
+		FMath::FloorToInt(Request.Start.Z / CellSize));
+
+	return Key;
+}
+
+float FWaypointPathRequestQueue::GetPriority(const FRequestGroup& Group, TConstArrayView<FVector> PlayerLocations, double CurrentTime)
+{
+	float BestPriority = TNumericLimits<float>::Max();
+
+	for (const TPair<uint32, FWaypointPathRequest>& Request : Group.Requests)
+	{
+		const AController* Controller = Request.Value.Requester.Get();
+		const APawn* Pawn = Controller ? Controller->GetPawn() : nullptr;
+		const FVector Location = Pawn ? Pawn->GetActorLocation() : Request.Value.Start;
+
+		float DistanceSq = PlayerLocations.Num() > 0 ? TNumericLimits<float>::Max() : 0.f;
+		for (const FVector& PlayerLocation : PlayerLocations)
+		{
+			DistanceSq = FMath::Min(DistanceSq, static_cast<float>(FVector::DistSquared(Location, PlayerLocation)));
+		}
+
+		// Visible agents standing still are the most noticeable
+		if (Pawn && Pawn->WasRecentlyRendered(0.2f))
+		{
+			DistanceSq *= 0.1f;
+		}
+
+		BestPriority = FMath::Min(BestPriority, DistanceSq);
+	}
+
+	// Waiting requests slowly move up so far away agents aren't starved
+	const float WaitedSeconds = static_cast<float>(CurrentTime - Group.QueuedTime);
+	return BestPriority / (1.f + WaitedSeconds * WaitedSeconds);
+}
+
+void FWaypointPathRequestQueue::ServiceGroup(UWorld& World, FRequestGroup& Group)
+{
+	const FWaypointPathRequest& First = Group.Requests[0].Value;
+	const ANavigationData* NavData = First.NavData.Get();
+	const AActor* Goal = First.Goal.Get();
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(&World);
+
+	FNavPathSharedPtr Path;
+	if (NavSys && NavData && Goal)
+	{
+		Path = WaypointPathRequestQueue::FindPath(*NavSys, *NavData, Goal->GetActorLocation(), First);
+	}
+
+	// Merged requests follow the same corridor from the polygon they stand on, each with its own path since path following registers itself on it
+	FWaypointSegmentCorridor SharedCorridor;
+	if (Group.Requests.Num() > 1 && Path.IsValid())
+	{
+		FWaypointSegmentCorridor::Build(*Path, SharedCorridor);
+	}
+
+	for (int32 i = 0; i < Group.Requests.Num(); ++i)
+	{
+		const FWaypointPathRequest& Request = Group.Requests[i].Value;
+		FNavPathSharedPtr RequestPath = Path;
+
+		if (i > 0 && Path.IsValid())
+		{
+			const UObject* Querier = Request.Requester.Get();
+			RequestPath = SharedCorridor.MakeAgentPath(Request.Start, Querier, UNavigationQueryFilter::GetQueryFilter(*NavData, Querier, Request.FilterClass));
+
+			// Partial paths have no corridor to share, and an agent off the corridor would have to walk back to where the first one stood
+			if (!RequestPath.IsValid())
+			{
+				RequestPath = WaypointPathRequestQueue::FindPath(*NavSys, *NavData, Goal->GetActorLocation(), Request);
+			}
+		}
+
+		Request.OnFinished.ExecuteIfBound(Group.Requests[i].Key, RequestPath);
+	}
+}
@@ -0,0 +1,404 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointPatrolComponent.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+
+#include "AIController.h"
+#include "BehaviorTree/BlackboardData.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/Pawn.h"
+#include "Navigation/PathFollowingComponent.h"
+#include "NavigationSystem.h"
+
+namespace WaypointSquad
+{
+	// Point a distance along the path from where the agent is on it, backwards for negative distances, and the heading of the path there
+	static FVector WalkPath(TConstArrayView<FNavPathPoint> Points, int32 SegmentIndex, const FVector& Start, FVector::FReal Distance, FVector& InOutDirection)
+	{
+		const bool bForward = Distance >= 0.;
+		FVector::FReal Remaining = FMath::Abs(Distance);
+		FVector Current = Start;
+
+		if (Points.IsValidIndex(SegmentIndex + 1))
+		{
+			const FVector SegmentDirection = (Points[SegmentIndex + 1].Location - Points[SegmentIndex].Location).GetSafeNormal2D();
+			InOutDirection = SegmentDirection.IsZero() ? InOutDirection : SegmentDirection;
+		}
+
+		for (int32 i = bForward ? SegmentIndex + 1 : SegmentIndex; Points.IsValidIndex(i); i += bForward ? 1 : -1)
+		{
+			const FVector Next = Points[i].Location;
+			const FVector::FReal Length = FVector::Dist(Current, Next);
+			const FVector Direction = (bForward ? Next - Current : Current - Next).GetSafeNormal2D();
+			InOutDirection = Direction.IsZero() ? InOutDirection : Direction;
+
+			if (Length >= Remaining)
+			{
+				return Length > 0. ? FMath::Lerp(Current, Next, Remaining / Length) : Next;
+			}
+
+			Remaining -= Length;
+			Current = Next;
+		}
+
+		// Slots past either end of the path bunch up there
+		return Current;
+	}
+}
+
+UWaypointPatrolComponent::UWaypointPatrolComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+UWaypointPatrolComponent* UWaypointPatrolComponent::FindPatrolComponent(const AController* Controller)
+{
+	if (Controller == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (UWaypointPatrolComponent* PatrolComponent = Controller->FindComponentByClass<UWaypointPatrolComponent>())
+	{
+		return PatrolComponent;
+	}
+
+	const APawn* Pawn = Controller->GetPawn();
+	return Pawn ? Pawn->FindComponentByClass<UWaypointPatrolComponent>() : nullptr;
+}
+
+void UWaypointPatrolComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (Loop.IsValid() && !CurrentHandle.IsValid())
+	{
+		SetLoop(Loop.Get(), INDEX_NONE, bReverseDirection);
+	}
+}
+
+void UWaypointPatrolComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	LeaveSquad();
+
+	// Followers carry on from the leader's point on their own
+	for (const TWeakObjectPtr<UWaypointPatrolComponent>& Follower : SquadFollowers)
+	{
+		if (Follower.IsValid())
+		{
+			Follower->SquadLeader.Reset();
+		}
+	}
+
+	SquadFollowers.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UWaypointPatrolComponent::SetLoop(AWaypointLoop* NewLoop, int32 StartIndex, bool bReverse)
+{
+	LeaveSquad();
+
+	Loop = NewLoop;
+	bReverseDirection = bReverse;
+	CurrentHandle = FWaypointHandle();
+	WaitEndTime = -1.;
+	RestoredWaitTime = 0.f;
+
+	if (NewLoop)
+	{
+		const FWaypointLoopData& LoopData = NewLoop->GetLoopData();
+		const int32 Index = LoopData.IsValidIndex(StartIndex) ? StartIndex : FindClosestIndex();
+		if (LoopData.IsValidIndex(Index))
+		{
+			CurrentHandle = LoopData.GetHandle(Index);
+		}
+	}
+
+	NotifyWaypointChanged();
+}
+
+void UWaypointPatrolComponent::SetCurrentWaypoint(AWaypoint* Waypoint)
+{
+	AWaypointLoop* NewLoop = Waypoint ? Waypoint->OwningLoop.Get() : nullptr;
+	SetLoop(NewLoop, NewLoop ? NewLoop->FindWaypoint(Waypoint) : INDEX_NONE, bReverseDirection);
+}
+
+void UWaypointPatrolComponent::SetResumePoint(const FWaypointResumePoint& ResumePoint)
+{
+	if (ResumePoint.IsValid())
+	{
+		SetLoop(ResumePoint.Loop, ResumePoint.PointIndex, ResumePoint.bReverse);
+	}
+}
+
+void UWaypointPatrolComponent::AdvanceToNextWaypoint()
+{
+	// The leader moves the whole squad on
+	const AWaypointLoop* CurrentLoop = Loop.Get();
+	if (CurrentLoop == nullptr || IsSquadFollower())
+	{
+		return;
+	}
+
+	const FWaypointLoopData& LoopData = CurrentLoop->GetLoopData();
+
+	// The current point was removed from the loop, carry on from wherever the agent is
+	int32 Index = LoopData.ResolveHandle(CurrentHandle);
+	if (Index == INDEX_NONE)
+	{
+		Index = FindClosestIndex();
+	}
+	else
+	{
+		Index = bReverseDirection ? LoopData.GetPreviousIndex(Index) : LoopData.GetNextIndex(Index);
+	}
+
+	CurrentHandle = LoopData.IsValidIndex(Index) ? LoopData.GetHandle(Index) : FWaypointHandle();
+	WaitEndTime = -1.;
+	NotifyWaypointChanged();
+}
+
+AWaypoint* UWaypointPatrolComponent::GetCurrentWaypoint() const
+{
+	const AWaypointLoop* CurrentLoop = Loop.Get();
+	return CurrentLoop ? CurrentLoop->GetWaypoint(GetCurrentIndex()) : nullptr;
+}
+
+int32 UWaypointPatrolComponent::GetCurrentIndex() const
+{
+	const AWaypointLoop* CurrentLoop = Loop.Get();
+	return CurrentLoop ? CurrentLoop->GetLoopData().ResolveHandle(CurrentHandle) : INDEX_NONE;
+}
+
+bool UWaypointPatrolComponent::GetCurrentPoint(FVector& OutLocation, FWaypointPointParams& OutParams) const
+{
+	const int32 Index = GetCurrentIndex();
+	if (Index == INDEX_NONE)
+	{
+		return false;
+	}
+
+	const FWaypointLoopData& LoopData = Loop->GetLoopData();
+	OutLocation = LoopData.GetLocation(Index);
+	OutParams = LoopData.GetParams(Index);
+	return true;
+}
+
+AActor* UWaypointPatrolComponent::GetAgent() const
+{
+	AActor* Owner = GetOwner();
+	const AController* Controller = Cast<AController>(Owner);
+	return Controller ? Controller->GetPawn() : Owner;
+}
+
+void UWaypointPatrolComponent::StartWait(float Duration)
+{
+	const UWorld* World = GetWorld();
+	WaitEndTime = World ? World->GetTimeSeconds() + Duration : -1.;
+
+	// Followers wait with their leader, saved with the same time left
+	for (const TWeakObjectPtr<UWaypointPatrolComponent>& Follower : SquadFollowers)
+	{
+		if (Follower.IsValid())
+		{
+			Follower->WaitEndTime = WaitEndTime;
+		}
+	}
+}
+
+void UWaypointPatrolComponent::EndWait()
+{
+	WaitEndTime = -1.;
+}
+
+float UWaypointPatrolComponent::GetRemainingWaitTime() const
+{
+	const UWorld* World = GetWorld();
+	if (WaitEndTime < 0. || World == nullptr)
+	{
+		return 0.f;
+	}
+
+	return FMath::Max(static_cast<float>(WaitEndTime - World->GetTimeSeconds()), 0.f);
+}
+
+void UWaypointPatrolComponent::RestorePatrol(AWaypointLoop* NewLoop, int32 PointIndex, bool bReverse, float RemainingWaitTime)
+{
+	SetLoop(NewLoop, PointIndex, bReverse);
+
+	// A wait only makes sense at the point it was saved at
+	RestoredWaitTime = CurrentHandle.IsValid() && GetCurrentIndex() == PointIndex ? RemainingWaitTime : 0.f;
+}
+
+float UWaypointPatrolComponent::ConsumeRestoredWaitTime()
+{
+	const float WaitTime = RestoredWaitTime;
+	RestoredWaitTime = 0.f;
+	return WaitTime;
+}
+
+void UWaypointPatrolComponent::JoinSquad(UWaypointPatrolComponent* Leader, FVector InFormationOffset)
+{
+	if (Leader && Leader->IsSquadFollower())
+	{
+		Leader = Leader->GetSquadLeader();
+	}
+
+	LeaveSquad();
+
+	if (Leader == nullptr || Leader == this)
+	{
+		return;
+	}
+
+	SquadLeader = Leader;
+	FormationOffset = InFormationOffset;
+	Leader->SquadFollowers.AddUnique(this);
+	SyncWithLeader();
+
+	// Squads are a single level, the followers of this agent move over to its new leader
+	TArray<TWeakObjectPtr<UWaypointPatrolComponent>> Followers = MoveTemp(SquadFollowers);
+	SquadFollowers.Reset();
+
+	for (const TWeakObjectPtr<UWaypointPatrolComponent>& Follower : Followers)
+	{
+		if (Follower.IsValid() && Follower != Leader)
+		{
+			Follower->SquadLeader = Leader;
+			Leader->SquadFollowers.AddUnique(Follower);
+			Follower->SyncWithLeader();
+		}
+	}
+}
+
+void UWaypointPatrolComponent::LeaveSquad()
+{
+	if (UWaypointPatrolComponent* Leader = SquadLeader.Get())
+	{
+		Leader->SquadFollowers.Remove(this);
+	}
+
+	SquadLeader.Reset();
+}
+
+void UWaypointPatrolComponent::SyncWithLeader()
+{
+	const UWaypointPatrolComponent* Leader = SquadLeader.Get();
+	if (Leader == nullptr)
+	{
+		return;
+	}
+
+	Loop = Leader->Loop;
+	bReverseDirection = Leader->bReverseDirection;
+	CurrentHandle = Leader->CurrentHandle;
+	WaitEndTime = Leader->WaitEndTime;
+	RestoredWaitTime = 0.f;
+
+	NotifyWaypointChanged();
+}
+
+bool UWaypointPatrolComponent::GetFormationSlot(FVector& OutLocation) const
+{
+	const UWaypointPatrolComponent* Leader = SquadLeader.Get();
+	const APawn* LeaderPawn = Leader ? Cast<APawn>(Leader->GetAgent()) : nullptr;
+	if (LeaderPawn == nullptr)
+	{
+		return false;
+	}
+
+	FVector Anchor = LeaderPawn->GetNavAgentLocation();
+	FVector Forward = LeaderPawn->GetActorForwardVector().GetSafeNormal2D();
+
+	// Slots follow the leader's path around corners instead of cutting them, the path is only walked, never found
+	const AAIController* LeaderController = Cast<AAIController>(LeaderPawn->GetController());
+	const UPathFollowingComponent* PathFollowingComp = LeaderController ? LeaderController->GetPathFollowingComponent() : nullptr;
+	const FNavigationPath* Path = PathFollowingComp && PathFollowingComp->GetStatus() != EPathFollowingStatus::Idle ? PathFollowingComp->GetPath().Get() : nullptr;
+	if (Path && Path->IsValid() && Path->GetPathPoints().Num() > 1)
+	{
+		Anchor = WaypointSquad::WalkPath(Path->GetPathPoints(), PathFollowingComp->GetCurrentPathIndex(), Anchor, FormationOffset.X, Forward);
+	}
+	else
+	{
+		Anchor += Forward * FormationOffset.X;
+	}
+
+	const FVector Right = FVector::CrossProduct(FVector::UpVector, Forward);
+	const FVector Slot = Anchor + Right * FormationOffset.Y + FVector::UpVector * FormationOffset.Z;
+
+	// Slots off the navmesh, past a wall or a ledge, fall back onto the leader's path
+	FNavLocation NavLocation;
+	const UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	OutLocation = NavSys && NavSys->ProjectPointToNavigation(Slot, NavLocation) ? NavLocation.Location : Anchor;
+	return true;
+}
+
+int32 UWaypointPatrolComponent::FindClosestIndex() const
+{
+	const AActor* Agent = GetAgent();
+
+	const AWaypointLoop* CurrentLoop = Loop.Get();
+	if (CurrentLoop == nullptr || Agent == nullptr)
+	{
+		return INDEX_NONE;
+	}
+
+	return CurrentLoop->GetLoopData().FindClosestPoint(Agent->GetActorLocation());
+}
+
+void UWaypointPatrolComponent::NotifyWaypointChanged()
+{
+	if (bSyncBlackboard)
+	{
+		SyncBlackboard();
+	}
+
+	for (int32 i = SquadFollowers.Num() - 1; i >= 0; --i)
+	{
+		if (UWaypointPatrolComponent* Follower = SquadFollowers[i].Get())
+		{
+			Follower->SyncWithLeader();
+		}
+		else
+		{
+			SquadFollowers.RemoveAtSwap(i);
+		}
+	}
+
+	OnWaypointChanged.Broadcast(this);
+}
+
+void UWaypointPatrolComponent::SyncBlackboard()
+{
+	const AActor* Owner = GetOwner();
+	const AController* Controller = Cast<AController>(Owner);
+	if (Controller == nullptr)
+	{
+		const APawn* Pawn = Cast<APawn>(Owner);
+		Controller = Pawn ? Pawn->GetController() : nullptr;
+	}
+
+	UBlackboardComponent* Blackboard = Controller ? Controller->FindComponentByClass<UBlackboardComponent>() : nullptr;
+	if (Blackboard == nullptr)
+	{
+		return;
+	}
+
+	// Resolved once per blackboard asset, the name lookup is what native patrol state is meant to avoid
+	const UBlackboardData* BlackboardAsset = Blackboard->GetBlackboardAsset();
+	if (BlackboardKeyAsset.Get() != BlackboardAsset)
+	{
+		BlackboardKeyAsset = BlackboardAsset;
+		BlackboardKeyID = Blackboard->GetKeyID(BlackboardKeyName);
+	}
+
+	if (BlackboardKeyID != FBlackboard::InvalidKey)
+	{
+		Blackboard->SetValue<UBlackboardKeyType_Object>(BlackboardKeyID, GetCurrentWaypoint());
+	}
+}
@@ -0,0 +1,322 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointPatrolSaveData.h"
+#include "WaypointLoop.h"
+#include "WaypointPatrolComponent.h"
+#include "WaypointSubsystem.h"
+#include "WaypointsModule.h"
+
+#include "Algo/Reverse.h"
+#include "Engine/World.h"
+
+namespace WaypointPatrolSaveData
+{
+	// 'WPPS', then the format version
+	static constexpr uint32 Magic = 0x53505057;
+	static constexpr uint32 Version = 1;
+
+	static constexpr uint16 NoLoop = MAX_uint16;
+
+	// The top bit of the point index is the patrol direction
+	static constexpr uint16 ReverseBit = 0x8000;
+	static constexpr int32 MaxPointIndex = ReverseBit - 1;
+
+	/** Data layout: header, the loops the agents are on, then one packed agent per component */
+	struct FHeader
+	{
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		int32 NumLoops = 0;
+		int32 NumAgents = 0;
+	};
+
+	struct FPackedLoop
+	{
+		FGuid Guid;
+
+		// What the points of the loop were when saved, agents only resume where they were if the loop is still the same
+		uint32 NumPoints;
+		uint32 LocationsHash;
+	};
+
+	struct FPackedAgent
+	{
+		uint16 Loop = NoLoop;
+		uint16 Point = 0;
+
+		// Fraction of the leg to the point already walked, over the whole uint16 range
+		uint16 Progress = 0;
+
+		// Hundredths of a second left to wait at the point, 0 while walking
+		uint16 WaitTime = 0;
+	};
+
+	static_assert(sizeof(FHeader) == 16 && sizeof(FPackedLoop) == 24 && sizeof(FPackedAgent) == FWaypointPatrolSaveData::BytesPerAgent, "Changing the packed layout needs a new version");
+
+	template <typename T>
+	static void AppendSection(TArray<uint8>& Bytes, const TArray<T>& Section)
+	{
+		Bytes.Append(reinterpret_cast<const uint8*>(Section.GetData()), Section.Num() * sizeof(T));
+	}
+
+	using FLegPath = TArray<FVector, TInlineAllocator<16>>;
+
+	/** Path of the leg to a point, from the point before it in the patrol direction */
+	static void GetLegPath(const AWaypointLoop& Loop, int32 TargetIndex, bool bReverse, FLegPath& OutPoints)
+	{
+		const FWaypointLoopData& LoopData = Loop.GetLoopData();
+		const int32 FromIndex = bReverse ? LoopData.GetNextIndex(TargetIndex) : LoopData.GetPreviousIndex(TargetIndex);
+
+		// Segments go from each point to the next, a reversed patrol walks them backwards
+		const TArray<FWaypointSegmentPath>& SegmentPaths = Loop.GetSegmentPaths();
+		const int32 SegmentIndex = bReverse ? TargetIndex : FromIndex;
+
+		if (SegmentPaths.IsValidIndex(SegmentIndex) && SegmentPaths[SegmentIndex].Points.Num() >= 2)
+		{
+			OutPoints.Append(SegmentPaths[SegmentIndex].Points);
+			if (bReverse)
+			{
+				Algo::Reverse(OutPoints);
+			}
+		}
+		else
+		{
+			OutPoints.Add(LoopData.GetLocation(FromIndex));
+			OutPoints.Add(LoopData.GetLocation(TargetIndex));
+		}
+	}
+
+	/** Fraction of the path's length that lies before the point of the path closest to the location */
+	static float ProjectOnPath(TConstArrayView<FVector> Points, const FVector& Location)
+	{
+		FVector::FReal Length = 0.;
+		FVector::FReal ClosestDistance = 0.;
+		FVector::FReal ClosestDistSq = TNumericLimits<FVector::FReal>::Max();
+
+		for (int32 i = 1; i < Points.Num(); ++i)
+		{
+			const FVector Closest = FMath::ClosestPointOnSegment(Location, Points[i - 1], Points[i]);
+			const FVector::FReal DistSq = FVector::DistSquared(Location, Closest);
+			if (DistSq < ClosestDistSq)
+			{
+				ClosestDistSq = DistSq;
+				ClosestDistance = Length + FVector::Dist(Points[i - 1], Closest);
+			}
+
+			Length += FVector::Dist(Points[i - 1], Points[i]);
+		}
+
+		return Length > UE_KINDA_SMALL_NUMBER ? static_cast<float>(ClosestDistance / Length) : 1.f;
+	}
+
+	static FVector EvaluatePath(TConstArrayView<FVector> Points, float Alpha)
+	{
+		FVector::FReal Length = 0.;
+		for (int32 i = 1; i < Points.Num(); ++i)
+		{
+			Length += FVector::Dist(Points[i - 1], Points[i]);
+		}
+
+		FVector::FReal Remaining = Length * Alpha;
+		for (int32 i = 1; i < Points.Num(); ++i)
+		{
+			const FVector::FReal SegmentLength = FVector::Dist(Points[i - 1], Points[i]);
+			if (Remaining <= SegmentLength && SegmentLength > 0.)
+			{
+				return FMath::Lerp(Points[i - 1], Points[i], Remaining / SegmentLength);
+			}
+
+			Remaining -= SegmentLength;
+		}
+
+		return Points.Last();
+	}
+}
+
+void FWaypointPatrolSaveData::Save(TConstArrayView<const UWaypointPatrolComponent*> Components, TArray<uint8>& OutData)
+{
+	using namespace WaypointPatrolSaveData;
+
+	TArray<FPackedLoop> PackedLoops;
+	TMap<const AWaypointLoop*, uint16> LoopIndices;
+
+	TArray<FPackedAgent> PackedAgents;
+	PackedAgents.SetNum(Components.Num());
+
+	FLegPath LegPath;
+	for (int32 AgentIndex = 0; AgentIndex < Components.Num(); ++AgentIndex)
+	{
+		const UWaypointPatrolComponent* Component = Components[AgentIndex];
+		const AWaypointLoop* Loop = Component ? Component->GetLoop() : nullptr;
+		const int32 PointIndex = Component ? Component->GetCurrentIndex() : INDEX_NONE;
+		if (Loop == nullptr || PointIndex == INDEX_NONE || PointIndex > MaxPointIndex)
+		{
+			continue;
+		}
+
+		const uint16* LoopIndex = LoopIndices.Find(Loop);
+		if (LoopIndex == nullptr)
+		{
+			if (PackedLoops.Num() >= NoLoop)
+			{
+				continue;
+			}
+
+			const FWaypointLoopData& LoopData = Loop->GetLoopData();
+			LoopIndex = &LoopIndices.Add(Loop, static_cast<uint16>(PackedLoops.Num()));
+			PackedLoops.Add({ Loop->GetLoopGuid(), static_cast<uint32>(LoopData.Num()), LoopData.HashLocations() });
+		}
+
+		FPackedAgent& PackedAgent = PackedAgents[AgentIndex];
+		PackedAgent.Loop = *LoopIndex;
+		PackedAgent.Point = static_cast<uint16>(PointIndex) | (Component->IsReversed() ? ReverseBit : 0);
+
+		const float WaitTime = Component->GetRemainingWaitTime();
+		if (WaitTime > 0.f)
+		{
+			// Waiting at the point means the leg to it is done
+			PackedAgent.Progress = MAX_uint16;
+			PackedAgent.WaitTime = static_cast<uint16>(FMath::Clamp(FMath::RoundToInt32(WaitTime * 100.f), 1, (int32)MAX_uint16));
+		}
+		else if (const AActor* Agent = Component->GetAgent())
+		{
+			LegPath.Reset();
+			GetLegPath(*Loop, PointIndex, Component->IsReversed(), LegPath);
+			PackedAgent.Progress = static_cast<uint16>(FMath::RoundToInt32(ProjectOnPath(LegPath, Agent->GetActorLocation()) * MAX_uint16));
+		}
+	}
+
+	FHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Header.NumLoops = PackedLoops.Num();
+	Header.NumAgents = PackedAgents.Num();
+
+	OutData.Reset(sizeof(Header) + PackedLoops.Num() * sizeof(FPackedLoop) + PackedAgents.Num() * sizeof(FPackedAgent));
+	OutData.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+	AppendSection(OutData, PackedLoops);
+	AppendSection(OutData, PackedAgents);
+}
+
+int32 FWaypointPatrolSaveData::Restore(UWorld& World, TConstArrayView<UWaypointPatrolComponent*> Components, TConstArrayView<uint8> Data, bool bRestoreAgentLocations)
+{
+	using namespace WaypointPatrolSaveData;
+
+	if (Data.Num() < (int32)sizeof(FHeader))
+	{
+		UE_LOG(LogWaypoints, Warning, TEXT("Patrol save data is %d bytes, too short to hold anything"), Data.Num());
+		return 0;
+	}
+
+	FHeader Header;
+	FMemory::Memcpy(&Header, Data.GetData(), sizeof(Header));
+
+	if (Header.Magic != Magic || Header.Version != Version || Header.NumLoops < 0 || Header.NumLoops > NoLoop || Header.NumAgents < 0
+		|| Data.Num() != int64(sizeof(FHeader)) + int64(Header.NumLoops) * sizeof(FPackedLoop) + int64(Header.NumAgents) * sizeof(FPackedAgent))
+	{
+		UE_LOG(LogWaypoints, Warning, TEXT("Patrol save data is corrupt or from another version, patrols weren't restored"));
+		return 0;
+	}
+
+	if (Header.NumAgents != Components.Num())
+	{
+		UE_LOG(LogWaypoints, Warning, TEXT("Patrol save data holds %d agents but %d were given to restore, they are matched in order"), Header.NumAgents, Components.Num());
+	}
+
+	// Read out of the data, which has no alignment guarantees
+	TArray<FPackedLoop> PackedLoops;
+	PackedLoops.SetNumUninitialized(Header.NumLoops);
+	FMemory::Memcpy(PackedLoops.GetData(), Data.GetData() + sizeof(FHeader), PackedLoops.Num() * sizeof(FPackedLoop));
+
+	TArray<FPackedAgent> PackedAgents;
+	PackedAgents.SetNumUninitialized(FMath::Min(Header.NumAgents, Components.Num()));
+	FMemory::Memcpy(PackedAgents.GetData(), Data.GetData() + sizeof(FHeader) + PackedLoops.Num() * sizeof(FPackedLoop), PackedAgents.Num() * sizeof(FPackedAgent));
+
+	// Every loop of the world is looked up once, however many agents patrol it
+	TMap<FGuid, AWaypointLoop*> LoopsByGuid;
+	if (const UWaypointSubsystem* Subsystem = UWorld::GetSubsystem<UWaypointSubsystem>(&World))
+	{
+		Subsystem->ForEachLoop([&LoopsByGuid](AWaypointLoop& Loop)
+			{
+				LoopsByGuid.Add(Loop.GetLoopGuid(), &Loop);
+			});
+	}
+
+	struct FRestoredLoop
+	{
+		AWaypointLoop* Loop = nullptr;
+		bool bUnchanged = false;
+	};
+
+	TArray<FRestoredLoop> RestoredLoops;
+	RestoredLoops.SetNum(PackedLoops.Num());
+
+	int32 NumMissingLoops = 0;
+	for (int32 LoopIndex = 0; LoopIndex < PackedLoops.Num(); ++LoopIndex)
+	{
+		const FPackedLoop& PackedLoop = PackedLoops[LoopIndex];
+		AWaypointLoop* const* Loop = LoopsByGuid.Find(PackedLoop.Guid);
+		if (Loop == nullptr)
+		{
+			++NumMissingLoops;
+			continue;
+		}
+
+		const FWaypointLoopData& LoopData = (*Loop)->GetLoopData();
+		RestoredLoops[LoopIndex].Loop = *Loop;
+		RestoredLoops[LoopIndex].bUnchanged = LoopData.Num() == PackedLoop.NumPoints && LoopData.HashLocations() == PackedLoop.LocationsHash;
+	}
+
+	if (NumMissingLoops > 0)
+	{
+		UE_LOG(LogWaypoints, Warning, TEXT("%d of the %d saved patrol loops aren't in the world anymore, their agents keep their current patrol"), NumMissingLoops, PackedLoops.Num());
+	}
+
+	int32 NumRestored = 0;
+	FLegPath LegPath;
+	for (int32 AgentIndex = 0; AgentIndex < PackedAgents.Num(); ++AgentIndex)
+	{
+		UWaypointPatrolComponent* Component = Components[AgentIndex];
+		if (Component == nullptr)
+		{
+			continue;
+		}
+
+		const FPackedAgent& PackedAgent = PackedAgents[AgentIndex];
+		if (PackedAgent.Loop == NoLoop)
+		{
+			Component->SetLoop(nullptr);
+			continue;
+		}
+
+		const FRestoredLoop& RestoredLoop = PackedAgent.Loop < RestoredLoops.Num() ? RestoredLoops[PackedAgent.Loop] : FRestoredLoop();
+		if (RestoredLoop.Loop == nullptr)
+		{
+			continue;
+		}
+
+		const bool bReverse = (PackedAgent.Point & ReverseBit) != 0;
+		const int32 PointIndex = PackedAgent.Point & ~ReverseBit;
+
+		// The points were moved or renumbered since the save, the saved index could be anywhere now
+		if (!RestoredLoop.bUnchanged)
+		{
+			Component->SetLoop(RestoredLoop.Loop, INDEX_NONE, bReverse);
+			++NumRestored;
+			continue;
+		}
+
+		Component->RestorePatrol(RestoredLoop.Loop, PointIndex, bReverse, PackedAgent.WaitTime / 100.f);
+		++NumRestored;
+
+		AActor* Agent = bRestoreAgentLocations ? Component->GetAgent() : nullptr;
+		if (Agent)
+		{
+			LegPath.Reset();
+			GetLegPath(*RestoredLoop.Loop, PointIndex, bReverse, LegPath);
+			Agent->SetActorLocation(EvaluatePath(LegPath, PackedAgent.Progress / float(MAX_uint16)), false, nullptr, ETeleportType::TeleportPhysics);
+		}
+	}
+
+	return NumRestored;
+}
@@ -0,0 +1,164 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointPatrolTaskStats.h"
+#include "WaypointsModule.h"
+
+#include "Containers/Ticker.h"
+#include "HAL/IConsoleManager.h"
+
+namespace WaypointPatrolTaskStats
+{
+	struct FTypeStats
+	{
+		// Kept up to date even when not collecting, so a benchmark sees agents that were already patrolling
+		int32 NumAgents = 0;
+		SIZE_T InstanceBytes = 0;
+
+		uint64 Cycles = 0;
+		int64 NumLegs = 0;
+		int64 NumMoveTaskLegs = 0;
+		int64 NumObjects = 0;
+		SIZE_T ObjectBytes = 0;
+
+		// Sum of the agent count over every collected frame
+		int64 AgentFrames = 0;
+	};
+
+	static FTypeStats Stats[(int32)EWaypointPatrolTaskType::Num];
+	static bool bCollecting = false;
+	static int64 NumFrames = 0;
+	static double RemainingSeconds = 0.;
+	static FTSTicker::FDelegateHandle TickerHandle;
+
+	static const TCHAR* GetTypeName(EWaypointPatrolTaskType Type)
+	{
+		return Type == EWaypointPatrolTaskType::BehaviorTree ? TEXT("Behavior Tree") : TEXT("StateTree");
+	}
+
+	static void PrintReport()
+	{
+		UE_LOG(LogWaypoints, Display, TEXT("Patrol task benchmark, %lld frames"), NumFrames);
+
+		for (int32 i = 0; i < (int32)EWaypointPatrolTaskType::Num; ++i)
+		{
+			const FTypeStats& TypeStats = Stats[i];
+			if (TypeStats.AgentFrames == 0)
+			{
+				continue;
+			}
+
+			const double AverageAgents = double(TypeStats.AgentFrames) / FMath::Max<int64>(NumFrames, 1);
+			const double TotalMs = FPlatformTime::ToMilliseconds64(TypeStats.Cycles);
+
+			UE_LOG(LogWaypoints, Display, TEXT("  %s: %.1f agents, %lld legs, %lld through a move task"), GetTypeName((EWaypointPatrolTaskType)i), AverageAgents, TypeStats.NumLegs, TypeStats.NumMoveTaskLegs);
+			UE_LOG(LogWaypoints, Display, TEXT("    CPU:    %.3fms total, %.3fus per agent per frame"), TotalMs, TotalMs * 1000. / TypeStats.AgentFrames);
+			UE_LOG(LogWaypoints, Display, TEXT("    Memory: %.0f bytes of task state per agent, %lld objects (%.0f bytes) created, %.2f objects per leg"),
+				TypeStats.NumAgents > 0 ? double(TypeStats.InstanceBytes) / TypeStats.NumAgents : 0.,
+				TypeStats.NumObjects, double(TypeStats.ObjectBytes),
+				TypeStats.NumLegs > 0 ? double(TypeStats.NumObjects) / TypeStats.NumLegs : 0.);
+		}
+	}
+
+	static bool Tick(float DeltaTime)
+	{
+		++NumFrames;
+		for (FTypeStats& TypeStats : Stats)
+		{
+			TypeStats.AgentFrames += TypeStats.NumAgents;
+		}
+
+		RemainingSeconds -= DeltaTime;
+		if (RemainingSeconds > 0.)
+		{
+			return true;
+		}
+
+		PrintReport();
+		bCollecting = false;
+		TickerHandle.Reset();
+		return false;
+	}
+
+	static void StartBenchmark(const TArray<FString>& Args)
+	{
+		if (TickerHandle.IsValid())
+		{
+			FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+		}
+
+		for (FTypeStats& TypeStats : Stats)
+		{
+			TypeStats.Cycles = 0;
+			TypeStats.NumLegs = 0;
+			TypeStats.NumMoveTaskLegs = 0;
+			TypeStats.NumObjects = 0;
+			TypeStats.ObjectBytes = 0;
+			TypeStats.AgentFrames = 0;
+		}
+
+		NumFrames = 0;
+		RemainingSeconds = Args.Num() > 0 ? FCString::Atod(*Args[0]) : 10.;
+		bCollecting = true;
+		TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&Tick));
+
+		UE_LOG(LogWaypoints, Display, TEXT("Collecting patrol task stats for %.1fs"), RemainingSeconds);
+	}
+
+	static FAutoConsoleCommand BenchmarkCommand(
+		TEXT("Waypoints.PatrolTaskBenchmark"),
+		TEXT("Measures the CPU time, task state and objects created per agent by the Behavior Tree and StateTree patrol tasks.\n")
+		TEXT("Usage: Waypoints.PatrolTaskBenchmark [Seconds=10]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&StartBenchmark));
+}
+
+int32 FWaypointPatrolTaskStats::ScopeDepth = 0;
+
+bool FWaypointPatrolTaskStats::IsCollecting()
+{
+	return WaypointPatrolTaskStats::bCollecting;
+}
+
+void FWaypointPatrolTaskStats::AddCycles(EWaypointPatrolTaskType Type, uint64 Cycles)
+{
+	WaypointPatrolTaskStats::Stats[(int32)Type].Cycles += Cycles;
+}
+
+void FWaypointPatrolTaskStats::AgentStarted(EWaypointPatrolTaskType Type, SIZE_T InstanceBytes)
+{
+	WaypointPatrolTaskStats::FTypeStats& TypeStats = WaypointPatrolTaskStats::Stats[(int32)Type];
+	++TypeStats.NumAgents;
+	TypeStats.InstanceBytes += InstanceBytes;
+}
+
+void FWaypointPatrolTaskStats::AgentStopped(EWaypointPatrolTaskType Type, SIZE_T InstanceBytes)
+{
+	WaypointPatrolTaskStats::FTypeStats& TypeStats = WaypointPatrolTaskStats::Stats[(int32)Type];
+	TypeStats.NumAgents = FMath::Max(TypeStats.NumAgents - 1, 0);
+	TypeStats.InstanceBytes -= FMath::Min(TypeStats.InstanceBytes, InstanceBytes);
+}
+
+void FWaypointPatrolTaskStats::LegFinished(EWaypointPatrolTaskType Type)
+{
+	if (IsCollecting())
+	{
+		++WaypointPatrolTaskStats::Stats[(int32)Type].NumLegs;
+	}
+}
+
+void FWaypointPatrolTaskStats::MoveTaskStarted(EWaypointPatrolTaskType Type)
+{
+	if (IsCollecting())
+	{
+		++WaypointPatrolTaskStats::Stats[(int32)Type].NumMoveTaskLegs;
+	}
+}
+
+void FWaypointPatrolTaskStats::ObjectAllocated(EWaypointPatrolTaskType Type, SIZE_T Bytes)
+{
+	if (IsCollecting())
+	{
+		WaypointPatrolTaskStats::FTypeStats& TypeStats = WaypointPatrolTaskStats::Stats[(int32)Type];
+		++TypeStats.NumObjects;
+		TypeStats.ObjectBytes += Bytes;
+	}
+}
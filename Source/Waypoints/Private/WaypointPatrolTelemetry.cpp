@@ -0,0 +1,257 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointPatrolTelemetry.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+#include "WaypointsModule.h"
+
+#include "AI/Navigation/NavigationTypes.h"
+#include "Algo/Sort.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "NavigationData.h"
+
+#include <atomic>
+
+static int32 GWaypointsPatrolTelemetryEnabled = 1;
+static FAutoConsoleVariableRef CVarWaypointsPatrolTelemetryEnabled(
+	TEXT("Waypoints.PatrolTelemetry.Enabled"),
+	GWaypointsPatrolTelemetryEnabled,
+	TEXT("Records patrol events in per thread ring buffers, see Waypoints.DumpPatrolTelemetry.\n")
+	TEXT("0: off, 1: on (default)"));
+
+namespace WaypointPatrolTelemetry
+{
+	/** Written by a single thread. Readers copy it and throw away whatever may have been overwritten while copying. */
+	struct FThreadBuffer
+	{
+		static constexpr uint64 Capacity = 8192;
+
+		FWaypointPatrolEventRecord Records[Capacity];
+		std::atomic<uint64> NumWritten{ 0 };
+		uint32 ThreadId = 0;
+	};
+
+	struct FDumpedRecord
+	{
+		FWaypointPatrolEventRecord Record;
+		uint32 ThreadId = 0;
+	};
+
+	// Buffers outlive their thread, so the events of a finished thread can still be dumped
+	static FCriticalSection BuffersLock;
+	static TArray<TUniquePtr<FThreadBuffer>> Buffers;
+	static thread_local FThreadBuffer* ThreadBuffer = nullptr;
+
+	static FThreadBuffer& GetThreadBuffer()
+	{
+		if (ThreadBuffer == nullptr)
+		{
+			TUniquePtr<FThreadBuffer> NewBuffer = MakeUnique<FThreadBuffer>();
+			NewBuffer->ThreadId = FPlatformTLS::GetCurrentThreadId();
+			ThreadBuffer = NewBuffer.Get();
+
+			FScopeLock Lock(&BuffersLock);
+			Buffers.Add(MoveTemp(NewBuffer));
+		}
+
+		return *ThreadBuffer;
+	}
+
+	static void Record(EWaypointPatrolEvent Event, uint32 AgentId, uint32 LoopId, int32 WaypointIndex)
+	{
+		FThreadBuffer& Buffer = GetThreadBuffer();
+		const uint64 Index = Buffer.NumWritten.load(std::memory_order_relaxed);
+
+		FWaypointPatrolEventRecord& Record = Buffer.Records[Index % FThreadBuffer::Capacity];
+		Record.Cycles = FPlatformTime::Cycles64();
+		Record.AgentId = AgentId;
+		Record.LoopId = LoopId;
+		Record.WaypointIndex = WaypointIndex;
+		Record.Event = Event;
+
+		Buffer.NumWritten.store(Index + 1, std::memory_order_release);
+	}
+
+	static void CopyBuffer(const FThreadBuffer& Buffer, TArray<FDumpedRecord>& OutRecords)
+	{
+		const uint64 End = Buffer.NumWritten.load(std::memory_order_acquire);
+		const uint64 Begin = End > FThreadBuffer::Capacity ? End - FThreadBuffer::Capacity : 0;
+
+		const int32 FirstCopied = OutRecords.Num();
+		for (uint64 Index = Begin; Index < End; ++Index)
+		{
+			FDumpedRecord& Dumped = OutRecords.AddDefaulted_GetRef();
+			Dumped.Record = Buffer.Records[Index % FThreadBuffer::Capacity];
+			Dumped.ThreadId = Buffer.ThreadId;
+		}
+
+		// The writer kept going while we copied, the oldest records, and the one being written, may be torn
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64 EndAfterCopy = Buffer.NumWritten.load(std::memory_order_relaxed);
+		const uint64 FirstIntact = EndAfterCopy >= FThreadBuffer::Capacity ? EndAfterCopy - FThreadBuffer::Capacity + 1 : 0;
+		if (FirstIntact > Begin)
+		{
+			const int32 NumTorn = (int32)FMath::Min(FirstIntact - Begin, End - Begin);
+			OutRecords.RemoveAt(FirstCopied, NumTorn, false);
+		}
+	}
+
+	static const TCHAR* GetEventName(EWaypointPatrolEvent Event)
+	{
+		switch (Event)
+		{
+		case EWaypointPatrolEvent::Arrive: return TEXT("Arrive");
+		case EWaypointPatrolEvent::Depart: return TEXT("Depart");
+		case EWaypointPatrolEvent::WaitStart: return TEXT("WaitStart");
+		case EWaypointPatrolEvent::WaitEnd: return TEXT("WaitEnd");
+		case EWaypointPatrolEvent::PathFailed: return TEXT("PathFailed");
+		case EWaypointPatrolEvent::Repath: return TEXT("Repath");
+		default: return TEXT("Unknown");
+		}
+	}
+
+	static bool WriteCsv(const FString& Filename, const TArray<FDumpedRecord>& Records)
+	{
+		const uint64 FirstCycles = Records.Num() > 0 ? Records[0].Record.Cycles : 0;
+
+		FString Csv = TEXT("Seconds,Thread,Event,Agent,Loop,Waypoint\n");
+		Csv.Reserve(Records.Num() * 48);
+		for (const FDumpedRecord& Dumped : Records)
+		{
+			const FWaypointPatrolEventRecord& Record = Dumped.Record;
+			Csv += FString::Printf(TEXT("%.6f,%u,%s,%u,%u,%d\n"),
+				FPlatformTime::ToSeconds64(Record.Cycles - FirstCycles), Dumped.ThreadId, GetEventName(Record.Event), Record.AgentId, Record.LoopId, Record.WaypointIndex);
+		}
+
+		return FFileHelper::SaveStringToFile(Csv, *Filename);
+	}
+
+	static bool WriteBinary(const FString& Filename, TArray<FDumpedRecord>& Records)
+	{
+		TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileWriter(*Filename));
+		if (!Ar)
+		{
+			return false;
+		}
+
+		// 'WPTL', then the format version
+		uint32 Magic = 0x4C545057;
+		uint32 Version = 1;
+		double SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+		int32 NumRecords = Records.Num();
+		*Ar << Magic << Version << SecondsPerCycle << NumRecords;
+
+		for (FDumpedRecord& Dumped : Records)
+		{
+			FWaypointPatrolEventRecord& Record = Dumped.Record;
+			uint8 Event = (uint8)Record.Event;
+			*Ar << Record.Cycles << Dumped.ThreadId << Record.AgentId << Record.LoopId << Record.WaypointIndex << Event;
+		}
+
+		return Ar->Close();
+	}
+
+	static void DumpCommand(const TArray<FString>& Args)
+	{
+		const bool bBinary = Args.Num() > 1 && Args[1].Equals(TEXT("bin"), ESearchCase::IgnoreCase);
+
+		FString Filename = Args.Num() > 0 ? Args[0] : FString();
+		if (Filename.IsEmpty() || Filename.Equals(TEXT("-")))
+		{
+			Filename = FPaths::Combine(FPaths::ProjectLogDir(), FString::Printf(TEXT("PatrolTelemetry-%s.%s"), *FDateTime::Now().ToString(), bBinary ? TEXT("bin") : TEXT("csv")));
+		}
+
+		if (FWaypointPatrolTelemetry::Dump(Filename, bBinary))
+		{
+			UE_LOG(LogWaypoints, Display, TEXT("Patrol telemetry written to %s"), *FPaths::ConvertRelativePathToFull(Filename));
+		}
+		else
+		{
+			UE_LOG(LogWaypoints, Warning, TEXT("Couldn't write patrol telemetry to %s"), *Filename);
+		}
+	}
+
+	static FAutoConsoleCommand DumpTelemetryCommand(
+		TEXT("Waypoints.DumpPatrolTelemetry"),
+		TEXT("Writes the most recent patrol events of every thread to a file, oldest first.\n")
+		TEXT("Usage: Waypoints.DumpPatrolTelemetry [Filename|-] [csv|bin]. Defaults to a CSV file in the log folder."),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&DumpCommand));
+
+	static void GetIds(const UObject* Agent, const AWaypoint* Waypoint, uint32& OutAgentId, uint32& OutLoopId, int32& OutWaypointIndex)
+	{
+		const AWaypointLoop* Loop = Waypoint ? Waypoint->OwningLoop.Get() : nullptr;
+		OutAgentId = Agent ? Agent->GetUniqueID() : 0;
+		OutLoopId = Loop ? Loop->GetUniqueID() : 0;
+		OutWaypointIndex = Loop ? Loop->FindWaypoint(Waypoint) : INDEX_NONE;
+	}
+}
+
+bool FWaypointPatrolTelemetry::IsEnabled()
+{
+	return GWaypointsPatrolTelemetryEnabled != 0;
+}
+
+void FWaypointPatrolTelemetry::Record(EWaypointPatrolEvent Event, const UObject* Agent, const AWaypoint* Waypoint)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	uint32 AgentId, LoopId;
+	int32 WaypointIndex;
+	WaypointPatrolTelemetry::GetIds(Agent, Waypoint, AgentId, LoopId, WaypointIndex);
+	WaypointPatrolTelemetry::Record(Event, AgentId, LoopId, WaypointIndex);
+}
+
+void FWaypointPatrolTelemetry::ObservePath(FNavigationPath& Path, const UObject* Agent, const AWaypoint* Waypoint)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	// Ids are resolved now, the observer may fire after the agent or the waypoint are gone
+	uint32 AgentId, LoopId;
+	int32 WaypointIndex;
+	WaypointPatrolTelemetry::GetIds(Agent, Waypoint, AgentId, LoopId, WaypointIndex);
+
+	Path.AddObserver(FNavigationPath::FPathObserverDelegate::FDelegate::CreateLambda([AgentId, LoopId, WaypointIndex](FNavigationPath* UpdatedPath, ENavPathEvent::Type PathEvent)
+		{
+			if (!IsEnabled())
+			{
+				return;
+			}
+
+			if (PathEvent == ENavPathEvent::UpdatedDueToGoalMoved || PathEvent == ENavPathEvent::UpdatedDueToNavigationChanged)
+			{
+				WaypointPatrolTelemetry::Record(EWaypointPatrolEvent::Repath, AgentId, LoopId, WaypointIndex);
+			}
+			else if (PathEvent == ENavPathEvent::RePathFailed)
+			{
+				WaypointPatrolTelemetry::Record(EWaypointPatrolEvent::PathFailed, AgentId, LoopId, WaypointIndex);
+			}
+		}));
+}
+
+bool FWaypointPatrolTelemetry::Dump(const FString& Filename, bool bBinary)
+{
+	TArray<WaypointPatrolTelemetry::FDumpedRecord> Records;
+	{
+		FScopeLock Lock(&WaypointPatrolTelemetry::BuffersLock);
+		Records.Reserve(WaypointPatrolTelemetry::Buffers.Num() * WaypointPatrolTelemetry::FThreadBuffer::Capacity);
+
+		for (const TUniquePtr<WaypointPatrolTelemetry::FThreadBuffer>& Buffer : WaypointPatrolTelemetry::Buffers)
+		{
+			WaypointPatrolTelemetry::CopyBuffer(*Buffer, Records);
+		}
+	}
+
+	Algo::SortBy(Records, [](const WaypointPatrolTelemetry::FDumpedRecord& Dumped) { return Dumped.Record.Cycles; });
+
+	return bBinary ? WaypointPatrolTelemetry::WriteBinary(Filename, Records) : WaypointPatrolTelemetry::WriteCsv(Filename, Records);
+}
@@ -0,0 +1,368 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointRouteOptimizer.h"
+
+#include "Algo/Reverse.h"
+#include "NavigationData.h"
+#include "WaypointSubsystem.h"
+
+namespace WaypointRouteOptimizer
+{
+	// Added to the straight line length of a pair without a path, so the route only uses it if nothing else works
+	static constexpr float UnreachableCost = 1.e7f;
+
+	// Moves have to gain at least this much, so rounding errors can't make the search go back and forth
+	static constexpr double MinGain = 0.01;
+
+	// Longest run of consecutive points Or-opt moves at once
+	static constexpr int32 MaxChainLength = 3;
+
+	/** Loop order being optimized. Pinned positions never change, so the pin lookup is built once. */
+	struct FRoute
+	{
+		FRoute(TConstArrayView<float> InCosts, int32 InNumPoints, TConstArrayView<int32> PinnedIndices)
+			: Costs(InCosts)
+			, NumPoints(InNumPoints)
+		{
+			Order.SetNumUninitialized(NumPoints);
+			for (int32 i = 0; i < NumPoints; ++i)
+			{
+				Order[i] = i;
+			}
+
+			TBitArray<> Pinned(false, NumPoints);
+			for (const int32 PinnedIndex : PinnedIndices)
+			{
+				if (PinnedIndex >= 0 && PinnedIndex < NumPoints)
+				{
+					Pinned[PinnedIndex] = true;
+					bHasPins = true;
+				}
+			}
+
+			NextPin.SetNumUninitialized(NumPoints + 1);
+			NextPin[NumPoints] = NumPoints;
+			for (int32 i = NumPoints - 1; i >= 0; --i)
+			{
+				NextPin[i] = Pinned[i] ? i : NextPin[i + 1];
+			}
+		}
+
+		double Cost(int32 From, int32 To) const { return Costs[From * NumPoints + To]; }
+
+		/** Cost of the edge leaving a position */
+		double EdgeCost(int32 Position) const { return Cost(Order[Position], Order[(Position + 1) % NumPoints]); }
+
+		/** Whether a pinned position lies between the two positions, both included */
+		bool HasPinBetween(int32 First, int32 Last) const { return First <= Last && NextPin[First] <= Last; }
+		bool IsPinned(int32 Position) const { return NextPin[Position] == Position; }
+
+		double GetLength() const { return FWaypointRouteOptimizer::GetLoopLength(Costs, Order); }
+
+		TConstArrayView<float> Costs;
+		int32 NumPoints;
+		TArray<int32> Order;
+		TArray<int32> NextPin;
+		bool bHasPins = false;
+	};
+
+	/** Reverses runs of points to uncross the route */
+	static bool TwoOptPass(FRoute& Route, double Deadline)
+	{
+		TArray<int32>& Order = Route.Order;
+		const int32 NumPoints = Route.NumPoints;
+		bool bImproved = false;
+
+		for (int32 i = 0; i < NumPoints - 2 && FPlatformTime::Seconds() < Deadline; ++i)
+		{
+			// Reversing i + 1 to j replaces the edges (i, i + 1) and (j, j + 1) with (i, j) and (i + 1, j + 1)
+			for (int32 j = i + 2; j < NumPoints; ++j)
+			{
+				// Every longer run would contain the pin too
+				if (Route.HasPinBetween(i + 1, j))
+				{
+					break;
+				}
+
+				// Both edges are the same one
+				if (i == 0 && j == NumPoints - 1)
+				{
+					continue;
+				}
+
+				const int32 A = Order[i];
+				const int32 B = Order[i + 1];
+				const int32 C = Order[j];
+				const int32 D = Order[(j + 1) % NumPoints];
+
+				const double Delta = Route.Cost(A, C) + Route.Cost(B, D) - Route.Cost(A, B) - Route.Cost(C, D);
+				if (Delta < -MinGain)
+				{
+					Algo::Reverse(Order.GetData() + i + 1, j - i);
+					bImproved = true;
+				}
+			}
+		}
+
+		return bImproved;
+	}
+
+	/** Moves short runs of points, possibly reversed, to where they fit best */
+	static bool OrOptPass(FRoute& Route, double Deadline)
+	{
+		TArray<int32>& Order = Route.Order;
+		const int32 NumPoints = Route.NumPoints;
+		bool bImproved = false;
+
+		for (int32 ChainLength = 1; ChainLength <= MaxChainLength && NumPoints - ChainLength >= 2; ++ChainLength)
+		{
+			for (int32 Start = 0; Start + ChainLength <= NumPoints && FPlatformTime::Seconds() < Deadline; ++Start)
+			{
+				const int32 End = Start + ChainLength - 1;
+				if (Route.HasPinBetween(Start, End))
+				{
+					continue;
+				}
+
+				const int32 First = Order[Start];
+				const int32 Last = Order[End];
+				const int32 Prev = Order[(Start + NumPoints - 1) % NumPoints];
+				const int32 Next = Order[(End + 1) % NumPoints];
+				const double RemoveGain = Route.Cost(Prev, First) + Route.Cost(Last, Next) - Route.Cost(Prev, Next);
+
+				// Inserting between P and P + 1 shifts every point between the chain and P, none of them can be pinned
+				for (int32 P = 0; P < NumPoints - 1; ++P)
+				{
+					if (P >= Start - 1 && P <= End)
+					{
+						continue;
+					}
+
+					if (P > End ? Route.HasPinBetween(End + 1, P) : Route.HasPinBetween(P + 1, Start - 1))
+					{
+						continue;
+					}
+
+					const int32 A = Order[P];
+					const int32 B = Order[P + 1];
+					const double ForwardCost = Route.Cost(A, First) + Route.Cost(Last, B);
+					const double ReversedCost = Route.Cost(A, Last) + Route.Cost(First, B);
+					const double Delta = FMath::Min(ForwardCost, ReversedCost) - Route.Cost(A, B) - RemoveGain;
+					if (Delta >= -MinGain)
+					{
+						continue;
+					}
+
+					TArray<int32, TInlineAllocator<MaxChainLength>> Chain(Order.GetData() + Start, ChainLength);
+					if (ReversedCost < ForwardCost)
+					{
+						Algo::Reverse(Chain);
+					}
+
+					Order.RemoveAt(Start, ChainLength, false);
+					Order.Insert(Chain.GetData(), ChainLength, P > End ? P - ChainLength + 1 : P + 1);
+					bImproved = true;
+					break;
+				}
+			}
+		}
+
+		return bImproved;
+	}
+
+	/** Swaps two points, the only move that can carry a point past a pin */
+	static bool SwapPass(FRoute& Route, double Deadline)
+	{
+		TArray<int32>& Order = Route.Order;
+		const int32 NumPoints = Route.NumPoints;
+		bool bImproved = false;
+
+		auto GetEdgesCost = [&Route, NumPoints](int32 I, int32 J)
+		{
+			int32 Edges[4] = { (I + NumPoints - 1) % NumPoints, I, (J + NumPoints - 1) % NumPoints, J };
+			double EdgesCost = 0.;
+			for (int32 EdgeIndex = 0; EdgeIndex < 4; ++EdgeIndex)
+			{
+				// Neighbouring points share an edge, it's only counted once
+				bool bCounted = false;
+				for (int32 Other = 0; Other < EdgeIndex; ++Other)
+				{
+					bCounted |= Edges[Other] == Edges[EdgeIndex];
+				}
+
+				EdgesCost += bCounted ? 0. : Route.EdgeCost(Edges[EdgeIndex]);
+			}
+
+			return EdgesCost;
+		};
+
+		for (int32 I = 0; I < NumPoints - 1 && FPlatformTime::Seconds() < Deadline; ++I)
+		{
+			if (Route.IsPinned(I))
+			{
+				continue;
+			}
+
+			for (int32 J = I + 1; J < NumPoints; ++J)
+			{
+				if (Route.IsPinned(J))
+				{
+					continue;
+				}
+
+				const double Before = GetEdgesCost(I, J);
+				Swap(Order[I], Order[J]);
+
+				if (GetEdgesCost(I, J) < Before - MinGain)
+				{
+					bImproved = true;
+				}
+				else
+				{
+					Swap(Order[I], Order[J]);
+				}
+			}
+		}
+
+		return bImproved;
+	}
+
+	/** Greedy route from the first point, a much better start than a designer's placement order when nothing is pinned */
+	static void BuildNearestNeighbourOrder(const FRoute& Route, TArray<int32>& OutOrder)
+	{
+		const int32 NumPoints = Route.NumPoints;
+		TBitArray<> Visited(false, NumPoints);
+
+		OutOrder.Reset(NumPoints);
+		OutOrder.Add(0);
+		Visited[0] = true;
+
+		while (OutOrder.Num() < NumPoints)
+		{
+			const int32 Current = OutOrder.Last();
+			int32 Closest = INDEX_NONE;
+			for (int32 Candidate = 0; Candidate < NumPoints; ++Candidate)
+			{
+				if (!Visited[Candidate] && (Closest == INDEX_NONE || Route.Cost(Current, Candidate) < Route.Cost(Current, Closest)))
+				{
+					Closest = Candidate;
+				}
+			}
+
+			OutOrder.Add(Closest);
+			Visited[Closest] = true;
+		}
+	}
+}
+
+bool FWaypointRouteOptimizer::GetCostQueries(TConstArrayView<FVector> Locations, const FWaypointNavAgentInfoPtr& NavAgent, TArray<FWaypointSegmentQuery>& OutQueries)
+{
+	OutQueries.Reset();
+
+	if (!NavAgent.IsValid() || NavAgent->NavData.Get() == nullptr)
+	{
+		return false;
+	}
+
+	// Only the pairs after each point are queried, the segment index is the pair's place in the matrix
+	const int32 NumPoints = Locations.Num();
+	OutQueries.Reserve(NumPoints * (NumPoints - 1) / 2);
+	for (int32 Row = 0; Row < NumPoints; ++Row)
+	{
+		for (int32 Column = Row + 1; Column < NumPoints; ++Column)
+		{
+			FWaypointSegmentQuery& Query = OutQueries.AddDefaulted_GetRef();
+			Query.SegmentIndex = Row * NumPoints + Column;
+			Query.Start = Locations[Row];
+			Query.End = Locations[Column];
+			Query.NavAgent = NavAgent;
+		}
+	}
+
+	return true;
+}
+
+void FWaypointRouteOptimizer::BuildCostMatrix(TConstArrayView<FVector> Locations, TConstArrayView<FWaypointSegmentQuery> Queries, TConstArrayView<FWaypointSegmentPathResult> Results, TArray<float>& OutCosts)
+{
+	const int32 NumPoints = Locations.Num();
+	OutCosts.Reset();
+	OutCosts.SetNumZeroed(NumPoints * NumPoints);
+
+	for (int32 QueryIndex = 0; QueryIndex < Queries.Num(); ++QueryIndex)
+	{
+		const int32 Row = Queries[QueryIndex].SegmentIndex / NumPoints;
+		const int32 Column = Queries[QueryIndex].SegmentIndex % NumPoints;
+		const FWaypointSegmentPathResult& Result = Results[QueryIndex];
+
+		const float Cost = Result.bSuccess
+			? float(Result.Length)
+			: WaypointRouteOptimizer::UnreachableCost + float(FVector::Dist(Locations[Row], Locations[Column]));
+
+		OutCosts[Row * NumPoints + Column] = Cost;
+		OutCosts[Column * NumPoints + Row] = Cost;
+	}
+}
+
+void FWaypointRouteOptimizer::Optimize(TConstArrayView<float> Costs, int32 NumPoints, const FWaypointRouteOptimizationParams& Params, FWaypointRouteOptimizationResult& OutResult)
+{
+	using namespace WaypointRouteOptimizer;
+
+	OutResult = FWaypointRouteOptimizationResult();
+	if (NumPoints < 1 || Costs.Num() != NumPoints * NumPoints)
+	{
+		return;
+	}
+
+	FRoute Route(Costs, NumPoints, Params.PinnedIndices);
+	OutResult.OriginalLength = Route.GetLength();
+
+	if (!Route.bHasPins && NumPoints > 3)
+	{
+		TArray<int32> GreedyOrder;
+		BuildNearestNeighbourOrder(Route, GreedyOrder);
+		if (GetLoopLength(Costs, GreedyOrder) < OutResult.OriginalLength)
+		{
+			Route.Order = MoveTemp(GreedyOrder);
+		}
+	}
+
+	// Every pass is run until none of them finds anything left to improve
+	const double Deadline = FPlatformTime::Seconds() + Params.MaxSeconds;
+	bool bImproved = NumPoints > 3;
+	while (bImproved && FPlatformTime::Seconds() < Deadline)
+	{
+		bImproved = TwoOptPass(Route, Deadline);
+		bImproved |= OrOptPass(Route, Deadline);
+		bImproved |= SwapPass(Route, Deadline);
+	}
+
+	// A loop has no start, but the first point staying first is less surprising in the editor
+	if (!Route.bHasPins)
+	{
+		const int32 FirstPosition = Route.Order.Find(0);
+		TArray<int32> Rotated;
+		Rotated.Reserve(NumPoints);
+		for (int32 i = 0; i < NumPoints; ++i)
+		{
+			Rotated.Add(Route.Order[(FirstPosition + i) % NumPoints]);
+		}
+		Route.Order = MoveTemp(Rotated);
+	}
+
+	OutResult.OptimizedLength = Route.GetLength();
+	OutResult.Order = MoveTemp(Route.Order);
+	OutResult.bSuccess = true;
+}
+
+double FWaypointRouteOptimizer::GetLoopLength(TConstArrayView<float> Costs, TConstArrayView<int32> Order)
+{
+	const int32 NumPoints = Order.Num();
+
+	double Length = 0.;
+	for (int32 i = 0; i < NumPoints; ++i)
+	{
+		Length += Costs[Order[i] * NumPoints + Order[(i + 1) % NumPoints]];
+	}
+
+	return Length;
+}
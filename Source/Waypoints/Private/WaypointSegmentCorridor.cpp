@@ -0,0 +1,140 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointSegmentCorridor.h"
+
+#include "HAL/IConsoleManager.h"
+#include "NavigationData.h"
+#include "NavMesh/NavMeshPath.h"
+#include "NavMesh/RecastNavMesh.h"
+
+#if WITH_RECAST
+#include "Detour/DetourNavMesh.h"
+#endif // WITH_RECAST
+
+static int32 GWaypointsSharedCorridorsEnabled = 1;
+static FAutoConsoleVariableRef CVarWaypointsSharedCorridorsEnabled(
+	TEXT("Waypoints.SharedCorridors.Enabled"),
+	GWaypointsSharedCorridorsEnabled,
+	TEXT("Patrolling agents follow the corridor their loop found once for each leg instead of finding their own path.\n")
+	TEXT("0: off, 1: on (default)"));
+
+bool FWaypointSegmentCorridor::IsEnabled()
+{
+	return GWaypointsSharedCorridorsEnabled != 0;
+}
+
+bool FWaypointSegmentCorridor::Build(const FNavigationPath& Path, FWaypointSegmentCorridor& OutCorridor)
+{
+	OutCorridor.Reset();
+
+	const ANavigationData* PathNavData = Path.GetNavigationDataUsed();
+	const FNavMeshPath* NavMeshPath = Path.CastPath<FNavMeshPath>();
+	if (PathNavData == nullptr || NavMeshPath == nullptr || !Path.IsValid() || Path.IsPartial() || NavMeshPath->PathCorridor.Num() == 0 || Path.GetPathPoints().Num() < 2)
+	{
+		return false;
+	}
+
+	OutCorridor.NavData = PathNavData;
+	OutCorridor.Polys = NavMeshPath->PathCorridor;
+	OutCorridor.Points = NavMeshPath->GetPathPoints();
+	OutCorridor.PointPolyIndices.Reserve(OutCorridor.Points.Num());
+
+	// Points are found along the corridor in order, each on the same polygon as the previous one or further
+	int32 PolyIndex = 0;
+	for (const FNavPathPoint& Point : OutCorridor.Points)
+	{
+		const int32 Found = OutCorridor.Polys.Find(Point.NodeRef);
+		PolyIndex = Found != INDEX_NONE ? FMath::Max(PolyIndex, Found) : PolyIndex;
+		OutCorridor.PointPolyIndices.Add(PolyIndex);
+	}
+
+	return true;
+}
+
+void FWaypointSegmentCorridor::Reset()
+{
+	NavData.Reset();
+	Polys.Reset();
+	Points.Reset();
+	PointPolyIndices.Reset();
+	LoopRevision = 0;
+	RequestedRevision = 0;
+	bRequested = false;
+}
+
+bool FWaypointSegmentCorridor::IsValid() const
+{
+	if (IsEmpty() || !NavData.IsValid())
+	{
+		return false;
+	}
+
+#if WITH_RECAST
+	const ARecastNavMesh* NavMesh = Cast<ARecastNavMesh>(NavData.Get());
+	const dtNavMesh* DetourMesh = NavMesh ? NavMesh->GetRecastMesh() : nullptr;
+	if (DetourMesh == nullptr)
+	{
+		return false;
+	}
+
+	for (const NavNodeRef Poly : Polys)
+	{
+		if (!DetourMesh->isValidPolyRef(Poly))
+		{
+			return false;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif // WITH_RECAST
+}
+
+FNavPathSharedPtr FWaypointSegmentCorridor::MakeAgentPath(const FVector& AgentLocation, const UObject* Querier, FSharedConstNavQueryFilter Filter) const
+{
+	const ANavigationData* CorridorNavData = NavData.Get();
+	if (CorridorNavData == nullptr || IsEmpty())
+	{
+		return nullptr;
+	}
+
+	FNavLocation AgentNavLocation;
+	if (!CorridorNavData->ProjectPoint(AgentLocation, AgentNavLocation, CorridorNavData->GetDefaultQueryExtent()))
+	{
+		return nullptr;
+	}
+
+	const int32 StartPoly = Polys.Find(AgentNavLocation.NodeRef);
+	if (StartPoly == INDEX_NONE)
+	{
+		return nullptr;
+	}
+
+	// Made by the nav data like any found path, so it's registered with it and repathed from its query when the tiles under it change
+	const FPathFindingQueryData QueryData(Querier, AgentNavLocation.Location, Points.Last().Location, Filter.IsValid() ? Filter : CorridorNavData->GetDefaultQueryFilter());
+	FNavPathSharedPtr NavPath = CorridorNavData->CreatePathInstance<FNavMeshPath>(QueryData);
+	FNavMeshPath* Path = NavPath.IsValid() ? NavPath->CastPath<FNavMeshPath>() : nullptr;
+	if (Path == nullptr)
+	{
+		return nullptr;
+	}
+
+	Path->PathCorridor.Append(&Polys[StartPoly], Polys.Num() - StartPoly);
+
+	// The agent is somewhere on its polygon, the path goes from there to the first point further down the corridor
+	TArray<FNavPathPoint>& PathPoints = Path->GetPathPoints();
+	PathPoints.Reserve(Points.Num() + 1);
+	PathPoints.Add(FNavPathPoint(AgentNavLocation.Location, AgentNavLocation.NodeRef));
+
+	for (int32 i = 1; i < Points.Num(); ++i)
+	{
+		if (PointPolyIndices[i] > StartPoly || i == Points.Num() - 1)
+		{
+			PathPoints.Add(Points[i]);
+		}
+	}
+
+	Path->MarkReady();
+	return NavPath;
+}
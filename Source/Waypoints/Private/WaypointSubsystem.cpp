@@ -0,0 +1,923 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointSubsystem.h"
+
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+#include "WaypointPatrolComponent.h"
+#include "WaypointsModule.h"
+
+#include "AIController.h"
+#include "Algo/Sort.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "GameFramework/Character.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Crc.h"
+#include "NavFilters/NavigationQueryFilter.h"
+#include "NavigationData.h"
+#include "NavigationSystem.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "Tasks/Task.h"
+#include "UObject/UObjectGlobals.h"
+
+#include <atomic>
+
+// Counted for the editor benchmarks, queries run on any thread
+static std::atomic<uint64> NumSegmentPathQueries{ 0 };
+
+static float GWaypointsOccupancyUpdateInterval = 0.f;
+static FAutoConsoleVariableRef CVarWaypointsOccupancyUpdateInterval(
+	TEXT("Waypoints.Occupancy.UpdateInterval"),
+	GWaypointsOccupancyUpdateInterval,
+	TEXT("Seconds between checks for loop changes that rebuild the patrol occupancy field in the background, once it has been built.\n")
+	TEXT("0: only rebuilt when asked (default)"));
+
+static int32 GWaypointsAsyncPathBatchSize = 256;
+static FAutoConsoleVariableRef CVarWaypointsAsyncPathBatchSize(
+	TEXT("Waypoints.AsyncPaths.BatchSize"),
+	GWaypointsAsyncPathBatchSize,
+	TEXT("Segment path queries handed to the navigation system's async pathfinding at once, per request. The rest wait for the batch to finish."));
+
+namespace WaypointSubsystem
+{
+	/** Queries of one FindSegmentPathsAsync call, only touched on the game thread */
+	struct FAsyncPathBatch
+	{
+		TArray<FWaypointSegmentQuery> Queries;
+		TArray<FWaypointSegmentPathResult> Results;
+		FOnWaypointSegmentPathsFound OnFound;
+		int32 NextQuery = 0;
+		int32 NumPending = 0;
+	};
+
+	static void IssueAsyncPathQueries(const TWeakObjectPtr<UNavigationSystemV1>& WeakNavSys, const TSharedRef<FAsyncPathBatch>& Batch)
+	{
+		UNavigationSystemV1* NavSys = WeakNavSys.Get();
+		const int32 BatchSize = FMath::Max(GWaypointsAsyncPathBatchSize, 1);
+
+		// Queries that can't be issued fail right away, keep going until some are in flight
+		while (Batch->NumPending == 0 && Batch->NextQuery < Batch->Queries.Num())
+		{
+			const int32 EndQuery = FMath::Min(Batch->NextQuery + BatchSize, Batch->Queries.Num());
+			for (; Batch->NextQuery < EndQuery; ++Batch->NextQuery)
+			{
+				const int32 QueryIndex = Batch->NextQuery;
+				const FWaypointSegmentQuery& Query = Batch->Queries[QueryIndex];
+				const ANavigationData* NavData = Query.NavAgent.IsValid() ? Query.NavAgent->NavData.Get() : nullptr;
+				if (NavSys == nullptr || NavData == nullptr)
+				{
+					continue;
+				}
+
+				NumSegmentPathQueries.fetch_add(1, std::memory_order_relaxed);
+
+				FPathFindingQuery PathQuery(nullptr, *NavData, Query.Start, Query.End, Query.Filter.IsValid() ? Query.Filter : NavData->GetDefaultQueryFilter());
+				PathQuery.SetNavAgentProperties(Query.NavAgent->AgentProperties);
+				PathQuery.SetAllowPartialPaths(!Query.bRequireCompletePath);
+
+				++Batch->NumPending;
+				NavSys->FindPathAsync(Query.NavAgent->AgentProperties, PathQuery, FNavPathQueryDelegate::CreateLambda(
+					[WeakNavSys, Batch, QueryIndex](uint32 QueryId, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path)
+					{
+						FWaypointSegmentPathResult& PathResult = Batch->Results[QueryIndex];
+						if (Result == ENavigationQueryResult::Success && Path.IsValid() && !(Batch->Queries[QueryIndex].bRequireCompletePath && Path->IsPartial()))
+						{
+							const TArray<FNavPathPoint>& PathPoints = Path->GetPathPoints();
+							PathResult.Points.Reserve(PathPoints.Num());
+							for (const FNavPathPoint& PathPoint : PathPoints)
+							{
+								PathResult.Points.Add(PathPoint.Location);
+							}
+
+							PathResult.Length = Path->GetLength();
+							PathResult.Cost = Path->GetCost();
+							PathResult.bSuccess = true;
+							PathResult.Path = Path;
+						}
+
+						if (--Batch->NumPending == 0)
+						{
+							IssueAsyncPathQueries(WeakNavSys, Batch);
+						}
+					}));
+			}
+		}
+
+		if (Batch->NumPending == 0 && Batch->NextQuery >= Batch->Queries.Num())
+		{
+			Batch->OnFound.ExecuteIfBound(Batch->Queries, Batch->Results);
+		}
+	}
+}
+
+#if WITH_RECAST
+#include "Detour/DetourNavMesh.h"
+#include "NavMesh/RecastHelpers.h"
+
+/** Hashes the polygons of every tile under the area, leaving out the links Detour builds at runtime */
+static uint32 HashNavMeshTiles(const ARecastNavMesh& NavMesh, const FBox& Area, uint32 Hash)
+{
+	const dtNavMesh* DetourMesh = NavMesh.GetRecastMesh();
+	if (DetourMesh == nullptr || !Area.IsValid)
+	{
+		return Hash;
+	}
+
+	const FVector RecastMin = Unreal2RecastPoint(Area.Min);
+	const FVector RecastMax = Unreal2RecastPoint(Area.Max);
+	const dtReal MinPos[3] = { RecastMin.X, RecastMin.Y, RecastMin.Z };
+	const dtReal MaxPos[3] = { RecastMax.X, RecastMax.Y, RecastMax.Z };
+
+	// Recast flips the axes, so the corners don't map to min and max tile coordinates
+	int32 TileX[2], TileY[2];
+	DetourMesh->calcTileLoc(MinPos, &TileX[0], &TileY[0]);
+	DetourMesh->calcTileLoc(MaxPos, &TileX[1], &TileY[1]);
+
+	static constexpr int32 MaxLayers = 32;
+	const dtMeshTile* Tiles[MaxLayers];
+
+	for (int32 Y = FMath::Min(TileY[0], TileY[1]); Y <= FMath::Max(TileY[0], TileY[1]); ++Y)
+	{
+		for (int32 X = FMath::Min(TileX[0], TileX[1]); X <= FMath::Max(TileX[0], TileX[1]); ++X)
+		{
+			const int32 NumTiles = DetourMesh->getTilesAt(X, Y, Tiles, MaxLayers);
+
+			// The order layers are returned in depends on the order they were added
+			Algo::Sort(MakeArrayView(Tiles, NumTiles), [](const dtMeshTile* A, const dtMeshTile* B)
+				{
+					return (A->header ? A->header->layer : 0) < (B->header ? B->header->layer : 0);
+				});
+
+			Hash = HashCombine(Hash, ::GetTypeHash(NumTiles));
+			for (int32 TileIndex = 0; TileIndex < NumTiles; ++TileIndex)
+			{
+				const dtMeshTile* Tile = Tiles[TileIndex];
+				if (Tile->header == nullptr)
+				{
+					continue;
+				}
+
+				Hash = FCrc::MemCrc32(Tile->verts, sizeof(dtReal) * 3 * Tile->header->vertCount, Hash);
+				for (int32 PolyIndex = 0; PolyIndex < Tile->header->polyCount; ++PolyIndex)
+				{
+					const dtPoly& Poly = Tile->polys[PolyIndex];
+					Hash = FCrc::MemCrc32(Poly.verts, sizeof(Poly.verts[0]) * Poly.vertCount, Hash);
+					Hash = HashCombine(Hash, ::GetTypeHash(Poly.flags));
+					Hash = HashCombine(Hash, ::GetTypeHash(Poly.getArea()));
+					Hash = HashCombine(Hash, ::GetTypeHash(Poly.getType()));
+				}
+			}
+		}
+	}
+
+	return Hash;
+}
+
+/**
+ * Adds the bounds of every tile rebuilt since the snapshot, before and after, and updates the snapshot to the current tiles.
+ * False if the snapshot was of another Detour mesh, then the whole navmesh is new.
+ */
+static bool DiffNavMeshTiles(const ARecastNavMesh& NavMesh, FWaypointNavTileSnapshot& Snapshot, TArray<FBox>& OutChangedAreas)
+{
+	const dtNavMesh* DetourMesh = NavMesh.GetRecastMesh();
+	const int32 NumTiles = DetourMesh ? DetourMesh->getMaxTiles() : 0;
+
+	const bool bSameMesh = DetourMesh != nullptr && DetourMesh == Snapshot.DetourMesh && Snapshot.Salts.Num() == NumTiles;
+	if (!bSameMesh)
+	{
+		Snapshot.DetourMesh = DetourMesh;
+		Snapshot.Salts.Init(0, NumTiles);
+		Snapshot.Bounds.Init(FBox(ForceInit), NumTiles);
+	}
+
+	for (int32 TileIndex = 0; TileIndex < NumTiles; ++TileIndex)
+	{
+		// Empty slots count as salt 0, Detour never gives a tile that salt
+		const dtMeshTile* Tile = DetourMesh->getTile(TileIndex);
+		const uint32 Salt = Tile && Tile->header ? Tile->salt : 0;
+		if (Salt == Snapshot.Salts[TileIndex])
+		{
+			continue;
+		}
+
+		FBox TileBounds(ForceInit);
+		if (Salt != 0)
+		{
+			TileBounds += Recast2UnrealPoint(FVector(Tile->header->bmin[0], Tile->header->bmin[1], Tile->header->bmin[2]));
+			TileBounds += Recast2UnrealPoint(FVector(Tile->header->bmax[0], Tile->header->bmax[1], Tile->header->bmax[2]));
+		}
+
+		// A removed tile changes paths through where it was as much as an added one
+		if (bSameMesh && Snapshot.Bounds[TileIndex].IsValid)
+		{
+			OutChangedAreas.Add(Snapshot.Bounds[TileIndex]);
+		}
+		if (bSameMesh && TileBounds.IsValid)
+		{
+			OutChangedAreas.Add(TileBounds);
+		}
+
+		Snapshot.Salts[TileIndex] = Salt;
+		Snapshot.Bounds[TileIndex] = TileBounds;
+	}
+
+	return bSameMesh;
+}
+#endif // WITH_RECAST
+
+void UWaypointSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+#if WITH_EDITOR
+	ObjectPropertyChangedHandle = FCoreUObjectDelegates::OnObjectPropertyChanged.AddUObject(this, &UWaypointSubsystem::OnObjectPropertyChanged);
+	ObjectsReinstancedHandle = FCoreUObjectDelegates::OnObjectsReinstanced.AddUObject(this, &UWaypointSubsystem::OnObjectsReinstanced);
+#endif // WITH_EDITOR
+}
+
+void UWaypointSubsystem::Deinitialize()
+{
+#if WITH_EDITOR
+	FCoreUObjectDelegates::OnObjectPropertyChanged.Remove(ObjectPropertyChangedHandle);
+	FCoreUObjectDelegates::OnObjectsReinstanced.Remove(ObjectsReinstancedHandle);
+#endif // WITH_EDITOR
+
+	if (UNavigationSystemV1* NavSys = BoundNavSys.Get())
+	{
+		NavSys->OnNavDataRegisteredEvent.RemoveAll(this);
+		NavSys->OnNavigationGenerationFinishedDelegate.RemoveAll(this);
+	}
+
+	NavAgentCache.Invalidate();
+	Loops.Reset();
+	NavTileSnapshots.Reset();
+	OccupancyField.Reset();
+
+	Super::Deinitialize();
+}
+
+void UWaypointSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	PathRequestQueue.ProcessRequests(*GetWorld());
+
+	// Loops edited this frame publish a single snapshot however many points changed
+	for (const TWeakObjectPtr<AWaypointLoop>& Loop : Loops)
+	{
+		if (Loop.IsValid())
+		{
+			Loop->FlushSnapshot();
+		}
+	}
+
+	// Loops move, get added and have their paths requeried, the field follows them once it's been asked for
+	if (GWaypointsOccupancyUpdateInterval > 0.f && bHasOccupancyParams && !bOccupancyBuildInFlight)
+	{
+		const double Now = GetWorld()->GetTimeSeconds();
+		if (Now >= NextOccupancyCheckTime)
+		{
+			NextOccupancyCheckTime = Now + GWaypointsOccupancyUpdateInterval;
+			if (HashLoopsForOccupancy() != OccupancyLoopsHash)
+			{
+				BuildOccupancyField(OccupancyParams);
+			}
+		}
+	}
+}
+
+TStatId UWaypointSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UWaypointSubsystem, STATGROUP_Tickables);
+}
+
+FWaypointNavAgentInfoPtr UWaypointSubsystem::GetNavAgentInfo(const UClass* CharacterClass)
+{
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (NavSys == nullptr)
+	{
+		return nullptr;
+	}
+
+	// The navigation system can be created after this subsystem, so bind to it on first use
+	if (BoundNavSys.Get() != NavSys)
+	{
+		BindToNavigationSystem(*NavSys);
+	}
+
+	return NavAgentCache.FindOrResolve(*NavSys, CharacterClass);
+}
+
+void UWaypointSubsystem::RegisterLoop(AWaypointLoop* Loop)
+{
+	Loops.Add(Loop);
+
+	if (UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld()))
+	{
+		if (BoundNavSys.Get() != NavSys)
+		{
+			BindToNavigationSystem(*NavSys);
+		}
+	}
+}
+
+void UWaypointSubsystem::UnregisterLoop(AWaypointLoop* Loop)
+{
+	Loops.Remove(Loop);
+}
+
+AWaypointLoop* UWaypointSubsystem::FindClosestLoop(const FVector& Location) const
+{
+	AWaypointLoop* ClosestLoop = nullptr;
+	FVector::FReal MinDistance = TNumericLimits<FVector::FReal>::Max();
+
+	for (const TWeakObjectPtr<AWaypointLoop>& WeakLoop : Loops)
+	{
+		AWaypointLoop* Loop = WeakLoop.Get();
+		if (Loop == nullptr)
+		{
+			continue;
+		}
+
+		const FWaypointLoopData& LoopData = Loop->GetLoopData();
+		const int32 ClosestPoint = LoopData.FindClosestPoint(Location);
+		if (ClosestPoint == INDEX_NONE)
+		{
+			continue;
+		}
+
+		const FVector::FReal Distance = FVector::DistSquared(LoopData.GetLocation(ClosestPoint), Location);
+		if (Distance < MinDistance)
+		{
+			MinDistance = Distance;
+			ClosestLoop = Loop;
+		}
+	}
+
+	return ClosestLoop;
+}
+
+AWaypointLoop* UWaypointSubsystem::FindLoopForActor(const AActor* Actor, int32* OutPointIndex) const
+{
+	if (OutPointIndex)
+	{
+		*OutPointIndex = INDEX_NONE;
+	}
+
+	if (Actor == nullptr)
+	{
+		return nullptr;
+	}
+
+	AWaypointLoop* Loop = nullptr;
+	int32 PointIndex = INDEX_NONE;
+
+	if (const AWaypointLoop* ActorLoop = Cast<const AWaypointLoop>(Actor))
+	{
+		Loop = const_cast<AWaypointLoop*>(ActorLoop);
+	}
+	else if (const AWaypoint* Waypoint = Cast<const AWaypoint>(Actor))
+	{
+		Loop = Waypoint->OwningLoop.Get();
+		PointIndex = Loop ? Loop->FindWaypoint(Waypoint) : INDEX_NONE;
+	}
+	else
+	{
+		const APawn* Pawn = Cast<const APawn>(Actor);
+		const AController* Controller = Pawn ? Pawn->GetController() : Cast<const AController>(Actor);
+
+		const UWaypointPatrolComponent* PatrolComponent = Controller ? UWaypointPatrolComponent::FindPatrolComponent(Controller) : Actor->FindComponentByClass<UWaypointPatrolComponent>();
+		if (PatrolComponent && PatrolComponent->GetLoop())
+		{
+			Loop = PatrolComponent->GetLoop();
+			PointIndex = PatrolComponent->GetCurrentIndex();
+		}
+		else
+		{
+			Loop = FindClosestLoop(Actor->GetActorLocation());
+		}
+	}
+
+	if (Loop && OutPointIndex)
+	{
+		*OutPointIndex = PointIndex != INDEX_NONE ? PointIndex : Loop->GetLoopData().FindClosestPoint(Actor->GetActorLocation());
+	}
+
+	return Loop;
+}
+
+void UWaypointSubsystem::FindResumePoint(const AController* Agent, AWaypointLoop* Loop, int32 MaxCandidates, FOnWaypointResumePointFound OnFound)
+{
+	const APawn* Pawn = Agent ? Agent->GetPawn() : nullptr;
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (Pawn == nullptr || NavSys == nullptr)
+	{
+		OnFound.ExecuteIfBound(FWaypointResumePoint());
+		return;
+	}
+
+	const FVector Start = Pawn->GetNavAgentLocation();
+	if (Loop == nullptr)
+	{
+		Loop = FindClosestLoop(Start);
+	}
+
+	const ANavigationData* NavData = NavSys->GetNavDataForProps(Agent->GetNavAgentPropertiesRef(), Start);
+	if (Loop == nullptr || NavData == nullptr)
+	{
+		OnFound.ExecuteIfBound(FWaypointResumePoint());
+		return;
+	}
+
+	// The agent's own nav data and filter, which may differ from those of the loop
+	const AAIController* AIController = Cast<AAIController>(Agent);
+	const FWaypointNavAgentInfoPtr AgentNavAgent = MakeShared<const FWaypointNavAgentInfo, ESPMode::ThreadSafe>(Agent->GetNavAgentPropertiesRef(), NavData);
+	const FSharedConstNavQueryFilter Filter = UNavigationQueryFilter::GetQueryFilter(*NavData, Agent, AIController ? AIController->GetDefaultNavigationFilterClass() : nullptr);
+
+	const FWaypointLoopData& LoopData = Loop->GetLoopData();
+	TArray<int32> CandidateIndices;
+	LoopData.FindClosestPoints(Start, FMath::Max(MaxCandidates, 1), CandidateIndices);
+
+	TArray<FWaypointSegmentQuery> Queries;
+	TArray<FWaypointHandle> CandidateHandles;
+	Queries.Reserve(CandidateIndices.Num());
+	CandidateHandles.Reserve(CandidateIndices.Num());
+	for (const int32 Index : CandidateIndices)
+	{
+		FWaypointSegmentQuery& Query = Queries.AddDefaulted_GetRef();
+		Query.SegmentIndex = Index;
+		Query.Start = Start;
+		Query.End = LoopData.GetLocation(Index);
+		Query.NavAgent = AgentNavAgent;
+		Query.Filter = Filter;
+		Query.bRequireCompletePath = true;
+
+		CandidateHandles.Add(LoopData.GetHandle(Index));
+	}
+
+	FindSegmentPathsAsync(MoveTemp(Queries), FOnWaypointSegmentPathsFound::CreateLambda(
+		[WeakLoop = TWeakObjectPtr<AWaypointLoop>(Loop), Start, CandidateHandles = MoveTemp(CandidateHandles), OnFound = MoveTemp(OnFound)](TConstArrayView<FWaypointSegmentQuery> Queries, TArray<FWaypointSegmentPathResult>& Results)
+		{
+			FWaypointResumePoint ResumePoint;
+			AWaypointLoop* Loop = WeakLoop.Get();
+			if (Loop == nullptr)
+			{
+				OnFound.ExecuteIfBound(ResumePoint);
+				return;
+			}
+
+			// Points removed from the loop while the costs were computed resolve to INDEX_NONE and are skipped
+			const FWaypointLoopData& LoopData = Loop->GetLoopData();
+			for (int32 i = 0; i < Results.Num(); ++i)
+			{
+				const int32 Index = LoopData.ResolveHandle(CandidateHandles[i]);
+				if (Results[i].bSuccess && Index != INDEX_NONE && (!ResumePoint.IsValid() || Results[i].Cost < ResumePoint.PathCost))
+				{
+					ResumePoint.Loop = Loop;
+					ResumePoint.PointIndex = Index;
+					ResumePoint.PathCost = Results[i].Cost;
+				}
+			}
+
+			if (ResumePoint.IsValid())
+			{
+				ResumePoint.Waypoint = Loop->GetWaypoint(ResumePoint.PointIndex);
+
+				// Carry on in the direction the agent approached the entry point from instead of doubling back
+				const FVector Entry = LoopData.GetLocation(ResumePoint.PointIndex);
+				const FVector Approach = (Entry - Start).GetSafeNormal2D();
+				const FVector ToNext = (LoopData.GetLocation(LoopData.GetNextIndex(ResumePoint.PointIndex)) - Entry).GetSafeNormal2D();
+				const FVector ToPrevious = (LoopData.GetLocation(LoopData.GetPreviousIndex(ResumePoint.PointIndex)) - Entry).GetSafeNormal2D();
+				ResumePoint.bReverse = (Approach | ToPrevious) > (Approach | ToNext);
+			}
+
+			OnFound.ExecuteIfBound(ResumePoint);
+		}));
+}
+
+void UWaypointSubsystem::GenerateLoop(const FWaypointLoopGenerationParams& Params, FOnWaypointLoopGenerated OnGenerated)
+{
+	TSharedRef<FWaypointLoopGenerator> Generator = MakeShared<FWaypointLoopGenerator>(Params, GetNavAgentInfo(Params.CharacterClass));
+	Generator->SamplePoints();
+	ContinueLoopGeneration(Generator, Params, MoveTemp(OnGenerated));
+}
+
+void UWaypointSubsystem::ContinueLoopGeneration(const TSharedRef<FWaypointLoopGenerator>& Generator, const FWaypointLoopGenerationParams& Params, FOnWaypointLoopGenerated OnGenerated)
+{
+	TArray<FWaypointSegmentQuery> Queries;
+	Generator->GetPendingQueries(Queries);
+
+	// Each pass pathfinds the segments the previous one joined up, until no point is dropped
+	if (Queries.Num() > 0)
+	{
+		FindSegmentPathsAsync(MoveTemp(Queries), FOnWaypointSegmentPathsFound::CreateLambda(
+			[WeakThis = TWeakObjectPtr<ThisClass>(this), Generator, Params, OnGenerated](TConstArrayView<FWaypointSegmentQuery> Queries, TArray<FWaypointSegmentPathResult>& Results)
+			{
+				UWaypointSubsystem* Subsystem = WeakThis.Get();
+				if (Subsystem == nullptr)
+				{
+					OnGenerated.ExecuteIfBound(nullptr);
+					return;
+				}
+
+				Generator->ApplyPaths(Queries, Results);
+				Subsystem->ContinueLoopGeneration(Generator, Params, OnGenerated);
+			}));
+
+		return;
+	}
+
+	FWaypointLoopGenerationResult Result;
+	Generator->Finish(Result);
+
+	AWaypointLoop* Loop = nullptr;
+	if (Result.bSuccess)
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParams.ObjectFlags |= RF_Transient;
+
+		Loop = GetWorld()->SpawnActor<AWaypointLoop>(Params.Region.GetCenter(), FRotator::ZeroRotator, SpawnParams);
+		if (Loop)
+		{
+			Loop->SetGeneratedLoop(MoveTemp(Result.LoopData), MoveTemp(Result.SegmentPaths), Params.CharacterClass);
+		}
+	}
+	else
+	{
+		UE_LOG(LogWaypoints, Warning, TEXT("Couldn't generate a waypoint loop in %s, %.0f%% of the segments were reachable"), *Params.Region.ToString(), Result.Reachability * 100.f);
+	}
+
+	OnGenerated.ExecuteIfBound(Loop);
+}
+
+void UWaypointSubsystem::OptimizeLoopOrder(AWaypointLoop* Loop, const FWaypointRouteOptimizationParams& Params, FOnWaypointRouteOptimized OnOptimized)
+{
+	if (Loop == nullptr)
+	{
+		OnOptimized.ExecuteIfBound(nullptr, FWaypointRouteOptimizationResult());
+		return;
+	}
+
+	// The task reads the points from a snapshot, edits made in the meantime publish a new one instead of changing it
+	FWaypointLoopSnapshotRef Snapshot = Loop->GetSnapshot();
+	if (!Snapshot.IsValid())
+	{
+		OnOptimized.ExecuteIfBound(Loop, FWaypointRouteOptimizationResult());
+		return;
+	}
+
+	const uint32 Revision = Snapshot->GetLoopData().GetRevision();
+	const double StartTime = FPlatformTime::Seconds();
+
+	// The path lengths come from async pathfinding on the game thread, only the search over the cost matrix runs on a worker
+	TArray<FWaypointSegmentQuery> Queries;
+	const bool bHasNavData = FWaypointRouteOptimizer::GetCostQueries(Snapshot->GetLoopData().GetLocations(), Loop->GetNavAgentInfo(), Queries);
+
+	FindSegmentPathsAsync(MoveTemp(Queries), FOnWaypointSegmentPathsFound::CreateLambda(
+		[WeakLoop = TWeakObjectPtr<AWaypointLoop>(Loop), Snapshot = MoveTemp(Snapshot), Revision, bHasNavData, StartTime, Params, OnOptimized = MoveTemp(OnOptimized)](TConstArrayView<FWaypointSegmentQuery> Queries, TArray<FWaypointSegmentPathResult>& Results)
+		{
+			const TConstArrayView<FVector> Locations = Snapshot->GetLoopData().GetLocations();
+			TArray<float> Costs;
+			if (bHasNavData)
+			{
+				FWaypointRouteOptimizer::BuildCostMatrix(Locations, Queries, Results, Costs);
+			}
+
+			UE::Tasks::Launch(UE_SOURCE_LOCATION, [WeakLoop, NumPoints = Locations.Num(), Costs = MoveTemp(Costs), Revision, StartTime, Params, OnOptimized]() mutable
+				{
+					FWaypointRouteOptimizationResult Result;
+					if (!Costs.IsEmpty())
+					{
+						FWaypointRouteOptimizer::Optimize(Costs, NumPoints, Params, Result);
+					}
+
+					const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+					AsyncTask(ENamedThreads::GameThread, [WeakLoop, Revision, Result = MoveTemp(Result), Seconds, OnOptimized = MoveTemp(OnOptimized)]() mutable
+						{
+							AWaypointLoop* Loop = WeakLoop.Get();
+							if (Loop && Result.bSuccess)
+							{
+								// The order is made of indices into the points as they were, an edit in the meantime makes it meaningless
+								if (Loop->GetLoopData().GetRevision() == Revision)
+								{
+									Loop->ReorderPoints(Result.Order);
+
+									UE_LOG(LogWaypoints, Display, TEXT("Optimized the order of %s from %.0f to %.0f in %.2fs"),
+										*Loop->GetName(), Result.OriginalLength, Result.OptimizedLength, Seconds);
+								}
+								else
+								{
+									UE_LOG(LogWaypoints, Warning, TEXT("%s changed while its order was being optimized, the new order was dropped"), *Loop->GetName());
+									Result.bSuccess = false;
+								}
+							}
+							else if (Loop)
+							{
+								UE_LOG(LogWaypoints, Warning, TEXT("Couldn't optimize the order of %s, it has no nav data"), *Loop->GetName());
+							}
+
+							OnOptimized.ExecuteIfBound(Loop, Result);
+						});
+				});
+		}));
+}
+
+void UWaypointSubsystem::BuildOccupancyField(const FWaypointOccupancyParams& Params)
+{
+	OccupancyParams = Params;
+	bHasOccupancyParams = true;
+
+	// A single build at a time, the next one starts from whatever the loops look like when it's done
+	if (bOccupancyBuildInFlight)
+	{
+		OccupancyLoopsHash = 0;
+		return;
+	}
+
+	TArray<FWaypointOccupancyLoop> OccupancyLoops;
+	ForEachLoop([&OccupancyLoops](const AWaypointLoop& Loop)
+		{
+			const FWaypointLoopData& LoopData = Loop.GetLoopData();
+			if (LoopData.Num() < 2)
+			{
+				return;
+			}
+
+			// Segments that haven't been computed yet are walked in a straight line
+			const TArray<FWaypointSegmentPath>& SegmentPaths = Loop.GetSegmentPaths();
+			FWaypointOccupancyLoop& OccupancyLoop = OccupancyLoops.AddDefaulted_GetRef();
+			OccupancyLoop.LegPaths.Reserve(LoopData.Num());
+			OccupancyLoop.WaitTimes.Reserve(LoopData.Num());
+
+			for (int32 i = 0; i < LoopData.Num(); ++i)
+			{
+				const int32 NextIndex = LoopData.GetNextIndex(i);
+				if (SegmentPaths.IsValidIndex(i) && SegmentPaths[i].Points.Num() >= 2)
+				{
+					OccupancyLoop.LegPaths.Add(SegmentPaths[i].Points);
+				}
+				else
+				{
+					OccupancyLoop.LegPaths.Add({ LoopData.GetLocation(i), LoopData.GetLocation(NextIndex) });
+				}
+
+				OccupancyLoop.WaitTimes.Add(LoopData.GetParams(NextIndex).WaitTime);
+			}
+		});
+
+	OccupancyLoopsHash = HashLoopsForOccupancy();
+	bOccupancyBuildInFlight = true;
+
+	UE::Tasks::Launch(UE_SOURCE_LOCATION, [WeakThis = TWeakObjectPtr<ThisClass>(this), OccupancyLoops = MoveTemp(OccupancyLoops), Params]() mutable
+		{
+			const double StartTime = FPlatformTime::Seconds();
+
+			TSharedRef<FWaypointOccupancyField, ESPMode::ThreadSafe> Field = MakeShared<FWaypointOccupancyField, ESPMode::ThreadSafe>();
+			FWaypointOccupancyField::Build(OccupancyLoops, Params, *Field);
+
+			const double Seconds = FPlatformTime::Seconds() - StartTime;
+			const int32 NumLoops = OccupancyLoops.Num();
+
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, Field, Seconds, NumLoops]()
+				{
+					UWaypointSubsystem* Subsystem = WeakThis.Get();
+					if (Subsystem == nullptr)
+					{
+						return;
+					}
+
+					Subsystem->OccupancyField = Field;
+					Subsystem->bOccupancyBuildInFlight = false;
+
+					const FIntPoint Size = Field->GetSize();
+					UE_LOG(LogWaypoints, Log, TEXT("Built the patrol occupancy field of %d loops, %dx%d cells of %.0f, in %.2fs"),
+						NumLoops, Size.X, Size.Y, Field->GetCellSize(), Seconds);
+
+					// Asked for again while this one was being built
+					if (Subsystem->OccupancyLoopsHash == 0)
+					{
+						Subsystem->BuildOccupancyField(Subsystem->OccupancyParams);
+					}
+				});
+		});
+}
+
+bool UWaypointSubsystem::GetPatrolOccupancy(const FVector& Location, float& Presence, float& MeanTimeToVisit) const
+{
+	const FWaypointOccupancyCell* Cell = OccupancyField.IsValid() ? OccupancyField->FindCell(Location) : nullptr;
+	if (Cell == nullptr)
+	{
+		Presence = 0.f;
+		MeanTimeToVisit = -1.f;
+		return false;
+	}
+
+	Presence = Cell->Presence;
+	MeanTimeToVisit = Cell->MeanTimeToVisit;
+	return true;
+}
+
+uint32 UWaypointSubsystem::HashLoopsForOccupancy() const
+{
+	// Summed so the order loops are visited in doesn't matter, never 0 so 0 can mean out of date
+	uint32 Hash = 1;
+	ForEachLoop([&Hash](const AWaypointLoop& Loop)
+		{
+			uint32 LoopHash = HashCombineFast(GetTypeHash(&Loop), Loop.GetLoopData().GetRevision());
+			for (const FWaypointSegmentPath& Segment : Loop.GetSegmentPaths())
+			{
+				LoopHash = HashCombineFast(LoopHash, HashCombineFast(Segment.Hash, uint32(Segment.Points.Num())));
+			}
+
+			Hash += LoopHash;
+		});
+
+	return Hash != 0 ? Hash : 1;
+}
+
+void UWaypointSubsystem::FindSegmentPathsAsync(TArray<FWaypointSegmentQuery>&& Queries, FOnWaypointSegmentPathsFound OnFound)
+{
+	check(IsInGameThread());
+
+	TSharedRef<WaypointSubsystem::FAsyncPathBatch> Batch = MakeShared<WaypointSubsystem::FAsyncPathBatch>();
+	Batch->Queries = MoveTemp(Queries);
+	Batch->Results.SetNum(Batch->Queries.Num());
+	Batch->OnFound = MoveTemp(OnFound);
+
+	WaypointSubsystem::IssueAsyncPathQueries(FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld()), Batch);
+}
+
+bool UWaypointSubsystem::FindSegmentPath(const FWaypointSegmentQuery& Query, TArray<FVector>& OutPoints)
+{
+	check(IsInGameThread());
+
+	OutPoints.Reset();
+
+	const ANavigationData* NavData = Query.NavAgent.IsValid() ? Query.NavAgent->NavData.Get() : nullptr;
+	if (NavData == nullptr)
+	{
+		return false;
+	}
+
+	NumSegmentPathQueries.fetch_add(1, std::memory_order_relaxed);
+
+	FPathFindingQuery PathQuery(nullptr, *NavData, Query.Start, Query.End, Query.Filter.IsValid() ? Query.Filter : NavData->GetDefaultQueryFilter());
+	PathQuery.SetNavAgentProperties(Query.NavAgent->AgentProperties);
+
+	const FPathFindingResult Result = NavData->FindPath(Query.NavAgent->AgentProperties, PathQuery);
+	if (!Result.IsSuccessful() || !Result.Path.IsValid() || (Query.bRequireCompletePath && Result.IsPartial()))
+	{
+		return false;
+	}
+
+	const TArray<FNavPathPoint>& PathPoints = Result.Path->GetPathPoints();
+	OutPoints.Reserve(PathPoints.Num());
+	for (const FNavPathPoint& PathPoint : PathPoints)
+	{
+		OutPoints.Add(PathPoint.Location);
+	}
+
+	return true;
+}
+
+uint64 UWaypointSubsystem::GetNumSegmentPathQueries()
+{
+	return NumSegmentPathQueries.load(std::memory_order_relaxed);
+}
+
+uint32 UWaypointSubsystem::HashSegment(const FWaypointSegmentQuery& Query, const FBox& Corridor)
+{
+	// Tiles are added and removed on the game thread as the navmesh rebuilds, there's no lock to hold them still anywhere else
+	check(IsInGameThread());
+
+	const ANavigationData* NavData = Query.NavAgent.IsValid() ? Query.NavAgent->NavData.Get() : nullptr;
+	if (NavData == nullptr)
+	{
+		return 0;
+	}
+
+	const FNavAgentProperties& AgentProperties = Query.NavAgent->AgentProperties;
+
+	uint32 Hash = FCrc::MemCrc32(&Query.Start, sizeof(Query.Start));
+	Hash = FCrc::MemCrc32(&Query.End, sizeof(Query.End), Hash);
+	Hash = HashCombine(Hash, GetTypeHash(AgentProperties.AgentRadius));
+	Hash = HashCombine(Hash, GetTypeHash(AgentProperties.AgentHeight));
+	Hash = HashCombine(Hash, GetTypeHash(AgentProperties.AgentStepHeight));
+
+	// Names are hashed as strings, FName hashes change between sessions
+	Hash = FCrc::StrCrc32(*NavData->GetClass()->GetName(), Hash);
+
+#if WITH_RECAST
+	if (const ARecastNavMesh* NavMesh = Cast<const ARecastNavMesh>(NavData))
+	{
+		Hash = HashNavMeshTiles(*NavMesh, Corridor, Hash);
+	}
+#endif // WITH_RECAST
+
+	return Hash != 0 ? Hash : 1;
+}
+
+void UWaypointSubsystem::OnNavDataRegistered(ANavigationData* NavData)
+{
+	NavAgentCache.Invalidate();
+
+	if (NavData == nullptr)
+	{
+		return;
+	}
+
+	// Paths loaded with the map were kept while there was no nav data to check them against, only loops walking this nav data can check them now.
+	// Agents may resolve to other nav data from now on, profiles of nav data that was replaced would never be asked for again.
+	for (const TWeakObjectPtr<AWaypointLoop>& Loop : Loops)
+	{
+		if (Loop.IsValid())
+		{
+			Loop->PruneAgentProfiles();
+			Loop->InvalidateSegments(*NavData, TConstArrayView<FBox>());
+		}
+	}
+
+	// Later generations are compared with the tiles it was registered with
+	for (auto It = NavTileSnapshots.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+#if WITH_RECAST
+	if (const ARecastNavMesh* NavMesh = Cast<const ARecastNavMesh>(NavData))
+	{
+		TArray<FBox> ChangedAreas;
+		DiffNavMeshTiles(*NavMesh, NavTileSnapshots.FindOrAdd(NavMesh), ChangedAreas);
+	}
+#endif // WITH_RECAST
+}
+
+void UWaypointSubsystem::BindToNavigationSystem(UNavigationSystemV1& NavSys)
+{
+	if (UNavigationSystemV1* PreviousNavSys = BoundNavSys.Get())
+	{
+		PreviousNavSys->OnNavDataRegisteredEvent.RemoveAll(this);
+		PreviousNavSys->OnNavigationGenerationFinishedDelegate.RemoveAll(this);
+	}
+
+	BoundNavSys = &NavSys;
+	NavSys.OnNavDataRegisteredEvent.AddUniqueDynamic(this, &UWaypointSubsystem::OnNavDataRegistered);
+	NavSys.OnNavigationGenerationFinishedDelegate.AddUniqueDynamic(this, &UWaypointSubsystem::OnNavigationGenerationFinished);
+
+	NavAgentCache.Invalidate();
+}
+
+void UWaypointSubsystem::OnNavigationGenerationFinished(ANavigationData* NavData)
+{
+	if (NavData == nullptr)
+	{
+		return;
+	}
+
+	// Only this world's navigation system reports here, and only the tiles rebuilt since the last generation can change a path.
+	// Nav data without tiles to compare has every segment walking it revalidated, which is what the empty list means to the loops.
+	TArray<FBox> ChangedAreas;
+#if WITH_RECAST
+	if (const ARecastNavMesh* NavMesh = Cast<const ARecastNavMesh>(NavData))
+	{
+		if (DiffNavMeshTiles(*NavMesh, NavTileSnapshots.FindOrAdd(NavMesh), ChangedAreas) && ChangedAreas.Num() == 0)
+		{
+			return;
+		}
+	}
+#endif // WITH_RECAST
+
+	for (const TWeakObjectPtr<AWaypointLoop>& Loop : Loops)
+	{
+		if (Loop.IsValid())
+		{
+			Loop->InvalidateSegments(*NavData, ChangedAreas);
+		}
+	}
+}
+
+#if WITH_EDITOR
+void UWaypointSubsystem::OnObjectPropertyChanged(UObject* Object, FPropertyChangedEvent& Event)
+{
+	// Capsule size or nav agent settings of a character default changed
+	if (Object && Object->HasAnyFlags(RF_ClassDefaultObject | RF_ArchetypeObject))
+	{
+		const AActor* OwningActor = Object->IsA<AActor>() ? Cast<AActor>(Object) : Object->GetTypedOuter<AActor>();
+		if (Object->IsA<ACharacter>() || (OwningActor && OwningActor->IsA<ACharacter>()) || Object->IsA<ANavigationData>())
+		{
+			NavAgentCache.Invalidate();
+		}
+	}
+}
+
+void UWaypointSubsystem::OnObjectsReinstanced(const TMap<UObject*, UObject*>& ReplacedObjects)
+{
+	NavAgentCache.Invalidate();
+}
+#endif // WITH_EDITOR
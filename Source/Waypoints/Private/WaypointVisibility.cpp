@@ -0,0 +1,295 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointVisibility.h"
+#include "WaypointsModule.h"
+
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "Misc/Compression.h"
+#include "NavigationData.h"
+
+namespace WaypointVisibility
+{
+	// Past this, a grid that large would take longer to trace than anyone is willing to wait in the editor
+	static constexpr int64 MaxGridCells = 4 * 1024 * 1024;
+
+	// Samples are dropped on the navmesh at most a storey above or below their closest waypoint
+	static constexpr float ProjectHeight = 300.f;
+
+	// A location further above or below its sample than this is on another floor, and not covered by the bake
+	static constexpr float MaxSampleHeightDifference = 250.f;
+
+	/** Waypoints bucketed on a horizontal grid as coarse as the max distance, so only the buckets around a location can be in range of it */
+	struct FWaypointBuckets
+	{
+		FWaypointBuckets(TConstArrayView<FVector> Locations, float InBucketSize)
+			: BucketSize(InBucketSize)
+		{
+			for (int32 i = 0; i < Locations.Num(); ++i)
+			{
+				Buckets.FindOrAdd(GetBucket(FVector2D(Locations[i]))).Add(i);
+			}
+		}
+
+		FIntPoint GetBucket(const FVector2D& Location) const
+		{
+			return FIntPoint(FMath::FloorToInt32(Location.X / BucketSize), FMath::FloorToInt32(Location.Y / BucketSize));
+		}
+
+		template<typename FunctorType>
+		void ForEachNear(const FVector2D& Location, FunctorType&& Functor) const
+		{
+			const FIntPoint Center = GetBucket(Location);
+			for (int32 Y = Center.Y - 1; Y <= Center.Y + 1; ++Y)
+			{
+				for (int32 X = Center.X - 1; X <= Center.X + 1; ++X)
+				{
+					if (const TArray<int32>* Bucket = Buckets.Find(FIntPoint(X, Y)))
+					{
+						for (const int32 Index : *Bucket)
+						{
+							Functor(Index);
+						}
+					}
+				}
+			}
+		}
+
+		float BucketSize;
+		TMap<FIntPoint, TArray<int32>> Buckets;
+	};
+}
+
+bool FWaypointVisibility::Bake(const UWorld& World, const FWaypointLoopData& LoopData, const ANavigationData* NavData, const FWaypointVisibilityBakeSettings& Settings, FWaypointVisibility& OutVisibility)
+{
+	OutVisibility.Reset();
+	if (LoopData.Num() == 0)
+	{
+		return false;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	const TConstArrayView<FVector> Locations = LoopData.GetLocations();
+	const float Spacing = FMath::Max(Settings.SampleSpacing, 25.f);
+
+	FBox2D GridBounds(ForceInit);
+	for (const FVector& Location : Locations)
+	{
+		GridBounds += FVector2D(Location);
+	}
+	GridBounds = GridBounds.ExpandBy(Settings.MaxDistance);
+
+	const FIntPoint GridSize(FMath::CeilToInt32(GridBounds.GetSize().X / Spacing) + 1, FMath::CeilToInt32(GridBounds.GetSize().Y / Spacing) + 1);
+	if (int64(GridSize.X) * GridSize.Y > WaypointVisibility::MaxGridCells)
+	{
+		UE_LOG(LogWaypoints, Warning, TEXT("Visibility grid of %dx%d samples is too large, increase the sample spacing or reduce the max distance"), GridSize.X, GridSize.Y);
+		return false;
+	}
+
+	OutVisibility.NumWaypoints = LoopData.Num();
+	OutVisibility.LocationsHash = LoopData.HashLocations();
+	OutVisibility.GridOrigin = GridBounds.Min;
+	OutVisibility.GridSize = GridSize;
+	OutVisibility.SampleSpacing = Spacing;
+	OutVisibility.GridSamples.Init(INDEX_NONE, GridSize.X * GridSize.Y);
+
+	// A sample in every cell in range of a waypoint, on the navmesh when there is one since that's where intruders walk
+	const FVector ProjectExtent(Spacing * 0.5f, Spacing * 0.5f, WaypointVisibility::ProjectHeight);
+	const float MaxDistanceSq = FMath::Square(Settings.MaxDistance);
+	const WaypointVisibility::FWaypointBuckets Buckets(Locations, FMath::Max(Settings.MaxDistance, Spacing));
+
+	for (int32 Y = 0; Y < GridSize.Y; ++Y)
+	{
+		for (int32 X = 0; X < GridSize.X; ++X)
+		{
+			const FVector2D CellCenter = OutVisibility.GridOrigin + FVector2D(X, Y) * Spacing;
+
+			int32 ClosestIndex = INDEX_NONE;
+			double ClosestDistSq = MaxDistanceSq;
+			Buckets.ForEachNear(CellCenter, [&](int32 i)
+				{
+					const double DistSq = FVector2D::DistSquared(CellCenter, FVector2D(Locations[i]));
+					if (DistSq <= ClosestDistSq)
+					{
+						ClosestIndex = i;
+						ClosestDistSq = DistSq;
+					}
+				});
+
+			if (ClosestIndex == INDEX_NONE)
+			{
+				continue;
+			}
+
+			FVector Sample(CellCenter, Locations[ClosestIndex].Z);
+			if (NavData)
+			{
+				FNavLocation NavLocation;
+				if (!NavData->ProjectPoint(Sample, NavLocation, ProjectExtent))
+				{
+					continue;
+				}
+
+				Sample = NavLocation.Location;
+			}
+
+			OutVisibility.GridSamples[Y * GridSize.X + X] = OutVisibility.SamplePoints.Add(Sample);
+		}
+	}
+
+	const int32 NumWaypoints = OutVisibility.NumWaypoints;
+	const TArray<FVector>& SamplePoints = OutVisibility.SamplePoints;
+
+	OutVisibility.WordsPerRow = (NumWaypoints + SamplePoints.Num() + 31) / 32;
+	OutVisibility.Rows.SetNumZeroed(NumWaypoints * OutVisibility.WordsPerRow);
+
+	// Each waypoint writes its own row, so the traces can all run in parallel.
+	// A row only visits the waypoints and grid cells in range, and traces each of them once.
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(WaypointVisibilityBake), true);
+	const FVector EyeOffset(0.f, 0.f, Settings.EyeHeight);
+	const FVector TargetOffset(0.f, 0.f, Settings.TargetHeight);
+
+	ParallelFor(NumWaypoints, [&](int32 Row)
+		{
+			uint32* RowWords = &OutVisibility.Rows[Row * OutVisibility.WordsPerRow];
+			const FVector Eye = Locations[Row] + EyeOffset;
+
+			auto TraceColumn = [&](int32 Column, const FVector& Ground)
+			{
+				const FVector Target = Ground + TargetOffset;
+				if (FVector::DistSquared(Eye, Target) <= MaxDistanceSq && !World.LineTraceTestByChannel(Eye, Target, Settings.TraceChannel, QueryParams))
+				{
+					RowWords[Column >> 5] |= 1u << (Column & 31);
+				}
+			};
+
+			Buckets.ForEachNear(FVector2D(Locations[Row]), [&](int32 Column)
+				{
+					if (Column == Row)
+					{
+						RowWords[Column >> 5] |= 1u << (Column & 31);
+					}
+					else
+					{
+						TraceColumn(Column, Locations[Column]);
+					}
+				});
+
+			const FVector2D RangeMin = (FVector2D(Locations[Row]) - OutVisibility.GridOrigin - FVector2D(Settings.MaxDistance)) / Spacing;
+			const FVector2D RangeMax = (FVector2D(Locations[Row]) - OutVisibility.GridOrigin + FVector2D(Settings.MaxDistance)) / Spacing;
+			const int32 MinX = FMath::Max(FMath::FloorToInt32(RangeMin.X), 0);
+			const int32 MinY = FMath::Max(FMath::FloorToInt32(RangeMin.Y), 0);
+			const int32 MaxX = FMath::Min(FMath::CeilToInt32(RangeMax.X), GridSize.X - 1);
+			const int32 MaxY = FMath::Min(FMath::CeilToInt32(RangeMax.Y), GridSize.Y - 1);
+
+			for (int32 Y = MinY; Y <= MaxY; ++Y)
+			{
+				for (int32 X = MinX; X <= MaxX; ++X)
+				{
+					const int32 SampleIndex = OutVisibility.GridSamples[Y * GridSize.X + X];
+					if (SampleIndex != INDEX_NONE)
+					{
+						TraceColumn(NumWaypoints + SampleIndex, SamplePoints[SampleIndex]);
+					}
+				}
+			}
+		});
+
+	OutVisibility.Compress();
+
+	UE_LOG(LogWaypoints, Display, TEXT("Baked visibility of %d waypoints to %d samples in %.2fs, %d bytes compressed from %d"),
+		NumWaypoints, SamplePoints.Num(), FPlatformTime::Seconds() - StartTime, OutVisibility.CompressedRows.Num(), OutVisibility.Rows.Num() * (int32)sizeof(uint32));
+	return true;
+}
+
+bool FWaypointVisibility::IsValidFor(const FWaypointLoopData& LoopData) const
+{
+	return NumWaypoints > 0 && NumWaypoints == LoopData.Num() && LocationsHash == LoopData.HashLocations();
+}
+
+void FWaypointVisibility::Reset()
+{
+	*this = FWaypointVisibility();
+}
+
+int32 FWaypointVisibility::FindSample(const FVector& Location) const
+{
+	if (SampleSpacing <= 0.f)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 X = FMath::RoundToInt32((Location.X - GridOrigin.X) / SampleSpacing);
+	const int32 Y = FMath::RoundToInt32((Location.Y - GridOrigin.Y) / SampleSpacing);
+	if (X < 0 || Y < 0 || X >= GridSize.X || Y >= GridSize.Y)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 SampleIndex = GridSamples[Y * GridSize.X + X];
+	if (SampleIndex == INDEX_NONE || FMath::Abs(SamplePoints[SampleIndex].Z - Location.Z) > WaypointVisibility::MaxSampleHeightDifference)
+	{
+		return INDEX_NONE;
+	}
+
+	return SampleIndex;
+}
+
+SIZE_T FWaypointVisibility::GetAllocatedSize() const
+{
+	return SamplePoints.GetAllocatedSize() + GridSamples.GetAllocatedSize() + CompressedRows.GetAllocatedSize() + Rows.GetAllocatedSize();
+}
+
+void FWaypointVisibility::PostSerialize(const FArchive& Ar)
+{
+	if (Ar.IsLoading())
+	{
+		Decompress();
+	}
+}
+
+void FWaypointVisibility::PostEditImport()
+{
+	Decompress();
+}
+
+void FWaypointVisibility::Compress()
+{
+	CompressedRows.Reset();
+
+	const int32 UncompressedSize = Rows.Num() * sizeof(uint32);
+	if (UncompressedSize == 0)
+	{
+		return;
+	}
+
+	int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, UncompressedSize);
+	CompressedRows.SetNumUninitialized(CompressedSize);
+
+	if (FCompression::CompressMemory(NAME_Zlib, CompressedRows.GetData(), CompressedSize, Rows.GetData(), UncompressedSize))
+	{
+		CompressedRows.SetNum(CompressedSize);
+	}
+	else
+	{
+		UE_LOG(LogWaypoints, Error, TEXT("Couldn't compress the visibility of %d waypoints, it won't be saved"), NumWaypoints);
+		CompressedRows.Reset();
+	}
+}
+
+void FWaypointVisibility::Decompress()
+{
+	WordsPerRow = (NumWaypoints + SamplePoints.Num() + 31) / 32;
+	Rows.SetNumZeroed(NumWaypoints * WordsPerRow);
+
+	if (Rows.Num() == 0)
+	{
+		return;
+	}
+
+	if (CompressedRows.Num() == 0 || !FCompression::UncompressMemory(NAME_Zlib, Rows.GetData(), Rows.Num() * sizeof(uint32), CompressedRows.GetData(), CompressedRows.Num()))
+	{
+		UE_LOG(LogWaypoints, Warning, TEXT("Couldn't decompress the visibility of %d waypoints, it needs to be baked again"), NumWaypoints);
+		Reset();
+	}
+}
@@ -0,0 +1,40 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/AITask_MoveTo.h"
+#include "AITask_WaypointMoveTo.generated.h"
+
+class UAITask_WaypointMoveTo;
+
+DECLARE_DELEGATE_OneParam(FOnWaypointMoveLegFinished, UAITask_WaypointMoveTo& /*Task*/);
+
+/**
+ * Move task that outlives its move: once a leg is done it stays active and idle instead of ending,
+ * and is set up again with the next leg's request, so a patrolling AI keeps one task object for its whole patrol.
+ * Failing to start a move still ends it like any other move task.
+ */
+UCLASS()
+class WAYPOINTS_API UAITask_WaypointMoveTo : public UAITask_MoveTo
+{
+	GENERATED_BODY()
+
+public:
+	/** Called instead of the task ending when the move of a leg finishes */
+	FOnWaypointMoveLegFinished OnLegFinished;
+
+	/** Whether patrol tasks should keep their move task across legs, see Waypoints.MoveTasks.Reuse */
+	static bool IsReuseEnabled();
+
+	/** Whether the last leg is done and the task is waiting for the next one */
+	bool IsLegFinished() const { return bLegFinished; }
+
+	virtual void ConditionalPerformMove() override;
+
+protected:
+	virtual void Resume() override;
+	virtual void OnRequestFinished(FAIRequestID RequestID, const FPathFollowingResult& Result) override;
+
+	uint8 bLegFinished : 1;
+};
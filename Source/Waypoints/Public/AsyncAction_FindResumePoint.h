@@ -0,0 +1,44 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "WaypointResumeQuery.h"
+#include "AsyncAction_FindResumePoint.generated.h"
+
+class AController;
+class AWaypointLoop;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnResumePointQueryFinished, const FWaypointResumePoint&, ResumePoint);
+
+/** Blueprint node for UWaypointSubsystem::FindResumePoint */
+UCLASS()
+class WAYPOINTS_API UAsyncAction_FindResumePoint : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Finds where an AI should rejoin a loop: of the waypoints closest to it, the one cheapest to reach by navmesh path.
+	 * @param Loop	Loop to rejoin, the closest one if not set
+	 * @param MaxCandidates	Number of waypoints closest in a straight line whose path cost is computed
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Waypoints", meta = (BlueprintInternalUseOnly = "true", WorldContext = "WorldContextObject"))
+		static UAsyncAction_FindResumePoint* FindResumePoint(UObject* WorldContextObject, AController* Controller, AWaypointLoop* Loop, int32 MaxCandidates = 4);
+
+	UPROPERTY(BlueprintAssignable)
+		FOnResumePointQueryFinished OnFound;
+
+	UPROPERTY(BlueprintAssignable)
+		FOnResumePointQueryFinished OnFailed;
+
+	virtual void Activate() override;
+
+protected:
+	void OnResumePointFound(const FWaypointResumePoint& ResumePoint);
+
+	TWeakObjectPtr<AController> Controller;
+	TWeakObjectPtr<AWaypointLoop> Loop;
+	int32 MaxCandidates = 4;
+};
@@ -0,0 +1,54 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/BTDecorator.h"
+#include "BTDecorator_HasPatrolWaypoint.generated.h"
+
+class UWaypointPatrolComponent;
+
+UENUM()
+enum class EWaypointPatrolCondition : uint8
+{
+	// The patrol component has a point to head to
+	HasWaypoint,
+	// The point the patrol component is heading to has a wait time
+	WaypointHasWaitTime,
+};
+
+struct FBTHasPatrolWaypointDecoratorMemory
+{
+	TWeakObjectPtr<UWaypointPatrolComponent> PatrolComponent;
+	FDelegateHandle WaypointChangedHandle;
+
+	// Condition when it was last checked, a new point that doesn't change it doesn't abort anything
+	bool bLastResult = false;
+};
+
+/**
+ * Checks the patrol component of the AI, without going through the blackboard.
+ * Observes the component instead of a blackboard key, and only requests an abort when moving on to another point changes the condition.
+ */
+UCLASS()
+class WAYPOINTS_API UBTDecorator_HasPatrolWaypoint : public UBTDecorator
+{
+	GENERATED_UCLASS_BODY()
+
+	UPROPERTY(Category = Condition, EditAnywhere)
+		EWaypointPatrolCondition Condition;
+
+	virtual bool CalculateRawConditionValue(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) const override;
+	virtual void InitializeMemory(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTMemoryInit::Type InitType) const override;
+	virtual void CleanupMemory(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTMemoryClear::Type CleanupType) const override;
+	virtual uint16 GetInstanceMemorySize() const override;
+	virtual FString GetStaticDescription() const override;
+
+protected:
+	virtual void OnBecomeRelevant(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+	virtual void OnCeaseRelevant(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+
+	bool CheckCondition(const UWaypointPatrolComponent* PatrolComponent) const;
+
+	void OnWaypointChanged(UWaypointPatrolComponent* PatrolComponent, TWeakObjectPtr<UBehaviorTreeComponent> WeakOwnerComp);
+};
@@ -9,10 +9,14 @@
 #include "NavFilters/NavigationQueryFilter.h"
 #include "AITypes.h"
 #include "BehaviorTree/Tasks/BTTask_BlackboardBase.h"
+#include "WaypointLoopData.h"
 #include "BTTask_MoveToNextWaypoint.generated.h"
 
+class AWaypoint;
 class UAITask_MoveTo;
+class UAITask_WaypointMoveTo;
 class UBlackboardComponent;
+class UWaypointPatrolComponent;
 
 struct FBTMoveToNextWaypointTaskMemory
 {
@@ -24,15 +28,39 @@ struct FBTMoveToNextWaypointTaskMemory
 
 	TWeakObjectPtr<UAITask_MoveTo> Task;
 
+	/** Move task kept alive between legs, idle while the AI isn't moving to a waypoint */
+	TWeakObjectPtr<UAITask_WaypointMoveTo> PersistentTask;
+
 	uint8 bWaitingForPath : 1;
 	uint8 bObserverCanFinishTask : 1;
+
+	/** Following a shared corridor, the crowd settings it turned off for crowd agents are restored when the task finishes */
+	uint8 bFollowingSharedCorridor : 1;
+	uint8 bCrowdSimulation : 1;
+	uint8 bCrowdOptimizedVisibility : 1;
+	uint8 bCrowdOptimizedTopology : 1;
+
+	/** Keeping to a formation slot while the squad leader walks the leg to SquadLegIndex */
+	uint8 bFollowingSquadLeader : 1;
+
+	/** The last move to the formation slot was pathfound, it's walked until NextFormationRepath runs out */
+	uint8 bFormationPathfinding : 1;
+	int32 SquadLegIndex;
+	float NextFormationUpdate;
+	float NextFormationRepath;
 	
 	float RemainingWaitTime;
+
+	/** Request waiting in the patrol path queue, 0 if none */
+	uint32 PathRequestId;
+
+	/** Patrol state of the AI, the blackboard key is only used when it has none */
+	TWeakObjectPtr<UWaypointPatrolComponent> PatrolComponent;
 };
 
 /**
  * Move To task node.
- * Moves the AI pawn toward the specified Actor or Location blackboard entry using the navigation system.
+ * Moves the AI pawn toward the current waypoint of its patrol component, or the waypoint in the blackboard entry if it has none.
  */
 UCLASS(config=Game)
 class WAYPOINTS_API UBTTask_MoveToNextWaypoint : public UBTTask_BlackboardBase
@@ -54,6 +82,30 @@ class WAYPOINTS_API UBTTask_MoveToNextWaypoint : public UBTTask_BlackboardBase
 	UPROPERTY(Category = Node, EditAnywhere)
 	uint32 bReachTestIncludesGoalRadius : 1;
 
+	/** if set, the path is found through the budgeted patrol path queue and the move starts once the queue services it */
+	UPROPERTY(Category = Node, EditAnywhere)
+	uint32 bUsePathRequestQueue : 1;
+
+	/** if set, agents on a loop follow the corridor the loop found for the leg instead of finding their own path, leaving crowd agents only local avoidance to do */
+	UPROPERTY(Category = Node, EditAnywhere)
+	uint32 bUseSharedCorridors : 1;
+
+	/** if set, the AI keeps one move task for its whole patrol and sets it up again for each leg instead of creating a new one per waypoint. Legs moved along a shared corridor or a queued path create no task. */
+	UPROPERTY(Category = Node, EditAnywhere)
+	uint32 bReuseMoveTasks : 1;
+
+	/** how often squad followers check their formation slot, in seconds */
+	UPROPERTY(Category = "Node|Squad", EditAnywhere, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float FormationUpdateInterval;
+
+	/** how far squad followers may drift from their formation slot before moving back to it */
+	UPROPERTY(Category = "Node|Squad", EditAnywhere, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float FormationTolerance;
+
+	/** how often squad followers that can't walk straight to their slot find a new path to it, in seconds. They keep walking the last path in between */
+	UPROPERTY(Category = "Node|Squad", EditAnywhere, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float FormationRepathInterval;
+
 	/** set automatically if move should use GameplayTasks */
 	uint32 bUseGameplayTasks : 1;
 
@@ -62,6 +114,7 @@ class WAYPOINTS_API UBTTask_MoveToNextWaypoint : public UBTTask_BlackboardBase
 	virtual void OnTaskFinished(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTNodeResult::Type TaskResult) override;
 	virtual void TickTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, float DeltaSeconds) override;
 	virtual uint16 GetInstanceMemorySize() const override;
+	virtual void CleanupMemory(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, EBTMemoryClear::Type CleanupType) const override;
 
 	virtual void OnGameplayTaskDeactivated(UGameplayTask& Task) override;
 	virtual void OnMessage(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, FName Message, int32 RequestID, bool bSuccess) override;
@@ -76,7 +129,27 @@ class WAYPOINTS_API UBTTask_MoveToNextWaypoint : public UBTTask_BlackboardBase
 protected:
 
 	EBTNodeResult::Type PerformMoveTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory);
+
+	/** fills in the move request toward the target point, returns false if there's no waypoint */
+	bool BuildMoveRequest(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, FAIMoveRequest& MoveReq) const;
+
+	/** point the AI is heading to, from its patrol component or the blackboard. OutWaypoint is null for generated loops. */
+	bool GetTargetPoint(const UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, AWaypoint*& OutWaypoint, FVector& OutLocation, FWaypointPointParams& OutParams) const;
+
+	/** queues the path of the move in the patrol path queue, returns false if the queue can't be used */
+	bool RequestQueuedPath(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, const FAIMoveRequest& MoveReq);
+	void OnQueuedPathFinished(uint32 RequestId, FNavPathSharedPtr Path, TWeakObjectPtr<UBehaviorTreeComponent> WeakOwnerComp);
+
+	/** starts the move along the shared corridor of the leg, returns false if the corridor isn't ready or the AI isn't standing in it */
+	bool RequestSharedCorridorMove(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, const FAIMoveRequest& MoveReq);
 	
+	/** keeps a squad follower in its formation slot until the leader moves on from the leg, see UWaypointPatrolComponent::JoinSquad */
+	void UpdateFormationMove(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, float DeltaSeconds);
+
+	/** finishes the node with the result of its move task */
+	void OnMoveTaskFinished(UAITask_MoveTo& MoveTask);
+	void OnMoveTaskLegFinished(UAITask_WaypointMoveTo& MoveTask);
+
 	/** prepares move task for activation */
 	virtual UAITask_MoveTo* PrepareMoveTask(UBehaviorTreeComponent& OwnerComp, UAITask_MoveTo* ExistingTask, FAIMoveRequest& MoveRequest);
 };
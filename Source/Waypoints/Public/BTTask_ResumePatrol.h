@@ -0,0 +1,44 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/Tasks/BTTask_BlackboardBase.h"
+#include "BTTask_ResumePatrol.generated.h"
+
+struct FWaypointResumePoint;
+
+struct FBTResumePatrolTaskMemory
+{
+	/** Query the task is waiting for, results of older ones are ignored */
+	uint32 QueryId;
+
+	/** Set while ExecuteTask runs, a query that finishes right away is returned from it instead of finishing the task latently */
+	uint8 bExecuting : 1;
+	uint8 bSucceeded : 1;
+};
+
+/**
+ * Picks where the AI rejoins its patrol: of the waypoints closest to it, the one cheapest to reach by navmesh path.
+ * The result goes to the AI's patrol component, or to the blackboard key if it has none, which can't hold the patrol direction.
+ */
+UCLASS()
+class WAYPOINTS_API UBTTask_ResumePatrol : public UBTTask_BlackboardBase
+{
+	GENERATED_UCLASS_BODY()
+
+	/** Number of waypoints closest in a straight line whose path cost is computed */
+	UPROPERTY(Category = Node, EditAnywhere, meta = (ClampMin = "1", UIMin = "1"))
+	int32 MaxCandidates;
+
+	virtual EBTNodeResult::Type ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+	virtual EBTNodeResult::Type AbortTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+	virtual uint16 GetInstanceMemorySize() const override;
+	virtual FString GetStaticDescription() const override;
+
+protected:
+	void OnResumePointFound(const FWaypointResumePoint& ResumePoint, TWeakObjectPtr<UBehaviorTreeComponent> WeakOwnerComp, uint32 QueryId);
+
+	/** Hands the resume point to the patrol component or the blackboard, returns false if it isn't valid */
+	bool ApplyResumePoint(UBehaviorTreeComponent& OwnerComp, const FWaypointResumePoint& ResumePoint) const;
+};
@@ -0,0 +1,26 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnvironmentQuery/Generators/EnvQueryGenerator_ProjectedPoints.h"
+#include "EnvQueryGenerator_LoopWaypoints.generated.h"
+
+/**
+ * Generates the points of the loop each context actor is on, see UWaypointSubsystem::FindLoopForActor.
+ * Reads the packed loop data, so generated loops without waypoint actors work too.
+ */
+UCLASS(meta = (DisplayName = "Points: Waypoints of Loop"))
+class WAYPOINTS_API UEnvQueryGenerator_LoopWaypoints : public UEnvQueryGenerator_ProjectedPoints
+{
+	GENERATED_UCLASS_BODY()
+
+	// Actors whose loop is generated, a loop, a waypoint or a patrolling AI
+	UPROPERTY(EditDefaultsOnly, Category = Generator)
+		TSubclassOf<UEnvQueryContext> LoopContext;
+
+	virtual void GenerateItems(FEnvQueryInstance& QueryInstance) const override;
+
+	virtual FText GetDescriptionTitle() const override;
+	virtual FText GetDescriptionDetails() const override;
+};
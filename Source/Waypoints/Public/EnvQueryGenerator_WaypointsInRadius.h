@@ -0,0 +1,26 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DataProviders/AIDataProvider.h"
+#include "EnvironmentQuery/Generators/EnvQueryGenerator_ProjectedPoints.h"
+#include "EnvQueryGenerator_WaypointsInRadius.generated.h"
+
+/** Generates the points of every loop in the world that are within a radius of the context */
+UCLASS(meta = (DisplayName = "Points: Waypoints in Radius"))
+class WAYPOINTS_API UEnvQueryGenerator_WaypointsInRadius : public UEnvQueryGenerator_ProjectedPoints
+{
+	GENERATED_UCLASS_BODY()
+
+	UPROPERTY(EditDefaultsOnly, Category = Generator)
+		FAIDataProviderFloatValue SearchRadius;
+
+	UPROPERTY(EditDefaultsOnly, Category = Generator)
+		TSubclassOf<UEnvQueryContext> SearchCenter;
+
+	virtual void GenerateItems(FEnvQueryInstance& QueryInstance) const override;
+
+	virtual FText GetDescriptionTitle() const override;
+	virtual FText GetDescriptionDetails() const override;
+};
@@ -0,0 +1,29 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnvironmentQuery/EnvQueryTest.h"
+#include "EnvQueryTest_IsOnCurrentLoop.generated.h"
+
+/**
+ * Whether each item is a point of the loop the context is on: the loop of its patrol component, or else the closest one.
+ * See UWaypointSubsystem::FindLoopForActor.
+ */
+UCLASS(meta = (DisplayName = "Is On Current Loop"))
+class WAYPOINTS_API UEnvQueryTest_IsOnCurrentLoop : public UEnvQueryTest
+{
+	GENERATED_UCLASS_BODY()
+
+	UPROPERTY(EditDefaultsOnly, Category = Loop)
+		TSubclassOf<UEnvQueryContext> LoopContext;
+
+	// Items further than this from every point of the loop aren't on it
+	UPROPERTY(EditDefaultsOnly, Category = Loop, meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float MatchTolerance;
+
+	virtual void RunTest(FEnvQueryInstance& QueryInstance) const override;
+
+	virtual FText GetDescriptionTitle() const override;
+	virtual FText GetDescriptionDetails() const override;
+};
@@ -0,0 +1,44 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnvironmentQuery/EnvQueryTest.h"
+#include "EnvQueryTest_WaypointPathDistance.generated.h"
+
+UENUM()
+enum class EWaypointPathDistanceDirection : uint8
+{
+	// Following the order of the loop
+	Forward,
+	// Against the order of the loop
+	Backward,
+	// Whichever way is shorter
+	Shortest,
+};
+
+/**
+ * Distance along a loop, following the segment paths, from the point the context is at or heading to, to each item.
+ * Items that aren't a point of the context's loop fail the test.
+ */
+UCLASS(meta = (DisplayName = "Waypoint Path Distance"))
+class WAYPOINTS_API UEnvQueryTest_WaypointPathDistance : public UEnvQueryTest
+{
+	GENERATED_UCLASS_BODY()
+
+	// Actor the distance is measured from, also picks the loop, see UWaypointSubsystem::FindLoopForActor
+	UPROPERTY(EditDefaultsOnly, Category = Distance)
+		TSubclassOf<UEnvQueryContext> DistanceFrom;
+
+	UPROPERTY(EditDefaultsOnly, Category = Distance)
+		EWaypointPathDistanceDirection Direction;
+
+	// Items further than this from every point of the loop aren't on it
+	UPROPERTY(EditDefaultsOnly, Category = Distance, meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float MatchTolerance;
+
+	virtual void RunTest(FEnvQueryInstance& QueryInstance) const override;
+
+	virtual FText GetDescriptionTitle() const override;
+	virtual FText GetDescriptionDetails() const override;
+};
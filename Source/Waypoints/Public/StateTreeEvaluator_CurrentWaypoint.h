@@ -0,0 +1,57 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "StateTreeEvaluatorBase.h"
+#include "StateTreeEvaluator_CurrentWaypoint.generated.h"
+
+class AAIController;
+class AWaypoint;
+class AWaypointLoop;
+
+USTRUCT()
+struct WAYPOINTS_API FStateTreeCurrentWaypointEvaluatorInstanceData
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = "Context")
+		TObjectPtr<AAIController> AIController = nullptr;
+
+	// Loop to patrol. If not set, the loop closest to the pawn when the tree starts is used.
+	UPROPERTY(EditAnywhere, Category = "Parameter")
+		TObjectPtr<AWaypointLoop> PatrolLoop = nullptr;
+
+	// How often the closest waypoint is looked up again, in seconds. 0 only looks it up when the tree starts.
+	UPROPERTY(EditAnywhere, Category = "Parameter", meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float UpdateInterval = 0.5f;
+
+	UPROPERTY(EditAnywhere, Category = "Output")
+		TObjectPtr<AWaypointLoop> Loop = nullptr;
+
+	// Waypoint of the loop closest to the pawn, where a patrol should start or resume
+	UPROPERTY(EditAnywhere, Category = "Output")
+		TObjectPtr<AWaypoint> CurrentWaypoint = nullptr;
+
+	float TimeUntilUpdate = 0.f;
+};
+
+/**
+ * Finds the loop an agent patrols and the waypoint of it the agent is closest to.
+ * Reads the packed loop data, so no waypoint actors are touched until the closest one is known.
+ */
+USTRUCT(meta = (DisplayName = "Current Waypoint"))
+struct WAYPOINTS_API FStateTreeCurrentWaypointEvaluator : public FStateTreeEvaluatorCommonBase
+{
+	GENERATED_BODY()
+
+	using FInstanceDataType = FStateTreeCurrentWaypointEvaluatorInstanceData;
+
+	virtual const UStruct* GetInstanceDataType() const override { return FInstanceDataType::StaticStruct(); }
+
+	virtual void TreeStart(FStateTreeExecutionContext& Context) const override;
+	virtual void Tick(FStateTreeExecutionContext& Context, const float DeltaTime) const override;
+
+protected:
+	void UpdateCurrentWaypoint(FInstanceDataType& InstanceData) const;
+};
@@ -0,0 +1,103 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AITypes.h"
+#include "StateTreeTaskBase.h"
+#include "StateTreeTask_MoveToNextWaypoint.generated.h"
+
+class AAIController;
+class AWaypoint;
+struct FAIMoveRequest;
+
+enum class EWaypointMovePhase : uint8
+{
+	// The next leg starts on the next tick
+	NeedsMove,
+	WaitingForPath,
+	Moving,
+	WaitingAtWaypoint,
+};
+
+USTRUCT()
+struct WAYPOINTS_API FStateTreeMoveToNextWaypointTaskInstanceData
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = "Context")
+		TObjectPtr<AAIController> AIController = nullptr;
+
+	// Waypoint the patrol starts from, usually bound to the Current Waypoint evaluator
+	UPROPERTY(EditAnywhere, Category = "Input")
+		TObjectPtr<AWaypoint> Waypoint = nullptr;
+
+	// Patrols the loop from each waypoint to the previous one, usually bound to the Resume Patrol task
+	UPROPERTY(EditAnywhere, Category = "Parameter")
+		bool bReverseDirection = false;
+
+	// Waypoint the agent is moving to or waiting at
+	UPROPERTY(EditAnywhere, Category = "Output")
+		TObjectPtr<AWaypoint> TargetWaypoint = nullptr;
+
+	FAIRequestID MoveRequestID;
+
+	/** Request waiting in the patrol path queue, 0 if none */
+	uint32 PathRequestId = 0;
+
+	/** Move the queue started once it found the path, set from its callback since the instance data can move in the meantime */
+	TSharedPtr<FAIRequestID> QueuedMoveRequestID;
+
+	float RemainingWaitTime = 0.f;
+
+	EWaypointMovePhase Phase = EWaypointMovePhase::NeedsMove;
+};
+
+/**
+ * Patrols a waypoint loop: moves to the waypoint, waits there, then moves on to the next one, for as long as the state is active.
+ * Same rules as the Move To Next Waypoint Behavior Tree task, but the whole patrol state is the instance data above.
+ * Moves are requested on the AI controller directly, so no gameplay task object is created per leg.
+ */
+USTRUCT(meta = (DisplayName = "Move To Next Waypoint"))
+struct WAYPOINTS_API FStateTreeMoveToNextWaypointTask : public FStateTreeTaskCommonBase
+{
+	GENERATED_BODY()
+
+	using FInstanceDataType = FStateTreeMoveToNextWaypointTaskInstanceData;
+
+	FStateTreeMoveToNextWaypointTask();
+
+	virtual const UStruct* GetInstanceDataType() const override { return FInstanceDataType::StaticStruct(); }
+
+	virtual EStateTreeRunStatus EnterState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const override;
+	virtual EStateTreeRunStatus Tick(FStateTreeExecutionContext& Context, const float DeltaTime) const override;
+	virtual void ExitState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const override;
+
+	UPROPERTY(EditAnywhere, Category = "Parameter")
+		bool bWaitAtWaypoint = true;
+
+	/** if set, radius of AI's capsule will be added to threshold between AI and goal location in destination reach test  */
+	UPROPERTY(EditAnywhere, Category = "Parameter")
+		bool bReachTestIncludesAgentRadius = true;
+
+	/** if set, radius of goal's capsule will be added to threshold between AI and goal location in destination reach test  */
+	UPROPERTY(EditAnywhere, Category = "Parameter")
+		bool bReachTestIncludesGoalRadius = true;
+
+	/** if set, the path is found through the budgeted patrol path queue and the move starts once the queue services it */
+	UPROPERTY(EditAnywhere, Category = "Parameter")
+		bool bUsePathRequestQueue = true;
+
+protected:
+	bool BuildMoveRequest(const FInstanceDataType& InstanceData, FAIMoveRequest& MoveReq) const;
+
+	/** Starts moving to the target waypoint, returns false if the move couldn't be started */
+	bool StartMove(FInstanceDataType& InstanceData) const;
+
+	/** Starts waiting at the target waypoint, or heads for the next one */
+	void FinishLeg(FInstanceDataType& InstanceData, bool bSuccess) const;
+
+	bool HasReachedTarget(const FInstanceDataType& InstanceData) const;
+
+	void StopMove(FInstanceDataType& InstanceData) const;
+};
@@ -0,0 +1,57 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "StateTreeTaskBase.h"
+#include "WaypointResumeQuery.h"
+#include "StateTreeTask_ResumePatrol.generated.h"
+
+class AAIController;
+class AWaypoint;
+class AWaypointLoop;
+
+USTRUCT()
+struct WAYPOINTS_API FStateTreeResumePatrolTaskInstanceData
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = "Context")
+		TObjectPtr<AAIController> AIController = nullptr;
+
+	// Loop to rejoin. If not set, the loop closest to the pawn is used.
+	UPROPERTY(EditAnywhere, Category = "Parameter")
+		TObjectPtr<AWaypointLoop> PatrolLoop = nullptr;
+
+	// Number of waypoints closest in a straight line whose path cost is computed
+	UPROPERTY(EditAnywhere, Category = "Parameter", meta = (ClampMin = "1", UIMin = "1"))
+		int32 MaxCandidates = 4;
+
+	UPROPERTY(EditAnywhere, Category = "Output")
+		TObjectPtr<AWaypoint> Waypoint = nullptr;
+
+	// Direction to patrol the loop in from the waypoint, usually bound to the Move To Next Waypoint task
+	UPROPERTY(EditAnywhere, Category = "Output")
+		bool bReverseDirection = false;
+
+	/** Filled in on the game thread once the query is done */
+	TSharedPtr<TOptional<FWaypointResumePoint>> Result;
+};
+
+/**
+ * Finds where the agent rejoins its patrol: of the waypoints closest to it, the one cheapest to reach by navmesh path.
+ * Succeeds once the query is done, also handing the result to the agent's patrol component if it has one.
+ */
+USTRUCT(meta = (DisplayName = "Resume Patrol"))
+struct WAYPOINTS_API FStateTreeResumePatrolTask : public FStateTreeTaskCommonBase
+{
+	GENERATED_BODY()
+
+	using FInstanceDataType = FStateTreeResumePatrolTaskInstanceData;
+
+	virtual const UStruct* GetInstanceDataType() const override { return FInstanceDataType::StaticStruct(); }
+
+	virtual EStateTreeRunStatus EnterState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const override;
+	virtual EStateTreeRunStatus Tick(FStateTreeExecutionContext& Context, const float DeltaTime) const override;
+	virtual void ExitState(FStateTreeExecutionContext& Context, const FStateTreeTransitionResult& Transition) const override;
+};
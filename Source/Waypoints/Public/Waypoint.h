@@ -6,6 +6,8 @@
 #include "NavigationSystem.h"
 #include "GameFramework/Actor.h"
 #include "UObject/WeakObjectPtrTemplates.h"
+#include "WaypointLoopData.h"
+#include "WaypointNavAgentCache.h"
 #include "Waypoint.generated.h"
 
 class AWaypointLoop;
@@ -17,7 +19,6 @@ class WAYPOINTS_API AWaypoint : public AActor
 	GENERATED_UCLASS_BODY()
 
 public:
-	virtual void PostRegisterAllComponents() override;
 #if WITH_EDITOR
 	virtual void PreEditChange(FProperty* PropertyThatWillChange) override;
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
@@ -25,6 +26,7 @@ public:
 	virtual bool CanDeleteSelectedActor(FText& OutReason) const override { return true; };
 #endif // WITH_EDITOR
 	virtual void PostDuplicate(EDuplicateMode::Type DuplicateMode) override;
+	virtual void PostRegisterAllComponents() override;
 	virtual void Destroyed() override;
 
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Waypoint")
@@ -55,6 +57,26 @@ public:
 
 	void RecalculateIndex();
 
+	// Nav agent and nav data used for the path to the next waypoint, resolved through the per-world cache
+	FWaypointNavAgentInfoPtr GetNavAgentInfo() const;
+
+	// Forgets the owning loop without notifying it, used when the loop removes this waypoint itself
+	void ClearWaypointLoop();
+
+	// Handle of this waypoint's point in the owning loop's packed data
+	FWaypointHandle GetLoopHandle() const { return LoopHandle; }
+
+	// Patrol settings of this waypoint, as stored in the packed loop data
+	FWaypointPointParams GetPointParams() const;
+
+	// Sets the patrol settings and facing of this waypoint from packed loop data, only the yaw of the facing direction is kept
+	void ApplyPointParams(const FWaypointPointParams& Params);
+
+	bool IsPinnedInLoopOrder() const { return bPinnedInLoopOrder; }
+
+	TSubclassOf<ACharacter> GetCharacterClass() const { return CharacterClass; }
+	void SetCharacterClass(TSubclassOf<ACharacter> NewCharacterClass);
+
 protected:
 	UPROPERTY(VisibleAnywhere, Category = "Waypoint")
 		int32 WaypointIndex;
@@ -68,20 +90,14 @@ protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Waypoint")
 		class UBillboardComponent* Sprite;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Waypoint")
-		class USplineComponent* PathComponent;
-
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Waypoint")
 		class UArrowComponent* GuardFacingArrow;
 
 
 	const ANavigationData* GetNavData() const;
-	const FNavAgentProperties& GetNavAgentProperties() const;
+	FNavAgentProperties GetNavAgentProperties() const;
 
 protected:
-	UFUNCTION(CallInEditor)
-		void OnNavigationGenerationFinished(class ANavigationData* NavData);
-
 	UFUNCTION(CallInEditor, Category = "Waypoint")
 		void SelectNextWaypoint() const;
 
@@ -106,9 +122,22 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Waypoint", meta = (ClampMin = "-1.0", UIMin = "-1.0"))
 		float AcceptanceRadius;
 
+	// Keeps this waypoint at its place in the loop when the loop order is optimized
+	UPROPERTY(EditAnywhere, Category = "Waypoint")
+		bool bPinnedInLoopOrder;
+
 	// Character class used for navigation data
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Waypoint")
 		TSubclassOf<ACharacter> CharacterClass;
 
 	void SetWaypointLoop(AWaypointLoop* Loop);
+
+private:
+	friend class AWaypointLoop;
+
+	FWaypointHandle LoopHandle;
+
+	// Agent made from NavProperties, kept until they're edited or the class entry it took its nav data from is replaced
+	mutable FWaypointNavAgentInfoPtr ExplicitNavAgentInfo;
+	mutable FWaypointNavAgentInfoPtr ExplicitNavAgentSource;
 };
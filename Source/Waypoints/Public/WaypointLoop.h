@@ -5,10 +5,59 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "UObject/WeakObjectPtrTemplates.h"
+#include "WaypointLoopData.h"
+#include "WaypointLoopSnapshot.h"
+#include "WaypointNavAgentCache.h"
+#include "WaypointSegmentCorridor.h"
+#include "WaypointVisibility.h"
 #include "WaypointLoop.generated.h"
 
+class ANavigationData;
 class AWaypoint;
 class USceneComponent;
+class UWaypointLoopRenderComponent;
+
+enum class EWaypointLoopChange : uint8
+{
+	Added,
+	Removed,
+	WaypointsChanged,
+	PropertiesChanged,
+};
+
+/** Cached navigation path from one waypoint of a loop to the next */
+USTRUCT()
+struct WAYPOINTS_API FWaypointSegmentPath
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		TArray<FVector> Points;
+
+	// Corridor of the path, expanded by the agent radius. Invalid until the segment has been computed.
+	UPROPERTY()
+		FBox Bounds = FBox(ForceInit);
+
+	// Hash of the endpoints, nav agent and navmesh tiles under the corridor the path was found with. 0 if unknown.
+	UPROPERTY()
+		uint32 Hash = 0;
+
+	bool HasBeenComputed() const { return Bounds.IsValid != 0; }
+};
+
+/** Segment paths and leg corridors of a loop for agents on other nav data than the one it was built for, found when an agent first needs them */
+struct FWaypointAgentProfilePaths
+{
+	// First agent that asked, every agent resolving to the same nav data shares its paths
+	FWaypointNavAgentInfoPtr NavAgent;
+
+	TArray<FWaypointSegmentPath> SegmentPaths;
+	TArray<FWaypointSegmentCorridor> LegCorridors;
+};
+
+#if WITH_EDITOR
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnWaypointLoopChanged, AWaypointLoop* /*Loop*/, EWaypointLoopChange /*Change*/);
+#endif // WITH_EDITOR
 
 UCLASS()
 class WAYPOINTS_API AWaypointLoop : public AActor
@@ -18,6 +67,10 @@ class WAYPOINTS_API AWaypointLoop : public AActor
 	UPROPERTY()
 		USceneComponent* Scene;
 
+	// Draws the paths of every segment in this loop in a single batch
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Waypoint Loop")
+		UWaypointLoopRenderComponent* PathRenderComponent;
+
 	UPROPERTY(EditInstanceOnly, Category="Waypoint Loop")
 		TArray<TWeakObjectPtr<AWaypoint>> Waypoints;
 
@@ -27,16 +80,187 @@ class WAYPOINTS_API AWaypointLoop : public AActor
 	UPROPERTY(EditInstanceOnly, Category = "Waypoint Loop")
 		FLinearColor SplineColor;
 
+	UPROPERTY(EditInstanceOnly, Category = "Visibility")
+		FWaypointVisibilityBakeSettings VisibilityBakeSettings;
+
 	void AddWaypoint(AWaypoint* NewWaypoint);
 	void InsertWaypoint(AWaypoint* NewWaypoint, int32 Index);
 	void RemoveWaypoint(const AWaypoint* Waypoint);
+
+	// Fills an empty loop with waypoints that don't belong to a loop yet, recalculating it a single time.
+	// Known paths are indexed by segment and only requeried if their hash doesn't match anymore.
+	void InitializeWaypoints(TConstArrayView<AWaypoint*> NewWaypoints, TArray<FWaypointSegmentPath>&& KnownSegmentPaths);
+
+	// Puts the points in a new order, NewOrder[i] being the current index of the point that ends up at i.
+	// Segments that still join the same two points keep their path.
+	void ReorderPoints(TConstArrayView<int32> NewOrder);
+
+	// Removes several waypoints at once, recalculating the loop a single time. Removed waypoints are detached from the loop.
+	void RemoveWaypoints(TConstArrayView<AWaypoint*> WaypointsToRemove);
+
 	int32 FindWaypoint(const AWaypoint* Elem) const;
 	AWaypoint* GetClosestWaypoint(const FVector& Location);
+	AWaypoint* GetWaypoint(int32 Index) const;
+
+	// Copies the location and patrol settings of a waypoint into the packed loop data
+	void UpdateWaypoint(const AWaypoint* Waypoint);
+
+	// Packed copy of the waypoints, in loop order. Runtime queries should read this instead of the actors.
+	const FWaypointLoopData& GetLoopData() const { return LoopData; }
+
+	// Immutable copy of the loop data, republished once a frame after changes, see FlushSnapshot. Safe to call from any thread for as long
+	// as the loop exists, the snapshot itself stays valid for as long as it's held. Called on the game thread, pending changes are published first.
+	FWaypointLoopSnapshotRef GetSnapshot();
+
+	// Publishes the changes made to the loop data since the last snapshot, called by the subsystem every frame
+	void FlushSnapshot() { SnapshotPublisher.Flush(LoopData); }
+
+	// Number of points in the loop, whether they come from waypoint actors or were generated
+	int32 GetNumPoints() const { return bGenerated ? LoopData.Num() : PointEntries.Num(); }
+
+	// Takes over a loop generated from the navmesh or decoded from a loop asset. Generated loops have no waypoint actors, only their packed data and paths.
+	// Their nav agent is resolved from the character class whenever it's needed, like waypoints do, so it follows nav data being registered again.
+	void SetGeneratedLoop(FWaypointLoopData&& InLoopData, TArray<FWaypointSegmentPath>&& InSegmentPaths, const UClass* InCharacterClass);
+	bool IsGenerated() const { return bGenerated; }
 
 	void RecalculateAllWaypoints();
 
+	// Revalidates every computed segment walking the nav data whose corridor overlaps one of the areas. An empty list means the whole nav data changed.
+	// Segments whose hash still matches keep their path, the others are requeried.
+	void InvalidateSegments(const ANavigationData& NavData, TConstArrayView<FBox> DirtyAreas);
+
+	const TArray<FWaypointSegmentPath>& GetSegmentPaths() const { return SegmentPaths; }
+
+	// Nav data that agents other than the loop's own have needed paths on
+	int32 GetNumAgentProfiles() const { return AgentProfiles.Num(); }
+
+	// Drops the profiles of nav data that is gone or that the loop's own agent now moves on
+	void PruneAgentProfiles();
+
+	// Length of the path from a point to the next one, the straight line until the segment has been computed
+	FVector::FReal GetSegmentLength(int32 SegmentIndex) const;
+
+	// Finds the paths of the given segments through async pathfinding and applies them on the game thread, for the loop's agent and every profile in use
+	void RequestSegmentPaths(TConstArrayView<int32> SegmentIndices);
+	void RequestSegmentPath(int32 SegmentIndex) { RequestSegmentPaths(MakeArrayView(&SegmentIndex, 1)); }
+
+	// Batches of segment paths requested by any loop that haven't been applied yet. Game thread only.
+	static int32 GetNumSegmentRequestsInFlight() { return NumSegmentRequestsInFlight; }
+
+	void SetSplineColor(const FLinearColor& NewColor);
+
+	// Identifies the loop in save games, stable between sessions for loops placed in a level or spawned from a loop asset
+	const FGuid& GetLoopGuid() const { return LoopGuid; }
+	void SetLoopGuid(const FGuid& NewGuid) { LoopGuid = NewGuid; }
+
+	// Nav agent the segments of this loop are pathfound for
+	FWaypointNavAgentInfoPtr GetNavAgentInfo() const;
+
+	// Path from the agent to the target point along the corridor shared by every agent on the same nav data walking that leg.
+	// Forward legs come with the segment paths of the agent's profile, other legs are queried the first time an agent needs them.
+	// Null until the corridor is found or if the agent isn't standing in it, the caller should find its own path then.
+	FNavPathSharedPtr MakeSharedCorridorPath(int32 TargetIndex, bool bReverse, const FVector& AgentLocation, const FWaypointNavAgentInfoPtr& AgentNavAgent, const UObject* Querier = nullptr);
+
+	// Reorders the waypoints to shorten the patrol path, waypoints marked as pinned keep their place. The new order is applied once it's found.
+	UFUNCTION(CallInEditor, Category = "Waypoint Loop")
+		void OptimizeWaypointOrder();
+
+	// Baked visibility of this loop, null if it was never baked or the waypoints moved since
+	const FWaypointVisibility* GetVisibility() const;
+
+	// Answers whether a guard at the waypoint closest to the observer can see the target from the baked visibility.
+	// Returns false if the loop has no valid bake or the target isn't covered by it, the caller should trace instead.
+	UFUNCTION(BlueprintCallable, Category = "Waypoint Loop|Visibility")
+		bool QueryBakedVisibility(const FVector& ObserverLocation, const FVector& TargetLocation, bool& bVisible) const;
+
+	virtual void PostActorCreated() override;
+	virtual void PostDuplicate(EDuplicateMode::Type DuplicateMode) override;
+	virtual void Destroyed() override;
+	virtual void PostRegisterAllComponents() override;
+	virtual void PostUnregisterAllComponents() override;
+
 #if WITH_EDITOR
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& Event) override;
 	virtual void PostLoad() override;
+	virtual void PostEditUndo() override;
+	virtual void PostEditImport() override;
+
+	/** Broadcast when a loop is created, destroyed, or has its waypoints or display properties edited */
+	static FOnWaypointLoopChanged OnLoopChanged;
 #endif // WITH_EDITOR
+
+protected:
+	// Traces from every waypoint to the others and to the samples around the loop, see FWaypointVisibility
+	UFUNCTION(CallInEditor, Category = "Visibility")
+		void BakeVisibility();
+
+	void NotifyLoopChanged(EWaypointLoopChange Change);
+
+	// Profile INDEX_NONE is the loop's own agent
+	void SetSegmentPath(int32 SegmentIndex, TArray<FVector>&& Points, const FBox& Bounds, uint32 Hash, int32 ProfileIndex = INDEX_NONE);
+
+	// Forgets the path of a segment and the corridors of its legs, so it's queried again whatever its hash
+	void ResetSegment(int32 SegmentIndex, int32 ProfileIndex = INDEX_NONE);
+
+	// Drops the shared corridors of both legs walking a segment
+	void ResetLegCorridors(int32 SegmentIndex, int32 ProfileIndex = INDEX_NONE);
+
+	void RequestProfileSegmentPaths(int32 ProfileIndex, TConstArrayView<int32> SegmentIndices);
+
+	// Queries the corridor of a leg in the background, see MakeSharedCorridorPath
+	void RequestLegCorridor(int32 ProfileIndex, int32 TargetIndex, bool bReverse);
+	void InvalidateProfileSegments(int32 ProfileIndex, TConstArrayView<FBox> DirtyAreas);
+
+	// Profile of the nav data an agent moves on, INDEX_NONE if it's the loop's own. New profiles have all their segments requested.
+	int32 FindOrAddAgentProfile(const FWaypointNavAgentInfoPtr& NavAgent);
+
+	TArray<FWaypointSegmentPath>& GetProfileSegmentPaths(int32 ProfileIndex) { return AgentProfiles.IsValidIndex(ProfileIndex) ? AgentProfiles[ProfileIndex].SegmentPaths : SegmentPaths; }
+	TArray<FWaypointSegmentCorridor>& GetProfileCorridors(int32 ProfileIndex) { return AgentProfiles.IsValidIndex(ProfileIndex) ? AgentProfiles[ProfileIndex].LegCorridors : LegCorridors; }
+
+	// Rebuilds the packed data and the handles of every loaded waypoint from the Waypoints array
+	void RebuildLoopData();
+
+	// Packs the waypoint of an entry of the Waypoints array as the point at Index. Handles of the other points stay valid.
+	void InsertPackedPoint(int32 Entry, int32 Index);
+
+	// Removes a point and its entry of the Waypoints array, its waypoint's handle is reset. Handles of the other points stay valid.
+	void RemovePackedPoint(int32 Index);
+
+	// Sends the computed segment paths to the render component
+	void RefreshPathRendering();
+
+	FWaypointLoopData LoopData;
+
+	// Entry of the Waypoints array each point was packed from. Entries of waypoints that aren't loaded are kept, they just have no point.
+	TArray<int32> PointEntries;
+
+	FWaypointLoopSnapshotPublisher SnapshotPublisher;
+
+	bool bGenerated = false;
+
+	static int32 NumSegmentRequestsInFlight;
+
+	// Character a generated loop was pathfound for, the default agent if null. Waypoint actors provide their own.
+	TWeakObjectPtr<const UClass> GeneratedCharacterClass;
+
+	// Path of each segment, indexed by the waypoint it starts from. Saved with the map so loading only requeries segments whose hash changed.
+	UPROPERTY()
+		TArray<FWaypointSegmentPath> SegmentPaths;
+
+	UPROPERTY()
+		FWaypointVisibility Visibility;
+
+	UPROPERTY()
+		FGuid LoopGuid;
+
+	// Shared corridor of the leg to each point, two per point for patrols walking the loop either way. Not saved, polygon refs are only valid for the navmesh they were found on.
+	TArray<FWaypointSegmentCorridor> LegCorridors;
+
+	// Paths for agents on other nav data, one profile per nav data. Not saved, only profiles agents use at runtime are computed.
+	TArray<FWaypointAgentProfilePaths> AgentProfiles;
+
+	// Whether the bake matches the points, checked again whenever the loop data changes
+	mutable uint32 VisibilityCheckedRevision = 0;
+	mutable bool bVisibilityChecked = false;
+	mutable bool bVisibilityValid = false;
 };
@@ -0,0 +1,100 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/BulkData.h"
+#include "Engine/DataAsset.h"
+#include "WaypointLoopData.h"
+#include "WaypointLoopAsset.generated.h"
+
+class ACharacter;
+class AWaypointLoop;
+struct FWaypointSegmentPath;
+
+/** Per loop settings of a loop asset, the points themselves live in the packed payload */
+USTRUCT()
+struct WAYPOINTS_API FWaypointLoopAssetEntry
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, Category = "Waypoint Loop")
+		FName Name;
+
+	UPROPERTY(EditAnywhere, Category = "Waypoint Loop")
+		FLinearColor SplineColor = FLinearColor::White;
+
+	// Character the segment paths were baked for
+	UPROPERTY(EditAnywhere, Category = "Waypoint Loop")
+		TSubclassOf<ACharacter> CharacterClass;
+
+	UPROPERTY(VisibleAnywhere, Category = "Waypoint Loop")
+		int32 NumPoints = 0;
+};
+
+/**
+ * Waypoint loops baked into a single binary payload, for maps with too many points to keep as actors.
+ * Positions are quantized to the centimetre relative to the origin of their cell, point parameters are packed,
+ * and the path of every segment is baked along with the hash it was found with.
+ * The payload is bulk data that is never decoded as a whole: loading it creates no object per point, and it is
+ * memory mapped where the platform allows it. Loops are decoded one at a time when they are spawned.
+ */
+UCLASS(BlueprintType)
+class WAYPOINTS_API UWaypointLoopAsset : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	/** Side of a cell, positions are stored as 16 bit centimetre offsets from the corner of their cell */
+	static constexpr int32 CellSize = 65536;
+
+	/** Replaces the contents of the asset with the given loops. Their paths are rehashed against the quantized endpoints. */
+	bool Build(TConstArrayView<const AWaypointLoop*> SourceLoops);
+
+	int32 GetNumLoops() const { return Loops.Num(); }
+	const FWaypointLoopAssetEntry& GetLoopEntry(int32 LoopIndex) const { return Loops[LoopIndex]; }
+
+	/**
+	 * Decodes the points of a loop, and optionally its baked paths, without touching any UObject.
+	 * The agent radius is what the path corridors were expanded by. Safe to call from any thread, the payload stays locked while it's read.
+	 */
+	bool DecodeLoop(int32 LoopIndex, FWaypointLoopData& OutLoopData, TArray<FWaypointSegmentPath>* OutSegmentPaths = nullptr, float AgentRadius = 0.f) const;
+
+	/**
+	 * Spawns a loop in the world. Without waypoint actors the loop only holds its packed data, like a generated loop,
+	 * and is transient since that data isn't saved with the level. Otherwise it's converted back to a regular loop that can be edited.
+	 * Baked paths are kept while their hash matches.
+	 */
+	AWaypointLoop* SpawnLoop(UWorld* World, int32 LoopIndex, bool bSpawnWaypoints = false) const;
+
+	/** Size of the packed payload in bytes */
+	int64 GetPayloadSize() const { return Payload.GetBulkDataSize(); }
+
+	virtual void Serialize(FArchive& Ar) override;
+	virtual void BeginDestroy() override;
+
+protected:
+	// Replaces the contents of the asset with every waypoint loop of the level open in the editor
+	UFUNCTION(CallInEditor, Category = "Waypoint Loop Asset")
+		void BuildFromEditorLevel();
+
+	// Spawns every loop of the asset in the level open in the editor, with waypoint actors
+	UFUNCTION(CallInEditor, Category = "Waypoint Loop Asset")
+		void SpawnInEditorLevel();
+
+	/** Locks the payload the first time it's needed and keeps it locked, returns null if it isn't a valid payload */
+	const uint8* GetPayloadData() const;
+
+	void ReleasePayloadData();
+
+	/** Replaces the payload with the given bytes, waiting for decodes in flight to finish */
+	void SetPayload(TConstArrayView<uint8> Bytes);
+
+	UPROPERTY(EditAnywhere, EditFixedSize, Category = "Waypoint Loop Asset")
+		TArray<FWaypointLoopAssetEntry> Loops;
+
+	FByteBulkData Payload;
+
+	mutable FCriticalSection PayloadLock;
+	mutable const uint8* PayloadData = nullptr;
+};
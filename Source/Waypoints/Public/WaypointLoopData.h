@@ -0,0 +1,117 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Stable reference to a point of a loop. Survives other points being inserted or removed, and goes stale once its own point is removed. */
+struct FWaypointHandle
+{
+	uint32 Slot = 0;
+
+	// 0 is never handed out, so a default handle is always invalid
+	uint32 Generation = 0;
+
+	bool IsValid() const { return Generation != 0; }
+
+	bool operator==(const FWaypointHandle& Other) const { return Slot == Other.Slot && Generation == Other.Generation; }
+	bool operator!=(const FWaypointHandle& Other) const { return !(*this == Other); }
+
+	friend uint32 GetTypeHash(const FWaypointHandle& Handle)
+	{
+		return HashCombine(Handle.Slot, Handle.Generation);
+	}
+};
+
+enum class EWaypointPointFlags : uint8
+{
+	None = 0,
+	OrientGuardToWaypoint = 1 << 0,
+	StopOnOverlap = 1 << 1,
+};
+ENUM_CLASS_FLAGS(EWaypointPointFlags);
+
+/** Everything a patrol needs to know about a point, besides its location */
+struct FWaypointPointParams
+{
+	FVector3f FacingDirection = FVector3f::ForwardVector;
+	float WaitTime = 0.f;
+	float AcceptanceRadius = 128.f;
+	EWaypointPointFlags Flags = EWaypointPointFlags::StopOnOverlap;
+};
+
+/**
+ * Packed copy of the points of a waypoint loop, in loop order.
+ * Locations are kept in their own array so spatial queries scan contiguous memory, and nothing in here references a UObject.
+ */
+struct WAYPOINTS_API FWaypointLoopData
+{
+public:
+	int32 Num() const { return Locations.Num(); }
+	bool IsValidIndex(int32 Index) const { return Locations.IsValidIndex(Index); }
+
+	const FVector& GetLocation(int32 Index) const { return Locations[Index]; }
+	const FWaypointPointParams& GetParams(int32 Index) const { return Params[Index]; }
+	TConstArrayView<FVector> GetLocations() const { return Locations; }
+
+	int32 GetNextIndex(int32 Index) const { return Num() > 0 ? (Index + 1) % Num() : INDEX_NONE; }
+	int32 GetPreviousIndex(int32 Index) const { return Num() > 0 ? (Index + Num() - 1) % Num() : INDEX_NONE; }
+
+	/** Returns the handle of the point at the given position */
+	FWaypointHandle GetHandle(int32 Index) const;
+
+	/** Returns the current position of a point, or INDEX_NONE if the handle is stale */
+	int32 ResolveHandle(FWaypointHandle Handle) const;
+
+	/** Position of the point closest to the location, INDEX_NONE if the loop is empty */
+	int32 FindClosestPoint(const FVector& Location) const;
+
+	/** Position of the point closest to the location if it's within the tolerance, INDEX_NONE otherwise */
+	int32 FindPointAt(const FVector& Location, float Tolerance) const;
+
+	/** Positions of the points closest to the location, closest first, at most MaxPoints of them */
+	void FindClosestPoints(const FVector& Location, int32 MaxPoints, TArray<int32>& OutIndices) const;
+
+	/** Inserts a point at the given position, or at the end if the index is INDEX_NONE */
+	FWaypointHandle InsertPoint(const FVector& Location, const FWaypointPointParams& PointParams, int32 Index = INDEX_NONE);
+
+	void RemovePoint(int32 Index);
+
+	void UpdatePoint(int32 Index, const FVector& Location, const FWaypointPointParams& PointParams);
+
+	/** Moves the points into a new order, NewOrder[i] being the current position of the point that ends up at i. Handles stay valid. */
+	void Reorder(TConstArrayView<int32> NewOrder);
+
+	/** Removes every point, handles given out so far go stale */
+	void Reset();
+
+	SIZE_T GetAllocatedSize() const;
+
+	/** Hash of the point locations, stable between sessions so it can be saved to tell whether a loop moved since */
+	uint32 HashLocations() const;
+
+	/** Changes every time a point is inserted, removed or updated, so data derived from the points can tell it's stale */
+	uint32 GetRevision() const { return Revision; }
+
+private:
+	struct FSlot
+	{
+		int32 PointIndex = INDEX_NONE;
+		uint32 Generation = 1;
+	};
+
+	uint32 AllocateSlot(int32 PointIndex);
+	void FreeSlot(uint32 Slot);
+
+	/** Points the slots of every point from Index on back to their position after an insert or remove */
+	void FixupSlots(int32 FirstIndex);
+
+	TArray<FVector> Locations;
+	TArray<FWaypointPointParams> Params;
+	TArray<uint32> PointSlots;
+
+	TArray<FSlot> Slots;
+	TArray<uint32> FreeSlots;
+
+	uint32 Revision = 0;
+};
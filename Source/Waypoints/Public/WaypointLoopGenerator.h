@@ -0,0 +1,88 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WaypointLoop.h"
+#include "WaypointLoopData.h"
+#include "WaypointNavAgentCache.h"
+
+/** What a procedurally generated loop should look like */
+struct FWaypointLoopGenerationParams
+{
+	/** Area the points are sampled in. The navmesh is searched over its whole height. */
+	FBox Region = FBox(ForceInit);
+
+	int32 NumPoints = 8;
+
+	/** Minimum distance between two points of the loop */
+	float MinSpacing = 500.f;
+
+	/** Fraction of the segments that must have a complete path for the loop to be kept, from 0 to 1 */
+	float MinReachability = 1.f;
+
+	/** Sampling attempts per requested point before giving up on filling the loop */
+	int32 MaxAttemptsPerPoint = 30;
+
+	int32 Seed = 0;
+
+	/** Character the loop is generated for, picks the navmesh and agent size. Default agent if null. */
+	const UClass* CharacterClass = nullptr;
+
+	/** Patrol settings given to every point. The facing direction is replaced by the direction to the next point. */
+	FWaypointPointParams PointParams;
+};
+
+struct FWaypointLoopGenerationResult
+{
+	FWaypointLoopData LoopData;
+	TArray<FWaypointSegmentPath> SegmentPaths;
+
+	/** Fraction of the segments of the final loop that have a complete path */
+	float Reachability = 0.f;
+
+	bool bSuccess = false;
+};
+
+DECLARE_DELEGATE_OneParam(FOnWaypointLoopGenerated, AWaypointLoop* /*Loop, null if generation failed*/);
+
+struct FWaypointSegmentQuery;
+struct FWaypointSegmentPathResult;
+
+/**
+ * Builds waypoint loops from the navmesh without spawning a waypoint actor per point.
+ * Points are sampled in the region, ordered into a loop around their centroid, and every segment is pathfound.
+ * Points that can neither be reached nor left are dropped and their neighbours joined up, until every remaining point is connected.
+ * Everything runs on the game thread: the generator hands out the queries of each pass and takes their paths back,
+ * UWaypointSubsystem::GenerateLoop runs them through async pathfinding in between.
+ */
+class WAYPOINTS_API FWaypointLoopGenerator
+{
+public:
+	FWaypointLoopGenerator(const FWaypointLoopGenerationParams& InParams, const FWaypointNavAgentInfoPtr& InNavAgent);
+
+	/** Scatters the points over the navmesh and orders them into a loop. Returns false if there's no nav data to sample. */
+	bool SamplePoints();
+
+	/** Queries of the segments whose path isn't known yet, none once the loop has settled */
+	void GetPendingQueries(TArray<FWaypointSegmentQuery>& OutQueries) const;
+
+	/** Takes the paths of the pending queries, then drops the points they cut off from the loop */
+	void ApplyPaths(TConstArrayView<FWaypointSegmentQuery> Queries, TArray<FWaypointSegmentPathResult>& Results);
+
+	/** Builds the loop out of the settled points, fails if too few of its segments are reachable */
+	void Finish(FWaypointLoopGenerationResult& OutResult);
+
+private:
+	/** Drops the points that can neither be reached nor left and marks the segments joining their neighbours up as pending */
+	void DropCutOffPoints();
+
+	FWaypointLoopGenerationParams Params;
+	FWaypointNavAgentInfoPtr NavAgent;
+
+	// Segment i goes from point i to the next one. Only the segments next to a dropped point are queried again.
+	TArray<FVector> Points;
+	TArray<FWaypointSegmentPath> Segments;
+	TArray<bool> Reachable;
+	TArray<bool> Dirty;
+};
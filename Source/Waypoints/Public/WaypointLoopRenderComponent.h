@@ -0,0 +1,57 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/PrimitiveComponent.h"
+#include "WaypointLoopRenderComponent.generated.h"
+
+/**
+ * Draws every path segment of a waypoint loop as one batched line list.
+ * Segment N is the path from waypoint N to waypoint N + 1, stored in world space.
+ * Segments are pushed to the render thread individually, so a single path result never rebuilds the whole loop.
+ */
+UCLASS(ClassGroup = Rendering, hidecategories = (Object, LOD, Lighting, TextureStreaming, Collision, Physics))
+class WAYPOINTS_API UWaypointLoopRenderComponent : public UPrimitiveComponent
+{
+	GENERATED_UCLASS_BODY()
+
+public:
+	struct FSegment
+	{
+		TArray<FVector> Points;
+		FBox Bounds = FBox(ForceInit);
+	};
+
+	/** Replaces the points of a single segment */
+	void SetSegment(int32 SegmentIndex, TArrayView<const FVector> Points);
+
+	/** Grows or shrinks the segment list to match the loop */
+	void SetNumSegments(int32 NumSegments);
+
+	void ClearSegments();
+
+	void SetLineColor(const FLinearColor& InLineColor);
+
+	int32 GetNumSegments() const { return Segments.Num(); }
+
+	/** True if paths should be computed and drawn in this world (always in the editor, opt-in through Waypoints.ShowPaths in development game builds) */
+	static bool IsPathDrawingEnabled(const UWorld* World);
+
+	//~ Begin UPrimitiveComponent Interface
+	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+	//~ End UPrimitiveComponent Interface
+
+	UPROPERTY(EditAnywhere, Category = "Rendering", meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float LineThickness;
+
+	// Vertical offset applied when drawing, so the path isn't hidden inside the floor
+	UPROPERTY(EditAnywhere, Category = "Rendering")
+		float HeightOffset;
+
+protected:
+	TArray<FSegment> Segments;
+
+	FLinearColor LineColor;
+};
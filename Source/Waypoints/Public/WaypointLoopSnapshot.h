@@ -0,0 +1,73 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/RefCounting.h"
+#include "WaypointLoopData.h"
+
+#include <atomic>
+
+/** Immutable copy of the packed data of a loop as it was at one point, see FWaypointLoopSnapshotPublisher */
+class WAYPOINTS_API FWaypointLoopSnapshot : public FThreadSafeRefCountedObject
+{
+public:
+	FWaypointLoopSnapshot(const FWaypointLoopData& InLoopData, uint32 InVersion)
+		: LoopData(InLoopData)
+		, Version(InVersion)
+	{
+	}
+
+	const FWaypointLoopData& GetLoopData() const { return LoopData; }
+
+	/** Increases every time the loop publishes a new snapshot */
+	uint32 GetVersion() const { return Version; }
+
+private:
+	const FWaypointLoopData LoopData;
+	const uint32 Version;
+};
+
+typedef TRefCountPtr<const FWaypointLoopSnapshot> FWaypointLoopSnapshotRef;
+
+/**
+ * Latest snapshot of a loop, replaced in one atomic swap once per batch of changes the game thread makes to the loop.
+ * Readers on any thread take a reference to the current snapshot without locking and keep a consistent view for as long as they hold it.
+ * Replaced snapshots are freed once the last reader lets go of them. The publisher only waits for readers that are in the middle of
+ * taking their reference, a window of a few instructions, and leaves the rest for the next flush if they take too long.
+ */
+class WAYPOINTS_API FWaypointLoopSnapshotPublisher : public FNoncopyable
+{
+public:
+	~FWaypointLoopSnapshotPublisher();
+
+	/** Replaces the current snapshot with a copy of the data. Single writer, called by the game thread as it edits the loop. */
+	void Publish(const FWaypointLoopData& LoopData);
+
+	/** Notes that the data changed without copying it, so a batch of edits only publishes once. Game thread only. */
+	void MarkDirty() { bDirty = true; }
+
+	bool IsDirty() const { return bDirty; }
+
+	/**
+	 * Publishes the data if it changed since the last publish, and frees the snapshots an earlier publish had to leave to readers.
+	 * Called once a frame by the game thread, and before the game thread reads the snapshot itself.
+	 */
+	void Flush(const FWaypointLoopData& LoopData);
+
+	/** Current snapshot, null if nothing was published yet. Lock free and safe from any thread while the publisher exists. */
+	FWaypointLoopSnapshotRef Acquire() const;
+
+private:
+	/** Drops the publisher's reference to replaced snapshots once no reader can be about to take one */
+	void ReleaseRetired(bool bWait);
+
+	std::atomic<const FWaypointLoopSnapshot*> Current{ nullptr };
+
+	// Readers between loading Current and adding their reference
+	mutable std::atomic<int32> NumAcquiring{ 0 };
+
+	TArray<const FWaypointLoopSnapshot*> Retired;
+	uint32 Version = 0;
+	bool bDirty = false;
+};
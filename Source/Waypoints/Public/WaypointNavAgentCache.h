@@ -0,0 +1,57 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AI/Navigation/NavigationTypes.h"
+#include "Misc/ScopeRWLock.h"
+#include "UObject/ObjectKey.h"
+
+class ANavigationData;
+class UNavigationSystemV1;
+
+/** Navigation settings resolved for one character class. Never modified after it's published, so it can be read from any thread. */
+struct FWaypointNavAgentInfo
+{
+	FWaypointNavAgentInfo(const FNavAgentProperties& InAgentProperties, const ANavigationData* InNavData)
+		: AgentProperties(InAgentProperties)
+		, NavData(InNavData)
+	{
+	}
+
+	// Agent used for path queries, derived from the character's capsule
+	const FNavAgentProperties AgentProperties;
+
+	// Nav data the character moves on, weak so a stale entry can't keep it alive
+	const TWeakObjectPtr<const ANavigationData> NavData;
+};
+
+typedef TSharedPtr<const FWaypointNavAgentInfo, ESPMode::ThreadSafe> FWaypointNavAgentInfoPtr;
+
+/**
+ * Per character class cache of nav agent properties and nav data.
+ * Entries are resolved on the game thread and can be looked up from any thread.
+ * Invalidating the cache drops the entries but never mutates them, so readers holding an entry stay valid.
+ */
+class WAYPOINTS_API FWaypointNavAgentCache
+{
+public:
+	/** Thread safe lookup, returns null if the class hasn't been resolved yet */
+	FWaypointNavAgentInfoPtr Find(const UClass* CharacterClass) const;
+
+	/** Returns the cached entry, resolving it through the navigation system first if needed. Game thread only. */
+	FWaypointNavAgentInfoPtr FindOrResolve(UNavigationSystemV1& NavSys, const UClass* CharacterClass);
+
+	/** Drops every entry, called when nav data or character defaults change */
+	void Invalidate();
+
+	/** Incremented on every invalidation */
+	uint32 GetGeneration() const { return Generation; }
+
+private:
+	static FWaypointNavAgentInfoPtr Resolve(UNavigationSystemV1& NavSys, const UClass* CharacterClass);
+
+	mutable FRWLock Lock;
+	TMap<TObjectKey<UClass>, FWaypointNavAgentInfoPtr> Entries;
+	TAtomic<uint32> Generation { 0 };
+};
@@ -0,0 +1,84 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FWaypointOccupancyParams
+{
+	/** Size of a grid cell, the field is flat and ignores height */
+	float CellSize = 200.f;
+
+	/** Guards watch every cell whose center is within this distance of them */
+	float WatchRadius = 500.f;
+
+	/** Walking speed of the guards, in cm/s */
+	float GuardSpeed = 300.f;
+
+	/** Guards on each loop, assumed to be spread evenly around it */
+	int32 GuardsPerLoop = 1;
+
+	/** Time step patrols are sampled at, cells a guard only crosses in less than this may be missed */
+	float SampleInterval = 0.25f;
+
+	/** Cells are made larger if the grid would have more than this */
+	int32 MaxCells = 1 << 20;
+};
+
+/** Patrol of one loop, copied off the loop so the field can be built on any thread */
+struct FWaypointOccupancyLoop
+{
+	/** Path of the leg from each point to the next one, ending on it */
+	TArray<TArray<FVector>> LegPaths;
+
+	/** Time guards wait at the end of each leg */
+	TArray<float> WaitTimes;
+};
+
+struct FWaypointOccupancyCell
+{
+	/** Fraction of the time at least one guard watches the cell */
+	float Presence = 0.f;
+
+	/** Time until a guard next watches the cell, averaged over every moment of the patrol. 0 while watched, negative if it never is. */
+	float MeanTimeToVisit = -1.f;
+
+	/** Longest time the cell goes unwatched, negative if it's never watched */
+	float MaxUnwatchedTime = -1.f;
+
+	bool IsWatched() const { return Presence > 0.f; }
+};
+
+/**
+ * Coarse grid of how much each spot is watched by patrols, built from the loops, their segment paths and waits
+ * by following one cycle of each patrol. Answers "how often is this spot watched" in constant time without looking at any guard.
+ * Loops aren't synchronized with each other: presence combines them as independent, while times to visit are those of the loop
+ * watching the cell most often, which makes them an upper bound where loops overlap.
+ */
+class WAYPOINTS_API FWaypointOccupancyField
+{
+public:
+	/** Builds the field of the loops, replacing its contents. Loops are followed in parallel, safe to call from worker threads. */
+	static void Build(TConstArrayView<FWaypointOccupancyLoop> Loops, const FWaypointOccupancyParams& Params, FWaypointOccupancyField& OutField);
+
+	bool IsEmpty() const { return Cells.Num() == 0; }
+
+	/** Cell under a location, null outside the field */
+	const FWaypointOccupancyCell* FindCell(const FVector& Location) const;
+
+	/** Area covered by the field, cells outside of it are never watched */
+	FBox2D GetBounds() const;
+	float GetCellSize() const { return CellSize; }
+	FIntPoint GetSize() const { return FIntPoint(SizeX, SizeY); }
+
+	const FWaypointOccupancyCell& GetCell(int32 X, int32 Y) const { return Cells[Y * SizeX + X]; }
+
+private:
+	FVector2D Origin = FVector2D::ZeroVector;
+	float CellSize = 0.f;
+	int32 SizeX = 0;
+	int32 SizeY = 0;
+	TArray<FWaypointOccupancyCell> Cells;
+};
+
+typedef TSharedPtr<const FWaypointOccupancyField, ESPMode::ThreadSafe> FWaypointOccupancyFieldPtr;
@@ -0,0 +1,101 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AI/Navigation/NavigationTypes.h"
+#include "Templates/SubclassOf.h"
+
+class AActor;
+class AController;
+class ANavigationData;
+class UNavigationQueryFilter;
+
+DECLARE_DELEGATE_TwoParams(FOnWaypointPathRequestFinished, uint32 /*RequestId*/, FNavPathSharedPtr /*Path*/);
+
+/** A path a patrolling agent wants for its next leg */
+struct FWaypointPathRequest
+{
+	// Used to prioritize the request, agents close to players or on screen are serviced first
+	TWeakObjectPtr<AController> Requester;
+
+	FVector Start = FVector::ZeroVector;
+
+	TWeakObjectPtr<AActor> Goal;
+
+	TWeakObjectPtr<const ANavigationData> NavData;
+
+	FNavAgentProperties AgentProperties;
+
+	TSubclassOf<UNavigationQueryFilter> FilterClass;
+
+	bool bAllowPartialPath = true;
+
+	// Called on the game thread once the path was found, with a null path if it failed
+	FOnWaypointPathRequestFinished OnFinished;
+};
+
+/**
+ * Spreads patrol path queries across frames.
+ * Each frame only a limited number of queries, within a time budget, are serviced, highest priority first.
+ * Requests for the same goal starting from the same spot are merged and share one query.
+ */
+class WAYPOINTS_API FWaypointPathRequestQueue
+{
+public:
+	/** Queues a request and returns its id, never 0 */
+	uint32 AddRequest(FWaypointPathRequest&& Request);
+
+	/** Drops a pending request, its delegate will not be called */
+	void CancelRequest(uint32 RequestId);
+
+	/** Services as many requests as the budget allows */
+	void ProcessRequests(UWorld& World);
+
+	int32 GetNumPendingRequests() const { return RequestKeys.Num(); }
+
+	/** True until the request is serviced or cancelled */
+	bool IsRequestPending(uint32 RequestId) const { return RequestKeys.Contains(RequestId); }
+
+	/** True if requests should go through the queue at all (Waypoints.PathQueue.Enabled) */
+	static bool IsEnabled();
+
+private:
+	struct FMergeKey
+	{
+		TWeakObjectPtr<AActor> Goal;
+		TWeakObjectPtr<const ANavigationData> NavData;
+		const UClass* FilterClass = nullptr;
+		FIntVector StartCell;
+
+		bool operator==(const FMergeKey& Other) const
+		{
+			return Goal == Other.Goal && NavData == Other.NavData && FilterClass == Other.FilterClass && StartCell == Other.StartCell;
+		}
+
+		friend uint32 GetTypeHash(const FMergeKey& Key)
+		{
+			uint32 Hash = GetTypeHash(Key.Goal);
+			Hash = HashCombine(Hash, GetTypeHash(Key.NavData));
+			Hash = HashCombine(Hash, ::PointerHash(Key.FilterClass));
+			return HashCombine(Hash, GetTypeHash(Key.StartCell));
+		}
+	};
+
+	struct FRequestGroup
+	{
+		TArray<TPair<uint32, FWaypointPathRequest>> Requests;
+		double QueuedTime = 0.;
+	};
+
+	static FMergeKey MakeKey(const FWaypointPathRequest& Request);
+
+	/** Lower is serviced first */
+	static float GetPriority(const FRequestGroup& Group, TConstArrayView<FVector> PlayerLocations, double CurrentTime);
+
+	void ServiceGroup(UWorld& World, FRequestGroup& Group);
+
+	TMap<FMergeKey, FRequestGroup> Groups;
+	TMap<uint32, FMergeKey> RequestKeys;
+	uint32 NextRequestId = 1;
+};
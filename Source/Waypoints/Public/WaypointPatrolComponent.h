@@ -0,0 +1,153 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/BehaviorTreeTypes.h"
+#include "Components/ActorComponent.h"
+#include "WaypointLoopData.h"
+#include "WaypointResumeQuery.h"
+#include "WaypointPatrolComponent.generated.h"
+
+class AController;
+class AWaypoint;
+class AWaypointLoop;
+class UBlackboardData;
+class UWaypointPatrolComponent;
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnPatrolWaypointChanged, UWaypointPatrolComponent* /*PatrolComponent*/);
+
+/**
+ * Loop an agent patrols and the waypoint it is heading to.
+ * Patrol tasks and decorators read and advance it directly instead of going through a blackboard key,
+ * so moving on to the next waypoint doesn't trigger blackboard observers. Add it to the AI controller or its pawn.
+ */
+UCLASS(ClassGroup = AI, meta = (BlueprintSpawnableComponent))
+class WAYPOINTS_API UWaypointPatrolComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UWaypointPatrolComponent();
+
+	/** Patrol component of an AI, looked up on the controller first and then on its pawn */
+	static UWaypointPatrolComponent* FindPatrolComponent(const AController* Controller);
+
+	/** Starts patrolling a loop from one of its points, or from the point closest to the agent if the index is invalid */
+	UFUNCTION(BlueprintCallable, Category = "Waypoints")
+		void SetLoop(AWaypointLoop* NewLoop, int32 StartIndex = -1, bool bReverse = false);
+
+	/** Rejoins a loop where a resume point query said to */
+	UFUNCTION(BlueprintCallable, Category = "Waypoints")
+		void SetResumePoint(const FWaypointResumePoint& ResumePoint);
+
+	/** Heads for a waypoint, patrolling the loop it belongs to */
+	UFUNCTION(BlueprintCallable, Category = "Waypoints")
+		void SetCurrentWaypoint(AWaypoint* Waypoint);
+
+	UFUNCTION(BlueprintCallable, Category = "Waypoints")
+		void AdvanceToNextWaypoint();
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Waypoints")
+		AWaypointLoop* GetLoop() const { return Loop.Get(); }
+
+	/** Waypoint actor the agent is heading to. Null for generated loops, which only have points. */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Waypoints")
+		AWaypoint* GetCurrentWaypoint() const;
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Waypoints")
+		bool IsReversed() const { return bReverseDirection; }
+
+	/** Index of the current point in the loop, -1 if there is none */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Waypoints")
+		int32 GetCurrentIndex() const;
+
+	/** Location and patrol settings of the current point, from the packed loop data. Returns false if there is none. */
+	bool GetCurrentPoint(FVector& OutLocation, FWaypointPointParams& OutParams) const;
+
+	/** Pawn of the controller the component is on, or the actor it is on otherwise */
+	AActor* GetAgent() const;
+
+	/** Called by patrol tasks when the agent starts and stops waiting at its current point, so the wait can be saved */
+	void StartWait(float Duration);
+	void EndWait();
+
+	/** Time left to wait at the current point, 0 if the agent isn't waiting */
+	float GetRemainingWaitTime() const;
+
+	/** Puts the agent back where a save game left it, see FWaypointPatrolSaveData. The next patrol task finishes the interrupted wait. */
+	void RestorePatrol(AWaypointLoop* NewLoop, int32 PointIndex, bool bReverse, float RemainingWaitTime);
+
+	/** Wait restored from a save game, handed to the patrol task that starts next. Returns 0 if there is none. */
+	float ConsumeRestoredWaitTime();
+
+	/**
+	 * Follows another agent's patrol as part of its squad instead of patrolling alone. Only the leader pathfinds,
+	 * followers keep to a slot at the offset from the leader along its path, X forward and Y right of its heading.
+	 * Following a follower joins its leader. Setting a loop on a follower takes it out of the squad.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Waypoints|Squad")
+		void JoinSquad(UWaypointPatrolComponent* Leader, FVector FormationOffset);
+
+	UFUNCTION(BlueprintCallable, Category = "Waypoints|Squad")
+		void LeaveSquad();
+
+	/** Agent whose patrol this one follows, null if it patrols on its own or leads a squad */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Waypoints|Squad")
+		UWaypointPatrolComponent* GetSquadLeader() const { return SquadLeader.Get(); }
+
+	bool IsSquadFollower() const { return SquadLeader.IsValid(); }
+
+	/** Where this follower should stand, on the navmesh next to the leader's path. Returns false if it isn't following anyone. */
+	bool GetFormationSlot(FVector& OutLocation) const;
+
+	/** Broadcast whenever the current point changes */
+	FOnPatrolWaypointChanged OnWaypointChanged;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Takes the loop, current point and wait of the squad leader */
+	void SyncWithLeader();
+
+	void NotifyWaypointChanged();
+
+	/** Closest point of the loop to the agent, used when the current point was removed from the loop */
+	int32 FindClosestIndex() const;
+
+	void SyncBlackboard();
+
+	UPROPERTY(EditInstanceOnly, Category = "Patrol")
+		TWeakObjectPtr<AWaypointLoop> Loop;
+
+	/** if set, the loop is patrolled from each waypoint to the previous one */
+	UPROPERTY(EditAnywhere, Category = "Patrol")
+		bool bReverseDirection = false;
+
+	/** if set, the current waypoint is also written to a blackboard key, for trees that still read it from there */
+	UPROPERTY(EditAnywhere, Category = "Blackboard")
+		bool bSyncBlackboard = false;
+
+	UPROPERTY(EditAnywhere, Category = "Blackboard", meta = (EditCondition = "bSyncBlackboard"))
+		FName BlackboardKeyName = TEXT("Waypoint");
+
+	/** Point of the loop the agent is heading to */
+	FWaypointHandle CurrentHandle;
+
+	FBlackboard::FKey BlackboardKeyID = FBlackboard::InvalidKey;
+
+	/** Blackboard asset the key was resolved against, running another tree can switch it */
+	TWeakObjectPtr<const UBlackboardData> BlackboardKeyAsset;
+
+	/** World time the wait at the current point ends, negative while not waiting */
+	double WaitEndTime = -1.;
+
+	float RestoredWaitTime = 0.f;
+
+	TWeakObjectPtr<UWaypointPatrolComponent> SquadLeader;
+	TArray<TWeakObjectPtr<UWaypointPatrolComponent>> SquadFollowers;
+
+	/** Slot of a follower relative to the leader's heading */
+	FVector FormationOffset = FVector::ZeroVector;
+};
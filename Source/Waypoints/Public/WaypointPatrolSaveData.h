@@ -0,0 +1,30 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWaypointPatrolComponent;
+class UWorld;
+
+/**
+ * Patrol progress of many agents packed into one binary block for save games: the loop, the point the agent is heading to,
+ * how far along the leg it is and how long it still has to wait. Loops are written once to a table by guid and agents refer
+ * to them by index, so restoring resolves every loop a single time instead of an actor reference per agent.
+ * Agents are matched by their order in the arrays given to Save and Restore, the game keeps its own list of guards.
+ */
+struct WAYPOINTS_API FWaypointPatrolSaveData
+{
+	/** Packs the patrol state of the components into the data, replacing its contents. Null components are saved as not patrolling. */
+	static void Save(TConstArrayView<const UWaypointPatrolComponent*> Components, TArray<uint8>& OutData);
+
+	/**
+	 * Restores the components in the order they were saved and returns how many were put back on a loop.
+	 * Agents on loops whose points changed since the save rejoin them at their closest point.
+	 * With bRestoreAgentLocations, agents are also moved to where they were along their leg.
+	 */
+	static int32 Restore(UWorld& World, TConstArrayView<UWaypointPatrolComponent*> Components, TConstArrayView<uint8> Data, bool bRestoreAgentLocations = false);
+
+	/** Bytes written for each agent, on top of a header and a table entry per loop */
+	static constexpr int32 BytesPerAgent = 8;
+};
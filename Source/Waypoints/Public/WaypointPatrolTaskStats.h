@@ -0,0 +1,65 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+enum class EWaypointPatrolTaskType : uint8
+{
+	BehaviorTree,
+	StateTree,
+	Num
+};
+
+/**
+ * Per agent cost of the patrol tasks, to compare the Behavior Tree and StateTree implementations on the same map.
+ * Only collects while a benchmark started with Waypoints.PatrolTaskBenchmark is running. Game thread only.
+ */
+struct WAYPOINTS_API FWaypointPatrolTaskStats
+{
+	/** Adds the time spent in its scope to a task type. Nested scopes, like a task finishing from its own tick, are only counted once. */
+	struct FScopedCycles
+	{
+		explicit FScopedCycles(EWaypointPatrolTaskType InType)
+			: Type(InType)
+			, bCounted(IsCollecting())
+		{
+			if (bCounted && ScopeDepth++ == 0)
+			{
+				StartCycles = FPlatformTime::Cycles64();
+			}
+		}
+
+		~FScopedCycles()
+		{
+			if (bCounted && --ScopeDepth == 0)
+			{
+				AddCycles(Type, FPlatformTime::Cycles64() - StartCycles);
+			}
+		}
+
+	private:
+		EWaypointPatrolTaskType Type;
+		bool bCounted;
+		uint64 StartCycles = 0;
+	};
+
+	static bool IsCollecting();
+
+	static void AddCycles(EWaypointPatrolTaskType Type, uint64 Cycles);
+
+	/** An agent started or stopped running the task, with the bytes of state it keeps while doing so */
+	static void AgentStarted(EWaypointPatrolTaskType Type, SIZE_T InstanceBytes);
+	static void AgentStopped(EWaypointPatrolTaskType Type, SIZE_T InstanceBytes);
+
+	static void LegFinished(EWaypointPatrolTaskType Type);
+
+	/** A leg is walked through a gameplay move task, rather than a move the patrol task requested itself */
+	static void MoveTaskStarted(EWaypointPatrolTaskType Type);
+
+	/** A UObject was created to perform a leg */
+	static void ObjectAllocated(EWaypointPatrolTaskType Type, SIZE_T Bytes);
+
+private:
+	static int32 ScopeDepth;
+};
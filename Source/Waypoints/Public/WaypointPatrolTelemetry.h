@@ -0,0 +1,47 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AWaypoint;
+struct FNavigationPath;
+
+enum class EWaypointPatrolEvent : uint8
+{
+	Arrive,
+	Depart,
+	WaitStart,
+	WaitEnd,
+	PathFailed,
+	Repath,
+};
+
+/** One patrol event, kept small so thousands fit in each thread's buffer */
+struct FWaypointPatrolEventRecord
+{
+	uint64 Cycles = 0;
+	uint32 AgentId = 0;
+	uint32 LoopId = 0;
+	int32 WaypointIndex = INDEX_NONE;
+	EWaypointPatrolEvent Event = EWaypointPatrolEvent::Arrive;
+};
+
+/**
+ * Always on recorder of patrol events, to find out what a guard did after the fact without the visual logger.
+ * Each thread writes to its own ring buffer without locking, keeping the most recent events.
+ * Waypoints.DumpPatrolTelemetry writes every buffer to a CSV or binary file.
+ */
+struct WAYPOINTS_API FWaypointPatrolTelemetry
+{
+	/** Records an event of an agent about a waypoint. Agent is usually the AI controller. */
+	static void Record(EWaypointPatrolEvent Event, const UObject* Agent, const AWaypoint* Waypoint);
+
+	/** Records a Repath event each time the path is updated, and a PathFailed one if updating it fails */
+	static void ObservePath(FNavigationPath& Path, const UObject* Agent, const AWaypoint* Waypoint);
+
+	/** Writes the events of every thread, oldest first. Returns false if the file couldn't be written. */
+	static bool Dump(const FString& Filename, bool bBinary);
+
+	static bool IsEnabled();
+};
@@ -0,0 +1,39 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WaypointResumeQuery.generated.h"
+
+class AWaypoint;
+class AWaypointLoop;
+
+/** Where an agent should rejoin a loop, and which way it should patrol it from there */
+USTRUCT(BlueprintType)
+struct WAYPOINTS_API FWaypointResumePoint
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Waypoints")
+		TObjectPtr<AWaypointLoop> Loop = nullptr;
+
+	// Position of the entry point in the loop, -1 if no point could be reached
+	UPROPERTY(BlueprintReadOnly, Category = "Waypoints")
+		int32 PointIndex = INDEX_NONE;
+
+	// Waypoint actor of the entry point, null for generated loops
+	UPROPERTY(BlueprintReadOnly, Category = "Waypoints")
+		TObjectPtr<AWaypoint> Waypoint = nullptr;
+
+	// Patrol the loop backwards from the entry point, so the agent keeps heading the way it approached it
+	UPROPERTY(BlueprintReadOnly, Category = "Waypoints")
+		bool bReverse = false;
+
+	// Navmesh path cost from the agent to the entry point
+	UPROPERTY(BlueprintReadOnly, Category = "Waypoints")
+		float PathCost = 0.f;
+
+	bool IsValid() const { return Loop != nullptr && PointIndex != INDEX_NONE; }
+};
+
+DECLARE_DELEGATE_OneParam(FOnWaypointResumePointFound, const FWaypointResumePoint& /*ResumePoint, invalid if none was reachable*/);
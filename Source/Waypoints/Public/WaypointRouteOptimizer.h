@@ -0,0 +1,56 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WaypointNavAgentCache.h"
+
+class AWaypointLoop;
+struct FWaypointSegmentQuery;
+struct FWaypointSegmentPathResult;
+
+struct FWaypointRouteOptimizationParams
+{
+	/** Points that keep their place in the loop, every other point can be moved anywhere */
+	TArray<int32> PinnedIndices;
+
+	/** The search stops improving the route after this long, the cost matrix isn't included */
+	float MaxSeconds = 5.f;
+};
+
+struct FWaypointRouteOptimizationResult
+{
+	/** Point indices in their new loop order */
+	TArray<int32> Order;
+
+	/** Total path length of the loop before and after */
+	double OriginalLength = 0.;
+	double OptimizedLength = 0.;
+
+	bool bSuccess = false;
+};
+
+DECLARE_DELEGATE_TwoParams(FOnWaypointRouteOptimized, AWaypointLoop* /*Loop*/, const FWaypointRouteOptimizationResult& /*Result*/);
+
+/**
+ * Reorders the points of a loop to shorten the path a guard walks around it.
+ * The path length between every pair of points is queried up front through async pathfinding, then the route is improved with 2-opt, Or-opt and point swaps
+ * until no move helps. Path lengths are treated as symmetric, so each pair is only queried once.
+ */
+struct WAYPOINTS_API FWaypointRouteOptimizer
+{
+	/** Segment queries for every pair of points the cost matrix needs, to run through FindSegmentPathsAsync. Game thread only, false without nav data. */
+	static bool GetCostQueries(TConstArrayView<FVector> Locations, const FWaypointNavAgentInfoPtr& NavAgent, TArray<FWaypointSegmentQuery>& OutQueries);
+
+	/**
+	 * Path length between every pair of points, row major, from the results of the cost queries.
+	 * Unreachable pairs cost far more than any path so they're avoided. Safe to call from any thread.
+	 */
+	static void BuildCostMatrix(TConstArrayView<FVector> Locations, TConstArrayView<FWaypointSegmentQuery> Queries, TConstArrayView<FWaypointSegmentPathResult> Results, TArray<float>& OutCosts);
+
+	/** Improves the order of the points against the cost matrix. Safe to call from any thread. */
+	static void Optimize(TConstArrayView<float> Costs, int32 NumPoints, const FWaypointRouteOptimizationParams& Params, FWaypointRouteOptimizationResult& OutResult);
+
+	/** Length of the loop visiting the points in the given order */
+	static double GetLoopLength(TConstArrayView<float> Costs, TConstArrayView<int32> Order);
+};
@@ -0,0 +1,48 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavigationPath.h"
+
+/**
+ * Navmesh corridor of one leg of a loop: the polygons from a point to the next and the string pulled path through them.
+ * Found once and shared by every agent walking the leg, each gets a copy starting at the polygon it stands on,
+ * so crowd agents only have local avoidance left to do instead of pathfinding and optimizing their own corridor.
+ * Polygon refs don't survive the navmesh tiles they're on being rebuilt, corridors are dropped whenever their segment is requeried.
+ */
+struct WAYPOINTS_API FWaypointSegmentCorridor
+{
+	/** Takes the corridor of a path found on a navmesh, complete paths only */
+	static bool Build(const FNavigationPath& Path, FWaypointSegmentCorridor& OutCorridor);
+
+	/** Whether patrolling agents should follow shared corridors, see Waypoints.SharedCorridors.Enabled */
+	static bool IsEnabled();
+
+	bool IsEmpty() const { return Polys.Num() == 0; }
+	void Reset();
+
+	/** Whether every polygon of the corridor is still on the navmesh */
+	bool IsValid() const;
+
+	/**
+	 * Path from the agent along the rest of the corridor, null if the agent isn't standing on one of its polygons.
+	 * The path is registered with the nav data under the querier and filter, so it's invalidated and repathed like a path the agent found itself.
+	 */
+	FNavPathSharedPtr MakeAgentPath(const FVector& AgentLocation, const UObject* Querier = nullptr, FSharedConstNavQueryFilter Filter = nullptr) const;
+
+	TWeakObjectPtr<const ANavigationData> NavData;
+
+	TArray<NavNodeRef> Polys;
+	TArray<FNavPathPoint> Points;
+
+	// Index in Polys of the polygon each point is on
+	TArray<int32> PointPolyIndices;
+
+	// Revision of the loop data the corridor was found for
+	uint32 LoopRevision = 0;
+
+	// Revision of the loop data the last query for the leg was made at, so a leg without a path isn't queried again until the loop or the navmesh changes
+	uint32 RequestedRevision = 0;
+	bool bRequested = false;
+};
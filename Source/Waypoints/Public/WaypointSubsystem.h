@@ -0,0 +1,204 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WaypointLoopGenerator.h"
+#include "WaypointNavAgentCache.h"
+#include "WaypointOccupancyField.h"
+#include "WaypointPathRequestQueue.h"
+#include "WaypointResumeQuery.h"
+#include "WaypointRouteOptimizer.h"
+#include "WaypointSubsystem.generated.h"
+
+class AActor;
+class AController;
+class ANavigationData;
+class AWaypointLoop;
+class UNavigationSystemV1;
+class dtNavMesh;
+
+/** One path query between two points, self contained so it can be copied around and issued later */
+struct FWaypointSegmentQuery
+{
+	int32 SegmentIndex = INDEX_NONE;
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	FWaypointNavAgentInfoPtr NavAgent;
+
+	// Filter of the querier, the nav data's default one if not set
+	FSharedConstNavQueryFilter Filter;
+
+	// Fails the query instead of returning a path that stops short of the end
+	bool bRequireCompletePath = false;
+};
+
+/** Path found for a segment query */
+struct FWaypointSegmentPathResult
+{
+	TArray<FVector> Points;
+	FVector::FReal Length = 0.;
+	FVector::FReal Cost = 0.;
+	bool bSuccess = false;
+
+	// Path the points were taken from, for callers that need its navmesh corridor too
+	FNavPathSharedPtr Path;
+};
+
+DECLARE_DELEGATE_TwoParams(FOnWaypointSegmentPathsFound, TConstArrayView<FWaypointSegmentQuery> /*Queries*/, TArray<FWaypointSegmentPathResult>& /*Results*/);
+
+/** Tile slots of a navmesh as they were last seen, Detour gives a slot a new salt whenever its tile is removed */
+struct FWaypointNavTileSnapshot
+{
+	const dtNavMesh* DetourMesh = nullptr;
+	TArray<uint32> Salts;
+	TArray<FBox> Bounds;
+};
+
+/**
+ * Per world state shared by all waypoint loops.
+ */
+UCLASS()
+class WAYPOINTS_API UWaypointSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/** Budgeted queue patrol moves use to find their paths */
+	FWaypointPathRequestQueue& GetPathRequestQueue() { return PathRequestQueue; }
+
+	/** Resolves the nav agent of a character class through the cache. Game thread only. */
+	FWaypointNavAgentInfoPtr GetNavAgentInfo(const UClass* CharacterClass);
+
+	FWaypointNavAgentCache& GetNavAgentCache() { return NavAgentCache; }
+
+	void RegisterLoop(AWaypointLoop* Loop);
+	void UnregisterLoop(AWaypointLoop* Loop);
+
+	/** Loop with the waypoint closest to the location, null if the world has no loops */
+	AWaypointLoop* FindClosestLoop(const FVector& Location) const;
+
+	/**
+	 * Loop an actor is on: a loop itself, the loop of a waypoint, the loop of the patrol component of an AI or its pawn,
+	 * or else the closest loop. OutPointIndex is the point the actor is at or heading to, the closest one if that isn't known.
+	 */
+	AWaypointLoop* FindLoopForActor(const AActor* Actor, int32* OutPointIndex = nullptr) const;
+
+	template <typename FunctionType>
+	void ForEachLoop(FunctionType&& Function) const
+	{
+		for (const TWeakObjectPtr<AWaypointLoop>& WeakLoop : Loops)
+		{
+			if (AWaypointLoop* Loop = WeakLoop.Get())
+			{
+				Function(*Loop);
+			}
+		}
+	}
+
+	/**
+	 * Finds where an agent should rejoin a loop, the closest loop if none is given.
+	 * The points closest to the agent in a straight line are pathfound through async pathfinding and the cheapest by navmesh path cost wins.
+	 * The delegate is called on the game thread.
+	 */
+	void FindResumePoint(const AController* Agent, AWaypointLoop* Loop, int32 MaxCandidates, FOnWaypointResumePointFound OnFound);
+
+	/**
+	 * Generates a loop over the navmesh in a region, see FWaypointLoopGenerator. Points are sampled right away and the segments
+	 * are validated through async pathfinding. The loop is spawned in one go once they all have been, without any waypoint actor.
+	 */
+	void GenerateLoop(const FWaypointLoopGenerationParams& Params, FOnWaypointLoopGenerated OnGenerated);
+
+	/**
+	 * Reorders the points of a loop to shorten its patrol path, see FWaypointRouteOptimizer.
+	 * The path lengths between every pair of points and the search run on a worker task. The new order is applied on the game thread,
+	 * unless the loop changed in the meantime.
+	 */
+	void OptimizeLoopOrder(AWaypointLoop* Loop, const FWaypointRouteOptimizationParams& Params, FOnWaypointRouteOptimized OnOptimized);
+
+	/**
+	 * Rebuilds the patrol occupancy field from the segment paths and waits of every loop, see FWaypointOccupancyField.
+	 * Loops are copied on the game thread, the field is built on a worker task and swapped in on the game thread once done.
+	 * With Waypoints.Occupancy.UpdateInterval set, the field is rebuilt with the same params whenever the loops change.
+	 */
+	void BuildOccupancyField(const FWaypointOccupancyParams& Params);
+
+	/** Last occupancy field built, null until the first build finishes. Immutable, so it can be held on to and read from any thread. */
+	FWaypointOccupancyFieldPtr GetOccupancyField() const { return OccupancyField; }
+
+	/**
+	 * How much a spot is watched by patrols, from the occupancy field: the fraction of the time a guard watches it
+	 * and the average time until one next does. Returns false if the field hasn't been built or doesn't cover the spot.
+	 */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Waypoints|Occupancy")
+		bool GetPatrolOccupancy(const FVector& Location, float& Presence, float& MeanTimeToVisit) const;
+
+	/**
+	 * Finds the paths of segment queries through the async pathfinding of the navigation system, which runs them in step with
+	 * navmesh generation and garbage collection. Queries are issued in batches of Waypoints.AsyncPaths.BatchSize, the next one once
+	 * the previous one is done. The delegate is called on the game thread with a result per query, right away if none could be issued.
+	 * Game thread only.
+	 */
+	void FindSegmentPathsAsync(TArray<FWaypointSegmentQuery>&& Queries, FOnWaypointSegmentPathsFound OnFound);
+
+	/** Finds the path of a segment query right away, blocking until it's done. Game thread only. */
+	static bool FindSegmentPath(const FWaypointSegmentQuery& Query, TArray<FVector>& OutPoints);
+
+	/** Segment path queries run since startup, by loops, generators and simulations alike. Safe to call from any thread. */
+	static uint64 GetNumSegmentPathQueries();
+
+	/**
+	 * Hash of everything the path of a segment depends on: its endpoints, the nav agent and the navmesh tiles under its corridor.
+	 * Stable between sessions, so it can be saved with the path. Game thread only, it reads the Detour tiles. Returns 0 without nav data.
+	 */
+	static uint32 HashSegment(const FWaypointSegmentQuery& Query, const FBox& Corridor);
+
+protected:
+	UFUNCTION()
+		void OnNavDataRegistered(ANavigationData* NavData);
+
+	UFUNCTION()
+		void OnNavigationGenerationFinished(ANavigationData* NavData);
+
+	void BindToNavigationSystem(UNavigationSystemV1& NavSys);
+
+	/** Pathfinds the next pass of a loop generation, or spawns the loop once it has settled */
+	void ContinueLoopGeneration(const TSharedRef<FWaypointLoopGenerator>& Generator, const FWaypointLoopGenerationParams& Params, FOnWaypointLoopGenerated OnGenerated);
+
+	/** Hash of the points and segment paths of every loop, the occupancy field is rebuilt when it changes */
+	uint32 HashLoopsForOccupancy() const;
+
+#if WITH_EDITOR
+	void OnObjectPropertyChanged(UObject* Object, FPropertyChangedEvent& Event);
+	void OnObjectsReinstanced(const TMap<UObject*, UObject*>& ReplacedObjects);
+
+	FDelegateHandle ObjectPropertyChangedHandle;
+	FDelegateHandle ObjectsReinstancedHandle;
+#endif // WITH_EDITOR
+
+	FWaypointNavAgentCache NavAgentCache;
+
+	FWaypointPathRequestQueue PathRequestQueue;
+
+	TWeakObjectPtr<UNavigationSystemV1> BoundNavSys;
+
+	// Tiles of each navmesh of this world when it last finished generating, to tell which ones were rebuilt since
+	TMap<TWeakObjectPtr<const ANavigationData>, FWaypointNavTileSnapshot> NavTileSnapshots;
+
+	TSet<TWeakObjectPtr<AWaypointLoop>> Loops;
+
+	FWaypointOccupancyFieldPtr OccupancyField;
+	FWaypointOccupancyParams OccupancyParams;
+
+	// Loops the current or pending occupancy field was built from
+	uint32 OccupancyLoopsHash = 0;
+	double NextOccupancyCheckTime = 0.;
+	bool bOccupancyBuildInFlight = false;
+	bool bHasOccupancyParams = false;
+};
@@ -0,0 +1,133 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "WaypointLoopData.h"
+#include "WaypointVisibility.generated.h"
+
+class ANavigationData;
+class UWorld;
+
+USTRUCT()
+struct WAYPOINTS_API FWaypointVisibilityBakeSettings
+{
+	GENERATED_BODY()
+
+	// Distance between two sample points of the grid laid around the loop
+	UPROPERTY(EditAnywhere, Category = "Visibility", meta = (ClampMin = "25.0", UIMin = "25.0"))
+		float SampleSpacing = 200.f;
+
+	// Furthest a waypoint can see, samples and waypoints further away are reported as hidden
+	UPROPERTY(EditAnywhere, Category = "Visibility", meta = (ClampMin = "0.0", UIMin = "0.0"))
+		float MaxDistance = 2000.f;
+
+	// Height of the guard's eyes above a waypoint
+	UPROPERTY(EditAnywhere, Category = "Visibility")
+		float EyeHeight = 150.f;
+
+	// Height above the ground of what the guard has to see, a crouching intruder is lower than a standing one
+	UPROPERTY(EditAnywhere, Category = "Visibility")
+		float TargetHeight = 100.f;
+
+	UPROPERTY(EditAnywhere, Category = "Visibility")
+		TEnumAsByte<ECollisionChannel> TraceChannel = ECC_Visibility;
+};
+
+/**
+ * Baked line of sight from every waypoint of a loop to the other waypoints and to a grid of sample points around the loop.
+ * One row of bits per waypoint, its columns being the waypoints then the samples. The rows are saved zlib compressed
+ * and expanded once on load or import, so a query is a grid lookup and a bit test instead of a trace.
+ */
+USTRUCT()
+struct WAYPOINTS_API FWaypointVisibility
+{
+	GENERATED_BODY()
+
+	/** Bakes the visibility of a loop with one parallel batch of traces. Blocks until done, meant for the editor. */
+	static bool Bake(const UWorld& World, const FWaypointLoopData& LoopData, const ANavigationData* NavData, const FWaypointVisibilityBakeSettings& Settings, FWaypointVisibility& OutVisibility);
+
+	/** Whether this was baked for the points of the loop as they are now */
+	bool IsValidFor(const FWaypointLoopData& LoopData) const;
+
+	bool IsEmpty() const { return NumWaypoints == 0; }
+	void Reset();
+
+	int32 GetNumSamples() const { return SamplePoints.Num(); }
+	const FVector& GetSamplePoint(int32 SampleIndex) const { return SamplePoints[SampleIndex]; }
+
+	/** Sample point covering the location, INDEX_NONE if the location is off the grid or too far above or below it */
+	int32 FindSample(const FVector& Location) const;
+
+	bool IsWaypointVisible(int32 FromWaypoint, int32 ToWaypoint) const { return TestBit(FromWaypoint, ToWaypoint); }
+	bool IsSampleVisible(int32 FromWaypoint, int32 SampleIndex) const { return TestBit(FromWaypoint, NumWaypoints + SampleIndex); }
+
+	SIZE_T GetAllocatedSize() const;
+
+	void PostSerialize(const FArchive& Ar);
+
+	/** Text import sets the saved properties without going through PostSerialize, the rows are expanded here instead */
+	void PostEditImport();
+
+private:
+	bool TestBit(int32 Row, int32 Column) const
+	{
+		if (Row < 0 || Row >= NumWaypoints || Column < 0 || Column >= NumWaypoints + SamplePoints.Num())
+		{
+			return false;
+		}
+
+		// Rows that were never expanded, or failed to be, hide everything
+		const int32 WordIndex = Row * WordsPerRow + (Column >> 5);
+		if (!Rows.IsValidIndex(WordIndex))
+		{
+			return false;
+		}
+
+		return (Rows[WordIndex] >> (Column & 31)) & 1;
+	}
+
+	void Compress();
+	void Decompress();
+
+	UPROPERTY()
+		int32 NumWaypoints = 0;
+
+	// Hash of the waypoint locations the visibility was baked for
+	UPROPERTY()
+		uint32 LocationsHash = 0;
+
+	UPROPERTY()
+		TArray<FVector> SamplePoints;
+
+	// Samples are laid on a horizontal grid, each cell holds the index of its sample or INDEX_NONE
+	UPROPERTY()
+		FVector2D GridOrigin = FVector2D::ZeroVector;
+
+	UPROPERTY()
+		FIntPoint GridSize = FIntPoint::ZeroValue;
+
+	UPROPERTY()
+		float SampleSpacing = 0.f;
+
+	UPROPERTY()
+		TArray<int32> GridSamples;
+
+	UPROPERTY()
+		TArray<uint8> CompressedRows;
+
+	int32 WordsPerRow = 0;
+
+	// Expanded rows, 32 columns to a word
+	TArray<uint32> Rows;
+};
+
+template<>
+struct TStructOpsTypeTraits<FWaypointVisibility> : public TStructOpsTypeTraitsBase2<FWaypointVisibility>
+{
+	enum
+	{
+		WithPostSerialize = true,
+	};
+};
@@ -16,6 +16,7 @@ public class Waypoints : ModuleRules
                 "NavigationSystem",
                 "AIModule",
                 "GameplayTasks",
+                "StateTreeModule",
 			}
         );
 
@@ -25,11 +26,17 @@ public class Waypoints : ModuleRules
             {
                 "CoreUObject",
                 "Engine",
+                "RenderCore",
                 "Slate",
                 "SlateCore",
 			}
         );
 
+        if (Target.bCompileRecast)
+        {
+            PrivateDependencyModuleNames.Add("Navmesh");
+        }
+
         if (Target.Type == TargetType.Editor)
         {
             PrivateDependencyModuleNames.AddRange(
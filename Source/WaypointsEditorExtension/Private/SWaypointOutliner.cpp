@@ -0,0 +1,334 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "SWaypointOutliner.h"
+
+#include "Editor.h"
+#include "ScopedTransaction.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+#include "WaypointsEditorUtils.h"
+#include "Widgets/Colors/SColorBlock.h"
+#include "Widgets/Colors/SColorPicker.h"
+#include "Widgets/Input/SButton.h"
+#include "Widgets/Layout/SBox.h"
+#include "Widgets/Text/STextBlock.h"
+#include "Widgets/Views/SHeaderRow.h"
+#include "Widgets/Views/STableRow.h"
+
+#define LOCTEXT_NAMESPACE "SWaypointOutliner"
+
+namespace WaypointOutlinerColumns
+{
+	static const FName Name(TEXT("Name"));
+	static const FName Info(TEXT("Info"));
+}
+
+class SWaypointOutlinerRow : public SMultiColumnTableRow<FWaypointOutlinerItemPtr>
+{
+public:
+	SLATE_BEGIN_ARGS(SWaypointOutlinerRow) {}
+	SLATE_END_ARGS()
+
+	void Construct(const FArguments& InArgs, const TSharedRef<STableViewBase>& InOwnerTable, FWaypointOutlinerItemPtr InItem)
+	{
+		Item = InItem;
+		SMultiColumnTableRow<FWaypointOutlinerItemPtr>::Construct(FSuperRowType::FArguments(), InOwnerTable);
+	}
+
+	virtual TSharedRef<SWidget> GenerateWidgetForColumn(const FName& ColumnName) override
+	{
+		if (ColumnName == WaypointOutlinerColumns::Name)
+		{
+			return SNew(SHorizontalBox)
+				+ SHorizontalBox::Slot()
+				.AutoWidth()
+				[
+					SNew(SExpanderArrow, SharedThis(this))
+				]
+				+ SHorizontalBox::Slot()
+				.AutoWidth()
+				.VAlign(VAlign_Center)
+				.Padding(0.f, 0.f, 4.f, 0.f)
+				[
+					SNew(SBox)
+					.WidthOverride(12.f)
+					.HeightOverride(12.f)
+					.Visibility(Item->IsLoop() ? EVisibility::Visible : EVisibility::Collapsed)
+					[
+						SNew(SColorBlock)
+						.Color(this, &SWaypointOutlinerRow::GetLoopColor)
+					]
+				]
+				+ SHorizontalBox::Slot()
+				.FillWidth(1.f)
+				.VAlign(VAlign_Center)
+				[
+					SNew(STextBlock)
+					.Text(this, &SWaypointOutlinerRow::GetNameText)
+				];
+		}
+
+		return SNew(STextBlock)
+			.Text(this, &SWaypointOutlinerRow::GetInfoText);
+	}
+
+private:
+	FLinearColor GetLoopColor() const
+	{
+		const AWaypointLoop* Loop = Item->Loop.Get();
+		return Loop ? Loop->SplineColor : FLinearColor::Black;
+	}
+
+	FText GetNameText() const
+	{
+		if (Item->IsLoop())
+		{
+			const AWaypointLoop* Loop = Item->Loop.Get();
+			return Loop ? FText::FromString(Loop->GetActorLabel()) : LOCTEXT("InvalidLoop", "(deleted)");
+		}
+
+		const AWaypoint* Waypoint = Item->Waypoint.Get();
+		return FText::Format(LOCTEXT("WaypointRowName", "{0}. {1}"),
+			FText::AsNumber(Item->Index),
+			Waypoint ? FText::FromString(Waypoint->GetActorLabel()) : LOCTEXT("InvalidWaypoint", "(deleted)"));
+	}
+
+	FText GetInfoText() const
+	{
+		if (Item->IsLoop())
+		{
+			const AWaypointLoop* Loop = Item->Loop.Get();
+			return FText::Format(LOCTEXT("LoopRowInfo", "{0} waypoints"), FText::AsNumber(Loop ? Loop->Waypoints.Num() : 0));
+		}
+
+		const AWaypoint* Waypoint = Item->Waypoint.Get();
+		if (Waypoint && Waypoint->GetWaitTime() > 0.f)
+		{
+			return FText::Format(LOCTEXT("WaypointRowWait", "wait {0}s"), FText::AsNumber(Waypoint->GetWaitTime()));
+		}
+
+		return FText::GetEmpty();
+	}
+
+	FWaypointOutlinerItemPtr Item;
+};
+
+void SWaypointOutliner::Construct(const FArguments& InArgs)
+{
+	Model = MakeUnique<FWaypointOutlinerModel>();
+	Model->OnChanged.AddSP(this, &SWaypointOutliner::OnModelChanged);
+
+	ChildSlot
+	[
+		SNew(SVerticalBox)
+		+ SVerticalBox::Slot()
+		.AutoHeight()
+		.Padding(2.f)
+		[
+			SNew(SHorizontalBox)
+			+ SHorizontalBox::Slot()
+			.AutoWidth()
+			[
+				SNew(SButton)
+				.Text(LOCTEXT("Select", "Select"))
+				.ToolTipText(LOCTEXT("SelectTooltip", "Select the waypoints of the selected rows in the level"))
+				.IsEnabled(this, &SWaypointOutliner::HasSelection)
+				.OnClicked(this, &SWaypointOutliner::OnSelectClicked)
+			]
+			+ SHorizontalBox::Slot()
+			.AutoWidth()
+			[
+				SNew(SButton)
+				.Text(LOCTEXT("Recolor", "Recolor"))
+				.ToolTipText(LOCTEXT("RecolorTooltip", "Pick a new path color for the selected loops"))
+				.IsEnabled(this, &SWaypointOutliner::HasSelection)
+				.OnClicked(this, &SWaypointOutliner::OnRecolorClicked)
+			]
+			+ SHorizontalBox::Slot()
+			.AutoWidth()
+			[
+				SNew(SButton)
+				.Text(LOCTEXT("RebuildPaths", "Rebuild Paths"))
+				.ToolTipText(LOCTEXT("RebuildPathsTooltip", "Recalculate the navigation paths of the selected loops"))
+				.IsEnabled(this, &SWaypointOutliner::HasSelection)
+				.OnClicked(this, &SWaypointOutliner::OnRebuildPathsClicked)
+			]
+			+ SHorizontalBox::Slot()
+			.AutoWidth()
+			[
+				SNew(SButton)
+				.Text(LOCTEXT("Delete", "Delete"))
+				.ToolTipText(LOCTEXT("DeleteTooltip", "Delete the selected loops and waypoints"))
+				.IsEnabled(this, &SWaypointOutliner::HasSelection)
+				.OnClicked(this, &SWaypointOutliner::OnDeleteClicked)
+			]
+		]
+		+ SVerticalBox::Slot()
+		.FillHeight(1.f)
+		[
+			SAssignNew(TreeView, STreeView<FWaypointOutlinerItemPtr>)
+			.TreeItemsSource(&Model->GetRootItems())
+			.SelectionMode(ESelectionMode::Multi)
+			.OnGenerateRow(this, &SWaypointOutliner::OnGenerateRow)
+			.OnGetChildren(this, &SWaypointOutliner::OnGetChildren)
+			.OnMouseButtonDoubleClick(this, &SWaypointOutliner::OnItemDoubleClicked)
+			.HeaderRow
+			(
+				SNew(SHeaderRow)
+				+ SHeaderRow::Column(WaypointOutlinerColumns::Name)
+				.DefaultLabel(LOCTEXT("NameColumn", "Name"))
+				.FillWidth(0.7f)
+				+ SHeaderRow::Column(WaypointOutlinerColumns::Info)
+				.DefaultLabel(LOCTEXT("InfoColumn", "Info"))
+				.FillWidth(0.3f)
+			)
+		]
+	];
+}
+
+TSharedRef<ITableRow> SWaypointOutliner::OnGenerateRow(FWaypointOutlinerItemPtr Item, const TSharedRef<STableViewBase>& OwnerTable)
+{
+	return SNew(SWaypointOutlinerRow, OwnerTable, Item);
+}
+
+void SWaypointOutliner::OnGetChildren(FWaypointOutlinerItemPtr Item, TArray<FWaypointOutlinerItemPtr>& OutChildren)
+{
+	if (Item->IsLoop())
+	{
+		OutChildren = Model->GetChildren(Item);
+	}
+}
+
+void SWaypointOutliner::OnItemDoubleClicked(FWaypointOutlinerItemPtr Item)
+{
+	TArray<AActor*> Actors;
+	if (Item->IsLoop())
+	{
+		AWaypointLoop* Loop = Item->Loop.Get();
+		Actors.Append(WaypointsEditorUtils::GatherLoopWaypoints(MakeArrayView(&Loop, 1)));
+	}
+	else if (Item->Waypoint.IsValid())
+	{
+		Actors.Add(Item->Waypoint.Get());
+	}
+
+	WaypointsEditorUtils::SelectActors(Actors);
+	GEditor->MoveViewportCamerasToActor(Actors, true);
+}
+
+void SWaypointOutliner::OnModelChanged()
+{
+	if (TreeView.IsValid())
+	{
+		TreeView->RequestTreeRefresh();
+	}
+}
+
+void SWaypointOutliner::GetSelection(TArray<AWaypointLoop*>& OutLoops, TArray<AWaypoint*>& OutWaypoints) const
+{
+	for (const FWaypointOutlinerItemPtr& Item : TreeView->GetSelectedItems())
+	{
+		if (!Item.IsValid())
+		{
+			continue;
+		}
+
+		if (Item->IsLoop())
+		{
+			if (AWaypointLoop* Loop = Item->Loop.Get())
+			{
+				OutLoops.Add(Loop);
+			}
+		}
+		else if (AWaypoint* Waypoint = Item->Waypoint.Get())
+		{
+			OutWaypoints.Add(Waypoint);
+		}
+	}
+}
+
+bool SWaypointOutliner::HasSelection() const
+{
+	return TreeView.IsValid() && TreeView->GetNumItemsSelected() > 0;
+}
+
+FReply SWaypointOutliner::OnSelectClicked()
+{
+	TArray<AWaypointLoop*> Loops;
+	TArray<AWaypoint*> Waypoints;
+	GetSelection(Loops, Waypoints);
+
+	TArray<AActor*> Actors;
+	Actors.Append(WaypointsEditorUtils::GatherLoopWaypoints(Loops));
+	Actors.Append(Waypoints);
+
+	WaypointsEditorUtils::SelectActors(Actors);
+
+	return FReply::Handled();
+}
+
+FReply SWaypointOutliner::OnRecolorClicked()
+{
+	TArray<AWaypointLoop*> Loops;
+	TArray<AWaypoint*> Waypoints;
+	GetSelection(Loops, Waypoints);
+	Loops.Append(WaypointsEditorUtils::GatherOwningLoops(Waypoints));
+
+	if (Loops.Num() == 0)
+	{
+		return FReply::Handled();
+	}
+
+	TArray<TWeakObjectPtr<AWaypointLoop>> WeakLoops(Loops);
+
+	FColorPickerArgs PickerArgs;
+	PickerArgs.bUseAlpha = false;
+	PickerArgs.bIsModal = true;
+	PickerArgs.InitialColor = Loops[0]->SplineColor;
+	PickerArgs.OnColorCommitted = FOnLinearColorValueChanged::CreateLambda([WeakLoops](FLinearColor NewColor)
+		{
+			const FScopedTransaction Transaction(LOCTEXT("RecolorLoops", "Recolor Waypoint Loops"));
+			for (const TWeakObjectPtr<AWaypointLoop>& Loop : WeakLoops)
+			{
+				if (Loop.IsValid())
+				{
+					Loop->Modify();
+					Loop->SetSplineColor(NewColor);
+				}
+			}
+		});
+
+	OpenColorPicker(PickerArgs);
+
+	return FReply::Handled();
+}
+
+FReply SWaypointOutliner::OnRebuildPathsClicked()
+{
+	TArray<AWaypointLoop*> Loops;
+	TArray<AWaypoint*> Waypoints;
+	GetSelection(Loops, Waypoints);
+	Loops.Append(WaypointsEditorUtils::GatherOwningLoops(Waypoints));
+
+	TSet<AWaypointLoop*> UniqueLoops(Loops);
+	for (AWaypointLoop* Loop : UniqueLoops)
+	{
+		Loop->RecalculateAllWaypoints();
+	}
+
+	return FReply::Handled();
+}
+
+FReply SWaypointOutliner::OnDeleteClicked()
+{
+	TArray<AWaypointLoop*> Loops;
+	TArray<AWaypoint*> Waypoints;
+	GetSelection(Loops, Waypoints);
+
+	TreeView->ClearSelection();
+	WaypointsEditorUtils::DeleteWaypoints(Loops, Waypoints);
+
+	return FReply::Handled();
+}
+
+#undef LOCTEXT_NAMESPACE
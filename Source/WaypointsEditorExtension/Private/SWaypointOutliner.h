@@ -0,0 +1,39 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Widgets/SCompoundWidget.h"
+#include "Widgets/Views/STreeView.h"
+#include "WaypointOutlinerModel.h"
+
+class AWaypoint;
+class AWaypointLoop;
+
+/** Dockable panel listing every waypoint loop in the level with batch operations on the selected rows */
+class SWaypointOutliner : public SCompoundWidget
+{
+public:
+	SLATE_BEGIN_ARGS(SWaypointOutliner) {}
+	SLATE_END_ARGS()
+
+	void Construct(const FArguments& InArgs);
+
+private:
+	TSharedRef<ITableRow> OnGenerateRow(FWaypointOutlinerItemPtr Item, const TSharedRef<STableViewBase>& OwnerTable);
+	void OnGetChildren(FWaypointOutlinerItemPtr Item, TArray<FWaypointOutlinerItemPtr>& OutChildren);
+	void OnItemDoubleClicked(FWaypointOutlinerItemPtr Item);
+	void OnModelChanged();
+
+	/** Splits the selected rows into whole loops and individual waypoints */
+	void GetSelection(TArray<AWaypointLoop*>& OutLoops, TArray<AWaypoint*>& OutWaypoints) const;
+
+	FReply OnSelectClicked();
+	FReply OnRecolorClicked();
+	FReply OnRebuildPathsClicked();
+	FReply OnDeleteClicked();
+	bool HasSelection() const;
+
+	TUniquePtr<FWaypointOutlinerModel> Model;
+	TSharedPtr<STreeView<FWaypointOutlinerItemPtr>> TreeView;
+};
@@ -0,0 +1,389 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointEditorBenchmarkCommandlet.h"
+
+#include "Async/TaskGraphInterfaces.h"
+#include "Editor.h"
+#include "Editor/UnrealEdEngine.h"
+#include "Engine/Selection.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "FileHelpers.h"
+#include "HAL/FileManager.h"
+#include "Misc/PackageName.h"
+#include "NavigationSystem.h"
+#include "ScopedTransaction.h"
+#include "UnrealEdGlobals.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+#include "WaypointSubsystem.h"
+#include "WaypointsEditorUtils.h"
+
+#define LOCTEXT_NAMESPACE "WaypointEditorBenchmark"
+
+DEFINE_LOG_CATEGORY_STATIC(LogWaypointEditorBenchmark, Log, All);
+
+namespace WaypointEditorBenchmark
+{
+	// Past this, the paths of a step are considered stuck and the step is reported as unsettled
+	static constexpr double SettleTimeout = 120.;
+
+	/** Hands the queued async path queries to the navigation system, which would happen on its tick, and applies the results that are in */
+	static void PumpGameThread()
+	{
+		UWorld* World = GEditor ? GEditor->GetEditorWorldContext().World() : nullptr;
+		if (UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(World))
+		{
+			NavSys->Tick(0.f);
+		}
+
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+	}
+
+	/** Pumps the game thread, where segment paths are applied, until no loop waits on a path */
+	static bool WaitForSegmentPaths()
+	{
+		const double Deadline = FPlatformTime::Seconds() + SettleTimeout;
+		while (AWaypointLoop::GetNumSegmentRequestsInFlight() > 0)
+		{
+			if (FPlatformTime::Seconds() > Deadline)
+			{
+				return false;
+			}
+
+			PumpGameThread();
+			FPlatformProcess::SleepNoStats(0.f);
+		}
+
+		return true;
+	}
+
+	struct FStep
+	{
+		explicit FStep(const TCHAR* InName)
+			: Name(InName)
+			, StartQueries(UWaypointSubsystem::GetNumSegmentPathQueries())
+			, StartTime(FPlatformTime::Seconds())
+		{
+		}
+
+		/** The edits are done, what's left is waiting on the paths they requested */
+		void EditsDone(int32 InNumOperations)
+		{
+			NumOperations = InNumOperations;
+			EditSeconds = FPlatformTime::Seconds() - StartTime;
+		}
+
+		void Finish()
+		{
+			bSettled = WaitForSegmentPaths();
+			TotalSeconds = FPlatformTime::Seconds() - StartTime;
+			NumPathQueries = UWaypointSubsystem::GetNumSegmentPathQueries() - StartQueries;
+		}
+
+		void Report() const
+		{
+			UE_LOG(LogWaypointEditorBenchmark, Display, TEXT("%-10s %6d ops %10.2fms edits (%.3fms/op) %10.2fms with paths %8llu path queries%s"),
+				Name, NumOperations, EditSeconds * 1000., EditSeconds * 1000. / FMath::Max(NumOperations, 1), TotalSeconds * 1000., NumPathQueries,
+				bSettled ? TEXT("") : TEXT(", paths never settled"));
+		}
+
+		const TCHAR* Name;
+		uint64 StartQueries;
+		double StartTime;
+
+		int32 NumOperations = 0;
+		double EditSeconds = 0.;
+		double TotalSeconds = 0.;
+		uint64 NumPathQueries = 0;
+		bool bSettled = true;
+	};
+
+	static FString GetMapFilename(const FString& LongPackageName)
+	{
+		return FPackageName::LongPackageNameToFilename(LongPackageName, FPackageName::GetMapPackageExtension());
+	}
+
+	static TArray<AWaypointLoop*> GatherLoops(UWorld& World)
+	{
+		TArray<AWaypointLoop*> Loops;
+		for (TActorIterator<AWaypointLoop> It(&World); It; ++It)
+		{
+			Loops.Add(*It);
+		}
+
+		// Same order every run, whatever order the actors were loaded in
+		Loops.Sort([](const AWaypointLoop& A, const AWaypointLoop& B) { return A.GetFName().LexicalLess(B.GetFName()); });
+		return Loops;
+	}
+
+	/** Lays the loops out as circles on a grid, centered on the navmesh */
+	static int32 SpawnLoops(UWorld& World, int32 NumLoops, int32 NumPoints, float Radius)
+	{
+		UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(&World);
+		const FBox NavBounds = NavSys ? NavSys->GetNavigableWorldBounds() : FBox(ForceInit);
+		const FVector Center = NavBounds.IsValid ? NavBounds.GetCenter() : FVector::ZeroVector;
+
+		const int32 NumColumns = FMath::CeilToInt32(FMath::Sqrt(static_cast<float>(NumLoops)));
+		const float LoopSpacing = Radius * 2.5f;
+		const FVector ProjectExtent(Radius * 0.1f, Radius * 0.1f, 5000.f);
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		int32 NumWaypoints = 0;
+		for (int32 LoopIndex = 0; LoopIndex < NumLoops; ++LoopIndex)
+		{
+			const FVector LoopCenter = Center + FVector(
+				(LoopIndex % NumColumns - (NumColumns - 1) * 0.5f) * LoopSpacing,
+				(LoopIndex / NumColumns - (NumColumns - 1) * 0.5f) * LoopSpacing,
+				0.f);
+
+			AWaypointLoop* Loop = World.SpawnActor<AWaypointLoop>(FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+			if (Loop == nullptr)
+			{
+				continue;
+			}
+
+			TArray<AWaypoint*> Waypoints;
+			Waypoints.Reserve(NumPoints);
+			for (int32 PointIndex = 0; PointIndex < NumPoints; ++PointIndex)
+			{
+				const float Angle = UE_TWO_PI * PointIndex / NumPoints;
+				FVector Location = LoopCenter + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * Radius;
+
+				FNavLocation NavLocation;
+				if (NavSys && NavSys->ProjectPointToNavigation(Location, NavLocation, ProjectExtent))
+				{
+					Location = NavLocation.Location;
+				}
+
+				if (AWaypoint* Waypoint = World.SpawnActor<AWaypoint>(Location, FRotator::ZeroRotator, SpawnParams))
+				{
+					Waypoints.Add(Waypoint);
+				}
+			}
+
+			Loop->InitializeWaypoints(Waypoints, TArray<FWaypointSegmentPath>());
+			NumWaypoints += Waypoints.Num();
+		}
+
+		return NumWaypoints;
+	}
+
+	/** Drags one waypoint of each loop away from the loop's first waypoint, a little further every frame, then releases it */
+	static int32 DragWaypoints(TConstArrayView<AWaypointLoop*> Loops, int32 NumFrames, float Distance)
+	{
+		int32 NumMoves = 0;
+		for (AWaypointLoop* Loop : Loops)
+		{
+			AWaypoint* Waypoint = Loop->GetWaypoint(Loop->GetNumPoints() / 2);
+			if (Waypoint == nullptr)
+			{
+				continue;
+			}
+
+			const FScopedTransaction Transaction(LOCTEXT("DragWaypoint", "Move Waypoint"));
+			Waypoint->Modify();
+
+			const FVector StartLocation = Waypoint->GetActorLocation();
+			const FVector Direction = (StartLocation - Loop->GetLoopData().GetLocation(0)).GetSafeNormal2D();
+
+			for (int32 Frame = 1; Frame <= NumFrames; ++Frame)
+			{
+				Waypoint->SetActorLocation(StartLocation + Direction * (Distance * Frame / NumFrames));
+				Waypoint->PostEditMove(false);
+				PumpGameThread();
+				++NumMoves;
+			}
+
+			Waypoint->PostEditMove(true);
+		}
+
+		return NumMoves;
+	}
+
+	/** Alt-drags waypoints spread over the loops: the selection is duplicated, then the copies are moved away */
+	static int32 DuplicateWaypoints(UWorld& World, TConstArrayView<AWaypointLoop*> Loops, int32 NumDuplicates, float Distance)
+	{
+		TArray<AActor*> Originals;
+		for (int32 i = 0; i < NumDuplicates && Loops.Num() > 0; ++i)
+		{
+			if (AWaypoint* Waypoint = Loops[i % Loops.Num()]->GetWaypoint(i / Loops.Num()))
+			{
+				Originals.AddUnique(Waypoint);
+			}
+		}
+
+		WaypointsEditorUtils::SelectActors(Originals);
+		GUnrealEd->edactDuplicateSelected(World.GetCurrentLevel(), false);
+
+		int32 NumCopies = 0;
+		for (FSelectionIterator It(GEditor->GetSelectedActorIterator()); It; ++It)
+		{
+			if (AWaypoint* Copy = Cast<AWaypoint>(*It))
+			{
+				Copy->SetActorLocation(Copy->GetActorLocation() + FVector(Distance, 0.f, 0.f));
+				Copy->PostEditMove(true);
+				++NumCopies;
+			}
+		}
+
+		return NumCopies;
+	}
+
+	/** Runs Select Waypoint Loop from the context menu of one waypoint of each loop */
+	static int32 SelectLoops(TConstArrayView<AWaypointLoop*> Loops)
+	{
+		int32 NumSelections = 0;
+		for (AWaypointLoop* Loop : Loops)
+		{
+			if (AWaypoint* Waypoint = Loop->GetWaypoint(0))
+			{
+				WaypointsEditorUtils::SelectOwningLoops(MakeArrayView(&Waypoint, 1));
+				++NumSelections;
+			}
+		}
+
+		return NumSelections;
+	}
+
+	/** Deletes every other waypoint of every loop in one go, like pressing Delete in the viewport */
+	static int32 DeleteWaypoints(UWorld& World, TConstArrayView<AWaypointLoop*> Loops)
+	{
+		TArray<AActor*> ToDelete;
+		for (AWaypointLoop* Loop : Loops)
+		{
+			for (int32 i = 1; i < Loop->GetNumPoints(); i += 2)
+			{
+				if (AWaypoint* Waypoint = Loop->GetWaypoint(i))
+				{
+					ToDelete.Add(Waypoint);
+				}
+			}
+		}
+
+		WaypointsEditorUtils::SelectActors(ToDelete);
+		GUnrealEd->edactDeleteSelected(&World, true, false, false);
+
+		return ToDelete.Num();
+	}
+}
+
+UWaypointEditorBenchmarkCommandlet::UWaypointEditorBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UWaypointEditorBenchmarkCommandlet::Main(const FString& Params)
+{
+	using namespace WaypointEditorBenchmark;
+
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamValues;
+	ParseCommandLine(*Params, Tokens, Switches, ParamValues);
+
+	int32 NumLoops = 20;
+	int32 NumPoints = 50;
+	float Radius = 1500.f;
+	int32 NumDragFrames = 60;
+	int32 NumDuplicates = 20;
+	FString OutMap = TEXT("/Game/WaypointEditorBenchmark");
+	FParse::Value(*Params, TEXT("Loops="), NumLoops);
+	FParse::Value(*Params, TEXT("Points="), NumPoints);
+	FParse::Value(*Params, TEXT("Radius="), Radius);
+	FParse::Value(*Params, TEXT("Drags="), NumDragFrames);
+	FParse::Value(*Params, TEXT("Duplicates="), NumDuplicates);
+	FParse::Value(*Params, TEXT("OutMap="), OutMap);
+
+	NumLoops = FMath::Max(NumLoops, 1);
+	NumPoints = FMath::Max(NumPoints, 2);
+	Radius = FMath::Max(Radius, 100.f);
+
+	FText Reason;
+	if (!FPackageName::IsValidLongPackageName(OutMap, false, &Reason))
+	{
+		UE_LOG(LogWaypointEditorBenchmark, Error, TEXT("Invalid -OutMap %s: %s"), *OutMap, *Reason.ToString());
+		return 1;
+	}
+
+	const FString* BaseMap = ParamValues.Find(TEXT("Map"));
+	UWorld* World = BaseMap ? UEditorLoadingAndSavingUtils::LoadMap(GetMapFilename(*BaseMap)) : UEditorLoadingAndSavingUtils::NewBlankMap(false);
+	if (World == nullptr)
+	{
+		UE_LOG(LogWaypointEditorBenchmark, Error, TEXT("Failed to open %s"), BaseMap ? **BaseMap : TEXT("a blank map"));
+		return 1;
+	}
+
+	UE_LOG(LogWaypointEditorBenchmark, Display, TEXT("Generating %d loops of %d waypoints on %s"), NumLoops, NumPoints, BaseMap ? **BaseMap : TEXT("a blank map"));
+
+	// Steps are referenced while they run, they must not move
+	TArray<FStep> Steps;
+	Steps.Reserve(6);
+
+	// Generation isn't an editor operation as such, but it's the cost of placing that many waypoints and finding their paths the first time
+	FStep& Generate = Steps.Emplace_GetRef(TEXT("Generate"));
+	Generate.EditsDone(SpawnLoops(*World, NumLoops, NumPoints, Radius));
+	Generate.Finish();
+
+	if (!UEditorLoadingAndSavingUtils::SaveMap(World, OutMap))
+	{
+		UE_LOG(LogWaypointEditorBenchmark, Error, TEXT("Failed to save %s"), *OutMap);
+		return 1;
+	}
+
+	// Unloads the generated map, so it's opened from disk like a designer would
+	UEditorLoadingAndSavingUtils::NewBlankMap(false);
+
+	FStep& Open = Steps.Emplace_GetRef(TEXT("Open"));
+	World = UEditorLoadingAndSavingUtils::LoadMap(GetMapFilename(OutMap));
+	Open.EditsDone(1);
+	Open.Finish();
+
+	if (World == nullptr)
+	{
+		UE_LOG(LogWaypointEditorBenchmark, Error, TEXT("Failed to open %s"), *OutMap);
+		return 1;
+	}
+
+	const TArray<AWaypointLoop*> Loops = GatherLoops(*World);
+
+	FStep& Drag = Steps.Emplace_GetRef(TEXT("Drag"));
+	Drag.EditsDone(DragWaypoints(Loops, NumDragFrames, Radius * 0.5f));
+	Drag.Finish();
+
+	FStep& Duplicate = Steps.Emplace_GetRef(TEXT("Duplicate"));
+	Duplicate.EditsDone(DuplicateWaypoints(*World, Loops, NumDuplicates, Radius * 0.2f));
+	Duplicate.Finish();
+
+	FStep& Select = Steps.Emplace_GetRef(TEXT("Select"));
+	Select.EditsDone(SelectLoops(Loops));
+	Select.Finish();
+
+	FStep& Delete = Steps.Emplace_GetRef(TEXT("Delete"));
+	Delete.EditsDone(DeleteWaypoints(*World, Loops));
+	Delete.Finish();
+
+	bool bAllSettled = true;
+	for (const FStep& Step : Steps)
+	{
+		Step.Report();
+		bAllSettled &= Step.bSettled;
+	}
+
+	GEditor->SelectNone(false, true);
+	UEditorLoadingAndSavingUtils::NewBlankMap(false);
+
+	if (!Switches.Contains(TEXT("KeepMap")))
+	{
+		IFileManager::Get().Delete(*GetMapFilename(OutMap), false, true, true);
+	}
+
+	return bAllSettled ? 0 : 1;
+}
+
+#undef LOCTEXT_NAMESPACE
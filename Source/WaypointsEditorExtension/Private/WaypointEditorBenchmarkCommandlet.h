@@ -0,0 +1,29 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "WaypointEditorBenchmarkCommandlet.generated.h"
+
+/**
+ * Generates a map of waypoint loops and times the editor operations designers wait on: opening the map, dragging waypoints,
+ * Alt-drag duplication, loop selection from the context menu and deleting waypoints. Each step reports its wall time,
+ * split between the edits themselves and waiting for the segment paths they requested, and the path queries it issued.
+ *
+ * UnrealEditor-Cmd.exe Project.uproject -run=WaypointEditorBenchmark
+ *     [-Map=/Game/Maps/MyMap] [-Loops=20] [-Points=50] [-Radius=1500] [-Drags=60] [-Duplicates=20]
+ *     [-OutMap=/Game/WaypointEditorBenchmark] [-KeepMap]
+ *
+ * The loops are laid out on the navmesh of -Map when given, on an empty map otherwise where every path query fails right away.
+ */
+UCLASS()
+class UWaypointEditorBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UWaypointEditorBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,130 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointOutlinerModel.h"
+
+#include "Editor.h"
+#include "EngineUtils.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+
+FWaypointOutlinerModel::FWaypointOutlinerModel()
+{
+	LoopChangedHandle = AWaypointLoop::OnLoopChanged.AddRaw(this, &FWaypointOutlinerModel::HandleLoopChanged);
+	MapChangeHandle = FEditorDelegates::MapChange.AddRaw(this, &FWaypointOutlinerModel::HandleMapChange);
+
+	Rebuild();
+}
+
+FWaypointOutlinerModel::~FWaypointOutlinerModel()
+{
+	AWaypointLoop::OnLoopChanged.Remove(LoopChangedHandle);
+	FEditorDelegates::MapChange.Remove(MapChangeHandle);
+}
+
+void FWaypointOutlinerModel::Rebuild()
+{
+	RootItems.Reset();
+	LoopItems.Reset();
+
+	if (UWorld* World = GetEditorWorld())
+	{
+		for (TActorIterator<AWaypointLoop> It(World); It; ++It)
+		{
+			AddLoop(*It);
+		}
+	}
+
+	OnChanged.Broadcast();
+}
+
+const TArray<FWaypointOutlinerItemPtr>& FWaypointOutlinerModel::GetChildren(const FWaypointOutlinerItemPtr& Item)
+{
+	if (Item->IsLoop() && Item->bChildrenDirty)
+	{
+		Item->Children.Reset();
+		Item->bChildrenDirty = false;
+
+		if (AWaypointLoop* Loop = Item->Loop.Get())
+		{
+			Item->Children.Reserve(Loop->Waypoints.Num());
+			for (int32 i = 0; i < Loop->Waypoints.Num(); ++i)
+			{
+				FWaypointOutlinerItemPtr Child = MakeShared<FWaypointOutlinerItem>();
+				Child->Loop = Item->Loop;
+				Child->Waypoint = Loop->Waypoints[i];
+				Child->Index = i;
+				Item->Children.Add(MoveTemp(Child));
+			}
+		}
+	}
+
+	return Item->Children;
+}
+
+void FWaypointOutlinerModel::HandleLoopChanged(AWaypointLoop* Loop, EWaypointLoopChange Change)
+{
+	if (Loop == nullptr || Loop->GetWorld() != GetEditorWorld())
+	{
+		return;
+	}
+
+	switch (Change)
+	{
+	case EWaypointLoopChange::Added:
+		AddLoop(Loop);
+		break;
+
+	case EWaypointLoopChange::Removed:
+		RemoveLoop(Loop);
+		break;
+
+	case EWaypointLoopChange::WaypointsChanged:
+		if (FWaypointOutlinerItemPtr* Item = LoopItems.Find(Loop))
+		{
+			(*Item)->bChildrenDirty = true;
+		}
+		else
+		{
+			AddLoop(Loop);
+		}
+		break;
+
+	case EWaypointLoopChange::PropertiesChanged:
+		break;
+	}
+
+	OnChanged.Broadcast();
+}
+
+void FWaypointOutlinerModel::HandleMapChange(uint32 MapChangeFlags)
+{
+	Rebuild();
+}
+
+void FWaypointOutlinerModel::AddLoop(AWaypointLoop* Loop)
+{
+	if (!IsValid(Loop) || LoopItems.Contains(Loop))
+	{
+		return;
+	}
+
+	FWaypointOutlinerItemPtr Item = MakeShared<FWaypointOutlinerItem>();
+	Item->Loop = Loop;
+
+	LoopItems.Add(Loop, Item);
+	RootItems.Add(MoveTemp(Item));
+}
+
+void FWaypointOutlinerModel::RemoveLoop(AWaypointLoop* Loop)
+{
+	FWaypointOutlinerItemPtr Item;
+	if (LoopItems.RemoveAndCopyValue(Loop, Item))
+	{
+		RootItems.RemoveSingle(Item);
+	}
+}
+
+UWorld* FWaypointOutlinerModel::GetEditorWorld()
+{
+	return GEditor ? GEditor->GetEditorWorldContext().World() : nullptr;
+}
@@ -0,0 +1,68 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class AWaypoint;
+class AWaypointLoop;
+enum class EWaypointLoopChange : uint8;
+
+/** A row of the waypoint outliner, either a loop or one of its waypoints */
+struct FWaypointOutlinerItem
+{
+	TWeakObjectPtr<AWaypointLoop> Loop;
+
+	// Only set for waypoint rows
+	TWeakObjectPtr<AWaypoint> Waypoint;
+
+	// Position of the waypoint in its loop
+	int32 Index = INDEX_NONE;
+
+	// Waypoint rows of a loop, only built once the loop is expanded
+	TArray<TSharedPtr<FWaypointOutlinerItem>> Children;
+	bool bChildrenDirty = true;
+
+	bool IsLoop() const { return Index == INDEX_NONE; }
+};
+
+typedef TSharedPtr<FWaypointOutlinerItem> FWaypointOutlinerItemPtr;
+
+/**
+ * Cached list of the waypoint loops in the editor world.
+ * Updated incrementally from loop change events; waypoint rows are built lazily per loop,
+ * so levels with tens of thousands of waypoints only pay for the loops that are expanded.
+ */
+class FWaypointOutlinerModel
+{
+public:
+	FWaypointOutlinerModel();
+	~FWaypointOutlinerModel();
+
+	/** Throws away the cache and gathers all loops from the editor world */
+	void Rebuild();
+
+	const TArray<FWaypointOutlinerItemPtr>& GetRootItems() const { return RootItems; }
+
+	/** Returns the waypoint rows of a loop, rebuilding them if the loop changed since the last call */
+	const TArray<FWaypointOutlinerItemPtr>& GetChildren(const FWaypointOutlinerItemPtr& Item);
+
+	/** Broadcast after the cached rows changed */
+	FSimpleMulticastDelegate OnChanged;
+
+private:
+	void HandleLoopChanged(AWaypointLoop* Loop, EWaypointLoopChange Change);
+	void HandleMapChange(uint32 MapChangeFlags);
+
+	void AddLoop(AWaypointLoop* Loop);
+	void RemoveLoop(AWaypointLoop* Loop);
+
+	static UWorld* GetEditorWorld();
+
+	TArray<FWaypointOutlinerItemPtr> RootItems;
+	TMap<TObjectKey<AWaypointLoop>, FWaypointOutlinerItemPtr> LoopItems;
+
+	FDelegateHandle LoopChangedHandle;
+	FDelegateHandle MapChangeHandle;
+};
@@ -0,0 +1,133 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointPatrolSimCommandlet.h"
+#include "WaypointPatrolSimulation.h"
+
+#include "Editor.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "NavigationSystem.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectGlobals.h"
+#include "WaypointLoop.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogWaypointPatrolSim, Log, All);
+
+UWaypointPatrolSimCommandlet::UWaypointPatrolSimCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UWaypointPatrolSimCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamValues;
+	ParseCommandLine(*Params, Tokens, Switches, ParamValues);
+
+	const FString* MapName = ParamValues.Find(TEXT("Map"));
+	if (MapName == nullptr)
+	{
+		UE_LOG(LogWaypointPatrolSim, Error, TEXT("No map given, use -Map=/Game/Path/To/Map"));
+		return 1;
+	}
+
+	FWaypointPatrolSimSettings Settings;
+	FParse::Value(*Params, TEXT("Agents="), Settings.NumAgents);
+	FParse::Value(*Params, TEXT("Duration="), Settings.Duration);
+	FParse::Value(*Params, TEXT("Step="), Settings.StepSeconds);
+	FParse::Value(*Params, TEXT("Seed="), Settings.Seed);
+	FParse::Value(*Params, TEXT("Speed="), Settings.Speed);
+	FParse::Value(*Params, TEXT("SpeedVariance="), Settings.SpeedVariance);
+	FParse::Value(*Params, TEXT("MaxQueriesPerStep="), Settings.MaxQueriesPerStep);
+	FParse::Value(*Params, TEXT("MergeDistance="), Settings.MergeDistance);
+	Settings.bSkipPathfinding = Switches.Contains(TEXT("NoPathfinding"));
+
+	UPackage* Package = LoadPackage(nullptr, **MapName, LOAD_None);
+	UWorld* World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+	if (World == nullptr)
+	{
+		UE_LOG(LogWaypointPatrolSim, Error, TEXT("Failed to load map %s"), **MapName);
+		return 1;
+	}
+
+	World->AddToRoot();
+	World->WorldType = EWorldType::Editor;
+
+	UWorld::InitializationValues IVS;
+	IVS.RequiresHitProxies(false)
+		.ShouldSimulatePhysics(false)
+		.EnableTraceCollision(false)
+		.CreateNavigation(true)
+		.CreateAISystem(false)
+		.AllowAudioPlayback(false)
+		.CreatePhysicsScene(true);
+	World->InitWorld(IVS);
+	World->UpdateWorldComponents(true, false);
+
+	FWorldContext& WorldContext = GEditor->GetEditorWorldContext();
+	WorldContext.SetCurrentWorld(World);
+	GWorld = World;
+
+	// Registers the nav data that was saved with the map
+	FNavigationSystem::AddNavigationSystemToWorld(*World, FNavigationSystemRunMode::EditorMode);
+	if (Switches.Contains(TEXT("BuildNav")))
+	{
+		if (UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(World))
+		{
+			NavSys->Build();
+		}
+	}
+
+	FWaypointPatrolSimulation Simulation(Settings);
+
+	int32 NumLoops = 0;
+	for (TActorIterator<AWaypointLoop> It(World); It; ++It)
+	{
+		Simulation.AddLoop(**It);
+		++NumLoops;
+	}
+
+	Simulation.SpawnAgents();
+
+	int32 Result = 0;
+	if (Simulation.GetNumAgents() == 0)
+	{
+		UE_LOG(LogWaypointPatrolSim, Error, TEXT("%s has no waypoint loops to patrol"), **MapName);
+		Result = 1;
+	}
+	else
+	{
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Simulating %d agents on %d loops for %.0fs of game time, %.4fs steps, seed %d"),
+			Simulation.GetNumAgents(), NumLoops, Settings.Duration, Settings.StepSeconds, Settings.Seed);
+
+		Simulation.Run();
+
+		const FWaypointPatrolSimStats& Stats = Simulation.GetStats();
+		const double SimulatedSeconds = Stats.NumSteps * Settings.StepSeconds;
+		const double WallSeconds = FMath::Max(Stats.WallSeconds, UE_SMALL_NUMBER);
+
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Wall time:         %.2fs (%.1fx real time)"), Stats.WallSeconds, SimulatedSeconds / WallSeconds);
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Throughput:        %.0f agent steps/s, %.2fus per agent step"),
+			Stats.NumSteps * Simulation.GetNumAgents() / WallSeconds, WallSeconds * 1000000. / FMath::Max<double>(Stats.NumSteps * Simulation.GetNumAgents(), 1.));
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Legs:              %lld completed, %lld failed"), Stats.NumLegsCompleted, Stats.NumLegsFailed);
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Path requests:     %lld, %lld queries (%lld failed), %.2fs pathfinding"),
+			Stats.NumPathRequests, Stats.NumPathQueries, Stats.NumPathQueriesFailed, Stats.PathfindingSeconds);
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Longest queue wait: %d steps"), Stats.MaxQueueWaitSteps);
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Peak memory:       %.2f MB simulation, %.2f MB process"),
+			Stats.PeakSimulationBytes / (1024. * 1024.), Stats.PeakUsedPhysical / (1024. * 1024.));
+		UE_LOG(LogWaypointPatrolSim, Display, TEXT("Checksum:          %08x"), Stats.Checksum);
+	}
+
+	WorldContext.SetCurrentWorld(nullptr);
+	GWorld = nullptr;
+
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+	CollectGarbage(RF_NoFlags);
+
+	return Result;
+}
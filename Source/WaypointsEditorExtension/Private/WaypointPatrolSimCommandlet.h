@@ -0,0 +1,25 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "WaypointPatrolSimCommandlet.generated.h"
+
+/**
+ * Runs patrol agents on every waypoint loop of a map at a fixed timestep, as fast as possible, and reports throughput.
+ *
+ * UnrealEditor-Cmd.exe Project.uproject -run=WaypointPatrolSim -Map=/Game/Maps/MyMap
+ *     [-Agents=1000] [-Duration=600] [-Step=0.0333] [-Seed=0] [-Speed=600] [-SpeedVariance=0.1]
+ *     [-MaxQueriesPerStep=64] [-MergeDistance=100] [-NoPathfinding] [-BuildNav]
+ */
+UCLASS()
+class UWaypointPatrolSimCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UWaypointPatrolSimCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
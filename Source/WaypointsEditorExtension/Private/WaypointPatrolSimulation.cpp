@@ -0,0 +1,336 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointPatrolSimulation.h"
+
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+#include "Misc/Crc.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+#include "WaypointLoopData.h"
+#include "WaypointSubsystem.h"
+
+FWaypointPatrolSimulation::FWaypointPatrolSimulation(const FWaypointPatrolSimSettings& InSettings)
+	: Settings(InSettings)
+{
+	Settings.StepSeconds = FMath::Max(Settings.StepSeconds, UE_KINDA_SMALL_NUMBER);
+	Settings.MaxQueriesPerStep = FMath::Max(Settings.MaxQueriesPerStep, 1);
+	Settings.MergeDistance = FMath::Max(Settings.MergeDistance, 1.f);
+}
+
+void FWaypointPatrolSimulation::AddLoop(const AWaypointLoop& Loop)
+{
+	if (Loop.GetLoopData().Num() == 0)
+	{
+		return;
+	}
+
+	FLoop& SimLoop = Loops.AddDefaulted_GetRef();
+	SimLoop.Data = &Loop.GetLoopData();
+
+	// Same agent the loop uses for its segment paths
+	if (const AWaypoint* FirstWaypoint = Loop.GetWaypoint(0))
+	{
+		SimLoop.NavAgent = FirstWaypoint->GetNavAgentInfo();
+	}
+}
+
+void FWaypointPatrolSimulation::SpawnAgents()
+{
+	Agents.Reset();
+	PathRequests.Reset();
+	PathBytes = 0;
+
+	if (Loops.Num() == 0)
+	{
+		return;
+	}
+
+	FRandomStream Random(Settings.Seed);
+
+	Agents.SetNum(Settings.NumAgents);
+	PathRequests.Reserve(Settings.NumAgents);
+
+	for (int32 AgentIndex = 0; AgentIndex < Agents.Num(); ++AgentIndex)
+	{
+		FAgent& Agent = Agents[AgentIndex];
+		Agent.LoopIndex = AgentIndex % Loops.Num();
+
+		const FWaypointLoopData& LoopData = *Loops[Agent.LoopIndex].Data;
+		const int32 StartPoint = Random.RandRange(0, LoopData.Num() - 1);
+
+		Agent.Location = LoopData.GetLocation(StartPoint);
+		Agent.TargetPoint = LoopData.GetNextIndex(StartPoint);
+		Agent.Speed = Settings.Speed * (1.f + Random.FRandRange(-Settings.SpeedVariance, Settings.SpeedVariance));
+		Agent.State = EAgentState::NeedsPath;
+
+		QueuePathRequest(AgentIndex);
+	}
+}
+
+void FWaypointPatrolSimulation::Run()
+{
+	const int64 NumSteps = FMath::CeilToInt64(Settings.Duration / Settings.StepSeconds);
+	const int64 MemoryStatsInterval = FMath::Max<int64>(FMath::CeilToInt64(1. / Settings.StepSeconds), 1);
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	for (int64 i = 0; i < NumSteps; ++i)
+	{
+		Step(Settings.StepSeconds);
+
+		if (i % MemoryStatsInterval == 0)
+		{
+			UpdateMemoryStats();
+		}
+	}
+
+	Stats.WallSeconds = FPlatformTime::Seconds() - StartTime;
+
+	UpdateMemoryStats();
+	Stats.PeakUsedPhysical = FPlatformMemory::GetStats().PeakUsedPhysical;
+	Stats.Checksum = CalculateChecksum();
+}
+
+void FWaypointPatrolSimulation::Step(float DeltaSeconds)
+{
+	ServicePathRequests();
+
+	for (int32 AgentIndex = 0; AgentIndex < Agents.Num(); ++AgentIndex)
+	{
+		FAgent& Agent = Agents[AgentIndex];
+		switch (Agent.State)
+		{
+		case EAgentState::Moving:
+			MoveAgent(Agent, DeltaSeconds);
+			break;
+
+		case EAgentState::Waiting:
+			Agent.RemainingWaitTime -= DeltaSeconds;
+			if (Agent.RemainingWaitTime <= 0.f)
+			{
+				AdvanceTarget(Agent);
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		// Legs that just finished ask for their next path, in agent order
+		if (Agent.State == EAgentState::NeedsPath && Agent.QueuedStep == INDEX_NONE)
+		{
+			QueuePathRequest(AgentIndex);
+		}
+	}
+
+	++Stats.NumSteps;
+}
+
+void FWaypointPatrolSimulation::QueuePathRequest(int32 AgentIndex)
+{
+	Agents[AgentIndex].QueuedStep = static_cast<int32>(Stats.NumSteps);
+	PathRequests.Add(AgentIndex);
+	++Stats.NumPathRequests;
+}
+
+void FWaypointPatrolSimulation::ServicePathRequests()
+{
+	struct FMergeKey
+	{
+		int32 LoopIndex;
+		int32 TargetPoint;
+		FIntVector StartCell;
+
+		bool operator==(const FMergeKey& Other) const
+		{
+			return LoopIndex == Other.LoopIndex && TargetPoint == Other.TargetPoint && StartCell == Other.StartCell;
+		}
+
+		friend uint32 GetTypeHash(const FMergeKey& Key)
+		{
+			return HashCombine(HashCombine(::GetTypeHash(Key.LoopIndex), ::GetTypeHash(Key.TargetPoint)), GetTypeHash(Key.StartCell));
+		}
+	};
+
+	// Paths found this step, shared by every request with the same key
+	TMap<FMergeKey, TArray<FVector>> StepPaths;
+
+	int32 NumQueries = 0;
+	int32 NumServiced = 0;
+	for (; NumServiced < PathRequests.Num(); ++NumServiced)
+	{
+		FAgent& Agent = Agents[PathRequests[NumServiced]];
+		const FLoop& Loop = Loops[Agent.LoopIndex];
+
+		const FMergeKey Key{ Agent.LoopIndex, Agent.TargetPoint, FIntVector(
+			FMath::FloorToInt(Agent.Location.X / Settings.MergeDistance),
+			FMath::FloorToInt(Agent.Location.Y / Settings.MergeDistance),
+			FMath::FloorToInt(Agent.Location.Z / Settings.MergeDistance)) };
+
+		TArray<FVector>* Path = StepPaths.Find(Key);
+		if (Path == nullptr)
+		{
+			if (NumQueries >= Settings.MaxQueriesPerStep)
+			{
+				break;
+			}
+
+			++NumQueries;
+			Path = &StepPaths.Add(Key);
+			FindPath(Loop, Agent.Location, Loop.Data->GetLocation(Agent.TargetPoint), *Path);
+		}
+
+		Stats.MaxQueueWaitSteps = FMath::Max(Stats.MaxQueueWaitSteps, static_cast<int32>(Stats.NumSteps) - Agent.QueuedStep);
+
+		if (Path->Num() == 0)
+		{
+			FinishLeg(Agent, false);
+			continue;
+		}
+
+		SetAgentPath(Agent, *Path);
+		Agent.PathIndex = 0;
+		Agent.State = EAgentState::Moving;
+	}
+
+	PathRequests.RemoveAt(0, NumServiced, false);
+}
+
+void FWaypointPatrolSimulation::MoveAgent(FAgent& Agent, float DeltaSeconds)
+{
+	FVector::FReal Remaining = Agent.Speed * DeltaSeconds;
+	while (Remaining > 0. && Agent.PathIndex < Agent.Path.Num())
+	{
+		const FVector ToPoint = Agent.Path[Agent.PathIndex] - Agent.Location;
+		const FVector::FReal Distance = ToPoint.Size();
+		if (Distance <= Remaining)
+		{
+			Agent.Location = Agent.Path[Agent.PathIndex];
+			Remaining -= Distance;
+			++Agent.PathIndex;
+		}
+		else
+		{
+			Agent.Location += ToPoint * (Remaining / Distance);
+			Remaining = 0.;
+		}
+	}
+
+	const FWaypointLoopData& LoopData = *Loops[Agent.LoopIndex].Data;
+	const float AcceptanceRadius = FMath::Max(LoopData.GetParams(Agent.TargetPoint).AcceptanceRadius, 0.f);
+
+	if (FVector::DistSquared(Agent.Location, LoopData.GetLocation(Agent.TargetPoint)) <= FMath::Square(AcceptanceRadius))
+	{
+		FinishLeg(Agent, true);
+	}
+	else if (Agent.PathIndex >= Agent.Path.Num())
+	{
+		// End of a partial path short of the waypoint
+		FinishLeg(Agent, false);
+	}
+}
+
+void FWaypointPatrolSimulation::FinishLeg(FAgent& Agent, bool bSuccess)
+{
+	SetAgentPath(Agent, TConstArrayView<FVector>());
+
+	if (!bSuccess)
+	{
+		++Stats.NumLegsFailed;
+		AdvanceTarget(Agent);
+		return;
+	}
+
+	++Stats.NumLegsCompleted;
+
+	const float WaitTime = Loops[Agent.LoopIndex].Data->GetParams(Agent.TargetPoint).WaitTime;
+	if (WaitTime > 0.f)
+	{
+		Agent.State = EAgentState::Waiting;
+		Agent.RemainingWaitTime = WaitTime;
+	}
+	else
+	{
+		AdvanceTarget(Agent);
+	}
+}
+
+void FWaypointPatrolSimulation::AdvanceTarget(FAgent& Agent)
+{
+	// The task moves on to the next waypoint whether the move succeeded or not
+	Agent.TargetPoint = Loops[Agent.LoopIndex].Data->GetNextIndex(Agent.TargetPoint);
+	Agent.State = EAgentState::NeedsPath;
+	Agent.QueuedStep = INDEX_NONE;
+}
+
+void FWaypointPatrolSimulation::SetAgentPath(FAgent& Agent, TConstArrayView<FVector> Points)
+{
+	PathBytes -= Agent.Path.GetAllocatedSize();
+
+	if (Points.Num() == 0)
+	{
+		Agent.Path.Empty();
+	}
+	else
+	{
+		Agent.Path = Points;
+	}
+
+	PathBytes += Agent.Path.GetAllocatedSize();
+}
+
+bool FWaypointPatrolSimulation::FindPath(const FLoop& Loop, const FVector& Start, const FVector& End, TArray<FVector>& OutPoints)
+{
+	++Stats.NumPathQueries;
+
+	if (Settings.bSkipPathfinding || !Loop.NavAgent.IsValid())
+	{
+		OutPoints = { Start, End };
+		return true;
+	}
+
+	FWaypointSegmentQuery Query;
+	Query.Start = Start;
+	Query.End = End;
+	Query.NavAgent = Loop.NavAgent;
+
+	const double QueryStartTime = FPlatformTime::Seconds();
+	const bool bSuccess = UWaypointSubsystem::FindSegmentPath(Query, OutPoints);
+	Stats.PathfindingSeconds += FPlatformTime::Seconds() - QueryStartTime;
+
+	if (!bSuccess)
+	{
+		++Stats.NumPathQueriesFailed;
+		OutPoints.Reset();
+	}
+
+	return bSuccess;
+}
+
+void FWaypointPatrolSimulation::UpdateMemoryStats()
+{
+	const SIZE_T SimulationBytes = Agents.GetAllocatedSize() + PathRequests.GetAllocatedSize() + Loops.GetAllocatedSize() + PathBytes;
+	Stats.PeakSimulationBytes = FMath::Max(Stats.PeakSimulationBytes, SimulationBytes);
+}
+
+uint32 FWaypointPatrolSimulation::CalculateChecksum() const
+{
+	uint32 Checksum = 0;
+	for (const FAgent& Agent : Agents)
+	{
+		// Rounded to centimeters so the checksum doesn't depend on how the floats are printed or compared
+		const int32 AgentState[] = {
+			FMath::RoundToInt32(Agent.Location.X),
+			FMath::RoundToInt32(Agent.Location.Y),
+			FMath::RoundToInt32(Agent.Location.Z),
+			Agent.TargetPoint,
+			static_cast<int32>(Agent.State),
+		};
+
+		Checksum = FCrc::MemCrc32(AgentState, sizeof(AgentState), Checksum);
+	}
+
+	return Checksum;
+}
@@ -0,0 +1,134 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WaypointNavAgentCache.h"
+
+class AWaypointLoop;
+struct FWaypointLoopData;
+
+struct FWaypointPatrolSimSettings
+{
+	int32 NumAgents = 1000;
+
+	// Seconds of game time to simulate
+	double Duration = 600.;
+
+	// Fixed timestep, independent of how fast the simulation actually runs
+	float StepSeconds = 1.f / 30.f;
+
+	int32 Seed = 0;
+
+	// Walking speed of the agents, each one gets up to SpeedVariance slower or faster
+	float Speed = 600.f;
+	float SpeedVariance = 0.1f;
+
+	// Path queries serviced per step. Counted rather than timed so runs stay deterministic.
+	int32 MaxQueriesPerStep = 64;
+
+	// Legs to the same waypoint starting in the same cell of this size share one query, like the patrol path queue
+	float MergeDistance = 100.f;
+
+	// Walk straight lines instead of querying the navmesh
+	bool bSkipPathfinding = false;
+};
+
+struct FWaypointPatrolSimStats
+{
+	int64 NumSteps = 0;
+	int64 NumLegsCompleted = 0;
+	int64 NumLegsFailed = 0;
+
+	int64 NumPathRequests = 0;
+	int64 NumPathQueries = 0;
+	int64 NumPathQueriesFailed = 0;
+
+	// Longest time a request waited to be serviced, in steps
+	int32 MaxQueueWaitSteps = 0;
+
+	double WallSeconds = 0.;
+	double PathfindingSeconds = 0.;
+
+	SIZE_T PeakSimulationBytes = 0;
+	uint64 PeakUsedPhysical = 0;
+
+	// Hash of the final agent state, equal between runs with the same map and settings
+	uint32 Checksum = 0;
+};
+
+/**
+ * Steps patrol agents along waypoint loops at a fixed timestep, without actors, controllers or path following.
+ * Agents follow the same rules as UBTTask_MoveToNextWaypoint: find a path to the waypoint, walk it until within the
+ * waypoint's acceptance radius, wait there for its wait time, then head for the next waypoint even if the leg failed.
+ */
+class FWaypointPatrolSimulation
+{
+public:
+	explicit FWaypointPatrolSimulation(const FWaypointPatrolSimSettings& InSettings);
+
+	/** Adds a loop agents can be placed on. Its packed data must stay unchanged while the simulation runs. */
+	void AddLoop(const AWaypointLoop& Loop);
+
+	/** Places the agents on the loops, spread evenly and starting at a seeded random waypoint */
+	void SpawnAgents();
+
+	void Run();
+
+	const FWaypointPatrolSimStats& GetStats() const { return Stats; }
+	int32 GetNumAgents() const { return Agents.Num(); }
+
+private:
+	enum class EAgentState : uint8
+	{
+		NeedsPath,
+		Moving,
+		Waiting,
+	};
+
+	struct FAgent
+	{
+		FVector Location = FVector::ZeroVector;
+		TArray<FVector> Path;
+		int32 PathIndex = 0;
+		int32 LoopIndex = INDEX_NONE;
+		int32 TargetPoint = INDEX_NONE;
+		float Speed = 0.f;
+		float RemainingWaitTime = 0.f;
+
+		// Step the agent asked for its path, INDEX_NONE while it isn't queued
+		int32 QueuedStep = INDEX_NONE;
+		EAgentState State = EAgentState::NeedsPath;
+	};
+
+	struct FLoop
+	{
+		const FWaypointLoopData* Data = nullptr;
+		FWaypointNavAgentInfoPtr NavAgent;
+	};
+
+	void Step(float DeltaSeconds);
+	void QueuePathRequest(int32 AgentIndex);
+	void ServicePathRequests();
+	void MoveAgent(FAgent& Agent, float DeltaSeconds);
+	void FinishLeg(FAgent& Agent, bool bSuccess);
+	void AdvanceTarget(FAgent& Agent);
+	void SetAgentPath(FAgent& Agent, TConstArrayView<FVector> Points);
+
+	bool FindPath(const FLoop& Loop, const FVector& Start, const FVector& End, TArray<FVector>& OutPoints);
+
+	void UpdateMemoryStats();
+	uint32 CalculateChecksum() const;
+
+	FWaypointPatrolSimSettings Settings;
+	FWaypointPatrolSimStats Stats;
+
+	TArray<FLoop> Loops;
+	TArray<FAgent> Agents;
+
+	// Agents waiting for a path, serviced first in first out
+	TArray<int32> PathRequests;
+
+	// Bytes held by agent paths, kept up to date as paths are replaced
+	SIZE_T PathBytes = 0;
+};
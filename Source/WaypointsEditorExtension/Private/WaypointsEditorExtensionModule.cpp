@@ -5,6 +5,7 @@
 #include "Engine/Engine.h"
 #include "Modules/ModuleManager.h"
 #include "Waypoint.h"
+#include "WaypointLoop.h"
 #include "Styling/SlateStyle.h"
 #include "Styling/SlateStyleRegistry.h"
 #include "Editor/UnrealEdEngine.h"
@@ -15,6 +16,13 @@
 #include "LevelEditor.h"
 #include "PluginUtils.h"
 #include "Interfaces/IPluginManager.h"
+#include "Framework/Application/SlateApplication.h"
+#include "Framework/Docking/TabManager.h"
+#include "Widgets/Docking/SDockTab.h"
+#include "WorkspaceMenuStructure.h"
+#include "WorkspaceMenuStructureModule.h"
+#include "SWaypointOutliner.h"
+#include "WaypointsEditorUtils.h"
 
 #define IMAGE_BRUSH(RelativePath, ...) FSlateImageBrush(StyleSet->RootToContentDir(RelativePath, TEXT(".png")), __VA_ARGS__)
 
@@ -22,6 +30,8 @@
 
 FDelegateHandle LevelViewportExtenderHandle;
 
+static const FName WaypointOutlinerTabName(TEXT("WaypointOutliner"));
+
 class FWaypointsEditorExtensionModule_Impl : public IWaypointsEditorExtensionModule
 {
 public:
@@ -30,6 +40,7 @@ public:
 
 	static TSharedRef<FExtender> OnExtendLevelEditorActorContextMenu(const TSharedRef<FUICommandList> CommandList, const TArray<AActor*> SelectedActors);
 	static void CreateWaypointsSelectionMenu(FMenuBuilder& MenuBuilder, const TArray<AWaypoint*> Waypoints);
+	static TSharedRef<SDockTab> SpawnWaypointOutlinerTab(const FSpawnTabArgs& Args);
 
 private:
 	TSharedPtr<FSlateStyleSet> StyleSet;
@@ -62,10 +73,21 @@ void FWaypointsEditorExtensionModule_Impl::StartupModule()
 
 		FSlateStyleRegistry::RegisterSlateStyle(*StyleSet.Get());
 	}
+
+	FGlobalTabmanager::Get()->RegisterNomadTabSpawner(WaypointOutlinerTabName, FOnSpawnTab::CreateStatic(&FWaypointsEditorExtensionModule_Impl::SpawnWaypointOutlinerTab))
+		.SetDisplayName(LOCTEXT("WaypointOutlinerTabTitle", "Waypoint Outliner"))
+		.SetTooltipText(LOCTEXT("WaypointOutlinerTabTooltip", "Lists every waypoint loop in the level"))
+		.SetGroup(WorkspaceMenu::GetMenuStructure().GetLevelEditorCategory())
+		.SetIcon(FSlateIcon(StyleSet->GetStyleSetName(), "ClassIcon.Waypoint"));
 }
 
 void FWaypointsEditorExtensionModule_Impl::ShutdownModule()
 {
+	if (FSlateApplication::IsInitialized())
+	{
+		FGlobalTabmanager::Get()->UnregisterNomadTabSpawner(WaypointOutlinerTabName);
+	}
+
 	// Unload editor extension
 	if (LevelViewportExtenderHandle.IsValid())
 	{
@@ -121,32 +143,46 @@ void FWaypointsEditorExtensionModule_Impl::CreateWaypointsSelectionMenu(FMenuBui
 		FSlateIcon(),
 		FUIAction(FExecuteAction::CreateLambda([Waypoints]()
 			{
-				TArray<AWaypoint*> LoopWaypoints;
-				for (auto Waypoint : Waypoints)
-				{
-					if (LoopWaypoints.Contains(Waypoint))
-					{
-						break;
-					}
-
-					for (TWeakObjectPtr<AWaypoint>& WaypointWeakPtr : Waypoint->GetLoop())
-					{
-						LoopWaypoints.Push(WaypointWeakPtr.Get());
-					}
-				}
+				WaypointsEditorUtils::SelectOwningLoops(Waypoints);
+			}
+		))
+	);
 
-				GEditor->GetSelectedActors()->BeginBatchSelectOperation();
-				for (AWaypoint* Waypoint : LoopWaypoints)
+	MenuBuilder.AddMenuEntry(
+		LOCTEXT("OptimizeWaypointLoopOrder", "Optimize Loop Order"),
+		LOCTEXT("OptimizeWaypointLoopOrderTooltip", "Reorders the waypoints of the selected loops to shorten their patrol path, pinned waypoints keep their place"),
+		FSlateIcon(),
+		FUIAction(FExecuteAction::CreateLambda([Waypoints]()
+			{
+				for (AWaypointLoop* Loop : WaypointsEditorUtils::GatherOwningLoops(Waypoints))
 				{
-					GUnrealEd->SelectActor(Waypoint, true, false, false);
+					Loop->OptimizeWaypointOrder();
 				}
+			}
+		))
+	);
 
-				GEditor->GetSelectedActors()->EndBatchSelectOperation();
+	MenuBuilder.AddMenuEntry(
+		LOCTEXT("OpenWaypointOutliner", "Open Waypoint Outliner"),
+		LOCTEXT("OpenWaypointOutlinerTooltip", "Opens the panel listing every waypoint loop in the level"),
+		FSlateIcon(),
+		FUIAction(FExecuteAction::CreateLambda([]()
+			{
+				FGlobalTabmanager::Get()->TryInvokeTab(WaypointOutlinerTabName);
 			}
 		))
 	);
 }
 
+TSharedRef<SDockTab> FWaypointsEditorExtensionModule_Impl::SpawnWaypointOutlinerTab(const FSpawnTabArgs& Args)
+{
+	return SNew(SDockTab)
+		.TabRole(ETabRole::NomadTab)
+		[
+			SNew(SWaypointOutliner)
+		];
+}
+
 #undef LOCTEXT_NAMESPACE
 
 IMPLEMENT_MODULE(FWaypointsEditorExtensionModule_Impl, WaypointsEditorExtension)
\ No newline at end of file
@@ -0,0 +1,137 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#include "WaypointsEditorUtils.h"
+
+#include "Editor.h"
+#include "Engine/Selection.h"
+#include "ScopedTransaction.h"
+#include "Waypoint.h"
+#include "WaypointLoop.h"
+
+#define LOCTEXT_NAMESPACE "WaypointsEditorUtils"
+
+TArray<AWaypoint*> WaypointsEditorUtils::GatherLoopWaypoints(TConstArrayView<AWaypointLoop*> Loops)
+{
+	TSet<AWaypointLoop*> VisitedLoops;
+	VisitedLoops.Reserve(Loops.Num());
+
+	TArray<AWaypoint*> LoopWaypoints;
+	for (AWaypointLoop* Loop : Loops)
+	{
+		bool bAlreadyVisited = false;
+		VisitedLoops.Add(Loop, &bAlreadyVisited);
+		if (!Loop || bAlreadyVisited)
+		{
+			continue;
+		}
+
+		LoopWaypoints.Reserve(LoopWaypoints.Num() + Loop->Waypoints.Num());
+		for (const TWeakObjectPtr<AWaypoint>& Waypoint : Loop->Waypoints)
+		{
+			if (Waypoint.IsValid())
+			{
+				LoopWaypoints.Push(Waypoint.Get());
+			}
+		}
+	}
+
+	return LoopWaypoints;
+}
+
+TArray<AWaypointLoop*> WaypointsEditorUtils::GatherOwningLoops(TConstArrayView<AWaypoint*> Waypoints)
+{
+	TSet<AWaypointLoop*> Loops;
+	for (AWaypoint* Waypoint : Waypoints)
+	{
+		if (Waypoint && Waypoint->OwningLoop.IsValid())
+		{
+			Loops.Add(Waypoint->OwningLoop.Get());
+		}
+	}
+
+	return Loops.Array();
+}
+
+void WaypointsEditorUtils::SelectActors(TConstArrayView<AActor*> Actors)
+{
+	USelection* Selection = GEditor->GetSelectedActors();
+
+	// Selecting through the selection set directly skips the per-actor notifications GUnrealEd->SelectActor sends
+	Selection->BeginBatchSelectOperation();
+	Selection->Modify();
+	Selection->DeselectAll();
+
+	for (AActor* Actor : Actors)
+	{
+		if (Actor && GEditor->CanSelectActor(Actor, true))
+		{
+			Selection->Select(Actor, true);
+		}
+	}
+
+	Selection->EndBatchSelectOperation(false);
+	GEditor->NoteSelectionChange();
+}
+
+void WaypointsEditorUtils::SelectOwningLoops(TConstArrayView<AWaypoint*> Waypoints)
+{
+	const TArray<AWaypointLoop*> Loops = GatherOwningLoops(Waypoints);
+
+	TArray<AActor*> LoopWaypoints;
+	LoopWaypoints.Append(GatherLoopWaypoints(Loops));
+
+	SelectActors(LoopWaypoints);
+}
+
+void WaypointsEditorUtils::DeleteWaypoints(TConstArrayView<AWaypointLoop*> Loops, TConstArrayView<AWaypoint*> Waypoints)
+{
+	const FScopedTransaction Transaction(LOCTEXT("DeleteWaypoints", "Delete Waypoints"));
+
+	GEditor->SelectNone(false, true);
+
+	// Group the waypoints by loop so every loop is only edited once
+	TMap<AWaypointLoop*, TArray<AWaypoint*>> WaypointsByLoop;
+	for (AWaypointLoop* Loop : Loops)
+	{
+		if (Loop && !WaypointsByLoop.Contains(Loop))
+		{
+			WaypointsByLoop.Add(Loop, GatherLoopWaypoints(MakeArrayView(&Loop, 1)));
+		}
+	}
+
+	TSet<AWaypointLoop*> WholeLoops;
+	for (const TPair<AWaypointLoop*, TArray<AWaypoint*>>& Pair : WaypointsByLoop)
+	{
+		WholeLoops.Add(Pair.Key);
+	}
+
+	for (AWaypoint* Waypoint : Waypoints)
+	{
+		// Waypoints of loops that are deleted entirely are already gathered
+		if (Waypoint && Waypoint->OwningLoop.IsValid() && !WholeLoops.Contains(Waypoint->OwningLoop.Get()))
+		{
+			WaypointsByLoop.FindOrAdd(Waypoint->OwningLoop.Get()).Add(Waypoint);
+		}
+	}
+
+	for (TPair<AWaypointLoop*, TArray<AWaypoint*>>& Pair : WaypointsByLoop)
+	{
+		AWaypointLoop* Loop = Pair.Key;
+		Loop->Modify();
+
+		for (AWaypoint* Waypoint : Pair.Value)
+		{
+			Waypoint->Modify();
+		}
+
+		Loop->RemoveWaypoints(Pair.Value);
+
+		UWorld* World = Loop->GetWorld();
+		for (AWaypoint* Waypoint : Pair.Value)
+		{
+			World->EditorDestroyActor(Waypoint, true);
+		}
+	}
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,27 @@
+// Copyright 2020 Nicholas Chalkley. All Rights Reserved
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+class AWaypoint;
+class AWaypointLoop;
+
+namespace WaypointsEditorUtils
+{
+	/** Collects every waypoint of the given loops, each loop visited once */
+	TArray<AWaypoint*> GatherLoopWaypoints(TConstArrayView<AWaypointLoop*> Loops);
+
+	/** Collects the unique loops the given waypoints belong to */
+	TArray<AWaypointLoop*> GatherOwningLoops(TConstArrayView<AWaypoint*> Waypoints);
+
+	/** Replaces the editor selection with the given actors in a single batch, notifying listeners once */
+	void SelectActors(TConstArrayView<AActor*> Actors);
+
+	/** Selects every waypoint of the loops the given waypoints belong to */
+	void SelectOwningLoops(TConstArrayView<AWaypoint*> Waypoints);
+
+	/** Deletes whole loops and individual waypoints, recalculating each affected loop only once */
+	void DeleteWaypoints(TConstArrayView<AWaypointLoop*> Loops, TConstArrayView<AWaypoint*> Waypoints);
+}
@@ -26,7 +26,11 @@ public class WaypointsEditorExtension : ModuleRules
                 "Slate",
                 "SlateCore",
                 "LevelEditor",
+                "InputCore",
+                "AppFramework",
+                "WorkspaceMenuStructure",
                 "Waypoints",
+                "NavigationSystem",
                 "PluginUtils",
                 "Projects"
 			}